@@ -0,0 +1,43 @@
+# Writes the SPIR-V words of every shader into a C++ source file, run with cmake -P
+#   OUTPUT       - path of the generated .cpp
+#   SHADER_DIR   - directory of the compiled .spv files
+#   SHADER_NAMES - |-separated file names of the shader sources, e.g. grass.vert|grass.frag
+
+string(REPLACE "|" ";" SHADER_NAMES "${SHADER_NAMES}")
+
+# Eight words, CMake regular expressions have no repetition counts
+set(LINE_PATTERN "0x[0-9a-f]+u,")
+foreach(i RANGE 1 7)
+    set(LINE_PATTERN "${LINE_PATTERN} 0x[0-9a-f]+u,")
+endforeach()
+
+set(ARRAYS "")
+set(ENTRIES "")
+set(INDEX 0)
+foreach(SHADER_NAME ${SHADER_NAMES})
+    file(READ "${SHADER_DIR}/${SHADER_NAME}.spv" HEX HEX)
+
+    # SPIR-V is a stream of little endian words, eight per line
+    string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u, " WORDS "${HEX}")
+    string(REGEX REPLACE "(${LINE_PATTERN}) " "\\1\n        " WORDS "${WORDS}")
+    string(STRIP "${WORDS}" WORDS)
+
+    set(ARRAYS "${ARRAYS}    // ${SHADER_NAME}\n    constexpr uint32_t shader${INDEX}[] = {\n        ${WORDS}\n    };\n\n")
+    set(ENTRIES "${ENTRIES}    { \"shaders/${SHADER_NAME}.spv\", shader${INDEX}, sizeof(shader${INDEX}) / sizeof(uint32_t) },\n")
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+file(WRITE "${OUTPUT}"
+"// Generated by cmake/EmbedShaders.cmake from the optimized SPIR-V of src/shaders, do not edit\n"
+"#include \"EmbeddedShaders.h\"\n"
+"\n"
+"namespace {\n"
+"${ARRAYS}"
+"}\n"
+"\n"
+"const EmbeddedShaders::Shader EmbeddedShaders::shaders[] = {\n"
+"${ENTRIES}"
+"};\n"
+"\n"
+"const size_t EmbeddedShaders::shaderCount = ${INDEX};\n"
+)
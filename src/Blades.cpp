@@ -1,76 +1,211 @@
+#include <cmath>
+#include <cstring>
 #include <vector>
+#include <glm/gtc/packing.hpp>
 #include "Blades.h"
 #include "BufferUtils.h"
 
-float generateRandomFloat() {
-    return rand() / (float)RAND_MAX;
+constexpr uint32_t Blades::MAX_QUADTREE_DEPTH;
+
+Blades::Blades(Device* device, float rootTileDim, uint32_t rootGridDim, float minTileDim, float lodThreshold, uint32_t maxTiles, float targetEdgePixels, uint32_t framesInFlight)
+  : Model(device, {}, {}), numRootTiles(rootGridDim * rootGridDim), extent(rootTileDim * rootGridDim), maxTiles(maxTiles), rootTileDim(rootTileDim), minTileDim(minTileDim), lodThreshold(lodThreshold), targetEdgePixels(targetEdgePixels) {
+    // Every root sits at a height of 1, which its leaves inherit
+    uint32_t rootSizeAndHeight = glm::packHalf2x16(glm::vec2(rootTileDim, 1.0f));
+
+    std::vector<Tile> rootTiles;
+    rootTiles.reserve(numRootTiles);
+    for (uint32_t i = 0; i < numRootTiles; i++) {
+        // Roots sit on multiples of rootTileDim so that every node of the quadtree is aligned to its own size,
+        // the compute pass relies on it to find neighbours
+        Tile root = {};
+        root.originX = (int32_t)(i % rootGridDim) - (int32_t)(rootGridDim / 2);
+        root.originZ = (int32_t)(i / rootGridDim) - (int32_t)(rootGridDim / 2);
+        root.sizeAndHeight = rootSizeAndHeight;
+        rootTiles.push_back(root);
+    }
+
+    // Uploaded here and only read by culling on the compute queue afterwards
+    BufferUtils::CreateBufferFromData(device, rootTiles.data(), numRootTiles * sizeof(Tile), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, bladesBuffer, bladesBufferMemory, device->GetQueueFamilies(QueueFlagBit::GraphicsBit | QueueFlagBit::TransferBit | QueueFlagBit::ComputeBit));
+
+    culledBladesBuffers.resize(framesInFlight);
+    numBladesBuffers.resize(framesInFlight);
+    cullStatsBuffers.resize(framesInFlight);
+    culledBladesBufferMemories.resize(framesInFlight);
+    numBladesBufferMemories.resize(framesInFlight);
+    cullStatsBufferMemories.resize(framesInFlight);
+    mappedCullStats.resize(framesInFlight);
+    traversalLevelsBuffers.resize(framesInFlight);
+    traversalNodesBuffers.resize(framesInFlight);
+    traversalLevelsBufferMemories.resize(framesInFlight);
+    traversalNodesBufferMemories.resize(framesInFlight);
+
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        // Only ever touched by the GPU, written by culling and read as vertices by the same frame
+        BufferUtils::CreateBuffer(device, maxTiles * sizeof(Tile), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, culledBladesBuffers[i], culledBladesBufferMemories[i]);
+        // Rewritten as a whole by the compute command buffer, so that it never depends on contents left by another queue
+        BufferUtils::CreateBuffer(device, sizeof(BladeDrawIndirect), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, numBladesBuffers[i], numBladesBufferMemories[i]);
+
+        // Counters are cleared by the compute command buffer and read back on the host
+        BufferUtils::CreateBuffer(device, sizeof(TileCullStats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cullStatsBuffers[i], cullStatsBufferMemories[i]);
+        mappedCullStats[i] = device->GetAllocator()->Map(cullStatsBufferMemories[i]);
+        memset(mappedCullStats[i], 0, sizeof(TileCullStats));
+
+        // Reset by the compute command buffer and read as dispatch arguments by the levels that follow
+        BufferUtils::CreateBuffer(device, (MAX_QUADTREE_DEPTH + 1) * sizeof(TraversalLevel), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, traversalLevelsBuffers[i], traversalLevelsBufferMemories[i]);
+        BufferUtils::CreateBuffer(device, 2 * maxTiles * sizeof(glm::vec4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, traversalNodesBuffers[i], traversalNodesBufferMemories[i]);
+    }
+}
+
+VkBuffer Blades::GetBladesBuffer() const {
+    return bladesBuffer;
 }
 
-Blades::Blades(Device* device, VkCommandPool commandPool, float planeDim) : Model(device, commandPool, {}, {}) {
-    std::vector<Blade> blades;
-    blades.reserve(NUM_BLADES);
-    //srand(123);
-    for (int i = 0; i < NUM_BLADES; i++) {
-        Blade currentBlade = Blade();
+VkBuffer Blades::GetCulledBladesBuffer(uint32_t frameIndex) const {
+    return culledBladesBuffers[frameIndex];
+}
 
-        glm::vec3 bladeUp(0.0f, 1.0f, 0.0f);
-		planeDim = 5;
+VkBuffer Blades::GetNumBladesBuffer(uint32_t frameIndex) const {
+    return numBladesBuffers[frameIndex];
+}
 
-        // Generate positions and direction (v0)
-        float x = (float)(i % 16) * planeDim - 8 * planeDim;
-        float y = 1.0f;
-        float z = (float)(i / 16) * planeDim - 8 * planeDim;
-        float direction = generateRandomFloat() * 2.f * 3.14159265f;
-        glm::vec3 bladePosition(x, y, z);
-        //currentBlade.v0 = glm::vec4(bladePosition, direction);
-        currentBlade.v0 = glm::vec4(bladePosition, planeDim);
+VkBuffer Blades::GetCullStatsBuffer(uint32_t frameIndex) const {
+    return cullStatsBuffers[frameIndex];
+}
 
-        // Bezier point and height (v1)
-        float height = MIN_HEIGHT + (generateRandomFloat() * (MAX_HEIGHT - MIN_HEIGHT));
-        currentBlade.v1 = glm::vec4(bladePosition + bladeUp * height, height);
+const TileCullStats& Blades::GetCullStats(uint32_t frameIndex) const {
+    return *static_cast<TileCullStats*>(mappedCullStats[frameIndex]);
+}
 
-        // Physical model guide and width (v2)
-        float width = MIN_WIDTH + (generateRandomFloat() * (MAX_WIDTH - MIN_WIDTH));
-        currentBlade.v2 = glm::vec4(bladePosition + bladeUp * height, width);
+VkBuffer Blades::GetTraversalLevelsBuffer(uint32_t frameIndex) const {
+    return traversalLevelsBuffers[frameIndex];
+}
 
-        // Up vector and stiffness coefficient (up)
-        float stiffness = MIN_BEND + (generateRandomFloat() * (MAX_BEND - MIN_BEND));
-        currentBlade.up = glm::vec4(bladeUp, stiffness);
+VkBuffer Blades::GetTraversalNodesBuffer(uint32_t frameIndex) const {
+    return traversalNodesBuffers[frameIndex];
+}
 
-        // custom color
-        currentBlade.color = glm::vec4(1.0f);
+uint32_t Blades::GetNumRootTiles() const {
+    return numRootTiles;
+}
+
+float Blades::GetExtent() const {
+    return extent;
+}
 
-        blades.push_back(currentBlade);
+uint32_t Blades::GetMaxTiles() const {
+    return maxTiles;
+}
+
+uint32_t Blades::GetTraversalLevelCount() const {
+    // Same depth as compute.comp picks for its leaves
+    int depth = static_cast<int>(std::floor(std::log2(rootTileDim / minTileDim) + 0.001f));
+    if (depth < 0) {
+        depth = 0;
+    }
+    if (depth > static_cast<int>(MAX_QUADTREE_DEPTH)) {
+        depth = static_cast<int>(MAX_QUADTREE_DEPTH);
     }
+    return static_cast<uint32_t>(depth) + 1;
+}
 
-    BladeDrawIndirect indirectDraw;
-    indirectDraw.vertexCount = NUM_BLADES;
-    indirectDraw.instanceCount = 1;
-    indirectDraw.firstVertex = 0;
-    indirectDraw.firstInstance = 0;
+TileTraversalPushConstants Blades::GetTraversalPushConstants() const {
+    TileTraversalPushConstants pushConstants;
+    pushConstants.numRootTiles = numRootTiles;
+    pushConstants.maxTiles = maxTiles;
+    pushConstants.rootTileDim = rootTileDim;
+    pushConstants.minTileDim = minTileDim;
+    pushConstants.lodThreshold = lodThreshold;
+    pushConstants.targetEdgePixels = targetEdgePixels;
+    pushConstants.viewportHeight = 0.0f;
+    pushConstants.level = 0;
+    return pushConstants;
+}
 
-    BufferUtils::CreateBufferFromData(device, commandPool, blades.data(), NUM_BLADES * sizeof(Blade), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, bladesBuffer, bladesBufferMemory);
-    BufferUtils::CreateBuffer(device, NUM_BLADES * sizeof(Blade), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, culledBladesBuffer, culledBladesBufferMemory);
-    BufferUtils::CreateBufferFromData(device, commandPool, &indirectDraw, sizeof(BladeDrawIndirect), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, numBladesBuffer, numBladesBufferMemory);
+void Blades::EnableReadback() {
+    if (IsReadbackEnabled()) {
+        return;
+    }
+
+    uint32_t framesInFlight = static_cast<uint32_t>(culledBladesBuffers.size());
+    readbackBuffers.resize(framesInFlight);
+    readbackBufferMemories.resize(framesInFlight);
+    mappedReadbacks.resize(framesInFlight);
+
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        BufferUtils::CreateBuffer(device, sizeof(BladeDrawIndirect) + maxTiles * sizeof(Tile), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffers[i], readbackBufferMemories[i]);
+        mappedReadbacks[i] = device->GetAllocator()->Map(readbackBufferMemories[i]);
+        memset(mappedReadbacks[i], 0, sizeof(BladeDrawIndirect));
+    }
 }
 
-VkBuffer Blades::GetBladesBuffer() const {
-    return bladesBuffer;
+bool Blades::IsReadbackEnabled() const {
+    return !readbackBuffers.empty();
 }
 
-VkBuffer Blades::GetCulledBladesBuffer() const {
-    return culledBladesBuffer;
+void Blades::RecordReadback(VkCommandBuffer commandBuffer, uint32_t frameIndex) const {
+    // Draws only read the tiles, so waiting for them is enough to make the culling writes visible to the copy
+    std::array<VkBufferMemoryBarrier, 2> readBarriers = {};
+    VkBuffer buffers[] = { numBladesBuffers[frameIndex], culledBladesBuffers[frameIndex] };
+    for (uint32_t k = 0; k < 2; ++k) {
+        readBarriers[k].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        readBarriers[k].srcAccessMask = 0;
+        readBarriers[k].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        readBarriers[k].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        readBarriers[k].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        readBarriers[k].buffer = buffers[k];
+        readBarriers[k].offset = 0;
+        readBarriers[k].size = VK_WHOLE_SIZE;
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, static_cast<uint32_t>(readBarriers.size()), readBarriers.data(), 0, nullptr);
+
+    VkBufferCopy drawRegion = {};
+    drawRegion.size = sizeof(BladeDrawIndirect);
+    vkCmdCopyBuffer(commandBuffer, numBladesBuffers[frameIndex], readbackBuffers[frameIndex], 1, &drawRegion);
+
+    VkBufferCopy tilesRegion = {};
+    tilesRegion.dstOffset = sizeof(BladeDrawIndirect);
+    tilesRegion.size = maxTiles * sizeof(Tile);
+    vkCmdCopyBuffer(commandBuffer, culledBladesBuffers[frameIndex], readbackBuffers[frameIndex], 1, &tilesRegion);
+
+    VkBufferMemoryBarrier hostBarrier = {};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = readbackBuffers[frameIndex];
+    hostBarrier.offset = 0;
+    hostBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+}
+
+const BladeDrawIndirect& Blades::GetReadbackDraw(uint32_t frameIndex) const {
+    return *static_cast<BladeDrawIndirect*>(mappedReadbacks[frameIndex]);
 }
 
-VkBuffer Blades::GetNumBladesBuffer() const {
-    return numBladesBuffer;
+const Tile* Blades::GetReadbackTiles(uint32_t frameIndex) const {
+    return reinterpret_cast<const Tile*>(static_cast<char*>(mappedReadbacks[frameIndex]) + sizeof(BladeDrawIndirect));
 }
 
 Blades::~Blades() {
     vkDestroyBuffer(device->GetVkDevice(), bladesBuffer, nullptr);
-    vkFreeMemory(device->GetVkDevice(), bladesBufferMemory, nullptr);
-    vkDestroyBuffer(device->GetVkDevice(), culledBladesBuffer, nullptr);
-    vkFreeMemory(device->GetVkDevice(), culledBladesBufferMemory, nullptr);
-    vkDestroyBuffer(device->GetVkDevice(), numBladesBuffer, nullptr);
-    vkFreeMemory(device->GetVkDevice(), numBladesBufferMemory, nullptr);
+    device->GetAllocator()->Free(bladesBufferMemory);
+    for (size_t i = 0; i < culledBladesBuffers.size(); ++i) {
+        vkDestroyBuffer(device->GetVkDevice(), culledBladesBuffers[i], nullptr);
+        device->GetAllocator()->Free(culledBladesBufferMemories[i]);
+        vkDestroyBuffer(device->GetVkDevice(), numBladesBuffers[i], nullptr);
+        device->GetAllocator()->Free(numBladesBufferMemories[i]);
+        vkDestroyBuffer(device->GetVkDevice(), cullStatsBuffers[i], nullptr);
+        device->GetAllocator()->Free(cullStatsBufferMemories[i]);
+        vkDestroyBuffer(device->GetVkDevice(), traversalLevelsBuffers[i], nullptr);
+        device->GetAllocator()->Free(traversalLevelsBufferMemories[i]);
+        vkDestroyBuffer(device->GetVkDevice(), traversalNodesBuffers[i], nullptr);
+        device->GetAllocator()->Free(traversalNodesBufferMemories[i]);
+    }
+    for (size_t i = 0; i < readbackBuffers.size(); ++i) {
+        vkDestroyBuffer(device->GetVkDevice(), readbackBuffers[i], nullptr);
+        device->GetAllocator()->Free(readbackBufferMemories[i]);
+    }
 }
@@ -2,74 +2,57 @@
 #include <vulkan/vulkan.h>
 #include <glm/glm.hpp>
 #include <array>
+#include <cstdint>
+#include <vector>
 #include "Model.h"
 
-constexpr static unsigned int NUM_BLADES = 1 << 8;
-constexpr static float MIN_HEIGHT = 1.3f;
-constexpr static float MAX_HEIGHT = 2.5f;
-constexpr static float MIN_WIDTH = 0.1f;
-constexpr static float MAX_WIDTH = 0.14f;
-constexpr static float MIN_BEND = 7.0f;
-constexpr static float MAX_BEND = 13.0f;
-
-struct Blade {
-    // Position and direction
-    glm::vec4 v0;
-    // Bezier point and height
-    glm::vec4 v1;
-    // Physical model guide and width
-    glm::vec4 v2;
-    // Up vector and stiffness coefficient
-    glm::vec4 up;
-    // special vec4 for custom colors: .xyz is RGB, .w is whether to use this color
-    glm::vec4 color;
+// A quadtree node of the terrain, written by the compute pass for every visible leaf and drawn as one patch.
+// Nodes are aligned to multiples of their own size, so the origin is stored in units of the tile size
+struct Tile {
+    // x and z of the origin divided by the tile size
+    int32_t originX;
+    int32_t originZ;
+    // Tile size and base height as two halfs, see packHalf2x16
+    uint32_t sizeAndHeight;
+    // Tessellation levels of the left, bottom, right and top edges, one byte each
+    uint32_t edgeTessLevels;
 
     static VkVertexInputBindingDescription getBindingDescription() {
         VkVertexInputBindingDescription bindingDescription = {};
         bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Blade);
+        bindingDescription.stride = sizeof(Tile);
         bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
         return bindingDescription;
     }
 
-    static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions() {
-        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions = {};
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
 
-        // v0
+        // origin
         attributeDescriptions[0].binding = 0;
         attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Blade, v0);
+        attributeDescriptions[0].format = VK_FORMAT_R32G32_SINT;
+        attributeDescriptions[0].offset = offsetof(Tile, originX);
 
-        // v1
+        // size and height
         attributeDescriptions[1].binding = 0;
         attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Blade, v1);
+        attributeDescriptions[1].format = VK_FORMAT_R32_UINT;
+        attributeDescriptions[1].offset = offsetof(Tile, sizeAndHeight);
 
-        // v2
+        // edge tessellation levels, unpacked to a uvec4 by the input assembler
         attributeDescriptions[2].binding = 0;
         attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attributeDescriptions[2].offset = offsetof(Blade, v2);
-
-        // up
-        attributeDescriptions[3].binding = 0;
-        attributeDescriptions[3].location = 3;
-        attributeDescriptions[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attributeDescriptions[3].offset = offsetof(Blade, up);
-
-        // color
-        attributeDescriptions[4].binding = 0;
-        attributeDescriptions[4].location = 4;
-        attributeDescriptions[4].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        attributeDescriptions[4].offset = offsetof(Blade, color);
+        attributeDescriptions[2].format = VK_FORMAT_R8G8B8A8_UINT;
+        attributeDescriptions[2].offset = offsetof(Tile, edgeTessLevels);
 
         return attributeDescriptions;
     }
 };
 
+static_assert(sizeof(Tile) == 16, "Tile must match the std430 layout in compute.comp");
+
 struct BladeDrawIndirect {
     uint32_t vertexCount;
     uint32_t instanceCount;
@@ -77,20 +60,105 @@ struct BladeDrawIndirect {
     uint32_t firstInstance;
 };
 
+// Per-frame tile culling counters written by the compute pass
+struct TileCullStats {
+    // Quadtree nodes rejected before their subtree was visited
+    uint32_t frustumCulledTiles;
+    uint32_t occludedTiles;
+    // Leaves that did not fit in the culled tiles buffer and nodes that did not fit in their traversal level
+    uint32_t droppedTiles;
+};
+
+// Indirect dispatch of one quadtree level followed by the number of nodes appended to it, matches TraversalLevel
+// in compute.comp
+struct TraversalLevel {
+    uint32_t groupCountX;
+    uint32_t groupCountY;
+    uint32_t groupCountZ;
+    uint32_t nodeCount;
+};
+
+// Push constants of the compute pass, matches s_pushConstants in compute.comp
+struct TileTraversalPushConstants {
+    uint32_t numRootTiles;
+    uint32_t maxTiles;
+    float rootTileDim;
+    float minTileDim;
+    float lodThreshold;
+    float targetEdgePixels;
+    // Filled in by the renderer
+    float viewportHeight;
+    uint32_t level;
+};
+
 class Blades : public Model {
 private:
     VkBuffer bladesBuffer;
-    VkBuffer culledBladesBuffer;
-    VkBuffer numBladesBuffer;
+    MemoryAllocation bladesBufferMemory;
+
+    // Written by the compute pass of each frame in flight, so every frame gets its own copy
+    std::vector<VkBuffer> culledBladesBuffers;
+    std::vector<VkBuffer> numBladesBuffers;
+    std::vector<VkBuffer> cullStatsBuffers;
+
+    std::vector<MemoryAllocation> culledBladesBufferMemories;
+    std::vector<MemoryAllocation> numBladesBufferMemories;
+    std::vector<MemoryAllocation> cullStatsBufferMemories;
+
+    std::vector<void*> mappedCullStats;
 
-    VkDeviceMemory bladesBufferMemory;
-    VkDeviceMemory culledBladesBufferMemory;
-    VkDeviceMemory numBladesBufferMemory;
+    // Quadtree levels and the two node lists they ping-pong between, only touched by culling
+    std::vector<VkBuffer> traversalLevelsBuffers;
+    std::vector<VkBuffer> traversalNodesBuffers;
+    std::vector<MemoryAllocation> traversalLevelsBufferMemories;
+    std::vector<MemoryAllocation> traversalNodesBufferMemories;
+
+    // Debug copies of the draw arguments followed by the culled tiles, empty unless readback is enabled
+    std::vector<VkBuffer> readbackBuffers;
+    std::vector<MemoryAllocation> readbackBufferMemories;
+    std::vector<void*> mappedReadbacks;
+
+    uint32_t numRootTiles;
+    // Width of the whole grid of roots
+    float extent;
+    uint32_t maxTiles;
+    float rootTileDim;
+    float minTileDim;
+    float lodThreshold;
+    float targetEdgePixels;
 
 public:
-    Blades(Device* device, VkCommandPool commandPool, float planeDim);
+    // Matches MAX_QUADTREE_DEPTH in compute.comp
+    static constexpr uint32_t MAX_QUADTREE_DEPTH = 8;
+
+    // The terrain is a rootGridDim x rootGridDim grid of quadtrees, each rootTileDim wide, that the compute pass
+    // subdivides down to minTileDim wherever a node covers more than lodThreshold of the screen height.
+    // Up to maxTiles leaves are drawn per frame, tessellated into triangles about targetEdgePixels wide on screen
+    // Tile sizes are stored as halfs, so rootTileDim should be exactly representable as one, e.g. 160
+    Blades(Device* device, float rootTileDim, uint32_t rootGridDim, float minTileDim, float lodThreshold, uint32_t maxTiles, float targetEdgePixels, uint32_t framesInFlight);
     VkBuffer GetBladesBuffer() const;
-    VkBuffer GetCulledBladesBuffer() const;
-    VkBuffer GetNumBladesBuffer() const;
+    VkBuffer GetCulledBladesBuffer(uint32_t frameIndex) const;
+    VkBuffer GetNumBladesBuffer(uint32_t frameIndex) const;
+    VkBuffer GetCullStatsBuffer(uint32_t frameIndex) const;
+    VkBuffer GetTraversalLevelsBuffer(uint32_t frameIndex) const;
+    VkBuffer GetTraversalNodesBuffer(uint32_t frameIndex) const;
+    // Only valid once the fence of that frame has signaled
+    const TileCullStats& GetCullStats(uint32_t frameIndex) const;
+    uint32_t GetNumRootTiles() const;
+    float GetExtent() const;
+    uint32_t GetMaxTiles() const;
+    // Number of quadtree levels culling dispatches, the roots included
+    uint32_t GetTraversalLevelCount() const;
+    TileTraversalPushConstants GetTraversalPushConstants() const;
+
+    // The culled tiles never leave device memory unless a debug readback is enabled, before command buffers are recorded
+    void EnableReadback();
+    bool IsReadbackEnabled() const;
+    // Copies the draw arguments and culled tiles of a frame to its readback buffer. Recorded on the graphics queue after
+    // the tiles were drawn, while it owns them
+    void RecordReadback(VkCommandBuffer commandBuffer, uint32_t frameIndex) const;
+    // Only valid once the fence of that frame has signaled, so they trail the frame being recorded by framesInFlight
+    const BladeDrawIndirect& GetReadbackDraw(uint32_t frameIndex) const;
+    const Tile* GetReadbackTiles(uint32_t frameIndex) const;
     ~Blades();
 };
@@ -1,13 +1,19 @@
+#include <algorithm>
 #include "BufferUtils.h"
 #include "Instance.h"
 
-void BufferUtils::CreateBuffer(Device* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+void BufferUtils::CreateBuffer(Device* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory, const std::vector<uint32_t>& queueFamilies) {
     // Create buffer
     VkBufferCreateInfo bufferInfo = {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (queueFamilies.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
 
     if (vkCreateBuffer(device->GetVkDevice(), &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create vertex buffer");
@@ -17,77 +23,40 @@ void BufferUtils::CreateBuffer(Device* device, VkDeviceSize size, VkBufferUsageF
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device->GetVkDevice(), buffer, &memRequirements);
 
-    // Allocate memory in device
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = device->GetInstance()->GetMemoryTypeIndex(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device->GetVkDevice(), &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to allocate vertex buffer");
-    }
+    // Carve memory for the buffer out of a shared block
+    bufferMemory = device->GetAllocator()->Allocate(memRequirements, properties, true);
 
     // Associate allocated memory with vertex buffer
-    vkBindBufferMemory(device->GetVkDevice(), buffer, bufferMemory, 0);
+    vkBindBufferMemory(device->GetVkDevice(), buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
-void BufferUtils::CopyBuffer(Device* device, VkCommandPool commandPool, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device->GetVkDevice(), &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    VkBufferCopy copyRegion = {};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+VkDeviceSize BufferUtils::GetUniformBufferStride(Device* device, VkDeviceSize size) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device->GetInstance()->GetPhysicalDevice(), &properties);
 
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(device->GetQueue(QueueFlags::Graphics), 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(device->GetQueue(QueueFlags::Graphics));
-    vkFreeCommandBuffers(device->GetVkDevice(), commandPool, 1, &commandBuffer);
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    return (size + alignment - 1) / alignment * alignment;
 }
 
-void BufferUtils::CreateBufferFromData(Device* device, VkCommandPool commandPool, void* bufferData, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
-    // Create the staging buffer
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
-    VkBufferUsageFlags stagingUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    VkMemoryPropertyFlags stagingProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    BufferUtils::CreateBuffer(device, bufferSize, stagingUsage, stagingProperties, stagingBuffer, stagingBufferMemory);
-
-    // Fill the staging buffer
-    void *data;
-    vkMapMemory(device->GetVkDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, bufferData, static_cast<size_t>(bufferSize));
-    vkUnmapMemory(device->GetVkDevice(), stagingBufferMemory);
+uint64_t BufferUtils::CreateBufferFromData(Device* device, const void* bufferData, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkBuffer& buffer, MemoryAllocation& bufferMemory, const std::vector<uint32_t>& queueFamilies) {
+    // Written on the transfer queue. A concurrently shared buffer is shared with it too, an exclusive one is handed over
+    // to its queue family, the graphics one unless told otherwise
+    std::vector<uint32_t> families = queueFamilies;
+    uint32_t owner = VK_QUEUE_FAMILY_IGNORED;
+    if (families.size() > 1) {
+        if (std::find(families.begin(), families.end(), device->GetQueueIndex(QueueFlags::Transfer)) == families.end()) {
+            families.push_back(device->GetQueueIndex(QueueFlags::Transfer));
+        }
+    } else {
+        owner = families.empty() ? device->GetQueueIndex(QueueFlags::Graphics) : families[0];
+    }
 
     // Create the buffer
     // for reading stuff, has to be SRC as well
     VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | bufferUsage;
     VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    BufferUtils::CreateBuffer(device, bufferSize, usage, flags, buffer, bufferMemory);
-
-    // Copy data from staging to buffer
-    BufferUtils::CopyBuffer(device, commandPool, stagingBuffer, buffer, bufferSize);
+    BufferUtils::CreateBuffer(device, bufferSize, usage, flags, buffer, bufferMemory, families);
 
-    // No need for the staging buffer anymore
-    vkDestroyBuffer(device->GetVkDevice(), stagingBuffer, nullptr);
-    vkFreeMemory(device->GetVkDevice(), stagingBufferMemory, nullptr);
+    // Staged and recorded into the open upload batch
+    return device->GetUploadManager()->UploadToBuffer(bufferData, bufferSize, buffer, 0, owner);
 }
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <vector>
 #include "Device.h"
 
 namespace BufferUtils {
-    void CreateBuffer(Device* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-    void CopyBuffer(Device* device, VkCommandPool commandPool, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-    void CreateBufferFromData(Device* device, VkCommandPool commandPool, void* bufferData, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+    // Owned by one queue family at a time, unless more than one queueFamilies are given to share it concurrently
+    void CreateBuffer(Device* device, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory, const std::vector<uint32_t>& queueFamilies = {});
+    // Size rounded up so that consecutive slices of a uniform buffer can be bound at their own offsets
+    VkDeviceSize GetUniformBufferStride(Device* device, VkDeviceSize size);
+    // Returns without waiting for the copy, the returned id is waited on with the device's UploadManager before first use.
+    // The only one of queueFamilies, or the graphics family if none are given, owns the buffer once the upload completes
+    uint64_t CreateBufferFromData(Device* device, const void* bufferData, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VkBuffer& buffer, MemoryAllocation& bufferMemory, const std::vector<uint32_t>& queueFamilies = {});
 }
@@ -8,11 +8,14 @@
 #define FRUSTUM_CULL_TEST 0
 #define WIND_GIF_CAMERA 0
 
+// Lowest the eye may get above the terrain
+static constexpr float GROUND_CLEARANCE = 1.0f;
+
 #include "Camera.h"
 #include "BufferUtils.h"
 
 #if FRUSTUM_CULL_TEST
-Camera::Camera(Device* device, float aspectRatio) : device(device) {
+Camera::Camera(Device* device, float aspectRatio, uint32_t framesInFlight) : device(device), framesInFlight(framesInFlight), terrain(nullptr) {
     r = 2.0f;
     theta = 0.0f;
     phi = 0.0f;
@@ -20,12 +23,15 @@ Camera::Camera(Device* device, float aspectRatio) : device(device) {
     cameraBufferObject.projectionMatrix = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 100.0f);
     cameraBufferObject.projectionMatrix[1][1] *= -1; // y-coordinate is flipped
 
-    BufferUtils::CreateBuffer(device, sizeof(CameraBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, bufferMemory);
-    vkMapMemory(device->GetVkDevice(), bufferMemory, 0, sizeof(CameraBufferObject), 0, &mappedData);
-    memcpy(mappedData, &cameraBufferObject, sizeof(CameraBufferObject));
+    bufferStride = BufferUtils::GetUniformBufferStride(device, sizeof(CameraBufferObject));
+    BufferUtils::CreateBuffer(device, framesInFlight * bufferStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, bufferMemory);
+    mappedData = device->GetAllocator()->Map(bufferMemory);
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        UpdateBuffer(i);
+    }
 }
 #elif WIND_GIF_CAMERA
-Camera::Camera(Device* device, float aspectRatio) : device(device) {
+Camera::Camera(Device* device, float aspectRatio, uint32_t framesInFlight) : device(device), framesInFlight(framesInFlight), terrain(nullptr) {
     r = 10.0f;
     theta = 0.0f;
     phi = 0.0f;
@@ -33,24 +39,31 @@ Camera::Camera(Device* device, float aspectRatio) : device(device) {
     cameraBufferObject.projectionMatrix = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 100.0f);
     cameraBufferObject.projectionMatrix[1][1] *= -1; // y-coordinate is flipped
 
-    BufferUtils::CreateBuffer(device, sizeof(CameraBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, bufferMemory);
-    vkMapMemory(device->GetVkDevice(), bufferMemory, 0, sizeof(CameraBufferObject), 0, &mappedData);
-    memcpy(mappedData, &cameraBufferObject, sizeof(CameraBufferObject));
+    bufferStride = BufferUtils::GetUniformBufferStride(device, sizeof(CameraBufferObject));
+    BufferUtils::CreateBuffer(device, framesInFlight * bufferStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, bufferMemory);
+    mappedData = device->GetAllocator()->Map(bufferMemory);
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        UpdateBuffer(i);
+    }
 }
 #else
-Camera::Camera(Device* device, float aspectRatio) : device(device) {
+Camera::Camera(Device* device, float aspectRatio, uint32_t framesInFlight) : device(device), framesInFlight(framesInFlight), terrain(nullptr) {
     r = 10.0f;
     theta = 0.0f;
     phi = 0.0f;
 	cameraRefPos = glm::vec3(0.0f);
     cameraBufferObject.viewMatrix = glm::lookAt(glm::vec3(0.0f, 1.0f, 10.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    cameraBufferObject.projectionMatrix = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 100.0f);
+    // Far enough to see the whole terrain quadtree
+    cameraBufferObject.projectionMatrix = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 2000.0f);
     cameraBufferObject.projectionMatrix[1][1] *= -1; // y-coordinate is flipped
 	cameraBufferObject.cameraPos = cameraRefPos;
 
-    BufferUtils::CreateBuffer(device, sizeof(CameraBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, bufferMemory);
-    vkMapMemory(device->GetVkDevice(), bufferMemory, 0, sizeof(CameraBufferObject), 0, &mappedData);
-    memcpy(mappedData, &cameraBufferObject, sizeof(CameraBufferObject));
+    bufferStride = BufferUtils::GetUniformBufferStride(device, sizeof(CameraBufferObject));
+    BufferUtils::CreateBuffer(device, framesInFlight * bufferStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, bufferMemory);
+    mappedData = device->GetAllocator()->Map(bufferMemory);
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        UpdateBuffer(i);
+    }
 }
 #endif // FRUSTUM_CULL_TEST
 
@@ -59,6 +72,15 @@ VkBuffer Camera::GetBuffer() const {
     return buffer;
 }
 
+VkDeviceSize Camera::GetBufferOffset(uint32_t frameIndex) const {
+    return frameIndex * bufferStride;
+}
+
+void Camera::UpdateBuffer(uint32_t frameIndex) {
+    cameraBufferObject.inverseViewProjectionMatrix = glm::inverse(cameraBufferObject.projectionMatrix * cameraBufferObject.viewMatrix);
+    memcpy(static_cast<char*>(mappedData) + GetBufferOffset(frameIndex), &cameraBufferObject, sizeof(CameraBufferObject));
+}
+
 void Camera::UpdateOrbit(float deltaX, float deltaY, float deltaZ) {
     theta += deltaX;
     phi += deltaY;
@@ -70,9 +92,17 @@ void Camera::UpdateOrbit(float deltaX, float deltaY, float deltaZ) {
     glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), radTheta, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::rotate(glm::mat4(1.0f), radPhi, glm::vec3(1.0f, 0.0f, 0.0f));
 	glm::mat4 finalTransform = glm::translate(glm::mat4(1.0f), cameraRefPos) * rotation * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, r));// glm::translate(glm::mat4(1.0f), glm::vec3(0.0f)) * rotation * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.0f, r));
 
-    cameraBufferObject.viewMatrix = glm::inverse(finalTransform);
+    // Lift the eye out of the hills it orbited or panned into. The orbit target stays where it is, so that the
+    // eye comes back down once the ground does
+    if (terrain != nullptr) {
+        glm::vec3 eye = glm::vec3(finalTransform[3]);
+        float minHeight = terrain->GetHeight(eye.x, eye.z) + GROUND_CLEARANCE;
+        if (eye.y < minHeight) {
+            finalTransform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, minHeight - eye.y, 0.0f)) * finalTransform;
+        }
+    }
 
-    memcpy(mappedData, &cameraBufferObject, sizeof(CameraBufferObject));
+    cameraBufferObject.viewMatrix = glm::inverse(finalTransform);
 }
 
 void Camera::PanCamera(float deltaX, float deltaY, float deltaZ) {
@@ -81,8 +111,6 @@ void Camera::PanCamera(float deltaX, float deltaY, float deltaZ) {
 	cameraRefPos.z += deltaZ; 
 
 	cameraBufferObject.cameraPos = cameraRefPos;
-
-	memcpy(mappedData, &cameraBufferObject, sizeof(CameraBufferObject));
 }
 
 void Camera::ResetCamera() {
@@ -92,12 +120,15 @@ void Camera::ResetCamera() {
 	cameraRefPos = glm::vec3(0.0f);
 }
 
+void Camera::SetTerrain(const Terrain* terrain) {
+    this->terrain = terrain;
+}
+
 const CameraBufferObject& Camera::GetCBO() {
     return cameraBufferObject;
 }
 
 Camera::~Camera() {
-  vkUnmapMemory(device->GetVkDevice(), bufferMemory);
   vkDestroyBuffer(device->GetVkDevice(), buffer, nullptr);
-  vkFreeMemory(device->GetVkDevice(), bufferMemory, nullptr);
+  device->GetAllocator()->Free(bufferMemory);
 }
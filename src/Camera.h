@@ -3,11 +3,16 @@
 
 #include <glm/glm.hpp>
 #include "Device.h"
+#include "Terrain.h"
 
 struct CameraBufferObject {
   glm::mat4 viewMatrix;
   glm::mat4 projectionMatrix;
   glm::vec3 cameraPos;
+  // std140 starts the matrix below on a 16 byte boundary
+  float padding;
+  // Takes depth buffer positions back to world space, kept up to date by UpdateBuffer
+  glm::mat4 inverseViewProjectionMatrix;
 };
 
 class Camera {
@@ -16,23 +21,34 @@ private:
     
     CameraBufferObject cameraBufferObject;
     
+    // One slice per frame in flight, so that moving the camera never touches a slice the GPU is reading
     VkBuffer buffer;
-    VkDeviceMemory bufferMemory;
+    MemoryAllocation bufferMemory;
+    VkDeviceSize bufferStride;
+    uint32_t framesInFlight;
 
     void* mappedData;
 
     float r, theta, phi;
 	glm::vec3 cameraRefPos;
 
+    // Keeps the eye above the ground when set
+    const Terrain* terrain;
+
 public:
-    Camera(Device* device, float aspectRatio);
+    Camera(Device* device, float aspectRatio, uint32_t framesInFlight);
     ~Camera();
 
     VkBuffer GetBuffer() const;
+    VkDeviceSize GetBufferOffset(uint32_t frameIndex) const;
+
+    // Copies the current camera into the slice of the given frame
+    void UpdateBuffer(uint32_t frameIndex);
 
     const CameraBufferObject& GetCBO();
     
     void UpdateOrbit(float deltaX, float deltaY, float deltaZ);
 	void PanCamera(float deltaX, float deltaY, float deltaZ);
 	void ResetCamera();
+    void SetTerrain(const Terrain* terrain);
 };
@@ -6,42 +6,93 @@
 #include "Camera.h"
 #include "Image.h"
 #include "BufferUtils.h"
+#include <chrono>
 
 #define PRINT_NUM_BLADES 0
+#define PRINT_CULL_STATS 0
+// Time spent creating pipelines, to compare starts with a cold and a warm pipeline cache
+#define PRINT_PIPELINE_TIMES 0
+// Memory the transient attachments take, with and without aliasing
+#define PRINT_RENDER_GRAPH_STATS 0
 
 #define LOTSA_NEWLINES "\n\n\n\n\n\n*** "
 
-static constexpr unsigned int WORKGROUP_SIZE = 32;
+static constexpr unsigned int DEPTH_PYRAMID_WORKGROUP_SIZE = 8;
 
 DeferredRenderer::DeferredRenderer(Device* device, SwapChain* swapChain, Scene* scene, Camera* camera)
     : device(device),
     logicalDevice(device->GetVkDevice()),
     swapChain(swapChain),
     scene(scene),
-    camera(camera) {
+    camera(camera),
+    framesInFlight(swapChain->GetFramesInFlight()) {
 
 
     CreateCommandPools();
-    CreateRenderPass();
-    // TODO: call CreateDeferred*() / RecordDeferred*() functions here DTODO
-    CreateDeferredRenderPass();
+    CreateRenderGraph();
+    CreateFrameResources();
+#if PRINT_RENDER_GRAPH_STATS
+    RenderGraphStats graphStats = renderGraph->GetStats();
+    printf("render graph passes: %u (%u culled), transient images: %u in %llu bytes (%llu bytes without aliasing, %llu lazily allocated)\n",
+        graphStats.passCount, graphStats.culledPassCount, graphStats.transientImageCount,
+        (unsigned long long)graphStats.transientBytes, (unsigned long long)graphStats.unaliasedBytes,
+        (unsigned long long)graphStats.lazilyAllocatedBytes);
+#endif // PRINT_RENDER_GRAPH_STATS
     CreateCameraDescriptorSetLayout();
+    // The depth pyramid's base level matches the depth buffer it is built from
+    terrainCompute = new TerrainCompute(device, scene, framesInFlight, cameraDescriptorSetLayout, swapChain->GetVkExtent().width, swapChain->GetVkExtent().height);
     CreateModelDescriptorSetLayout();
-    CreateTimeDescriptorSetLayout();
-    CreateComputeDescriptorSetLayout();
+    CreateDepthPyramidDescriptorSetLayout();
+    // Compiled on worker threads while the descriptor sets are being created, and waited on before recording
+#if PRINT_PIPELINE_TIMES
+    auto pipelinesStart = std::chrono::high_resolution_clock::now();
+#endif // PRINT_PIPELINE_TIMES
+    std::vector<std::future<void>> pipelineJobs;
+    pipelineJobs.push_back(device->GetThreadPool()->Submit([this]() { CreateGraphicsPipeline(); }));
+    pipelineJobs.push_back(device->GetThreadPool()->Submit([this]() { CreateGrassPipeline(); }));
+    pipelineJobs.push_back(device->GetThreadPool()->Submit([this]() { terrainCompute->CreateComputePipeline(); }));
+    pipelineJobs.push_back(device->GetThreadPool()->Submit([this]() { terrainCompute->CreateClipmapPipeline(); }));
+    pipelineJobs.push_back(device->GetThreadPool()->Submit([this]() { CreateDepthPyramidPipeline(); }));
     CreateDescriptorPool();
-    CreateCameraDescriptorSet();
+    CreateCameraDescriptorSets();
     CreateModelDescriptorSets();
     CreateGrassDescriptorSets();
-    CreateTimeDescriptorSet();
-    CreateComputeDescriptorSets();
-    CreateFrameResources();
-    CreateGraphicsPipeline();
-    CreateGrassPipeline();
-    CreateComputePipeline();
+    CreateDepthPyramidDescriptorSets();
+    ThreadPool::WaitAll(pipelineJobs);
+#if PRINT_PIPELINE_TIMES
+    std::chrono::duration<float, std::milli> pipelinesTime = std::chrono::high_resolution_clock::now() - pipelinesStart;
+    printf("pipelines ready after %.1f ms (%s pipeline cache)\n", pipelinesTime.count(), device->GetPipelineCache()->IsWarm() ? "warm" : "cold");
+#endif // PRINT_PIPELINE_TIMES
+#if PRINT_NUM_BLADES
+    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+        scene->GetBlades()[j]->EnableReadback();
+    }
+#endif // PRINT_NUM_BLADES
+    CreateGpuTimer();
     RecordCommandBuffers();
-    RecordDeferredCommandBuffer();
-    RecordComputeCommandBuffer();
+    RecordDepthPyramidCommandBuffers();
+    RecordComputeCommandBuffers();
+    CreateSyncObjects();
+    startupUploadId = device->GetUploadManager()->Flush();
+}
+
+const char* DeferredRenderer::GetName() const {
+    return "deferred";
+}
+
+std::vector<GpuTiming> DeferredRenderer::GetPassTimings() const {
+    return gpuTimer->GetTimings();
+}
+
+void DeferredRenderer::CreateGpuTimer() {
+    // The render graph's passes come after the compute sections
+    std::vector<std::string> sections = TerrainCompute::GetTimerSectionNames();
+    for (uint32_t p = 0; p < renderGraph->GetPassCount(); ++p) {
+        sections.push_back(renderGraph->GetPassName(p));
+    }
+
+    gpuTimer = new GpuTimer(device, framesInFlight, sections);
+    renderGraph->SetTimer(gpuTimer, TerrainCompute::TIMER_SECTION_COUNT);
 }
 
 void DeferredRenderer::CreateCommandPools() {
@@ -64,387 +115,178 @@ void DeferredRenderer::CreateCommandPools() {
     }
 }
 
-void DeferredRenderer::CreateRenderPass() {
-    // Color buffer attachment represented by one of the images from the swap chain
-    VkAttachmentDescription colorAttachment = {};
-    colorAttachment.format = swapChain->GetVkImageFormat();
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    // Create a color attachment reference to be used with subpass
-    VkAttachmentReference colorAttachmentRef = {};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    // Depth buffer attachment
-    VkFormat depthFormat = device->GetInstance()->GetSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-    VkAttachmentDescription depthAttachment = {};
-    depthAttachment.format = depthFormat;
-    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    // Create a depth attachment reference
-    VkAttachmentReference depthAttachmentRef = {};
-    depthAttachmentRef.attachment = 1;
-    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    // Create subpass description
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
-
-    std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
-
-    // Specify subpass dependency
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    // Create render pass
-    VkRenderPassCreateInfo renderPassInfo = {};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-    renderPassInfo.pAttachments = attachments.data();
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
-
-    if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create render pass");
-    }
-}
+void DeferredRenderer::CreateRenderGraph() {
+    renderGraph = new RenderGraph(device, framesInFlight);
 
-void DeferredRenderer::CreateDeferredRenderPass() {
-    // Color buffer attachment represented by one of the images from the swap chain
-    VkAttachmentDescription albedoAttachment = {};
-    albedoAttachment.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    albedoAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    albedoAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    albedoAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    albedoAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    albedoAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    albedoAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    albedoAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; // VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // newly added
-
-                                                                             // Create a albedo attachment reference to be used with subpass
-    VkAttachmentReference albedoAttachmentRef = {}; // newly added
-    albedoAttachmentRef.attachment = 0;
-    albedoAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    // newly added
-    // add position and normal attachments to the render pass (similar to color attachment)
-    VkAttachmentDescription positionAttachment = {};
-    positionAttachment.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    positionAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    positionAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    positionAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    positionAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    positionAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    positionAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    positionAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; // VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // newly added
-
-                                                                               // Create a position attachment reference to be used with subpass
-    VkAttachmentReference positionAttachmentRef = {};
-    positionAttachmentRef.attachment = 1;
-    positionAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentDescription normalAttachment = {};
-    normalAttachment.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    normalAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    normalAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    normalAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    normalAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    normalAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    normalAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    normalAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; // VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // newly added
-
-                                                                             // Create a normal attachment reference to be used with subpass
-    VkAttachmentReference normalAttachmentRef = {};
-    normalAttachmentRef.attachment = 2;
-    normalAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    // Hopefully imageView are created below for all the images we are attaching
-    // VkImageCreateInfo ??
-    // ----------------
-
-    // Depth buffer attachment
     VkFormat depthFormat = device->GetInstance()->GetSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-    VkAttachmentDescription depthAttachment = {};
-    depthAttachment.format = depthFormat;
-    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    std::vector<VkAttachmentReference> colorDeferredReferences;
-    colorDeferredReferences.push_back({ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-    colorDeferredReferences.push_back({ 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-    colorDeferredReferences.push_back({ 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL });
-
-    // Create a depth attachment reference
-    VkAttachmentReference depthAttachmentRef = {};
-    depthAttachmentRef.attachment = 3;// 1; newly added
-    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    // Create subpass description
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = static_cast<uint32_t>(colorDeferredReferences.size()); // newly added
-    subpass.pColorAttachments = colorDeferredReferences.data();							 // " "
-    subpass.pDepthStencilAttachment = &depthAttachmentRef;
-
-    std::array<VkAttachmentDescription, 4> attachments = { albedoAttachment, positionAttachment, normalAttachment, depthAttachment, };
-
-    // newly added 
-    // Use subpass dependencies for attachment layput transitions
-    std::array<VkSubpassDependency, 2> dependencies;
-
-    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependencies[0].dstSubpass = 0;
-    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    dependencies[1].srcSubpass = 0;
-    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-    // --------------
-
-    /*
-    // Specify subpass dependency
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    */
-
-    // Create render pass
-    VkRenderPassCreateInfo renderPassInfo = {};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-    renderPassInfo.pAttachments = attachments.data();
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 2; // 1; newly added
-    renderPassInfo.pDependencies = dependencies.data(); // &dependency; newly added
-
-    if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &deferredRenderPass) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create DEFERRED render pass");
-    }
 
-    // Create image, image views
-    // Create albedo image
-    Image::Create(
-        device,
-        swapChain->GetVkExtent().width,
-        swapChain->GetVkExtent().height,
-        VK_FORMAT_R16G16B16A16_SFLOAT,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        deferredAlbedoImage,
-        deferredAlbedoImageMemory);
-
-    // Create albedo image view
-    deferredAlbedoImageView = Image::CreateView(device, deferredAlbedoImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
-
-    // Create position image
-    Image::Create(
-        device,
-        swapChain->GetVkExtent().width,
-        swapChain->GetVkExtent().height,
-        VK_FORMAT_R16G16B16A16_SFLOAT,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        deferredPositionImage,
-        deferredPositionImageMemory);
-
-    // Create position image view
-    deferredPositionImageView = Image::CreateView(device, deferredPositionImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
-
-    // Create normal image
-    Image::Create(
-        device,
-        swapChain->GetVkExtent().width,
-        swapChain->GetVkExtent().height,
-        VK_FORMAT_R16G16B16A16_SFLOAT,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        deferredNormalImage,
-        deferredNormalImageMemory);
-
-    // Create normal image view
-    deferredNormalImageView = Image::CreateView(device, deferredNormalImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
-
-    // CREATE DEPTH IMAGE (deferred depth)
-    Image::Create(device,
-        swapChain->GetVkExtent().width,
-        swapChain->GetVkExtent().height,
-        depthFormat,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        deferredDepthImage,
-        deferredDepthImageMemory
-    );
-
-    // DTODO: may not need 2nd bit at end
-    deferredDepthImageView = Image::CreateView(device, deferredDepthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-    std::array<VkImageView, 4> imageViews;
-    imageViews[0] = deferredAlbedoImageView;
-    imageViews[1] = deferredPositionImageView;
-    imageViews[2] = deferredNormalImageView;
-    imageViews[3] = deferredDepthImageView;
-
-    // Create deferred framebuffers
-
-    VkFramebufferCreateInfo framebufferInfo = {};
-    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebufferInfo.pNext = NULL;
-    framebufferInfo.renderPass = deferredRenderPass;
-    framebufferInfo.attachmentCount = static_cast<uint32_t>(imageViews.size());
-    framebufferInfo.pAttachments = imageViews.data();
-    framebufferInfo.width = swapChain->GetVkExtent().width;
-    framebufferInfo.height = swapChain->GetVkExtent().height;
-    framebufferInfo.layers = 1;
-
-    if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, nullptr, &deferredFramebuffer) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create DEFERRED framebuffer");
-    }
+    VkClearValue gBufferClear = {};
+    gBufferClear.color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+    VkClearValue skyClear = {};
+    skyClear.color = { { 0.768f, 0.8039f, 0.898f, 1.0f } };
+    VkClearValue depthClear = {};
+    depthClear.depthStencil = { 1.0f, 0 };
+
+    // Normals are octahedral encoded into two channels, and position is reconstructed from the geometry depth
+    VkFormat normalFormat = device->GetInstance()->GetSupportedFormat({ VK_FORMAT_R16G16_SNORM, VK_FORMAT_R16G16_SFLOAT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+
+    albedoImage = renderGraph->AddImage("albedo", VK_FORMAT_R8G8B8A8_UNORM, gBufferClear);
+    normalImage = renderGraph->AddImage("normal", normalFormat, gBufferClear);
+    geometryDepthImage = renderGraph->AddImage("geometry depth", depthFormat, depthClear);
+    swapChainImage = renderGraph->ImportImage("swap chain", swapChain->GetVkImageFormat(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, skyClear);
+
+    geometryPass = renderGraph->AddPass("geometry", [this](VkCommandBuffer commandBuffer, uint32_t frame) {
+        RecordGeometryPass(commandBuffer, frame);
+    });
+    renderGraph->Write(geometryPass, albedoImage, RenderGraphUsage::ColorAttachment);
+    renderGraph->Write(geometryPass, normalImage, RenderGraphUsage::ColorAttachment);
+    renderGraph->Write(geometryPass, geometryDepthImage, RenderGraphUsage::DepthAttachment);
+
+    // A subpass of the geometry pass's render pass, so the G-buffers never leave tile memory on tilers
+    lightingPass = renderGraph->AddPass("lighting", [this](VkCommandBuffer commandBuffer, uint32_t frame) {
+        RecordLightingPass(commandBuffer, frame);
+    });
+    renderGraph->Read(lightingPass, albedoImage, RenderGraphUsage::InputAttachment);
+    renderGraph->Read(lightingPass, normalImage, RenderGraphUsage::InputAttachment);
+    renderGraph->Read(lightingPass, geometryDepthImage, RenderGraphUsage::InputAttachment);
+    renderGraph->Write(lightingPass, swapChainImage, RenderGraphUsage::ColorAttachment);
+
+    // Debug copies of the culled tiles, only recorded when a readback was enabled
+    readbackPass = renderGraph->AddPass("readback", [this](VkCommandBuffer commandBuffer, uint32_t frame) {
+        for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+            if (scene->GetBlades()[j]->IsReadbackEnabled()) {
+                scene->GetBlades()[j]->RecordReadback(commandBuffer, frame);
+            }
+        }
+    });
+    renderGraph->SetSideEffects(readbackPass);
 
-    // Create sampler for deferred buffers
-    VkSamplerCreateInfo sampler = {};
-    sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    sampler.magFilter = VK_FILTER_NEAREST;
-    sampler.minFilter = VK_FILTER_NEAREST;
-    sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    sampler.addressModeV = sampler.addressModeU;
-    sampler.addressModeW = sampler.addressModeU;
-    sampler.mipLodBias = 0.0f;
-    sampler.maxAnisotropy = 1.0f;
-    sampler.minLod = 0.0f;
-    sampler.maxLod = 1.0f;
-    sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-
-    if (vkCreateSampler(logicalDevice, &sampler, nullptr, &deferredSampler) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create DEFERRED sampler");
-    }
+    // The pyramid lives outside the graph, until next frame's culling
+    depthPyramidPass = renderGraph->AddPass("depth pyramid", [this](VkCommandBuffer commandBuffer, uint32_t frame) {
+        RecordDepthPyramidPass(commandBuffer, frame);
+    });
+    renderGraph->Read(depthPyramidPass, geometryDepthImage, RenderGraphUsage::ComputeSampled);
+    renderGraph->SetSideEffects(depthPyramidPass);
+
+    renderGraph->Compile();
 }
 
-void DeferredRenderer::RecordDeferredCommandBuffer() {
+void DeferredRenderer::RecordDepthPyramidCommandBuffers() {
+    depthPyramidCommandBuffers.resize(framesInFlight);
+
     // Specify the command pool and number of buffers to allocate
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = graphicsCommandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = static_cast<uint32_t>(1);
+    allocInfo.commandBufferCount = static_cast<uint32_t>(depthPyramidCommandBuffers.size());
 
-    if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &deferredCommandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate DEFERRED command buffers");
+    if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, depthPyramidCommandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate depth pyramid command buffers");
     }
 
-    // Create a semaphore used to synchronize offscreen rendering and usage
-    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        VkCommandBuffer depthPyramidCommandBuffer = depthPyramidCommandBuffers[f];
 
-    if (vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, nullptr, &deferredSemaphore) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate DEFERRED semaphore");
-    }
+        // Set up command buffer begin
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+        beginInfo.pInheritanceInfo = nullptr;
 
-    // Set up command buffer begin
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-    beginInfo.pInheritanceInfo = nullptr;
-
-    // Clear values for all attachments written in the fragment sahder
-    std::array<VkClearValue, 4> clearValues;
-    clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-    clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-    clearValues[2].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
-    clearValues[3].depthStencil = { 1.0f, 0 };
-
-    // Set up render pass begin
-    // This will clear values in G-buffer
-    VkRenderPassBeginInfo renderPassBeginInfo = {};
-    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.renderPass = deferredRenderPass;
-    renderPassBeginInfo.framebuffer = deferredFramebuffer;
-    renderPassBeginInfo.renderArea.extent.width = swapChain->GetVkExtent().width;
-    renderPassBeginInfo.renderArea.extent.height = swapChain->GetVkExtent().height;
-    renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassBeginInfo.pClearValues = clearValues.data();
-
-    // ~ Start recording ~
-    if (vkBeginCommandBuffer(deferredCommandBuffer, &beginInfo) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to begin recording DEFERRED command buffer");
+        // ~ Start recording ~
+        if (vkBeginCommandBuffer(depthPyramidCommandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording depth pyramid command buffer");
+        }
+
+        // Everything after the frame's render pass, which does not depend on the swap chain image
+        renderGraph->Record(depthPyramidCommandBuffer, readbackPass, depthPyramidPass, f);
+
+        // ~ End recording ~
+        if (vkEndCommandBuffer(depthPyramidCommandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record depth pyramid command buffer");
+        }
     }
+}
 
-    // TODO: change pipeline layout? DTODO
+void DeferredRenderer::RecordGeometryPass(VkCommandBuffer commandBuffer, uint32_t frame) {
     // Bind the camera descriptor set. This is set 0 in all pipelines so it will be inherited
-    vkCmdBindDescriptorSets(deferredCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipelineLayout, 0, 1, &cameraDescriptorSet, 0, nullptr);
-
-    vkCmdBeginRenderPass(deferredCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipelineLayout, 0, 1, &cameraDescriptorSets[frame], 0, nullptr);
 
     // Bind the deferred pipeline
-    vkCmdBindPipeline(deferredCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipeline);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipeline);
+
+    // Bind the height clipmap the terrain is displaced with
+    VkDescriptorSet clipmapDescriptorSet = terrainCompute->GetClipmapDescriptorSet(frame);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipelineLayout, 2, 1, &clipmapDescriptorSet, 0, nullptr);
 
     for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
-        VkBuffer vertexBuffers[] = { scene->GetBlades()[j]->GetCulledBladesBuffer() };//{ scene->GetBlades()[j]->GetCulledBladesBuffer() };
+        VkBuffer vertexBuffers[] = { scene->GetBlades()[j]->GetCulledBladesBuffer(frame) };
         VkDeviceSize offsets[] = { 0 };
-        // TODO: Uncomment this when the buffers are populated
-        vkCmdBindVertexBuffers(deferredCommandBuffer, 0, 1, vertexBuffers, offsets);
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
         // TODO: Bind the descriptor set for each grass blades model
-        vkCmdBindDescriptorSets(deferredCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipelineLayout, 1, 1, &grassDescriptorSets[j], 0, nullptr);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipelineLayout, 1, 1, &grassDescriptorSets[j], 0, nullptr);
 
         // Draw
-        // TODO: Uncomment this when the buffers are populated
         // CHECKITOUT: it's getNumBladesBuffer that specifies how many threads are spawned
         // see: https://www.khronos.org/registry/vulkan/specs/1.0/man/html/vkCmdDrawIndirect.html
         // see: https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkDrawIndirectCommand.html
-        vkCmdDrawIndirect(deferredCommandBuffer, scene->GetBlades()[j]->GetNumBladesBuffer(), 0, 1, sizeof(BladeDrawIndirect));
+        vkCmdDrawIndirect(commandBuffer, scene->GetBlades()[j]->GetNumBladesBuffer(frame), 0, 1, sizeof(BladeDrawIndirect));
     }
+}
 
-    // End render pass
-    vkCmdEndRenderPass(deferredCommandBuffer);
-
-    // ~ End recording ~
-    if (vkEndCommandBuffer(deferredCommandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to record DEFERRED command buffer");
+void DeferredRenderer::RecordDepthPyramidPass(VkCommandBuffer commandBuffer, uint32_t frame) {
+    // Build the frame's depth pyramid, which the compute pass culls tiles against when the frame comes around
+    // again. This frame's culling pass is done reading the pyramid and its camera, the compute semaphore this is
+    // submitted with covers it
+
+    // Snapshot the camera this frame's depth was rendered with and mark the pyramid as valid
+    VkBufferCopy hizCameraCopy = {};
+    hizCameraCopy.srcOffset = camera->GetBufferOffset(frame) + offsetof(CameraBufferObject, viewMatrix);
+    hizCameraCopy.dstOffset = offsetof(HiZBufferObject, viewMatrix);
+    hizCameraCopy.size = 2 * sizeof(glm::mat4);
+    vkCmdCopyBuffer(commandBuffer, camera->GetBuffer(), terrainCompute->GetDepthPyramid(frame)->GetHiZBuffer(), 1, &hizCameraCopy);
+    vkCmdFillBuffer(commandBuffer, terrainCompute->GetDepthPyramid(frame)->GetHiZBuffer(), offsetof(HiZBufferObject, valid), sizeof(uint32_t), 1);
+
+    VkBufferMemoryBarrier hizCameraBarrier = {};
+    hizCameraBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hizCameraBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hizCameraBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+    hizCameraBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hizCameraBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hizCameraBarrier.buffer = terrainCompute->GetDepthPyramid(frame)->GetHiZBuffer();
+    hizCameraBarrier.offset = 0;
+    hizCameraBarrier.size = sizeof(HiZBufferObject);
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &hizCameraBarrier, 0, nullptr);
+
+    // Reduce one level at a time, each from the one above it
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipeline);
+
+    for (uint32_t i = 0; i < terrainCompute->GetDepthPyramid(frame)->GetMipLevels(); ++i) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipelineLayout, 0, 1, &depthPyramidDescriptorSets[frame * terrainCompute->GetDepthPyramid(frame)->GetMipLevels() + i], 0, nullptr);
+
+        VkExtent2D mipExtent = terrainCompute->GetDepthPyramid(frame)->GetMipExtent(i);
+        vkCmdDispatch(commandBuffer, (mipExtent.width + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE, (mipExtent.height + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE, 1);
+
+        // Make the level visible to the next reduction, and the last one to next frame's culling
+        VkImageMemoryBarrier mipBarrier = {};
+        mipBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        mipBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        mipBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        mipBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        mipBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        mipBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        mipBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        mipBarrier.image = terrainCompute->GetDepthPyramid(frame)->GetImage();
+        mipBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        mipBarrier.subresourceRange.baseMipLevel = i;
+        mipBarrier.subresourceRange.levelCount = 1;
+        mipBarrier.subresourceRange.baseArrayLayer = 0;
+        mipBarrier.subresourceRange.layerCount = 1;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
     }
 }
 
@@ -487,27 +329,27 @@ void DeferredRenderer::CreateModelDescriptorSetLayout() {
 
     VkDescriptorSetLayoutBinding albedoImageLayoutBinding = {};
     albedoImageLayoutBinding.binding = 2;
-    albedoImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    albedoImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
     albedoImageLayoutBinding.descriptorCount = 1;
     albedoImageLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     albedoImageLayoutBinding.pImmutableSamplers = nullptr;
 
-    VkDescriptorSetLayoutBinding positionImageLayoutBinding = {};
-    positionImageLayoutBinding.binding = 3;
-    positionImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    positionImageLayoutBinding.descriptorCount = 1;
-    positionImageLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    positionImageLayoutBinding.pImmutableSamplers = nullptr;
-
     VkDescriptorSetLayoutBinding normalImageLayoutBinding = {};
-    normalImageLayoutBinding.binding = 4;
-    normalImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    normalImageLayoutBinding.binding = 3;
+    normalImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
     normalImageLayoutBinding.descriptorCount = 1;
     normalImageLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     normalImageLayoutBinding.pImmutableSamplers = nullptr;
 
+    VkDescriptorSetLayoutBinding depthImageLayoutBinding = {};
+    depthImageLayoutBinding.binding = 4;
+    depthImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    depthImageLayoutBinding.descriptorCount = 1;
+    depthImageLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    depthImageLayoutBinding.pImmutableSamplers = nullptr;
+
     std::vector<VkDescriptorSetLayoutBinding> bindings = { uboLayoutBinding, samplerLayoutBinding, 
-        albedoImageLayoutBinding, positionImageLayoutBinding, normalImageLayoutBinding };
+        albedoImageLayoutBinding, normalImageLayoutBinding, depthImageLayoutBinding };
 
     // Create the descriptor set layout
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
@@ -520,228 +362,181 @@ void DeferredRenderer::CreateModelDescriptorSetLayout() {
     }
 }
 
-void DeferredRenderer::CreateTimeDescriptorSetLayout() {
-    // Describe the binding of the descriptor set layout
-    VkDescriptorSetLayoutBinding uboLayoutBinding = {};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    uboLayoutBinding.pImmutableSamplers = nullptr;
-
-    std::vector<VkDescriptorSetLayoutBinding> bindings = { uboLayoutBinding };
-
-    // Create the descriptor set layout
-    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
-
-    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &timeDescriptorSetLayout) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create descriptor set layout");
-    }
-}
-
-void DeferredRenderer::CreateComputeDescriptorSetLayout() {
-    // TODOX: Create the descriptor set layout for the compute pipeline
-    // Remember this is like a class definition stating why types of information
-    // will be stored at each binding
-    // Describe the binding of the descriptor set layout
-    // TODOX: just copied this from time descriptor
-    VkDescriptorSetLayoutBinding inputBladesLayoutBinding = {};
-    inputBladesLayoutBinding.binding = 0;
-    inputBladesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    inputBladesLayoutBinding.descriptorCount = 1; // TODO: number of input blades???
-    inputBladesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    inputBladesLayoutBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutBinding culledBladesLayoutBinding = {};
-    culledBladesLayoutBinding.binding = 1;
-    culledBladesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    culledBladesLayoutBinding.descriptorCount = 1; // TODO: number of input blades???
-    culledBladesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    culledBladesLayoutBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutBinding numBladesLayoutBinding = {};
-    numBladesLayoutBinding.binding = 2;
-    numBladesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    numBladesLayoutBinding.descriptorCount = 1;
-    numBladesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    numBladesLayoutBinding.pImmutableSamplers = nullptr;
-
-    std::vector<VkDescriptorSetLayoutBinding> bindings = { inputBladesLayoutBinding, culledBladesLayoutBinding, numBladesLayoutBinding };
-
-    // Create the descriptor set layout
-    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
-
-    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &grassComputeDescriptorSetLayout) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create descriptor set layout");
-    }
-}
-
 void DeferredRenderer::CreateDescriptorPool() {
     // DTODO: update this with new buffers?
     // Describe which descriptor types that the descriptor sets will contain
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        // Camera
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , 1 },
+        // Camera, per frame
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , framesInFlight },
 
-        // Models + Blades
-        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER , static_cast<uint32_t>(scene->GetModels().size() * 7 + scene->GetBlades().size()) },
+        // Models (per frame) + Blades
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER , static_cast<uint32_t>(framesInFlight * scene->GetModels().size() * 7 + scene->GetBlades().size()) },
 
-        // Models + Blades
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , static_cast<uint32_t>(scene->GetModels().size() + scene->GetBlades().size()) },
+        // G-buffers of the lighting subpass, models (per frame) + Blades, which share the model layout
+        { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT , static_cast<uint32_t>((framesInFlight * scene->GetModels().size() + scene->GetBlades().size()) * 3) },
 
-        // Time (compute)
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , 1 },
+        // Models (per frame) + Blades
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , static_cast<uint32_t>(framesInFlight * scene->GetModels().size() + scene->GetBlades().size()) },
 
         // TODO: Add any additional types and counts of descriptors you will need to allocate
-        // Input blades (compute)
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , static_cast<uint32_t>(scene->GetBlades().size()) },
-
-        // Culled blades (compute)
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , static_cast<uint32_t>(scene->GetBlades().size()) },
 
-        // Number of remaining blades (compute)
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , static_cast<uint32_t>(scene->GetBlades().size()) },
+        // Depth pyramid build, one source and destination per level and frame
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER , framesInFlight * terrainCompute->GetDepthPyramid(0)->GetMipLevels() },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE , framesInFlight * terrainCompute->GetDepthPyramid(0)->GetMipLevels() },
     };
 
     VkDescriptorPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = 5;
+
+    // A set per blades, and per frame the camera, a set per model and one per pyramid level. The compute sets are in
+    // TerrainCompute's pool
+    poolInfo.maxSets = static_cast<uint32_t>(scene->GetBlades().size() + framesInFlight * (1 + scene->GetModels().size() + terrainCompute->GetDepthPyramid(0)->GetMipLevels()));
 
     if (vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create descriptor pool");
     }
 }
 
-void DeferredRenderer::CreateCameraDescriptorSet() {
-    // Describe the desciptor set
-    VkDescriptorSetLayout layouts[] = { cameraDescriptorSetLayout };
+void DeferredRenderer::CreateCameraDescriptorSets() {
+    cameraDescriptorSets.resize(framesInFlight);
+
+    // Describe the desciptor sets
+    std::vector<VkDescriptorSetLayout> layouts(cameraDescriptorSets.size(), cameraDescriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = layouts;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(cameraDescriptorSets.size());
+    allocInfo.pSetLayouts = layouts.data();
 
     // Allocate descriptor sets
-    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, &cameraDescriptorSet) != VK_SUCCESS) {
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, cameraDescriptorSets.data()) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate descriptor set");
     }
 
-    // Configure the descriptors to refer to buffers
-    VkDescriptorBufferInfo cameraBufferInfo = {};
-    cameraBufferInfo.buffer = camera->GetBuffer();
-    cameraBufferInfo.offset = 0;
-    cameraBufferInfo.range = sizeof(CameraBufferObject);
-
-    std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = cameraDescriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &cameraBufferInfo;
-    descriptorWrites[0].pImageInfo = nullptr;
-    descriptorWrites[0].pTexelBufferView = nullptr;
+    // Configure the descriptors to refer to each frame's slice of the camera buffer
+    std::vector<VkDescriptorBufferInfo> cameraBufferInfos(cameraDescriptorSets.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(cameraDescriptorSets.size());
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        cameraBufferInfos[f].buffer = camera->GetBuffer();
+        cameraBufferInfos[f].offset = camera->GetBufferOffset(f);
+        cameraBufferInfos[f].range = sizeof(CameraBufferObject);
+
+        descriptorWrites[f].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[f].dstSet = cameraDescriptorSets[f];
+        descriptorWrites[f].dstBinding = 0;
+        descriptorWrites[f].dstArrayElement = 0;
+        descriptorWrites[f].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[f].descriptorCount = 1;
+        descriptorWrites[f].pBufferInfo = &cameraBufferInfos[f];
+        descriptorWrites[f].pImageInfo = nullptr;
+        descriptorWrites[f].pTexelBufferView = nullptr;
+    }
 
     // Update descriptor sets
     vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
 void DeferredRenderer::CreateModelDescriptorSets() {
-    modelDescriptorSets.resize(scene->GetModels().size());
+    // Each frame reads its own G-buffer
+    modelDescriptorSets.resize(framesInFlight * scene->GetModels().size());
 
-    // Describe the desciptor set
-    VkDescriptorSetLayout layouts[] = { modelDescriptorSetLayout };
+    // Describe the desciptor sets
+    std::vector<VkDescriptorSetLayout> layouts(modelDescriptorSets.size(), modelDescriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
     allocInfo.descriptorSetCount = static_cast<uint32_t>(modelDescriptorSets.size());
-    allocInfo.pSetLayouts = layouts;
+    allocInfo.pSetLayouts = layouts.data();
 
     // Allocate descriptor sets
     if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, modelDescriptorSets.data()) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate descriptor set");
     }
 
-    // Image descriptors for the offscreen color attachments
-    VkDescriptorImageInfo texDescriptorAlbedo = {};
-    texDescriptorAlbedo.sampler = deferredSampler;
-    texDescriptorAlbedo.imageView = deferredAlbedoImageView;
-    texDescriptorAlbedo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-    VkDescriptorImageInfo texDescriptorPosition = {};
-    texDescriptorPosition.sampler = deferredSampler;
-    texDescriptorPosition.imageView = deferredPositionImageView;
-    texDescriptorPosition.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    UpdateModelDescriptorSets();
+}
 
-    VkDescriptorImageInfo texDescriptorNormal = {};
-    texDescriptorNormal.sampler = deferredSampler;
-    texDescriptorNormal.imageView = deferredNormalImageView;
-    texDescriptorNormal.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+void DeferredRenderer::UpdateModelDescriptorSets() {
+    uint32_t numModels = static_cast<uint32_t>(scene->GetModels().size());
 
+    std::vector<VkDescriptorBufferInfo> modelBufferInfos(modelDescriptorSets.size());
+    std::vector<VkDescriptorImageInfo> imageInfos(modelDescriptorSets.size());
+    std::vector<VkDescriptorImageInfo> texDescriptorAlbedos(modelDescriptorSets.size());
+    std::vector<VkDescriptorImageInfo> texDescriptorNormals(modelDescriptorSets.size());
+    std::vector<VkDescriptorImageInfo> texDescriptorDepths(modelDescriptorSets.size());
     std::vector<VkWriteDescriptorSet> descriptorWrites(5 * modelDescriptorSets.size());
 
-    for (uint32_t i = 0; i < scene->GetModels().size(); ++i) {
-        VkDescriptorBufferInfo modelBufferInfo = {};
-        modelBufferInfo.buffer = scene->GetModels()[i]->GetModelBuffer();
-        modelBufferInfo.offset = 0;
-        modelBufferInfo.range = sizeof(ModelBufferObject);
-
-        // Bind image and sampler resources to the descriptor
-        VkDescriptorImageInfo imageInfo = {};
-        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = scene->GetModels()[i]->GetTextureView();
-        imageInfo.sampler = scene->GetModels()[i]->GetTextureSampler();
-
-        descriptorWrites[5 * i + 0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[5 * i + 0].dstSet = modelDescriptorSets[i];
-        descriptorWrites[5 * i + 0].dstBinding = 0;
-        descriptorWrites[5 * i + 0].dstArrayElement = 0;
-        descriptorWrites[5 * i + 0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[5 * i + 0].descriptorCount = 1;
-        descriptorWrites[5 * i + 0].pBufferInfo = &modelBufferInfo;
-        descriptorWrites[5 * i + 0].pImageInfo = nullptr;
-        descriptorWrites[5 * i + 0].pTexelBufferView = nullptr;
-
-        descriptorWrites[5 * i + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[5 * i + 1].dstSet = modelDescriptorSets[i];
-        descriptorWrites[5 * i + 1].dstBinding = 1;
-        descriptorWrites[5 * i + 1].dstArrayElement = 0;
-        descriptorWrites[5 * i + 1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[5 * i + 1].descriptorCount = 1;
-        descriptorWrites[5 * i + 1].pImageInfo = &imageInfo;
-
-        descriptorWrites[5 * i + 2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[5 * i + 2].dstSet = modelDescriptorSets[i];
-        descriptorWrites[5 * i + 2].dstBinding = 2;
-        descriptorWrites[5 * i + 2].dstArrayElement = 0;
-        descriptorWrites[5 * i + 2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[5 * i + 2].descriptorCount = 1;
-        descriptorWrites[5 * i + 2].pImageInfo = &texDescriptorAlbedo;
-
-        descriptorWrites[5 * i + 3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[5 * i + 3].dstSet = modelDescriptorSets[i];
-        descriptorWrites[5 * i + 3].dstBinding = 3;
-        descriptorWrites[5 * i + 3].dstArrayElement = 0;
-        descriptorWrites[5 * i + 3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[5 * i + 3].descriptorCount = 1;
-        descriptorWrites[5 * i + 3].pImageInfo = &texDescriptorPosition;
-
-        descriptorWrites[5 * i + 4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[5 * i + 4].dstSet = modelDescriptorSets[i];
-        descriptorWrites[5 * i + 4].dstBinding = 4;
-        descriptorWrites[5 * i + 4].dstArrayElement = 0;
-        descriptorWrites[5 * i + 4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[5 * i + 4].descriptorCount = 1;
-        descriptorWrites[5 * i + 4].pImageInfo = &texDescriptorNormal;
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        for (uint32_t j = 0; j < numModels; ++j) {
+            uint32_t i = f * numModels + j;
+
+            modelBufferInfos[i].buffer = scene->GetModels()[j]->GetModelBuffer();
+            modelBufferInfos[i].offset = 0;
+            modelBufferInfos[i].range = sizeof(ModelBufferObject);
+
+            // Bind image and sampler resources to the descriptor
+            imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            imageInfos[i].imageView = scene->GetModels()[j]->GetTextureView();
+            imageInfos[i].sampler = scene->GetModels()[j]->GetTextureSampler();
+
+            // Input attachments of this frame's lighting subpass, read without a sampler
+            texDescriptorAlbedos[i].sampler = VK_NULL_HANDLE;
+            texDescriptorAlbedos[i].imageView = renderGraph->GetImageView(albedoImage, f);
+            texDescriptorAlbedos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            texDescriptorNormals[i].sampler = VK_NULL_HANDLE;
+            texDescriptorNormals[i].imageView = renderGraph->GetImageView(normalImage, f);
+            texDescriptorNormals[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            texDescriptorDepths[i].sampler = VK_NULL_HANDLE;
+            texDescriptorDepths[i].imageView = renderGraph->GetImageView(geometryDepthImage, f);
+            texDescriptorDepths[i].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+            descriptorWrites[5 * i + 0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[5 * i + 0].dstSet = modelDescriptorSets[i];
+            descriptorWrites[5 * i + 0].dstBinding = 0;
+            descriptorWrites[5 * i + 0].dstArrayElement = 0;
+            descriptorWrites[5 * i + 0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            descriptorWrites[5 * i + 0].descriptorCount = 1;
+            descriptorWrites[5 * i + 0].pBufferInfo = &modelBufferInfos[i];
+            descriptorWrites[5 * i + 0].pImageInfo = nullptr;
+            descriptorWrites[5 * i + 0].pTexelBufferView = nullptr;
+
+            descriptorWrites[5 * i + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[5 * i + 1].dstSet = modelDescriptorSets[i];
+            descriptorWrites[5 * i + 1].dstBinding = 1;
+            descriptorWrites[5 * i + 1].dstArrayElement = 0;
+            descriptorWrites[5 * i + 1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrites[5 * i + 1].descriptorCount = 1;
+            descriptorWrites[5 * i + 1].pImageInfo = &imageInfos[i];
+
+            descriptorWrites[5 * i + 2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[5 * i + 2].dstSet = modelDescriptorSets[i];
+            descriptorWrites[5 * i + 2].dstBinding = 2;
+            descriptorWrites[5 * i + 2].dstArrayElement = 0;
+            descriptorWrites[5 * i + 2].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            descriptorWrites[5 * i + 2].descriptorCount = 1;
+            descriptorWrites[5 * i + 2].pImageInfo = &texDescriptorAlbedos[i];
+
+            descriptorWrites[5 * i + 3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[5 * i + 3].dstSet = modelDescriptorSets[i];
+            descriptorWrites[5 * i + 3].dstBinding = 3;
+            descriptorWrites[5 * i + 3].dstArrayElement = 0;
+            descriptorWrites[5 * i + 3].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            descriptorWrites[5 * i + 3].descriptorCount = 1;
+            descriptorWrites[5 * i + 3].pImageInfo = &texDescriptorNormals[i];
+
+            descriptorWrites[5 * i + 4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[5 * i + 4].dstSet = modelDescriptorSets[i];
+            descriptorWrites[5 * i + 4].dstBinding = 4;
+            descriptorWrites[5 * i + 4].dstArrayElement = 0;
+            descriptorWrites[5 * i + 4].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            descriptorWrites[5 * i + 4].descriptorCount = 1;
+            descriptorWrites[5 * i + 4].pImageInfo = &texDescriptorDepths[i];
+        }
     }
 
     // Update descriptor sets
@@ -789,109 +584,96 @@ void DeferredRenderer::CreateGrassDescriptorSets() {
     vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
-void DeferredRenderer::CreateTimeDescriptorSet() {
-    // Describe the desciptor set
-    VkDescriptorSetLayout layouts[] = { timeDescriptorSetLayout };
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = layouts;
+void DeferredRenderer::CreateDepthPyramidDescriptorSetLayout() {
+    VkDescriptorSetLayoutBinding srcDepthLayoutBinding = {};
+    srcDepthLayoutBinding.binding = 0;
+    srcDepthLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    srcDepthLayoutBinding.descriptorCount = 1;
+    srcDepthLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    srcDepthLayoutBinding.pImmutableSamplers = nullptr;
 
-    // Allocate descriptor sets
-    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, &timeDescriptorSet) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate descriptor set");
-    }
+    VkDescriptorSetLayoutBinding dstDepthLayoutBinding = {};
+    dstDepthLayoutBinding.binding = 1;
+    dstDepthLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    dstDepthLayoutBinding.descriptorCount = 1;
+    dstDepthLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    dstDepthLayoutBinding.pImmutableSamplers = nullptr;
 
-    // Configure the descriptors to refer to buffers
-    VkDescriptorBufferInfo timeBufferInfo = {};
-    timeBufferInfo.buffer = scene->GetTimeBuffer();
-    timeBufferInfo.offset = 0;
-    timeBufferInfo.range = sizeof(Time);
-
-    std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = timeDescriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &timeBufferInfo;
-    descriptorWrites[0].pImageInfo = nullptr;
-    descriptorWrites[0].pTexelBufferView = nullptr;
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { srcDepthLayoutBinding, dstDepthLayoutBinding };
 
-    // Update descriptor sets
-    vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    // Create the descriptor set layout
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &depthPyramidDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout");
+    }
 }
 
-void DeferredRenderer::CreateComputeDescriptorSets() {
-    // TODO: Create Descriptor sets for the compute pipeline
-    // The descriptors should point to Storage buffers which will hold the grass blades, the culled grass blades, and the output number of grass blades 
-    grassComputeDescriptorSets.resize(scene->GetBlades().size());
+void DeferredRenderer::CreateDepthPyramidDescriptorSets() {
+    // One set per level of the pyramid and frame, as every frame builds it from its own depth buffer
+    depthPyramidDescriptorSets.resize(framesInFlight * terrainCompute->GetDepthPyramid(0)->GetMipLevels());
 
-    // Describe the desciptor set
-    VkDescriptorSetLayout layouts[] = { grassComputeDescriptorSetLayout };
+    // Describe the desciptor sets
+    std::vector<VkDescriptorSetLayout> layouts(depthPyramidDescriptorSets.size(), depthPyramidDescriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(grassComputeDescriptorSets.size());
-    allocInfo.pSetLayouts = layouts;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(depthPyramidDescriptorSets.size());
+    allocInfo.pSetLayouts = layouts.data();
 
     // Allocate descriptor sets
-    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, grassComputeDescriptorSets.data()) != VK_SUCCESS) {
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, depthPyramidDescriptorSets.data()) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate descriptor set");
     }
 
-    std::vector<VkWriteDescriptorSet> descriptorWrites(3 * grassComputeDescriptorSets.size());
+    UpdateDepthPyramidDescriptorSets();
+}
 
-    for (uint32_t i = 0; i < scene->GetBlades().size(); ++i) {
-        VkDescriptorBufferInfo inputBladesBufferInfo = {};
-        inputBladesBufferInfo.buffer = scene->GetBlades()[i]->GetBladesBuffer();
-        inputBladesBufferInfo.offset = 0;
-        inputBladesBufferInfo.range = sizeof(Blade) * NUM_BLADES;
-
-        VkDescriptorBufferInfo culledBladesBufferInfo = {};
-        culledBladesBufferInfo.buffer = scene->GetBlades()[i]->GetCulledBladesBuffer();
-        culledBladesBufferInfo.offset = 0;
-        culledBladesBufferInfo.range = sizeof(Blade) * NUM_BLADES;
-
-        VkDescriptorBufferInfo numBladesBufferInfo = {};
-        numBladesBufferInfo.buffer = scene->GetBlades()[i]->GetNumBladesBuffer();
-        numBladesBufferInfo.offset = 0;
-        numBladesBufferInfo.range = sizeof(BladeDrawIndirect);
-
-        descriptorWrites[3 * i + 0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[3 * i + 0].dstSet = grassComputeDescriptorSets[i];
-        descriptorWrites[3 * i + 0].dstBinding = 0;
-        descriptorWrites[3 * i + 0].dstArrayElement = 0;
-        descriptorWrites[3 * i + 0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[3 * i + 0].descriptorCount = 1; // TODO: should this be 1? same for culledBlades below??? 
-                                                         // I think so, because docs say descriptorCount is number of elts in pBufferInfo,
-                                                         // and pBufferInfo is array of VkDescriptorBufferInfo, of which we only have one (inputBladesBufferInfo)
-                                                         // https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkWriteDescriptorSet.html
-        descriptorWrites[3 * i + 0].pBufferInfo = &inputBladesBufferInfo;
-        descriptorWrites[3 * i + 0].pImageInfo = nullptr;
-        descriptorWrites[3 * i + 0].pTexelBufferView = nullptr;
-
-        descriptorWrites[3 * i + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[3 * i + 1].dstSet = grassComputeDescriptorSets[i];
-        descriptorWrites[3 * i + 1].dstBinding = 1;
-        descriptorWrites[3 * i + 1].dstArrayElement = 0;
-        descriptorWrites[3 * i + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[3 * i + 1].descriptorCount = 1;
-        descriptorWrites[3 * i + 1].pBufferInfo = &culledBladesBufferInfo;
-        descriptorWrites[3 * i + 1].pImageInfo = nullptr;
-        descriptorWrites[3 * i + 1].pTexelBufferView = nullptr;
-
-        descriptorWrites[3 * i + 2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[3 * i + 2].dstSet = grassComputeDescriptorSets[i];
-        descriptorWrites[3 * i + 2].dstBinding = 2;
-        descriptorWrites[3 * i + 2].dstArrayElement = 0;
-        descriptorWrites[3 * i + 2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[3 * i + 2].descriptorCount = 1;
-        descriptorWrites[3 * i + 2].pBufferInfo = &numBladesBufferInfo;
-        descriptorWrites[3 * i + 2].pImageInfo = nullptr;
-        descriptorWrites[3 * i + 2].pTexelBufferView = nullptr;
+void DeferredRenderer::UpdateDepthPyramidDescriptorSets() {
+    uint32_t mipLevels = terrainCompute->GetDepthPyramid(0)->GetMipLevels();
+
+    std::vector<VkDescriptorImageInfo> srcDepthInfos(depthPyramidDescriptorSets.size());
+    std::vector<VkDescriptorImageInfo> dstDepthInfos(depthPyramidDescriptorSets.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(2 * depthPyramidDescriptorSets.size());
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        for (uint32_t level = 0; level < mipLevels; ++level) {
+            uint32_t i = f * mipLevels + level;
+
+            // The first level reads the deferred depth buffer, every other level the one above it
+            srcDepthInfos[i].sampler = terrainCompute->GetDepthPyramid(f)->GetSampler();
+            if (level == 0) {
+                srcDepthInfos[i].imageView = renderGraph->GetImageView(geometryDepthImage, f);
+                srcDepthInfos[i].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+            }
+            else {
+                srcDepthInfos[i].imageView = terrainCompute->GetDepthPyramid(f)->GetMipImageView(level - 1);
+                srcDepthInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            }
+
+            dstDepthInfos[i].sampler = VK_NULL_HANDLE;
+            dstDepthInfos[i].imageView = terrainCompute->GetDepthPyramid(f)->GetMipImageView(level);
+            dstDepthInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            descriptorWrites[2 * i + 0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[2 * i + 0].dstSet = depthPyramidDescriptorSets[i];
+            descriptorWrites[2 * i + 0].dstBinding = 0;
+            descriptorWrites[2 * i + 0].dstArrayElement = 0;
+            descriptorWrites[2 * i + 0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrites[2 * i + 0].descriptorCount = 1;
+            descriptorWrites[2 * i + 0].pImageInfo = &srcDepthInfos[i];
+
+            descriptorWrites[2 * i + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[2 * i + 1].dstSet = depthPyramidDescriptorSets[i];
+            descriptorWrites[2 * i + 1].dstBinding = 1;
+            descriptorWrites[2 * i + 1].dstArrayElement = 0;
+            descriptorWrites[2 * i + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrites[2 * i + 1].descriptorCount = 1;
+            descriptorWrites[2 * i + 1].pImageInfo = &dstDepthInfos[i];
+        }
     }
 
     // Update descriptor sets
@@ -899,8 +681,8 @@ void DeferredRenderer::CreateComputeDescriptorSets() {
 }
 
 void DeferredRenderer::CreateGraphicsPipeline() {
-    VkShaderModule vertShaderModule = ShaderModule::Create("shaders/graphics-DEFERRED.vert.spv", logicalDevice);
-    VkShaderModule fragShaderModule = ShaderModule::Create("shaders/graphics-DEFERRED.frag.spv", logicalDevice);
+    VkShaderModule vertShaderModule = device->GetShaderModuleCache()->Get("shaders/graphics-DEFERRED.vert.spv");
+    VkShaderModule fragShaderModule = device->GetShaderModuleCache()->Get("shaders/graphics-DEFERRED.frag.spv");
 
     // Assign each shader module to the appropriate stage in the pipeline
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
@@ -1044,25 +826,23 @@ void DeferredRenderer::CreateGraphicsPipeline() {
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDynamicState = nullptr;
     pipelineInfo.layout = graphicsPipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
+    pipelineInfo.renderPass = renderGraph->GetRenderPass(lightingPass);
+    pipelineInfo.subpass = renderGraph->GetSubpass(lightingPass);
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
 
-    if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(logicalDevice, device->GetPipelineCache()->GetVkPipelineCache(), 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create graphics pipeline");
     }
 
-    vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
-    vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
 }
 
 void DeferredRenderer::CreateGrassPipeline() {
     // --- Set up programmable shaders ---
-    VkShaderModule vertShaderModule = ShaderModule::Create("shaders/grass.vert.spv", logicalDevice);
-    VkShaderModule tescShaderModule = ShaderModule::Create("shaders/grass.tesc.spv", logicalDevice);
-    VkShaderModule teseShaderModule = ShaderModule::Create("shaders/grass-DEFERRED.tese.spv", logicalDevice);
-    VkShaderModule fragShaderModule = ShaderModule::Create("shaders/grass-DEFERRED.frag.spv", logicalDevice);
+    VkShaderModule vertShaderModule = device->GetShaderModuleCache()->Get("shaders/grass.vert.spv");
+    VkShaderModule tescShaderModule = device->GetShaderModuleCache()->Get("shaders/grass.tesc.spv");
+    VkShaderModule teseShaderModule = device->GetShaderModuleCache()->Get("shaders/grass-DEFERRED.tese.spv");
+    VkShaderModule fragShaderModule = device->GetShaderModuleCache()->Get("shaders/grass-DEFERRED.frag.spv");
 
     // Assign each shader module to the appropriate stage in the pipeline
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
@@ -1097,8 +877,8 @@ void DeferredRenderer::CreateGrassPipeline() {
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-    auto bindingDescription = Blade::getBindingDescription();
-    auto attributeDescriptions = Blade::getAttributeDescriptions();
+    auto bindingDescription = Tile::getBindingDescription();
+    auto attributeDescriptions = Tile::getAttributeDescriptions();
 
     vertexInputInfo.vertexBindingDescriptionCount = 1;
     vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
@@ -1169,7 +949,7 @@ void DeferredRenderer::CreateGrassPipeline() {
     // Color blending (turned off here, but showing options for learning)
     // --> Configuration per attached framebuffer
     std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments;
-    for (int i = 0; i < 3; i++) {
+    for (int i = 0; i < 2; i++) {
         VkPipelineColorBlendAttachmentState colorBlendAttachment;
         colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
         colorBlendAttachment.blendEnable = VK_FALSE;
@@ -1197,7 +977,7 @@ void DeferredRenderer::CreateGrassPipeline() {
     colorBlending.blendConstants[2] = 0.0f;
     colorBlending.blendConstants[3] = 0.0f;
 
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { cameraDescriptorSetLayout, modelDescriptorSetLayout };
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { cameraDescriptorSetLayout, modelDescriptorSetLayout, terrainCompute->GetClipmapDescriptorSetLayout() };
 
     // Pipeline layout: used to specify uniform values
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
@@ -1233,70 +1013,79 @@ void DeferredRenderer::CreateGrassPipeline() {
     pipelineInfo.pTessellationState = &tessellationInfo;
     pipelineInfo.pDynamicState = nullptr;
     pipelineInfo.layout = grassPipelineLayout;
-    pipelineInfo.renderPass = deferredRenderPass; // important!!
-    pipelineInfo.subpass = 0;
+    pipelineInfo.renderPass = renderGraph->GetRenderPass(geometryPass); // important!!
+    pipelineInfo.subpass = renderGraph->GetSubpass(geometryPass);
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
 
-    if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &grassPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(logicalDevice, device->GetPipelineCache()->GetVkPipelineCache(), 1, &pipelineInfo, nullptr, &grassPipeline) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create graphics pipeline");
     }
-
-    // No need for the shader modules anymore
-    vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
-    vkDestroyShaderModule(logicalDevice, tescShaderModule, nullptr);
-    vkDestroyShaderModule(logicalDevice, teseShaderModule, nullptr);
-    vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
 }
 
-void DeferredRenderer::CreateComputePipeline() {
+void DeferredRenderer::CreateDepthPyramidPipeline() {
     // Set up programmable shaders
-    VkShaderModule computeShaderModule = ShaderModule::Create("shaders/compute.comp.spv", logicalDevice);
+    VkShaderModule depthPyramidShaderModule = device->GetShaderModuleCache()->Get("shaders/depthpyramid.comp.spv");
 
-    VkPipelineShaderStageCreateInfo computeShaderStageInfo = {};
-    computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-    computeShaderStageInfo.module = computeShaderModule;
-    computeShaderStageInfo.pName = "main";
+    VkPipelineShaderStageCreateInfo depthPyramidShaderStageInfo = {};
+    depthPyramidShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    depthPyramidShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    depthPyramidShaderStageInfo.module = depthPyramidShaderModule;
+    depthPyramidShaderStageInfo.pName = "main";
 
-    // TODO: Add the compute dsecriptor set layout you create to this list
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { cameraDescriptorSetLayout, timeDescriptorSetLayout, grassComputeDescriptorSetLayout };
-
-    // Define push constant stuff to hold NUM_BLADES
-    VkPushConstantRange pushConstantRange = {};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(int);
-    VkPushConstantRange pushConstantRangeArray[] = { pushConstantRange };
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { depthPyramidDescriptorSetLayout };
 
     // Create pipeline layout
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
     pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = pushConstantRangeArray;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
-    if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS) {
+    if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &depthPyramidPipelineLayout) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create pipeline layout");
     }
 
     // Create compute pipeline
     VkComputePipelineCreateInfo pipelineInfo = {};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    pipelineInfo.stage = computeShaderStageInfo;
-    pipelineInfo.layout = computePipelineLayout;
+    pipelineInfo.stage = depthPyramidShaderStageInfo;
+    pipelineInfo.layout = depthPyramidPipelineLayout;
     pipelineInfo.pNext = nullptr;
     pipelineInfo.flags = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
 
-    if (vkCreateComputePipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create compute pipeline");
+    if (vkCreateComputePipelines(logicalDevice, device->GetPipelineCache()->GetVkPipelineCache(), 1, &pipelineInfo, nullptr, &depthPyramidPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid pipeline");
     }
+}
+
+void DeferredRenderer::CreateSyncObjects() {
+    computeSemaphores.resize(framesInFlight);
+    frameFences.resize(framesInFlight);
+    computeFences.resize(framesInFlight);
 
-    // No need for shader modules anymore
-    vkDestroyShaderModule(logicalDevice, computeShaderModule, nullptr);
+    // Create a semaphore used to synchronize offscreen rendering and usage
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    // Signaled so that the first use of every frame does not wait
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        if (vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, nullptr, &computeSemaphores[f]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute semaphore");
+        }
+
+        if (vkCreateFence(logicalDevice, &fenceCreateInfo, nullptr, &frameFences[f]) != VK_SUCCESS ||
+            vkCreateFence(logicalDevice, &fenceCreateInfo, nullptr, &computeFences[f]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create fences");
+        }
+    }
 }
 
 void DeferredRenderer::CreateFrameResources() {
@@ -1331,47 +1120,14 @@ void DeferredRenderer::CreateFrameResources() {
         }
     }
 
-    VkFormat depthFormat = device->GetInstance()->GetSupportedFormat({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-    // CREATE DEPTH IMAGE
-    Image::Create(device,
-        swapChain->GetVkExtent().width,
-        swapChain->GetVkExtent().height,
-        depthFormat,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        depthImage,
-        depthImageMemory
-    );
-
-    depthImageView = Image::CreateView(device, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-    // Transition the image for use as depth-stencil
-    Image::TransitionLayout(device, graphicsCommandPool, depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-
-    // CREATE FRAMEBUFFERS
-    framebuffers.resize(swapChain->GetCount());
-    for (size_t i = 0; i < swapChain->GetCount(); i++) {
-        std::vector<VkImageView> attachments = {
-            imageViews[i],
-            depthImageView
-        };
-
-        VkFramebufferCreateInfo framebufferInfo = {};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        framebufferInfo.pAttachments = attachments.data();
-        framebufferInfo.width = swapChain->GetVkExtent().width;
-        framebufferInfo.height = swapChain->GetVkExtent().height;
-        framebufferInfo.layers = 1;
-
-        if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, nullptr, &framebuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create framebuffer");
-        }
-
+    std::vector<VkImage> swapChainImages(swapChain->GetCount());
+    for (uint32_t i = 0; i < swapChain->GetCount(); i++) {
+        swapChainImages[i] = swapChain->GetVkImage(i);
     }
+    renderGraph->SetImportedImages(swapChainImage, swapChainImages, imageViews);
+
+    // G-buffers and depth buffers, one set per frame in flight
+    renderGraph->CreateResources(swapChain->GetVkExtent());
 }
 
 void DeferredRenderer::DestroyFrameResources() {
@@ -1379,97 +1135,73 @@ void DeferredRenderer::DestroyFrameResources() {
         vkDestroyImageView(logicalDevice, imageViews[i], nullptr);
     }
 
-    vkDestroyImageView(logicalDevice, depthImageView, nullptr);
-    vkFreeMemory(logicalDevice, depthImageMemory, nullptr);
-    vkDestroyImage(logicalDevice, depthImage, nullptr);
-
-    for (size_t i = 0; i < framebuffers.size(); i++) {
-        vkDestroyFramebuffer(logicalDevice, framebuffers[i], nullptr);
-    }
-
-    // free deferred pipeline stuff
-    vkDestroyImageView(logicalDevice, deferredAlbedoImageView, nullptr);
-    vkFreeMemory(logicalDevice, deferredAlbedoImageMemory, nullptr);
-    vkDestroyImage(logicalDevice, deferredAlbedoImage, nullptr);
-
-    vkDestroyImageView(logicalDevice, deferredPositionImageView, nullptr);
-    vkFreeMemory(logicalDevice, deferredPositionImageMemory, nullptr);
-    vkDestroyImage(logicalDevice, deferredPositionImage, nullptr);
-
-    vkDestroyImageView(logicalDevice, deferredNormalImageView, nullptr);
-    vkFreeMemory(logicalDevice, deferredNormalImageMemory, nullptr);
-    vkDestroyImage(logicalDevice, deferredNormalImage, nullptr);
-
-    vkDestroyImageView(logicalDevice, deferredDepthImageView, nullptr);
-    vkFreeMemory(logicalDevice, deferredDepthImageMemory, nullptr);
-    vkDestroyImage(logicalDevice, deferredDepthImage, nullptr);
-
-    vkDestroyFramebuffer(logicalDevice, deferredFramebuffer, nullptr);
+    renderGraph->DestroyResources();
 }
 
 void DeferredRenderer::RecreateFrameResources() {
+    // Every frame in flight refers to the G-buffers and command buffers recreated below
+    vkDeviceWaitIdle(logicalDevice);
+
     vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
     vkDestroyPipeline(logicalDevice, grassPipeline, nullptr);
     vkDestroyPipelineLayout(logicalDevice, graphicsPipelineLayout, nullptr);
     vkDestroyPipelineLayout(logicalDevice, grassPipelineLayout, nullptr);
     vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(depthPyramidCommandBuffers.size()), depthPyramidCommandBuffers.data());
+    vkFreeCommandBuffers(logicalDevice, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
 
     DestroyFrameResources();
     CreateFrameResources();
-    CreateGraphicsPipeline();
+    UpdateModelDescriptorSets();
+    UpdateDepthPyramidDescriptorSets();
+    std::future<void> graphicsPipelineJob = device->GetThreadPool()->Submit([this]() { CreateGraphicsPipeline(); });
     CreateGrassPipeline();
+    graphicsPipelineJob.get();
     RecordCommandBuffers();
+    RecordDepthPyramidCommandBuffers();
+
+    // Tessellation levels depend on the viewport height
+    RecordComputeCommandBuffers();
 }
 
-void DeferredRenderer::RecordComputeCommandBuffer() {
+void DeferredRenderer::RecordComputeCommandBuffers() {
+    computeCommandBuffers.resize(framesInFlight);
+
     // Specify the command pool and number of buffers to allocate
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = computeCommandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(computeCommandBuffers.size());
 
-    if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &computeCommandBuffer) != VK_SUCCESS) {
+    if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate command buffers");
     }
 
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-    beginInfo.pInheritanceInfo = nullptr;
-
-    // ~ Start recording ~
-    if (vkBeginCommandBuffer(computeCommandBuffer, &beginInfo) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to begin recording compute command buffer");
-    }
-
-    // Bind to the compute pipeline
-    vkCmdBindPipeline(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        VkCommandBuffer computeCommandBuffer = computeCommandBuffers[f];
 
-    // Bind camera descriptor set
-    vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &cameraDescriptorSet, 0, nullptr);
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+        beginInfo.pInheritanceInfo = nullptr;
 
-    // Bind descriptor set for time uniforms
-    vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 1, 1, &timeDescriptorSet, 0, nullptr);
+        // ~ Start recording ~
+        if (vkBeginCommandBuffer(computeCommandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording compute command buffer");
+        }
 
-    // Update push constants
-    int pushValues[] = { NUM_BLADES };
-    vkCmdPushConstants(computeCommandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int), pushValues);
+        terrainCompute->Record(computeCommandBuffer, f, cameraDescriptorSets[f], static_cast<float>(swapChain->GetVkExtent().height), gpuTimer);
 
-    // TODO: For each group of blades bind its descriptor set and dispatch
-    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
-        vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 2, 1, &grassComputeDescriptorSets[j], 0, nullptr);
-        vkCmdDispatch(computeCommandBuffer, (int)ceil((float)NUM_BLADES / WORKGROUP_SIZE), 1, 1);
-    }
-
-    // ~ End recording ~
-    if (vkEndCommandBuffer(computeCommandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to record compute command buffer");
+        // ~ End recording ~
+        if (vkEndCommandBuffer(computeCommandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record compute command buffer");
+        }
     }
 }
 
 void DeferredRenderer::RecordCommandBuffers() {
-    commandBuffers.resize(swapChain->GetCount());
+    commandBuffers.resize(framesInFlight * swapChain->GetCount());
 
     // Specify the command pool and number of buffers to allocate
     VkCommandBufferAllocateInfo allocInfo = {};
@@ -1484,6 +1216,10 @@ void DeferredRenderer::RecordCommandBuffers() {
 
     // Start command buffer recording
     for (size_t i = 0; i < commandBuffers.size(); i++) {
+        // Frame in flight and swap chain image this command buffer is for
+        uint32_t f = static_cast<uint32_t>(i / swapChain->GetCount());
+        uint32_t image = static_cast<uint32_t>(i % swapChain->GetCount());
+
         VkCommandBufferBeginInfo beginInfo = {};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
@@ -1494,204 +1230,170 @@ void DeferredRenderer::RecordCommandBuffers() {
             throw std::runtime_error("Failed to begin recording command buffer");
         }
 
-        // Begin the render pass
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = framebuffers[i];
-        renderPassInfo.renderArea.offset = { 0, 0 };
-        renderPassInfo.renderArea.extent = swapChain->GetVkExtent();
-
-        std::array<VkClearValue, 2> clearValues = {};
-        clearValues[0].color = { 0.768f, 0.8039f, 0.898f, 1.0f };
-        clearValues[1].depthStencil = { 1.0f, 0 };
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
-
-        std::vector<VkBufferMemoryBarrier> barriers(scene->GetBlades().size());
-        for (uint32_t j = 0; j < barriers.size(); ++j) {
-            barriers[j].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-            barriers[j].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-            barriers[j].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
-            barriers[j].srcQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Compute);
-            barriers[j].dstQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Graphics);
-            barriers[j].buffer = scene->GetBlades()[j]->GetNumBladesBuffer();
-            barriers[j].offset = 0;
-            barriers[j].size = sizeof(BladeDrawIndirect);
+        // Acquire the culled blades released by the compute command buffer. The clipmap bake is already visible,
+        // the compute semaphore this is submitted with covers it
+        std::vector<VkBufferMemoryBarrier> acquireBarriers(2 * scene->GetBlades().size());
+        for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+            VkBuffer buffers[] = { scene->GetBlades()[j]->GetCulledBladesBuffer(f), scene->GetBlades()[j]->GetNumBladesBuffer(f) };
+            for (uint32_t k = 0; k < 2; ++k) {
+                VkBufferMemoryBarrier& barrier = acquireBarriers[2 * j + k];
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+                barrier.srcQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Compute);
+                barrier.dstQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Graphics);
+                barrier.buffer = buffers[k];
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+            }
         }
 
-        vkCmdPipelineBarrier(commandBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, barriers.size(), barriers.data(), 0, nullptr);
+        vkCmdPipelineBarrier(commandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, static_cast<uint32_t>(acquireBarriers.size()), acquireBarriers.data(), 0, nullptr);
 
-        // Bind the camera descriptor set. This is set 0 in all pipelines so it will be inherited
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 1, &cameraDescriptorSet, 0, nullptr);
+        // The geometry and lighting subpasses, which are one render pass
+        renderGraph->Record(commandBuffers[i], geometryPass, lightingPass, f, image);
 
-        vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        // ~ End recording ~
+        if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer");
+        }
+    }
+}
+
+void DeferredRenderer::RecordLightingPass(VkCommandBuffer commandBuffer, uint32_t frame) {
+    // Bind the camera descriptor set. This is set 0 in all pipelines so it will be inherited
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 1, &cameraDescriptorSets[frame], 0, nullptr);
 
-        // Bind the graphics pipeline
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    // Bind the graphics pipeline
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 
-        // DTODO: this "model" should act as screen-covering quad
-        for (uint32_t j = 0; j < scene->GetModels().size(); ++j) {
-            // Bind the vertex and index buffers
-            VkBuffer vertexBuffers[] = { scene->GetModels()[j]->getVertexBuffer() };
-            VkDeviceSize offsets[] = { 0 };
-            vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
+    // DTODO: this "model" should act as screen-covering quad
+    for (uint32_t j = 0; j < scene->GetModels().size(); ++j) {
+        // Bind the vertex and index buffers
+        VkBuffer vertexBuffers[] = { scene->GetModels()[j]->getVertexBuffer() };
+        VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
-            vkCmdBindIndexBuffer(commandBuffers[i], scene->GetModels()[j]->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(commandBuffer, scene->GetModels()[j]->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
 
-            // Bind the descriptor set for each model
-            vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 1, 1, &modelDescriptorSets[j], 0, nullptr);
+        // Bind the descriptor set for each model
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 1, 1, &modelDescriptorSets[frame * scene->GetModels().size() + j], 0, nullptr);
 
-            // Draw
-            std::vector<uint32_t> indices = scene->GetModels()[j]->getIndices();
-            vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-        }
+        // Draw
+        std::vector<uint32_t> indices = scene->GetModels()[j]->getIndices();
+        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+    }
 #if 0
-        // Bind the grass pipeline
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipeline);
+    // Bind the grass pipeline
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipeline);
 
-        for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
-            VkBuffer vertexBuffers[] = { scene->GetBlades()[j]->GetCulledBladesBuffer() };//{ scene->GetBlades()[j]->GetCulledBladesBuffer() };
-            VkDeviceSize offsets[] = { 0 };
-            // TODO: Uncomment this when the buffers are populated
-            vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-
-            // TODO: Bind the descriptor set for each grass blades model
-            vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipelineLayout, 1, 1, &grassDescriptorSets[j], 0, nullptr);
-
-            // Draw
-            // TODO: Uncomment this when the buffers are populated
-            // CHECKITOUT: it's getNumBladesBuffer that specifies how many threads are spawned
-            // see: https://www.khronos.org/registry/vulkan/specs/1.0/man/html/vkCmdDrawIndirect.html
-            // see: https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkDrawIndirectCommand.html
-            vkCmdDrawIndirect(commandBuffers[i], scene->GetBlades()[j]->GetNumBladesBuffer(), 0, 1, sizeof(BladeDrawIndirect));
-        }
-#endif
-        // End render pass
-        vkCmdEndRenderPass(commandBuffers[i]);
+    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+        VkBuffer vertexBuffers[] = { scene->GetBlades()[j]->GetCulledBladesBuffer(frame) };
+        VkDeviceSize offsets[] = { 0 };
+        // TODO: Uncomment this when the buffers are populated
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
-        // ~ End recording ~
-        if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to record command buffer");
-        }
+        // TODO: Bind the descriptor set for each grass blades model
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipelineLayout, 1, 1, &grassDescriptorSets[j], 0, nullptr);
+
+        // Draw
+        // TODO: Uncomment this when the buffers are populated
+        // CHECKITOUT: it's getNumBladesBuffer that specifies how many threads are spawned
+        // see: https://www.khronos.org/registry/vulkan/specs/1.0/man/html/vkCmdDrawIndirect.html
+        // see: https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkDrawIndirectCommand.html
+        vkCmdDrawIndirect(commandBuffer, scene->GetBlades()[j]->GetNumBladesBuffer(frame), 0, 1, sizeof(BladeDrawIndirect));
     }
+#endif
 }
 
 void DeferredRenderer::Frame() {
+    uint32_t frameIndex = swapChain->GetFrameIndex();
 
-    VkSubmitInfo computeSubmitInfo = {};
-    computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    // Only blocks while the uploads made at startup are still being copied
+    device->GetUploadManager()->Wait(startupUploadId);
 
-    computeSubmitInfo.commandBufferCount = 1;
-    computeSubmitInfo.pCommandBuffers = &computeCommandBuffer;
+    // Wait for the GPU to be done with the resources of this frame from framesInFlight frames ago
+    VkFence fences[] = { frameFences[frameIndex], computeFences[frameIndex] };
+    vkWaitForFences(logicalDevice, 2, fences, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    gpuTimer->Resolve(frameIndex);
+
+#if PRINT_CULL_STATS
+    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+        const TileCullStats& cullStats = scene->GetBlades()[j]->GetCullStats(frameIndex);
+        printf("frustum culled tiles: %u, occluded tiles: %u, dropped tiles: %u\n", cullStats.frustumCulledTiles, cullStats.occludedTiles, cullStats.droppedTiles);
+    }
+#endif // PRINT_CULL_STATS
 
-    if (vkQueueSubmit(device->GetQueue(QueueFlags::Compute), 1, &computeSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to submit draw command buffer");
+#if PRINT_NUM_BLADES
+    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+        const BladeDrawIndirect& draw = scene->GetBlades()[j]->GetReadbackDraw(frameIndex);
+        const Tile* tiles = scene->GetBlades()[j]->GetReadbackTiles(frameIndex);
+        printf("num tiles: %u", draw.vertexCount);
+        if (draw.vertexCount > 0) {
+            printf(", tile[0].origin: %d %d", tiles[0].originX, tiles[0].originZ);
+        }
+        printf("\n");
     }
+#endif // PRINT_NUM_BLADES
+
+    // Only now is it safe to overwrite this frame's uniforms
+    camera->UpdateBuffer(frameIndex);
+    scene->UpdateTimeBuffer(frameIndex);
 
+    // Acquire before submitting any work, so that a swap chain that needs to be recreated leaves no semaphore
+    // signaled without a submit waiting on it
     if (!swapChain->Acquire()) {
         RecreateFrameResources();
         return;
     }
 
-    // Submit the grass buffer (make G-buffer)
-    VkSubmitInfo deferredSubmitInfo = {};
-    deferredSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    VkSemaphore deferredWaitSemaphores[] = { swapChain->GetImageAvailableVkSemaphore() };
-    VkPipelineStageFlags deferredWaitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    deferredSubmitInfo.waitSemaphoreCount = 1;
-    deferredSubmitInfo.pWaitSemaphores = deferredWaitSemaphores;
-    deferredSubmitInfo.pWaitDstStageMask = deferredWaitStages;
-    deferredSubmitInfo.pSignalSemaphores = &deferredSemaphore;
+    // Culling runs on the compute queue as soon as this slot's fences were waited on
+    VkSubmitInfo computeSubmitInfo = {};
+    computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    deferredSubmitInfo.commandBufferCount = 1;
-    deferredSubmitInfo.pCommandBuffers = &deferredCommandBuffer;
+    computeSubmitInfo.commandBufferCount = 1;
+    computeSubmitInfo.pCommandBuffers = &computeCommandBuffers[frameIndex];
 
-    //VkSemaphore signalSemaphores[] = { swapChain->GetRenderFinishedVkSemaphore() };
-    deferredSubmitInfo.signalSemaphoreCount = 1;
-    //submitInfo.pSignalSemaphores = signalSemaphores;
+    computeSubmitInfo.signalSemaphoreCount = 1;
+    computeSubmitInfo.pSignalSemaphores = &computeSemaphores[frameIndex];
 
-    if (vkQueueSubmit(device->GetQueue(QueueFlags::Graphics), 1, &deferredSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to submit draw DEFERRED command buffer");
+    vkResetFences(logicalDevice, 1, &computeFences[frameIndex]);
+    if (vkQueueSubmit(device->GetQueue(QueueFlags::Compute), 1, &computeSubmitInfo, computeFences[frameIndex]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit compute command buffer");
     }
 
-    // Submit the command buffer
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    //VkSemaphore waitSemaphores[] = { swapChain->GetImageAvailableVkSemaphore() };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &deferredSemaphore;//waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
+    // The frame's render pass, then the depth pyramid, which presenting does not need to wait for
+    VkSubmitInfo submitInfos[2] = {};
+    submitInfos[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfos[1].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+    // The culled blades are drawn, the clipmap sampled and the depth pyramid rewritten only after culling is done.
+    // Waits cover every later batch of the submit as well
+    VkSemaphore waitSemaphores[] = { swapChain->GetImageAvailableVkSemaphore(), computeSemaphores[frameIndex] };
+    VkPipelineStageFlags waitStages[] = {
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+    };
+    submitInfos[0].waitSemaphoreCount = 2;
+    submitInfos[0].pWaitSemaphores = waitSemaphores;
+    submitInfos[0].pWaitDstStageMask = waitStages;
 
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[swapChain->GetIndex()];
+    submitInfos[0].commandBufferCount = 1;
+    submitInfos[0].pCommandBuffers = &commandBuffers[frameIndex * swapChain->GetCount() + swapChain->GetIndex()];
 
     VkSemaphore signalSemaphores[] = { swapChain->GetRenderFinishedVkSemaphore() };
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+    submitInfos[0].signalSemaphoreCount = 1;
+    submitInfos[0].pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(device->GetQueue(QueueFlags::Graphics), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to submit draw command buffer");
-    }
+    submitInfos[1].commandBufferCount = 1;
+    submitInfos[1].pCommandBuffers = &depthPyramidCommandBuffers[frameIndex];
 
-#if PRINT_NUM_BLADES
-    // try to read numBladesBuffer ============================================
-    // Create the staging buffer
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    VkDeviceSize bufferSize = sizeof(BladeDrawIndirect);
-
-    VkBufferUsageFlags stagingUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    VkMemoryPropertyFlags stagingProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    BufferUtils::CreateBuffer(device, bufferSize, stagingUsage, stagingProperties, stagingBuffer, stagingBufferMemory);
-
-    // Fill the staging buffer
-    void *data;
-    vkMapMemory(device->GetVkDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-    // CPU mem "data" should now be mapped to a vkbuffer!!??
-    // so copy data into "data"
-    BufferUtils::CopyBuffer(device, computeCommandPool, scene->GetBlades()[0]->GetNumBladesBuffer(), stagingBuffer, bufferSize);
-    vkUnmapMemory(device->GetVkDevice(), stagingBufferMemory);
-
-    // read "data"
-    BladeDrawIndirect* indirectDraw = (BladeDrawIndirect*)data;
-    //printf("num blades: %d\n", indirectDraw->vertexCount);
-
-    // No need for the staging buffer anymore
-    vkDestroyBuffer(device->GetVkDevice(), stagingBuffer, nullptr);
-    vkFreeMemory(device->GetVkDevice(), stagingBufferMemory, nullptr);
-    // try to read numBladesBuffer ============================================
-
-    // Try to read all the blades first position info ========================================
-    // Create the staging buffer
-    VkBuffer stagingBuffer1;
-    VkDeviceMemory stagingBuffer1Memory;
-    VkDeviceSize buffer1Size = NUM_BLADES * sizeof(Blade);
-
-    VkBufferUsageFlags staging1Usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    VkMemoryPropertyFlags staging1Properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    BufferUtils::CreateBuffer(device, buffer1Size, staging1Usage, staging1Properties, stagingBuffer1, stagingBuffer1Memory);
-
-    // Fill the staging buffer
-    void *data1;
-    vkMapMemory(device->GetVkDevice(), stagingBuffer1Memory, 0, buffer1Size, 0, &data1);
-    // CPU mem "data" should now be mapped to a vkbuffer!!??
-    // so copy data into "data"
-    BufferUtils::CopyBuffer(device, computeCommandPool, scene->GetBlades()[0]->GetBladesBuffer(), stagingBuffer1, buffer1Size);
-    vkUnmapMemory(device->GetVkDevice(), stagingBuffer1Memory);
-
-    // read "data"
-    Blade* blade1 = (Blade*)data1;
-    printf("blade[i].vo: %d\n", (*blade1).v0);
-
-    // No need for the staging buffer anymore
-    vkDestroyBuffer(device->GetVkDevice(), stagingBuffer1, nullptr);
-    // Try to read all the blades first position info ========================================
-
-#endif // PRINT_NUM_BLADES
+    // The fence covers the depth pyramid batch, which comes last on the queue
+    vkResetFences(logicalDevice, 1, &frameFences[frameIndex]);
+    if (vkQueueSubmit(device->GetQueue(QueueFlags::Graphics), 2, submitInfos, frameFences[frameIndex]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit draw command buffers");
+    }
+    gpuTimer->MarkSubmitted(frameIndex);
 
     if (!swapChain->Present()) {
         RecreateFrameResources();
@@ -1704,34 +1406,38 @@ DeferredRenderer::~DeferredRenderer() {
     // TODO: destroy any resources you created
 
     vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
-    vkFreeCommandBuffers(logicalDevice, computeCommandPool, 1, &computeCommandBuffer);
-    vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, 1, &deferredCommandBuffer);
+    vkFreeCommandBuffers(logicalDevice, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
+    vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(depthPyramidCommandBuffers.size()), depthPyramidCommandBuffers.data());
 
     vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
     vkDestroyPipeline(logicalDevice, grassPipeline, nullptr);
-    vkDestroyPipeline(logicalDevice, computePipeline, nullptr);
+    vkDestroyPipeline(logicalDevice, depthPyramidPipeline, nullptr);
     // newly added
     //vkDestroyPipeline(logicalDevice, deferredPipeline, nullptr);
 
     vkDestroyPipelineLayout(logicalDevice, graphicsPipelineLayout, nullptr);
     vkDestroyPipelineLayout(logicalDevice, grassPipelineLayout, nullptr);
-    vkDestroyPipelineLayout(logicalDevice, computePipelineLayout, nullptr);
+    vkDestroyPipelineLayout(logicalDevice, depthPyramidPipelineLayout, nullptr);
     // newly added
     //vkDestroyPipelineLayout(logicalDevice, deferredPipelineLayout, nullptr);
 
     vkDestroyDescriptorSetLayout(logicalDevice, cameraDescriptorSetLayout, nullptr);
     vkDestroyDescriptorSetLayout(logicalDevice, modelDescriptorSetLayout, nullptr);
-    vkDestroyDescriptorSetLayout(logicalDevice, timeDescriptorSetLayout, nullptr);
-    vkDestroyDescriptorSetLayout(logicalDevice, grassComputeDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, depthPyramidDescriptorSetLayout, nullptr);
 
     vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
 
-    vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
-    vkDestroyRenderPass(logicalDevice, deferredRenderPass, nullptr);
+    delete terrainCompute;
+
     DestroyFrameResources();
+    delete renderGraph;
     vkDestroyCommandPool(logicalDevice, computeCommandPool, nullptr);
     vkDestroyCommandPool(logicalDevice, graphicsCommandPool, nullptr);
+    delete gpuTimer;
 
-    vkDestroySemaphore(logicalDevice, deferredSemaphore, nullptr);
-    vkDestroySampler(logicalDevice, deferredSampler, nullptr);
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        vkDestroySemaphore(logicalDevice, computeSemaphores[f], nullptr);
+        vkDestroyFence(logicalDevice, frameFences[f], nullptr);
+        vkDestroyFence(logicalDevice, computeFences[f], nullptr);
+    }
 }
@@ -4,44 +4,55 @@
 #include "SwapChain.h"
 #include "Scene.h"
 #include "Camera.h"
+#include "TerrainCompute.h"
+#include "Renderer.h"
+#include "RenderGraph.h"
 
-class DeferredRenderer {
+class DeferredRenderer : public Renderer {
 public:
     DeferredRenderer() = delete;
     DeferredRenderer(Device* device, SwapChain* swapChain, Scene* scene, Camera* camera);
-    ~DeferredRenderer();
+    ~DeferredRenderer() override;
+
+    const char* GetName() const override;
+    std::vector<GpuTiming> GetPassTimings() const override;
 
     void CreateCommandPools();
+    void CreateGpuTimer();
 
-    void CreateDeferredRenderPass();
-    void CreateRenderPass();
+    void CreateRenderGraph();
 
     void CreateCameraDescriptorSetLayout();
     void CreateModelDescriptorSetLayout();
-    void CreateTimeDescriptorSetLayout();
-    void CreateComputeDescriptorSetLayout();
+    void CreateDepthPyramidDescriptorSetLayout();
 
     void CreateDescriptorPool();
 
-    void CreateCameraDescriptorSet();
+    void CreateCameraDescriptorSets();
     void CreateModelDescriptorSets();
+    void UpdateModelDescriptorSets();
     void CreateGrassDescriptorSets();
-    void CreateTimeDescriptorSet();
-    void CreateComputeDescriptorSets();
+    void CreateDepthPyramidDescriptorSets();
+    void UpdateDepthPyramidDescriptorSets();
 
     void CreateGraphicsPipeline();
     void CreateGrassPipeline();
-    void CreateComputePipeline();
+    void CreateDepthPyramidPipeline();
+
+    void CreateSyncObjects();
 
     void CreateFrameResources();
     void DestroyFrameResources();
-    void RecreateFrameResources();
+    void RecreateFrameResources() override;
 
     void RecordCommandBuffers();
-    void RecordComputeCommandBuffer();
-    void RecordDeferredCommandBuffer();
+    void RecordComputeCommandBuffers();
+    void RecordDepthPyramidCommandBuffers();
+    void RecordGeometryPass(VkCommandBuffer commandBuffer, uint32_t frame);
+    void RecordDepthPyramidPass(VkCommandBuffer commandBuffer, uint32_t frame);
+    void RecordLightingPass(VkCommandBuffer commandBuffer, uint32_t frame);
 
-    void Frame();
+    void Frame() override;
 
 private:
     Device* device;
@@ -50,65 +61,68 @@ private:
     Scene* scene;
     Camera* camera;
 
+    // Frames the CPU may record ahead of the GPU, see SwapChain
+    uint32_t framesInFlight;
+
+    // Last upload batch submitted while the renderer was created, the first frame waits for it. Later uploads, like
+    // streamed textures, are synchronized by whoever makes them
+    uint64_t startupUploadId;
+
+    // Times the compute sections and every pass, see GetPassTimings
+    GpuTimer* gpuTimer;
+
     VkCommandPool graphicsCommandPool;
     VkCommandPool computeCommandPool;
 
-    VkRenderPass deferredRenderPass;
-    VkRenderPass renderPass;
+    // Owns the render passes, framebuffers, G-buffers and depth buffers
+    RenderGraph* renderGraph;
+    uint32_t albedoImage;
+    uint32_t normalImage;
+    uint32_t geometryDepthImage;
+    uint32_t swapChainImage;
+    uint32_t geometryPass;
+    uint32_t readbackPass;
+    uint32_t depthPyramidPass;
+    uint32_t lightingPass;
 
     VkDescriptorSetLayout cameraDescriptorSetLayout;
     VkDescriptorSetLayout modelDescriptorSetLayout;
-    VkDescriptorSetLayout timeDescriptorSetLayout;
-    VkDescriptorSetLayout grassComputeDescriptorSetLayout;
+    VkDescriptorSetLayout depthPyramidDescriptorSetLayout;
 
     VkDescriptorPool descriptorPool;
 
-    VkDescriptorSet cameraDescriptorSet;
+    // Sets that refer to per-frame resources are stored frame by frame, frame f of n sets per frame starts at f * n
+    std::vector<VkDescriptorSet> cameraDescriptorSets;
     std::vector<VkDescriptorSet> modelDescriptorSets;
     std::vector<VkDescriptorSet> grassDescriptorSets;
-    VkDescriptorSet timeDescriptorSet;
-    std::vector<VkDescriptorSet> grassComputeDescriptorSets;
+    std::vector<VkDescriptorSet> depthPyramidDescriptorSets;
 
     VkPipelineLayout graphicsPipelineLayout;
     VkPipelineLayout grassPipelineLayout;
-    VkPipelineLayout computePipelineLayout;
+    VkPipelineLayout depthPyramidPipelineLayout;
     // newly added
     VkPipelineLayout deferredPipelineLayout;
 
     VkPipeline graphicsPipeline;
     VkPipeline grassPipeline;
-    VkPipeline computePipeline;
+    VkPipeline depthPyramidPipeline;
     // newly added
     VkPipeline deferredPipeline;
 
     std::vector<VkImageView> imageViews;
-    VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
-    std::vector<VkFramebuffer> framebuffers;
-
-    VkImage deferredAlbedoImage;
-    VkDeviceMemory deferredAlbedoImageMemory;
-    VkImageView deferredAlbedoImageView;
-
-    VkImage deferredPositionImage;
-    VkDeviceMemory deferredPositionImageMemory;
-    VkImageView deferredPositionImageView;
-
-    VkImage deferredNormalImage;
-    VkDeviceMemory deferredNormalImageMemory;
-    VkImageView deferredNormalImageView;
-
-    VkImage deferredDepthImage;
-    VkDeviceMemory deferredDepthImageMemory;
-    VkImageView deferredDepthImageView;
 
-    VkFramebuffer deferredFramebuffer;
-    VkSampler deferredSampler;
+    // Clipmap bake and culling, recorded the same way by every renderer
+    TerrainCompute* terrainCompute;
 
-    VkSemaphore deferredSemaphore;
+    // Signaled by the compute submit of each frame, waited on by the graphics work that draws its tiles
+    std::vector<VkSemaphore> computeSemaphores;
+    // Signaled when the graphics and compute work of a frame is done and its resources can be reused
+    std::vector<VkFence> frameFences;
+    std::vector<VkFence> computeFences;
 
+    // One per frame in flight and swap chain image, frame f of image i is at f * swapChain->GetCount() + i
     std::vector<VkCommandBuffer> commandBuffers;
-    VkCommandBuffer computeCommandBuffer;
-    VkCommandBuffer deferredCommandBuffer;
+    std::vector<VkCommandBuffer> computeCommandBuffers;
+    // One per frame in flight, the passes after the render pass
+    std::vector<VkCommandBuffer> depthPyramidCommandBuffers;
 };
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include "DepthPyramid.h"
+#include "BufferUtils.h"
+#include "Image.h"
+
+constexpr VkFormat DepthPyramid::FORMAT;
+
+DepthPyramid::DepthPyramid(Device* device, uint32_t width, uint32_t height)
+  : device(device), width(width), height(height) {
+
+    // Full chain down to 1x1
+    mipLevels = 1;
+    while ((std::max(width, height) >> mipLevels) > 0) {
+        mipLevels++;
+    }
+
+    // Built on the graphics queue and read by culling on the compute queue, shared so that no ownership transfers are needed.
+    // The transfer queue only transitions it once
+    std::vector<uint32_t> queueFamilies = device->GetQueueFamilies(QueueFlagBit::GraphicsBit | QueueFlagBit::ComputeBit | QueueFlagBit::TransferBit);
+
+    Image::Create(device, width, height, FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory, mipLevels, 1, queueFamilies);
+
+    // The pyramid is written and read by compute shaders only, so it lives in the general layout. Recorded with the
+    // renderer's startup uploads, which its first frame waits for
+    device->GetUploadManager()->TransitionImage(image, mipLevels, 1, VK_IMAGE_LAYOUT_GENERAL);
+
+    imageView = Image::CreateView(device, image, FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels);
+
+    mipImageViews.resize(mipLevels);
+    for (uint32_t i = 0; i < mipLevels; ++i) {
+        mipImageViews[i] = Image::CreateView(device, image, FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, i, 1);
+    }
+
+    // Texels are fetched directly, no filtering
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = samplerInfo.addressModeU;
+    samplerInfo.addressModeW = samplerInfo.addressModeU;
+    samplerInfo.mipLodBias = 0.0f;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(mipLevels);
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+    if (vkCreateSampler(device->GetVkDevice(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid sampler");
+    }
+
+    // Nothing has been rendered yet, so culling against the pyramid starts disabled
+    HiZBufferObject hizBufferObject = {};
+    hizBufferObject.viewMatrix = glm::mat4(1.0f);
+    hizBufferObject.projectionMatrix = glm::mat4(1.0f);
+    hizBufferObject.valid = 0;
+    BufferUtils::CreateBufferFromData(device, &hizBufferObject, sizeof(HiZBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hizBuffer, hizBufferMemory, queueFamilies);
+}
+
+uint32_t DepthPyramid::GetMipLevels() const {
+    return mipLevels;
+}
+
+VkExtent2D DepthPyramid::GetMipExtent(uint32_t mip) const {
+    return { std::max(width >> mip, 1u), std::max(height >> mip, 1u) };
+}
+
+VkImage DepthPyramid::GetImage() const {
+    return image;
+}
+
+VkImageView DepthPyramid::GetImageView() const {
+    return imageView;
+}
+
+VkImageView DepthPyramid::GetMipImageView(uint32_t mip) const {
+    return mipImageViews[mip];
+}
+
+VkSampler DepthPyramid::GetSampler() const {
+    return sampler;
+}
+
+VkBuffer DepthPyramid::GetHiZBuffer() const {
+    return hizBuffer;
+}
+
+DepthPyramid::~DepthPyramid() {
+    vkDestroyBuffer(device->GetVkDevice(), hizBuffer, nullptr);
+    device->GetAllocator()->Free(hizBufferMemory);
+
+    vkDestroySampler(device->GetVkDevice(), sampler, nullptr);
+
+    for (size_t i = 0; i < mipImageViews.size(); ++i) {
+        vkDestroyImageView(device->GetVkDevice(), mipImageViews[i], nullptr);
+    }
+    vkDestroyImageView(device->GetVkDevice(), imageView, nullptr);
+
+    vkDestroyImage(device->GetVkDevice(), image, nullptr);
+    device->GetAllocator()->Free(imageMemory);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Device.h"
+
+// Camera the pyramid was built with, snapshotted on the GPU when the pyramid is built
+struct HiZBufferObject {
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+    // Zero until the pyramid has been built at least once
+    uint32_t valid;
+};
+
+// Max-reduced mip chain of a depth buffer, used to occlusion cull terrain tiles against the previous frame
+class DepthPyramid {
+private:
+    Device* device;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+
+    VkImage image;
+    MemoryAllocation imageMemory;
+    // View of the whole mip chain, sampled when culling
+    VkImageView imageView;
+    // One view per mip, written when building the pyramid
+    std::vector<VkImageView> mipImageViews;
+    VkSampler sampler;
+
+    VkBuffer hizBuffer;
+    MemoryAllocation hizBufferMemory;
+
+public:
+    static constexpr VkFormat FORMAT = VK_FORMAT_R32_SFLOAT;
+
+    DepthPyramid() = delete;
+    DepthPyramid(Device* device, uint32_t width, uint32_t height);
+    ~DepthPyramid();
+
+    uint32_t GetMipLevels() const;
+    VkExtent2D GetMipExtent(uint32_t mip) const;
+
+    VkImage GetImage() const;
+    VkImageView GetImageView() const;
+    VkImageView GetMipImageView(uint32_t mip) const;
+    VkSampler GetSampler() const;
+    VkBuffer GetHiZBuffer() const;
+};
@@ -1,8 +1,16 @@
+#include <algorithm>
 #include "Device.h"
 #include "Instance.h"
 
+constexpr const char* Device::PIPELINE_CACHE_PATH;
+
 Device::Device(Instance* instance, VkDevice vkDevice, Queues queues)
   : instance(instance), vkDevice(vkDevice), queues(queues) {
+    allocator = new MemoryAllocator(this);
+    uploadManager = new UploadManager(this);
+    pipelineCache = new PipelineCache(this, PIPELINE_CACHE_PATH);
+    shaderModuleCache = new ShaderModuleCache(vkDevice);
+    threadPool = new ThreadPool();
 }
 
 Instance* Device::GetInstance() {
@@ -21,10 +29,45 @@ unsigned int Device::GetQueueIndex(QueueFlags flag) {
     return GetInstance()->GetQueueFamilyIndices()[flag];
 }
 
-SwapChain* Device::CreateSwapChain(VkSurfaceKHR surface, unsigned int numBuffers) {
-    return new SwapChain(this, surface, numBuffers);
+std::vector<uint32_t> Device::GetQueueFamilies(QueueFlagBits flags) {
+    std::vector<uint32_t> families;
+    for (unsigned int i = 0; i < flags.size(); ++i) {
+        if (flags[i] && std::find(families.begin(), families.end(), GetQueueIndex(static_cast<QueueFlags>(i))) == families.end()) {
+            families.push_back(GetQueueIndex(static_cast<QueueFlags>(i)));
+        }
+    }
+    return families;
+}
+
+MemoryAllocator* Device::GetAllocator() {
+    return allocator;
+}
+
+UploadManager* Device::GetUploadManager() {
+    return uploadManager;
+}
+
+PipelineCache* Device::GetPipelineCache() {
+    return pipelineCache;
+}
+
+ShaderModuleCache* Device::GetShaderModuleCache() {
+    return shaderModuleCache;
+}
+
+ThreadPool* Device::GetThreadPool() {
+    return threadPool;
+}
+
+SwapChain* Device::CreateSwapChain(VkSurfaceKHR surface, unsigned int numBuffers, unsigned int framesInFlight) {
+    return new SwapChain(this, surface, numBuffers, framesInFlight);
 }
 
 Device::~Device() {
+    delete threadPool;
+    delete shaderModuleCache;
+    delete pipelineCache;
+    delete uploadManager;
+    delete allocator;
     vkDestroyDevice(vkDevice, nullptr);
 }
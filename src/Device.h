@@ -1,8 +1,14 @@
 #pragma once
 
 #include <array>
+#include <vector>
 #include <vulkan/vulkan.h>
 #include "QueueFlags.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "PipelineCache.h"
+#include "ShaderModule.h"
+#include "ThreadPool.h"
 #include "SwapChain.h"
 
 class SwapChain;
@@ -10,11 +16,24 @@ class Device {
     friend class Instance;
 
 public:
-    SwapChain* CreateSwapChain(VkSurfaceKHR surface, unsigned int numBuffers);
+    static constexpr const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+    SwapChain* CreateSwapChain(VkSurfaceKHR surface, unsigned int numBuffers, unsigned int framesInFlight);
     Instance* GetInstance();
     VkDevice GetVkDevice();
     VkQueue GetQueue(QueueFlags flag);
     unsigned int GetQueueIndex(QueueFlags flag);
+    // Distinct families of the given queues, for resources they share concurrently
+    std::vector<uint32_t> GetQueueFamilies(QueueFlagBits flags);
+    // Every buffer and image memory is carved out of it, see BufferUtils and Image
+    MemoryAllocator* GetAllocator();
+    // Batches staging copies on the transfer queue, see BufferUtils::CreateBufferFromData and Image::FromFile
+    UploadManager* GetUploadManager();
+    // Shared by every pipeline, loaded from and saved to PIPELINE_CACHE_PATH
+    PipelineCache* GetPipelineCache();
+    ShaderModuleCache* GetShaderModuleCache();
+    // Workers for startup jobs like compiling pipelines
+    ThreadPool* GetThreadPool();
     ~Device();
 
 private:
@@ -26,4 +45,9 @@ private:
     Instance* instance;
     VkDevice vkDevice;
     Queues queues;
+    MemoryAllocator* allocator;
+    UploadManager* uploadManager;
+    PipelineCache* pipelineCache;
+    ShaderModuleCache* shaderModuleCache;
+    ThreadPool* threadPool;
 };
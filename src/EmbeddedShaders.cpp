@@ -0,0 +1,10 @@
+#include "EmbeddedShaders.h"
+
+const EmbeddedShaders::Shader* EmbeddedShaders::Find(const std::string& name) {
+    for (size_t i = 0; i < shaderCount; ++i) {
+        if (name == shaders[i].name) {
+            return &shaders[i];
+        }
+    }
+    return nullptr;
+}
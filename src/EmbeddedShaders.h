@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SPIR-V of every shader in shaders/, compiled, optimized and embedded at build time by cmake/EmbedShaders.cmake
+namespace EmbeddedShaders {
+    struct Shader {
+        // Path the shader was read from before it was embedded, e.g. shaders/grass.vert.spv
+        const char* name;
+        const uint32_t* code;
+        size_t wordCount;
+    };
+
+    // Defined in the generated EmbeddedShaders.generated.cpp
+    extern const Shader shaders[];
+    extern const size_t shaderCount;
+
+    // nullptr if no shader of that name was built into the executable
+    const Shader* Find(const std::string& name);
+}
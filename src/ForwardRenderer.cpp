@@ -1,4 +1,4 @@
-#include "Renderer.h"
+#include "ForwardRenderer.h"
 #include "Instance.h"
 #include "ShaderModule.h"
 #include "Vertex.h"
@@ -6,39 +6,75 @@
 #include "Camera.h"
 #include "Image.h"
 #include "BufferUtils.h"
+#include <chrono>
 
 #define PRINT_NUM_BLADES 0
+#define PRINT_CULL_STATS 0
+// Time spent creating pipelines, to compare starts with a cold and a warm pipeline cache
+#define PRINT_PIPELINE_TIMES 0
 
-static constexpr unsigned int WORKGROUP_SIZE = 32;
 
-Renderer::Renderer(Device* device, SwapChain* swapChain, Scene* scene, Camera* camera)
+ForwardRenderer::ForwardRenderer(Device* device, SwapChain* swapChain, Scene* scene, Camera* camera)
   : device(device),
     logicalDevice(device->GetVkDevice()),
     swapChain(swapChain),
     scene(scene),
-    camera(camera) {
+    camera(camera),
+    framesInFlight(swapChain->GetFramesInFlight()) {
 
     CreateCommandPools();
     CreateRenderPass();
     CreateCameraDescriptorSetLayout();
+    // There is no depth pass to build a pyramid from in the forward path. An empty pyramid keeps the compute pipeline
+    // layout shared with the other renderers, and since it is never marked valid culling skips occlusion
+    terrainCompute = new TerrainCompute(device, scene, framesInFlight, cameraDescriptorSetLayout, 1, 1);
     CreateModelDescriptorSetLayout();
-    CreateTimeDescriptorSetLayout();
-    CreateComputeDescriptorSetLayout();
+    // Compiled on worker threads while the descriptor sets are being created, and waited on before recording
+#if PRINT_PIPELINE_TIMES
+    auto pipelinesStart = std::chrono::high_resolution_clock::now();
+#endif // PRINT_PIPELINE_TIMES
+    std::vector<std::future<void>> pipelineJobs;
+    pipelineJobs.push_back(device->GetThreadPool()->Submit([this]() { CreateGraphicsPipeline(); }));
+    pipelineJobs.push_back(device->GetThreadPool()->Submit([this]() { CreateGrassPipeline(); }));
+    pipelineJobs.push_back(device->GetThreadPool()->Submit([this]() { terrainCompute->CreateComputePipeline(); }));
+    pipelineJobs.push_back(device->GetThreadPool()->Submit([this]() { terrainCompute->CreateClipmapPipeline(); }));
     CreateDescriptorPool();
-    CreateCameraDescriptorSet();
+    CreateCameraDescriptorSets();
     CreateModelDescriptorSets();
     CreateGrassDescriptorSets();
-    CreateTimeDescriptorSet();
-    CreateComputeDescriptorSets();
     CreateFrameResources();
-    CreateGraphicsPipeline();
-    CreateGrassPipeline();
-    CreateComputePipeline();
+    ThreadPool::WaitAll(pipelineJobs);
+#if PRINT_PIPELINE_TIMES
+    std::chrono::duration<float, std::milli> pipelinesTime = std::chrono::high_resolution_clock::now() - pipelinesStart;
+    printf("pipelines ready after %.1f ms (%s pipeline cache)\n", pipelinesTime.count(), device->GetPipelineCache()->IsWarm() ? "warm" : "cold");
+#endif // PRINT_PIPELINE_TIMES
+#if PRINT_NUM_BLADES
+    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+        scene->GetBlades()[j]->EnableReadback();
+    }
+#endif // PRINT_NUM_BLADES
+    CreateGpuTimer();
     RecordCommandBuffers();
-    RecordComputeCommandBuffer();
+    RecordComputeCommandBuffers();
+    CreateSyncObjects();
+    startupUploadId = device->GetUploadManager()->Flush();
+}
+
+const char* ForwardRenderer::GetName() const {
+    return "forward";
+}
+
+std::vector<GpuTiming> ForwardRenderer::GetPassTimings() const {
+    return gpuTimer->GetTimings();
+}
+
+void ForwardRenderer::CreateGpuTimer() {
+    std::vector<std::string> sections = TerrainCompute::GetTimerSectionNames();
+    sections.push_back("forward");
+    gpuTimer = new GpuTimer(device, framesInFlight, sections);
 }
 
-void Renderer::CreateCommandPools() {
+void ForwardRenderer::CreateCommandPools() {
     VkCommandPoolCreateInfo graphicsPoolInfo = {};
     graphicsPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     graphicsPoolInfo.queueFamilyIndex = device->GetInstance()->GetQueueFamilyIndices()[QueueFlags::Graphics];
@@ -58,7 +94,7 @@ void Renderer::CreateCommandPools() {
     }
 }
 
-void Renderer::CreateRenderPass() {
+void ForwardRenderer::CreateRenderPass() {
     // Color buffer attachment represented by one of the images from the swap chain
     VkAttachmentDescription colorAttachment = {};
     colorAttachment.format = swapChain->GetVkImageFormat();
@@ -125,7 +161,7 @@ void Renderer::CreateRenderPass() {
     }
 }
 
-void Renderer::CreateCameraDescriptorSetLayout() {
+void ForwardRenderer::CreateCameraDescriptorSetLayout() {
     // Describe the binding of the descriptor set layout
     VkDescriptorSetLayoutBinding uboLayoutBinding = {};
     uboLayoutBinding.binding = 0;
@@ -147,7 +183,7 @@ void Renderer::CreateCameraDescriptorSetLayout() {
     }
 }
 
-void Renderer::CreateModelDescriptorSetLayout() {
+void ForwardRenderer::CreateModelDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding uboLayoutBinding = {};
     uboLayoutBinding.binding = 0;
     uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -175,73 +211,11 @@ void Renderer::CreateModelDescriptorSetLayout() {
     }
 }
 
-void Renderer::CreateTimeDescriptorSetLayout() {
-    // Describe the binding of the descriptor set layout
-    VkDescriptorSetLayoutBinding uboLayoutBinding = {};
-    uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    uboLayoutBinding.pImmutableSamplers = nullptr;
-
-    std::vector<VkDescriptorSetLayoutBinding> bindings = { uboLayoutBinding };
-
-    // Create the descriptor set layout
-    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
-
-    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &timeDescriptorSetLayout) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create descriptor set layout");
-    }
-}
-
-void Renderer::CreateComputeDescriptorSetLayout() {
-    // TODOX: Create the descriptor set layout for the compute pipeline
-    // Remember this is like a class definition stating why types of information
-    // will be stored at each binding
-    // Describe the binding of the descriptor set layout
-    // TODOX: just copied this from time descriptor
-    VkDescriptorSetLayoutBinding inputBladesLayoutBinding = {};
-    inputBladesLayoutBinding.binding = 0;
-    inputBladesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    inputBladesLayoutBinding.descriptorCount = 1; // TODO: number of input blades???
-    inputBladesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    inputBladesLayoutBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutBinding culledBladesLayoutBinding = {};
-    culledBladesLayoutBinding.binding = 1;
-    culledBladesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    culledBladesLayoutBinding.descriptorCount = 1; // TODO: number of input blades???
-    culledBladesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    culledBladesLayoutBinding.pImmutableSamplers = nullptr;
-
-    VkDescriptorSetLayoutBinding numBladesLayoutBinding = {};
-    numBladesLayoutBinding.binding = 2;
-    numBladesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    numBladesLayoutBinding.descriptorCount = 1;
-    numBladesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    numBladesLayoutBinding.pImmutableSamplers = nullptr;
-
-    std::vector<VkDescriptorSetLayoutBinding> bindings = { inputBladesLayoutBinding, culledBladesLayoutBinding, numBladesLayoutBinding };
-
-    // Create the descriptor set layout
-    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
-
-    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &grassComputeDescriptorSetLayout) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to create descriptor set layout");
-    }
-}
-
-void Renderer::CreateDescriptorPool() {
+void ForwardRenderer::CreateDescriptorPool() {
     // Describe which descriptor types that the descriptor sets will contain
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        // Camera
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , 1},
+        // Camera, per frame
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , framesInFlight },
 
         // Models + Blades
         { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER , static_cast<uint32_t>(scene->GetModels().size() + scene->GetBlades().size()) },
@@ -249,67 +223,63 @@ void Renderer::CreateDescriptorPool() {
         // Models + Blades
         { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , static_cast<uint32_t>(scene->GetModels().size() + scene->GetBlades().size()) },
 
-        // Time (compute)
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , 1 },
-
         // TODO: Add any additional types and counts of descriptors you will need to allocate
-        // Input blades (compute)
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , static_cast<uint32_t>(scene->GetBlades().size()) },
-
-        // Culled blades (compute)
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , static_cast<uint32_t>(scene->GetBlades().size()) },
-
-        // Number of remaining blades (compute)
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , static_cast<uint32_t>(scene->GetBlades().size()) },
     };
 
     VkDescriptorPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = 5;
+
+    // A set per model and blades, and per frame the camera. The compute sets are in TerrainCompute's pool
+    poolInfo.maxSets = static_cast<uint32_t>(scene->GetModels().size() + scene->GetBlades().size() + framesInFlight);
 
     if (vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create descriptor pool");
     }
 }
 
-void Renderer::CreateCameraDescriptorSet() {
-    // Describe the desciptor set
-    VkDescriptorSetLayout layouts[] = { cameraDescriptorSetLayout };
+void ForwardRenderer::CreateCameraDescriptorSets() {
+    cameraDescriptorSets.resize(framesInFlight);
+
+    // Describe the desciptor sets
+    std::vector<VkDescriptorSetLayout> layouts(cameraDescriptorSets.size(), cameraDescriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = layouts;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(cameraDescriptorSets.size());
+    allocInfo.pSetLayouts = layouts.data();
 
     // Allocate descriptor sets
-    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, &cameraDescriptorSet) != VK_SUCCESS) {
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, cameraDescriptorSets.data()) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate descriptor set");
     }
 
-    // Configure the descriptors to refer to buffers
-    VkDescriptorBufferInfo cameraBufferInfo = {};
-    cameraBufferInfo.buffer = camera->GetBuffer();
-    cameraBufferInfo.offset = 0;
-    cameraBufferInfo.range = sizeof(CameraBufferObject);
-
-    std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = cameraDescriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &cameraBufferInfo;
-    descriptorWrites[0].pImageInfo = nullptr;
-    descriptorWrites[0].pTexelBufferView = nullptr;
+    // Configure the descriptors to refer to each frame's slice of the camera buffer
+    std::vector<VkDescriptorBufferInfo> cameraBufferInfos(cameraDescriptorSets.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(cameraDescriptorSets.size());
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        cameraBufferInfos[f].buffer = camera->GetBuffer();
+        cameraBufferInfos[f].offset = camera->GetBufferOffset(f);
+        cameraBufferInfos[f].range = sizeof(CameraBufferObject);
+
+        descriptorWrites[f].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[f].dstSet = cameraDescriptorSets[f];
+        descriptorWrites[f].dstBinding = 0;
+        descriptorWrites[f].dstArrayElement = 0;
+        descriptorWrites[f].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[f].descriptorCount = 1;
+        descriptorWrites[f].pBufferInfo = &cameraBufferInfos[f];
+        descriptorWrites[f].pImageInfo = nullptr;
+        descriptorWrites[f].pTexelBufferView = nullptr;
+    }
 
     // Update descriptor sets
     vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
-void Renderer::CreateModelDescriptorSets() {
+void ForwardRenderer::CreateModelDescriptorSets() {
     modelDescriptorSets.resize(scene->GetModels().size());
 
     // Describe the desciptor set
@@ -362,7 +332,7 @@ void Renderer::CreateModelDescriptorSets() {
     vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
-void Renderer::CreateGrassDescriptorSets() {
+void ForwardRenderer::CreateGrassDescriptorSets() {
     // TODO: Create Descriptor sets for the grass.
     // This should involve creating descriptor sets which point to the model matrix of each group of grass blades
     grassDescriptorSets.resize(scene->GetBlades().size());
@@ -403,118 +373,9 @@ void Renderer::CreateGrassDescriptorSets() {
     vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
-void Renderer::CreateTimeDescriptorSet() {
-    // Describe the desciptor set
-    VkDescriptorSetLayout layouts[] = { timeDescriptorSetLayout };
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = layouts;
-
-    // Allocate descriptor sets
-    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, &timeDescriptorSet) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate descriptor set");
-    }
-
-    // Configure the descriptors to refer to buffers
-    VkDescriptorBufferInfo timeBufferInfo = {};
-    timeBufferInfo.buffer = scene->GetTimeBuffer();
-    timeBufferInfo.offset = 0;
-    timeBufferInfo.range = sizeof(Time);
-
-    std::array<VkWriteDescriptorSet, 1> descriptorWrites = {};
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = timeDescriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &timeBufferInfo;
-    descriptorWrites[0].pImageInfo = nullptr;
-    descriptorWrites[0].pTexelBufferView = nullptr;
-
-    // Update descriptor sets
-    vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-}
-
-void Renderer::CreateComputeDescriptorSets() {
-    // TODO: Create Descriptor sets for the compute pipeline
-    // The descriptors should point to Storage buffers which will hold the grass blades, the culled grass blades, and the output number of grass blades 
-    grassComputeDescriptorSets.resize(scene->GetBlades().size());
-
-    // Describe the desciptor set
-    VkDescriptorSetLayout layouts[] = { grassComputeDescriptorSetLayout };
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(grassComputeDescriptorSets.size());
-    allocInfo.pSetLayouts = layouts;
-
-    // Allocate descriptor sets
-    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, grassComputeDescriptorSets.data()) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate descriptor set");
-    }
-
-    std::vector<VkWriteDescriptorSet> descriptorWrites(3 * grassComputeDescriptorSets.size());
-
-    for (uint32_t i = 0; i < scene->GetBlades().size(); ++i) {
-        VkDescriptorBufferInfo inputBladesBufferInfo = {};
-        inputBladesBufferInfo.buffer = scene->GetBlades()[i]->GetBladesBuffer();
-        inputBladesBufferInfo.offset = 0;
-        inputBladesBufferInfo.range = sizeof(Blade) * NUM_BLADES;
-
-        VkDescriptorBufferInfo culledBladesBufferInfo = {};
-        culledBladesBufferInfo.buffer = scene->GetBlades()[i]->GetCulledBladesBuffer();
-        culledBladesBufferInfo.offset = 0;
-        culledBladesBufferInfo.range = sizeof(Blade) * NUM_BLADES;
-
-        VkDescriptorBufferInfo numBladesBufferInfo = {};
-        numBladesBufferInfo.buffer = scene->GetBlades()[i]->GetNumBladesBuffer();
-        numBladesBufferInfo.offset = 0;
-        numBladesBufferInfo.range = sizeof(BladeDrawIndirect);
-
-        descriptorWrites[3 * i + 0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[3 * i + 0].dstSet = grassComputeDescriptorSets[i];
-        descriptorWrites[3 * i + 0].dstBinding = 0;
-        descriptorWrites[3 * i + 0].dstArrayElement = 0;
-        descriptorWrites[3 * i + 0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[3 * i + 0].descriptorCount = 1; // TODO: should this be 1? same for culledBlades below??? 
-                                                         // I think so, because docs say descriptorCount is number of elts in pBufferInfo,
-                                                         // and pBufferInfo is array of VkDescriptorBufferInfo, of which we only have one (inputBladesBufferInfo)
-                                                         // https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkWriteDescriptorSet.html
-        descriptorWrites[3 * i + 0].pBufferInfo = &inputBladesBufferInfo;
-        descriptorWrites[3 * i + 0].pImageInfo = nullptr;
-        descriptorWrites[3 * i + 0].pTexelBufferView = nullptr;
-
-        descriptorWrites[3 * i + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[3 * i + 1].dstSet = grassComputeDescriptorSets[i];
-        descriptorWrites[3 * i + 1].dstBinding = 1;
-        descriptorWrites[3 * i + 1].dstArrayElement = 0;
-        descriptorWrites[3 * i + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[3 * i + 1].descriptorCount = 1;
-        descriptorWrites[3 * i + 1].pBufferInfo = &culledBladesBufferInfo;
-        descriptorWrites[3 * i + 1].pImageInfo = nullptr;
-        descriptorWrites[3 * i + 1].pTexelBufferView = nullptr;
-
-        descriptorWrites[3 * i + 2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[3 * i + 2].dstSet = grassComputeDescriptorSets[i];
-        descriptorWrites[3 * i + 2].dstBinding = 2;
-        descriptorWrites[3 * i + 2].dstArrayElement = 0;
-        descriptorWrites[3 * i + 2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[3 * i + 2].descriptorCount = 1;
-        descriptorWrites[3 * i + 2].pBufferInfo = &numBladesBufferInfo;
-        descriptorWrites[3 * i + 2].pImageInfo = nullptr;
-        descriptorWrites[3 * i + 2].pTexelBufferView = nullptr;
-    }
-
-    // Update descriptor sets
-    vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-}
-
-void Renderer::CreateGraphicsPipeline() {
-    VkShaderModule vertShaderModule = ShaderModule::Create("shaders/graphics.vert.spv", logicalDevice);
-    VkShaderModule fragShaderModule = ShaderModule::Create("shaders/graphics.frag.spv", logicalDevice);
+void ForwardRenderer::CreateGraphicsPipeline() {
+    VkShaderModule vertShaderModule = device->GetShaderModuleCache()->Get("shaders/graphics.vert.spv");
+    VkShaderModule fragShaderModule = device->GetShaderModuleCache()->Get("shaders/graphics.frag.spv");
 
     // Assign each shader module to the appropriate stage in the pipeline
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
@@ -663,20 +524,18 @@ void Renderer::CreateGraphicsPipeline() {
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
 
-    if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(logicalDevice, device->GetPipelineCache()->GetVkPipelineCache(), 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create graphics pipeline");
     }
 
-    vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
-    vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
 }
 
-void Renderer::CreateGrassPipeline() {
+void ForwardRenderer::CreateGrassPipeline() {
     // --- Set up programmable shaders ---
-    VkShaderModule vertShaderModule = ShaderModule::Create("shaders/grass.vert.spv", logicalDevice);
-    VkShaderModule tescShaderModule = ShaderModule::Create("shaders/grass.tesc.spv", logicalDevice);
-    VkShaderModule teseShaderModule = ShaderModule::Create("shaders/grass.tese.spv", logicalDevice);
-    VkShaderModule fragShaderModule = ShaderModule::Create("shaders/grass.frag.spv", logicalDevice);
+    VkShaderModule vertShaderModule = device->GetShaderModuleCache()->Get("shaders/grass.vert.spv");
+    VkShaderModule tescShaderModule = device->GetShaderModuleCache()->Get("shaders/grass.tesc.spv");
+    VkShaderModule teseShaderModule = device->GetShaderModuleCache()->Get("shaders/grass.tese.spv");
+    VkShaderModule fragShaderModule = device->GetShaderModuleCache()->Get("shaders/grass.frag.spv");
 
     // Assign each shader module to the appropriate stage in the pipeline
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
@@ -711,8 +570,8 @@ void Renderer::CreateGrassPipeline() {
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-    auto bindingDescription = Blade::getBindingDescription();
-    auto attributeDescriptions = Blade::getAttributeDescriptions();
+    auto bindingDescription = Tile::getBindingDescription();
+    auto attributeDescriptions = Tile::getAttributeDescriptions();
 
     vertexInputInfo.vertexBindingDescriptionCount = 1;
     vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
@@ -804,7 +663,7 @@ void Renderer::CreateGrassPipeline() {
     colorBlending.blendConstants[2] = 0.0f;
     colorBlending.blendConstants[3] = 0.0f;
 
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { cameraDescriptorSetLayout, modelDescriptorSetLayout };
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { cameraDescriptorSetLayout, modelDescriptorSetLayout, terrainCompute->GetClipmapDescriptorSetLayout() };
 
     // Pipeline layout: used to specify uniform values
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
@@ -845,68 +704,37 @@ void Renderer::CreateGrassPipeline() {
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
 
-    if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &grassPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(logicalDevice, device->GetPipelineCache()->GetVkPipelineCache(), 1, &pipelineInfo, nullptr, &grassPipeline) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create graphics pipeline");
     }
-
-    // No need for the shader modules anymore
-    vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
-    vkDestroyShaderModule(logicalDevice, tescShaderModule, nullptr);
-    vkDestroyShaderModule(logicalDevice, teseShaderModule, nullptr);
-    vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
 }
 
-void Renderer::CreateComputePipeline() {
-    // Set up programmable shaders
-    VkShaderModule computeShaderModule = ShaderModule::Create("shaders/compute.comp.spv", logicalDevice);
-
-    VkPipelineShaderStageCreateInfo computeShaderStageInfo = {};
-    computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-    computeShaderStageInfo.module = computeShaderModule;
-    computeShaderStageInfo.pName = "main";
-
-    // TODO: Add the compute dsecriptor set layout you create to this list
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { cameraDescriptorSetLayout, timeDescriptorSetLayout, grassComputeDescriptorSetLayout };
-
-    // Define push constant stuff to hold NUM_BLADES
-    VkPushConstantRange pushConstantRange = {};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(int);
-    VkPushConstantRange pushConstantRangeArray[] = { pushConstantRange  };
+void ForwardRenderer::CreateSyncObjects() {
+    computeSemaphores.resize(framesInFlight);
+    frameFences.resize(framesInFlight);
+    computeFences.resize(framesInFlight);
 
-    // Create pipeline layout
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = pushConstantRangeArray;
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create pipeline layout");
-    }
+    // Signaled so that the first use of every frame does not wait
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    // Create compute pipeline
-    VkComputePipelineCreateInfo pipelineInfo = {};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    pipelineInfo.stage = computeShaderStageInfo;
-    pipelineInfo.layout = computePipelineLayout;
-    pipelineInfo.pNext = nullptr;
-    pipelineInfo.flags = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        if (vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, nullptr, &computeSemaphores[f]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute semaphore");
+        }
 
-    if (vkCreateComputePipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create compute pipeline");
+        if (vkCreateFence(logicalDevice, &fenceCreateInfo, nullptr, &frameFences[f]) != VK_SUCCESS ||
+            vkCreateFence(logicalDevice, &fenceCreateInfo, nullptr, &computeFences[f]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create fences");
+        }
     }
-
-    // No need for shader modules anymore
-    vkDestroyShaderModule(logicalDevice, computeShaderModule, nullptr);
 }
 
-void Renderer::CreateFrameResources() {
+void ForwardRenderer::CreateFrameResources() {
     imageViews.resize(swapChain->GetCount());
 
     for (uint32_t i = 0; i < swapChain->GetCount(); i++) {
@@ -950,13 +778,10 @@ void Renderer::CreateFrameResources() {
         depthImage,
         depthImageMemory
     );
+    // Needs no transition, the render pass clears it from an undefined initial layout every frame
 
     depthImageView = Image::CreateView(device, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
     
-    // Transition the image for use as depth-stencil
-    Image::TransitionLayout(device, graphicsCommandPool, depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-    
     // CREATE FRAMEBUFFERS
     framebuffers.resize(swapChain->GetCount());
     for (size_t i = 0; i < swapChain->GetCount(); i++) {
@@ -981,13 +806,13 @@ void Renderer::CreateFrameResources() {
     }
 }
 
-void Renderer::DestroyFrameResources() {
+void ForwardRenderer::DestroyFrameResources() {
     for (size_t i = 0; i < imageViews.size(); i++) {
         vkDestroyImageView(logicalDevice, imageViews[i], nullptr);
     }
 
     vkDestroyImageView(logicalDevice, depthImageView, nullptr);
-    vkFreeMemory(logicalDevice, depthImageMemory, nullptr);
+    device->GetAllocator()->Free(depthImageMemory);
     vkDestroyImage(logicalDevice, depthImage, nullptr);
 
     for (size_t i = 0; i < framebuffers.size(); i++) {
@@ -995,69 +820,66 @@ void Renderer::DestroyFrameResources() {
     }
 }
 
-void Renderer::RecreateFrameResources() {
+void ForwardRenderer::RecreateFrameResources() {
+    // Every frame in flight refers to the command buffers recreated below
+    vkDeviceWaitIdle(logicalDevice);
+
     vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
     vkDestroyPipeline(logicalDevice, grassPipeline, nullptr);
     vkDestroyPipelineLayout(logicalDevice, graphicsPipelineLayout, nullptr);
     vkDestroyPipelineLayout(logicalDevice, grassPipelineLayout, nullptr);
     vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    vkFreeCommandBuffers(logicalDevice, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
 
     DestroyFrameResources();
     CreateFrameResources();
-    CreateGraphicsPipeline();
+    std::future<void> graphicsPipelineJob = device->GetThreadPool()->Submit([this]() { CreateGraphicsPipeline(); });
     CreateGrassPipeline();
+    graphicsPipelineJob.get();
     RecordCommandBuffers();
+
+    // Tessellation levels depend on the viewport height
+    RecordComputeCommandBuffers();
 }
 
-void Renderer::RecordComputeCommandBuffer() {
+void ForwardRenderer::RecordComputeCommandBuffers() {
+    computeCommandBuffers.resize(framesInFlight);
+
     // Specify the command pool and number of buffers to allocate
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = computeCommandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(computeCommandBuffers.size());
 
-    if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, &computeCommandBuffer) != VK_SUCCESS) {
+    if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate command buffers");
     }
 
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-    beginInfo.pInheritanceInfo = nullptr;
-
-    // ~ Start recording ~
-    if (vkBeginCommandBuffer(computeCommandBuffer, &beginInfo) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to begin recording compute command buffer");
-    }
-
-    // Bind to the compute pipeline
-    vkCmdBindPipeline(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        VkCommandBuffer computeCommandBuffer = computeCommandBuffers[f];
 
-    // Bind camera descriptor set
-    vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &cameraDescriptorSet, 0, nullptr);
-
-    // Bind descriptor set for time uniforms
-    vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 1, 1, &timeDescriptorSet, 0, nullptr);
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+        beginInfo.pInheritanceInfo = nullptr;
 
-    // Update push constants
-    int pushValues[] = { NUM_BLADES };
-    vkCmdPushConstants(computeCommandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int), pushValues);
+        // ~ Start recording ~
+        if (vkBeginCommandBuffer(computeCommandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording compute command buffer");
+        }
 
-    // TODO: For each group of blades bind its descriptor set and dispatch
-    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
-        vkCmdBindDescriptorSets(computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 2, 1, &grassComputeDescriptorSets[j], 0, nullptr);
-        vkCmdDispatch(computeCommandBuffer, (int)ceil((float)NUM_BLADES / WORKGROUP_SIZE), 1, 1);
-    }
+        terrainCompute->Record(computeCommandBuffer, f, cameraDescriptorSets[f], static_cast<float>(swapChain->GetVkExtent().height), gpuTimer);
 
-    // ~ End recording ~
-    if (vkEndCommandBuffer(computeCommandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to record compute command buffer");
+        // ~ End recording ~
+        if (vkEndCommandBuffer(computeCommandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record compute command buffer");
+        }
     }
 }
 
-void Renderer::RecordCommandBuffers() {
-    commandBuffers.resize(swapChain->GetCount());
+void ForwardRenderer::RecordCommandBuffers() {
+    commandBuffers.resize(framesInFlight * swapChain->GetCount());
 
     // Specify the command pool and number of buffers to allocate
     VkCommandBufferAllocateInfo allocInfo = {};
@@ -1072,6 +894,10 @@ void Renderer::RecordCommandBuffers() {
 
     // Start command buffer recording
     for (size_t i = 0; i < commandBuffers.size(); i++) {
+        // Frame in flight and swap chain image this command buffer is for
+        uint32_t f = static_cast<uint32_t>(i / swapChain->GetCount());
+        size_t image = i % swapChain->GetCount();
+
         VkCommandBufferBeginInfo beginInfo = {};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
@@ -1086,7 +912,7 @@ void Renderer::RecordCommandBuffers() {
         VkRenderPassBeginInfo renderPassInfo = {};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = framebuffers[i];
+        renderPassInfo.framebuffer = framebuffers[image];
         renderPassInfo.renderArea.offset = { 0, 0 };
         renderPassInfo.renderArea.extent = swapChain->GetVkExtent();
 
@@ -1096,22 +922,31 @@ void Renderer::RecordCommandBuffers() {
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
 
-        std::vector<VkBufferMemoryBarrier> barriers(scene->GetBlades().size());
-        for (uint32_t j = 0; j < barriers.size(); ++j) {
-            barriers[j].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-            barriers[j].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-            barriers[j].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
-            barriers[j].srcQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Compute);
-            barriers[j].dstQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Graphics);
-            barriers[j].buffer = scene->GetBlades()[j]->GetNumBladesBuffer();
-            barriers[j].offset = 0;
-            barriers[j].size = sizeof(BladeDrawIndirect);
+        gpuTimer->RecordReset(commandBuffers[i], f, TerrainCompute::TIMER_SECTION_COUNT, 1);
+        gpuTimer->RecordBegin(commandBuffers[i], f, TerrainCompute::TIMER_SECTION_COUNT);
+
+        // Acquire the culled blades released by the compute command buffer. The clipmap bake is already visible,
+        // the compute semaphore this is submitted with covers it
+        std::vector<VkBufferMemoryBarrier> acquireBarriers(2 * scene->GetBlades().size());
+        for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+            VkBuffer buffers[] = { scene->GetBlades()[j]->GetCulledBladesBuffer(f), scene->GetBlades()[j]->GetNumBladesBuffer(f) };
+            for (uint32_t k = 0; k < 2; ++k) {
+                VkBufferMemoryBarrier& barrier = acquireBarriers[2 * j + k];
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+                barrier.srcQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Compute);
+                barrier.dstQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Graphics);
+                barrier.buffer = buffers[k];
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+            }
         }
 
-        vkCmdPipelineBarrier(commandBuffers[i], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, barriers.size(), barriers.data(), 0, nullptr);
+        vkCmdPipelineBarrier(commandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, static_cast<uint32_t>(acquireBarriers.size()), acquireBarriers.data(), 0, nullptr);
 
         // Bind the camera descriptor set. This is set 0 in all pipelines so it will be inherited
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 1, &cameraDescriptorSet, 0, nullptr);
+        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayout, 0, 1, &cameraDescriptorSets[f], 0, nullptr);
 
         vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
@@ -1137,8 +972,12 @@ void Renderer::RecordCommandBuffers() {
         // Bind the grass pipeline
         vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipeline);
 
+        // Bind the height clipmap the terrain is displaced with
+        VkDescriptorSet clipmapDescriptorSet = terrainCompute->GetClipmapDescriptorSet(f);
+        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, grassPipelineLayout, 2, 1, &clipmapDescriptorSet, 0, nullptr);
+
         for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
-            VkBuffer vertexBuffers[] = { scene->GetBlades()[j]->GetCulledBladesBuffer() };//{ scene->GetBlades()[j]->GetCulledBladesBuffer() };
+            VkBuffer vertexBuffers[] = { scene->GetBlades()[j]->GetCulledBladesBuffer(f) };
             VkDeviceSize offsets[] = { 0 };
             // TODO: Uncomment this when the buffers are populated
             vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
@@ -1151,12 +990,21 @@ void Renderer::RecordCommandBuffers() {
             // CHECKITOUT: it's getNumBladesBuffer that specifies how many threads are spawned
             // see: https://www.khronos.org/registry/vulkan/specs/1.0/man/html/vkCmdDrawIndirect.html
             // see: https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkDrawIndirectCommand.html
-            vkCmdDrawIndirect(commandBuffers[i], scene->GetBlades()[j]->GetNumBladesBuffer(), 0, 1, sizeof(BladeDrawIndirect));
+            vkCmdDrawIndirect(commandBuffers[i], scene->GetBlades()[j]->GetNumBladesBuffer(f), 0, 1, sizeof(BladeDrawIndirect));
         }
 
         // End render pass
         vkCmdEndRenderPass(commandBuffers[i]);
 
+        gpuTimer->RecordEnd(commandBuffers[i], f, TerrainCompute::TIMER_SECTION_COUNT);
+
+        // Debug copies of the culled tiles, only recorded when a readback was enabled
+        for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+            if (scene->GetBlades()[j]->IsReadbackEnabled()) {
+                scene->GetBlades()[j]->RecordReadback(commandBuffers[i], f);
+            }
+        }
+
         // ~ End recording ~
         if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
             throw std::runtime_error("Failed to record command buffer");
@@ -1164,134 +1012,128 @@ void Renderer::RecordCommandBuffers() {
     }
 }
 
-void Renderer::Frame() {
+void ForwardRenderer::Frame() {
+    uint32_t frameIndex = swapChain->GetFrameIndex();
 
-    VkSubmitInfo computeSubmitInfo = {};
-    computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    // Only blocks while the uploads made at startup are still being copied
+    device->GetUploadManager()->Wait(startupUploadId);
 
-    computeSubmitInfo.commandBufferCount = 1;
-    computeSubmitInfo.pCommandBuffers = &computeCommandBuffer;
+    // Wait for the GPU to be done with the resources of this frame from framesInFlight frames ago
+    VkFence fences[] = { frameFences[frameIndex], computeFences[frameIndex] };
+    vkWaitForFences(logicalDevice, 2, fences, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    gpuTimer->Resolve(frameIndex);
 
-    if (vkQueueSubmit(device->GetQueue(QueueFlags::Compute), 1, &computeSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to submit draw command buffer");
+#if PRINT_CULL_STATS
+    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+        const TileCullStats& cullStats = scene->GetBlades()[j]->GetCullStats(frameIndex);
+        printf("frustum culled tiles: %u, occluded tiles: %u, dropped tiles: %u\n", cullStats.frustumCulledTiles, cullStats.occludedTiles, cullStats.droppedTiles);
+    }
+#endif // PRINT_CULL_STATS
+
+#if PRINT_NUM_BLADES
+    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+        const BladeDrawIndirect& draw = scene->GetBlades()[j]->GetReadbackDraw(frameIndex);
+        const Tile* tiles = scene->GetBlades()[j]->GetReadbackTiles(frameIndex);
+        printf("num tiles: %u", draw.vertexCount);
+        if (draw.vertexCount > 0) {
+            printf(", tile[0].origin: %d %d", tiles[0].originX, tiles[0].originZ);
+        }
+        printf("\n");
     }
+#endif // PRINT_NUM_BLADES
+
+    // Only now is it safe to overwrite this frame's uniforms
+    camera->UpdateBuffer(frameIndex);
+    scene->UpdateTimeBuffer(frameIndex);
 
+    // Acquire before submitting any work, so that a swap chain that needs to be recreated leaves no semaphore
+    // signaled without a submit waiting on it
     if (!swapChain->Acquire()) {
         RecreateFrameResources();
         return;
     }
 
+    // Culling runs on the compute queue as soon as this slot's fences were waited on
+    VkSubmitInfo computeSubmitInfo = {};
+    computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+    computeSubmitInfo.commandBufferCount = 1;
+    computeSubmitInfo.pCommandBuffers = &computeCommandBuffers[frameIndex];
+
+    computeSubmitInfo.signalSemaphoreCount = 1;
+    computeSubmitInfo.pSignalSemaphores = &computeSemaphores[frameIndex];
+
+    vkResetFences(logicalDevice, 1, &computeFences[frameIndex]);
+    if (vkQueueSubmit(device->GetQueue(QueueFlags::Compute), 1, &computeSubmitInfo, computeFences[frameIndex]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit compute command buffer");
+    }
+
     // Submit the command buffer
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphores[] = { swapChain->GetImageAvailableVkSemaphore() };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submitInfo.waitSemaphoreCount = 1;
+    // The culled blades are drawn and the clipmap sampled only after culling is done
+    VkSemaphore waitSemaphores[] = { swapChain->GetImageAvailableVkSemaphore(), computeSemaphores[frameIndex] };
+    VkPipelineStageFlags waitStages[] = {
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT
+    };
+    submitInfo.waitSemaphoreCount = 2;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
 
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[swapChain->GetIndex()];
+    submitInfo.pCommandBuffers = &commandBuffers[frameIndex * swapChain->GetCount() + swapChain->GetIndex()];
 
     VkSemaphore signalSemaphores[] = { swapChain->GetRenderFinishedVkSemaphore() };
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(device->GetQueue(QueueFlags::Graphics), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+    vkResetFences(logicalDevice, 1, &frameFences[frameIndex]);
+    if (vkQueueSubmit(device->GetQueue(QueueFlags::Graphics), 1, &submitInfo, frameFences[frameIndex]) != VK_SUCCESS) {
         throw std::runtime_error("Failed to submit draw command buffer");
     }
-
-#if PRINT_NUM_BLADES
-    // try to read numBladesBuffer ============================================
-    // Create the staging buffer
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    VkDeviceSize bufferSize = sizeof(BladeDrawIndirect);
-
-    VkBufferUsageFlags stagingUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    VkMemoryPropertyFlags stagingProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    BufferUtils::CreateBuffer(device, bufferSize, stagingUsage, stagingProperties, stagingBuffer, stagingBufferMemory);
-
-    // Fill the staging buffer
-    void *data;
-    vkMapMemory(device->GetVkDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-    // CPU mem "data" should now be mapped to a vkbuffer!!??
-    // so copy data into "data"
-    BufferUtils::CopyBuffer(device, computeCommandPool, scene->GetBlades()[0]->GetNumBladesBuffer(), stagingBuffer, bufferSize);
-    vkUnmapMemory(device->GetVkDevice(), stagingBufferMemory);
-
-    // read "data"
-    BladeDrawIndirect* indirectDraw = (BladeDrawIndirect*)data;
-    //printf("num blades: %d\n", indirectDraw->vertexCount);
-
-    // No need for the staging buffer anymore
-    vkDestroyBuffer(device->GetVkDevice(), stagingBuffer, nullptr);
-    vkFreeMemory(device->GetVkDevice(), stagingBufferMemory, nullptr);
-    // try to read numBladesBuffer ============================================
-
-	// Try to read all the blades first position info ========================================
-	// Create the staging buffer
-	VkBuffer stagingBuffer1;
-	VkDeviceMemory stagingBuffer1Memory;
-	VkDeviceSize buffer1Size = NUM_BLADES * sizeof(Blade);
-
-	VkBufferUsageFlags staging1Usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-	VkMemoryPropertyFlags staging1Properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-	BufferUtils::CreateBuffer(device, buffer1Size, staging1Usage, staging1Properties, stagingBuffer1, stagingBuffer1Memory);
-
-	// Fill the staging buffer
-	void *data1;
-	vkMapMemory(device->GetVkDevice(), stagingBuffer1Memory, 0, buffer1Size, 0, &data1);
-	// CPU mem "data" should now be mapped to a vkbuffer!!??
-	// so copy data into "data"
-	BufferUtils::CopyBuffer(device, computeCommandPool, scene->GetBlades()[0]->GetBladesBuffer(), stagingBuffer1, buffer1Size);
-	vkUnmapMemory(device->GetVkDevice(), stagingBuffer1Memory);
-
-	// read "data"
-	Blade* blade1 = (Blade*)data1;
-	printf("blade[i].vo: %d\n", (*blade1).v0);
-
-	// No need for the staging buffer anymore
-	vkDestroyBuffer(device->GetVkDevice(), stagingBuffer1, nullptr);
-	// Try to read all the blades first position info ========================================
-
-#endif // PRINT_NUM_BLADES
+    gpuTimer->MarkSubmitted(frameIndex);
 
     if (!swapChain->Present()) {
         RecreateFrameResources();
     }
 }
 
-Renderer::~Renderer() {
+ForwardRenderer::~ForwardRenderer() {
     vkDeviceWaitIdle(logicalDevice);
 
     // TODO: destroy any resources you created
 
     vkFreeCommandBuffers(logicalDevice, graphicsCommandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
-    vkFreeCommandBuffers(logicalDevice, computeCommandPool, 1, &computeCommandBuffer);
+    vkFreeCommandBuffers(logicalDevice, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
     
     vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
     vkDestroyPipeline(logicalDevice, grassPipeline, nullptr);
-    vkDestroyPipeline(logicalDevice, computePipeline, nullptr);
 	// newly added
 	//vkDestroyPipeline(logicalDevice, deferredPipeline, nullptr);
 
     vkDestroyPipelineLayout(logicalDevice, graphicsPipelineLayout, nullptr);
     vkDestroyPipelineLayout(logicalDevice, grassPipelineLayout, nullptr);
-    vkDestroyPipelineLayout(logicalDevice, computePipelineLayout, nullptr);
 	// newly added
 	//vkDestroyPipelineLayout(logicalDevice, deferredPipelineLayout, nullptr);
 
     vkDestroyDescriptorSetLayout(logicalDevice, cameraDescriptorSetLayout, nullptr);
     vkDestroyDescriptorSetLayout(logicalDevice, modelDescriptorSetLayout, nullptr);
-    vkDestroyDescriptorSetLayout(logicalDevice, timeDescriptorSetLayout, nullptr);
-    vkDestroyDescriptorSetLayout(logicalDevice, grassComputeDescriptorSetLayout, nullptr);
 
     vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
 
+    delete terrainCompute;
+
     vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
     DestroyFrameResources();
     vkDestroyCommandPool(logicalDevice, computeCommandPool, nullptr);
     vkDestroyCommandPool(logicalDevice, graphicsCommandPool, nullptr);
+    delete gpuTimer;
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        vkDestroySemaphore(logicalDevice, computeSemaphores[f], nullptr);
+        vkDestroyFence(logicalDevice, frameFences[f], nullptr);
+        vkDestroyFence(logicalDevice, computeFences[f], nullptr);
+    }
 }
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Device.h"
+#include "SwapChain.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "TerrainCompute.h"
+#include "Renderer.h"
+
+class ForwardRenderer : public Renderer {
+public:
+    ForwardRenderer() = delete;
+    ForwardRenderer(Device* device, SwapChain* swapChain, Scene* scene, Camera* camera);
+    ~ForwardRenderer() override;
+
+    const char* GetName() const override;
+    std::vector<GpuTiming> GetPassTimings() const override;
+
+    void CreateCommandPools();
+    void CreateGpuTimer();
+
+    void CreateRenderPass();
+
+    void CreateCameraDescriptorSetLayout();
+    void CreateModelDescriptorSetLayout();
+
+    void CreateDescriptorPool();
+
+    void CreateCameraDescriptorSets();
+    void CreateModelDescriptorSets();
+    void CreateGrassDescriptorSets();
+
+    void CreateGraphicsPipeline();
+    void CreateGrassPipeline();
+
+    void CreateSyncObjects();
+
+    void CreateFrameResources();
+    void DestroyFrameResources();
+    void RecreateFrameResources() override;
+
+    void RecordCommandBuffers();
+    void RecordComputeCommandBuffers();
+
+    void Frame() override;
+
+private:
+    Device* device;
+    VkDevice logicalDevice;
+    SwapChain* swapChain;
+    Scene* scene;
+    Camera* camera;
+
+    // Frames the CPU may record ahead of the GPU, see SwapChain
+    uint32_t framesInFlight;
+
+    // Last upload batch submitted while the renderer was created, the first frame waits for it. Later uploads, like
+    // streamed textures, are synchronized by whoever makes them
+    uint64_t startupUploadId;
+
+    // Times the compute sections and every pass, see GetPassTimings
+    GpuTimer* gpuTimer;
+
+    VkCommandPool graphicsCommandPool;
+    VkCommandPool computeCommandPool;
+
+    VkRenderPass renderPass;
+
+    VkDescriptorSetLayout cameraDescriptorSetLayout;
+    VkDescriptorSetLayout modelDescriptorSetLayout;
+    
+    VkDescriptorPool descriptorPool;
+
+    // Sets that refer to per-frame resources are stored frame by frame, frame f of n sets per frame starts at f * n
+    std::vector<VkDescriptorSet> cameraDescriptorSets;
+    std::vector<VkDescriptorSet> modelDescriptorSets;
+    std::vector<VkDescriptorSet> grassDescriptorSets;
+
+    VkPipelineLayout graphicsPipelineLayout;
+    VkPipelineLayout grassPipelineLayout;
+	// newly added
+	VkPipelineLayout deferredPipelineLayout;
+
+    VkPipeline graphicsPipeline;
+    VkPipeline grassPipeline;
+	// newly added
+	VkPipeline deferredPipeline;
+
+    std::vector<VkImageView> imageViews;
+    VkImage depthImage;
+    MemoryAllocation depthImageMemory;
+    VkImageView depthImageView;
+    std::vector<VkFramebuffer> framebuffers;
+
+    // Clipmap bake and culling, recorded the same way by every renderer
+    TerrainCompute* terrainCompute;
+
+    // Signaled by the compute submit of each frame, waited on by the graphics submit that draws its tiles
+    std::vector<VkSemaphore> computeSemaphores;
+
+    // Signaled when the graphics and compute work of a frame is done and its resources can be reused
+    std::vector<VkFence> frameFences;
+    std::vector<VkFence> computeFences;
+
+    // One per frame in flight and swap chain image, frame f of image i is at f * swapChain->GetCount() + i
+    std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<VkCommandBuffer> computeCommandBuffers;
+};
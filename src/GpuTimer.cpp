@@ -0,0 +1,112 @@
+#include <algorithm>
+#include "GpuTimer.h"
+#include "Instance.h"
+
+constexpr float GpuTimer::SMOOTHING;
+
+GpuTimer::GpuTimer(Device* device, uint32_t framesInFlight, const std::vector<std::string>& sections)
+  : device(device), framesInFlight(framesInFlight), sections(sections), submitted(framesInFlight, false), milliseconds(sections.size(), -1.0f) {
+
+    VkPhysicalDevice physicalDevice = device->GetInstance()->GetPhysicalDevice();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    // Sections run on both queues, only the bits valid on both are compared
+    uint32_t validBits = std::min(queueFamilies[device->GetQueueIndex(QueueFlags::Graphics)].timestampValidBits,
+                                  queueFamilies[device->GetQueueIndex(QueueFlags::Compute)].timestampValidBits);
+    supported = validBits > 0 && !sections.empty();
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    if (!supported) {
+        return;
+    }
+
+    // A begin and an end timestamp per section and frame in flight
+    VkQueryPoolCreateInfo queryPoolInfo = {};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * framesInFlight * static_cast<uint32_t>(sections.size());
+
+    if (vkCreateQueryPool(device->GetVkDevice(), &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool");
+    }
+}
+
+uint32_t GpuTimer::GetQuery(uint32_t frame, uint32_t section) const {
+    return 2 * (frame * static_cast<uint32_t>(sections.size()) + section);
+}
+
+void GpuTimer::RecordReset(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstSection, uint32_t sectionCount) const {
+    if (supported) {
+        vkCmdResetQueryPool(commandBuffer, queryPool, GetQuery(frame, firstSection), 2 * sectionCount);
+    }
+}
+
+void GpuTimer::RecordBegin(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t section) const {
+    if (supported) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, GetQuery(frame, section));
+    }
+}
+
+void GpuTimer::RecordEnd(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t section) const {
+    if (supported) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, GetQuery(frame, section) + 1);
+    }
+}
+
+void GpuTimer::MarkSubmitted(uint32_t frame) {
+    submitted[frame] = true;
+}
+
+void GpuTimer::Resolve(uint32_t frame) {
+    if (!supported || !submitted[frame]) {
+        return;
+    }
+
+    // Timestamp and availability of every query of the frame. Sections that were skipped, like culled passes, stay
+    // unavailable after their reset
+    uint32_t queryCount = 2 * static_cast<uint32_t>(sections.size());
+    std::vector<uint64_t> results(2 * queryCount);
+    VkResult result = vkGetQueryPoolResults(device->GetVkDevice(), queryPool, GetQuery(frame, 0), queryCount, results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result != VK_SUCCESS && result != VK_NOT_READY) {
+        throw std::runtime_error("Failed to get timestamp query results");
+    }
+
+    for (size_t i = 0; i < sections.size(); ++i) {
+        const uint64_t* begin = &results[4 * i];
+        const uint64_t* end = &results[4 * i + 2];
+        if (begin[1] == 0 || end[1] == 0) {
+            continue;
+        }
+
+        float sectionMilliseconds = static_cast<float>((end[0] - begin[0]) & timestampMask) * timestampPeriod * 1e-6f;
+        if (milliseconds[i] < 0.0f) {
+            milliseconds[i] = sectionMilliseconds;
+        } else {
+            milliseconds[i] += SMOOTHING * (sectionMilliseconds - milliseconds[i]);
+        }
+    }
+}
+
+std::vector<GpuTiming> GpuTimer::GetTimings() const {
+    std::vector<GpuTiming> timings;
+    for (size_t i = 0; i < sections.size(); ++i) {
+        if (milliseconds[i] >= 0.0f) {
+            timings.push_back({ sections[i], milliseconds[i] });
+        }
+    }
+    return timings;
+}
+
+GpuTimer::~GpuTimer() {
+    if (queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device->GetVkDevice(), queryPool, nullptr);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include "Device.h"
+
+// GPU time of one section of a frame, averaged over recent frames
+struct GpuTiming {
+    std::string name;
+    float milliseconds;
+};
+
+// Timestamp queries around named sections of pre-recorded command buffers. Every frame in flight has its own queries,
+// which are read back once the frame's fences have been waited on, so reading them never stalls
+class GpuTimer {
+private:
+    Device* device;
+    uint32_t framesInFlight;
+    std::vector<std::string> sections;
+
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    // Nothing is recorded if the graphics or compute queue has no timestamps
+    bool supported;
+    uint64_t timestampMask;
+    float timestampPeriod;
+
+    // Frames whose queries have been submitted at least once and can be read
+    std::vector<bool> submitted;
+    // Negative until a section has been timed
+    std::vector<float> milliseconds;
+
+    uint32_t GetQuery(uint32_t frame, uint32_t section) const;
+
+public:
+    // Weight of the newest frame in the averaged timings
+    static constexpr float SMOOTHING = 0.05f;
+
+    GpuTimer() = delete;
+    GpuTimer(Device* device, uint32_t framesInFlight, const std::vector<std::string>& sections);
+    ~GpuTimer();
+
+    // Outside of render passes, before the first section recorded to the command buffer. Sections that are reset but
+    // not recorded keep their previous timing
+    void RecordReset(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t firstSection, uint32_t sectionCount) const;
+    void RecordBegin(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t section) const;
+    void RecordEnd(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t section) const;
+
+    // After the frame's command buffers have been submitted
+    void MarkSubmitted(uint32_t frame);
+    // After waiting for the frame's fences and before submitting it again
+    void Resolve(uint32_t frame);
+
+    // Sections that have been timed at least once, in the order they were given
+    std::vector<GpuTiming> GetTimings() const;
+};
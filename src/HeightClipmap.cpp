@@ -0,0 +1,108 @@
+#include <vector>
+#include "HeightClipmap.h"
+#include "BufferUtils.h"
+#include "Image.h"
+
+constexpr VkFormat HeightClipmap::FORMAT;
+
+// Origin of a window that overlaps nothing, so that every level is fully baked the first time
+static constexpr int CLIPMAP_INVALID_ORIGIN = -(1 << 30);
+
+HeightClipmap::HeightClipmap(Device* device, uint32_t resolution, float baseTexelSize, float range)
+  : device(device), resolution(resolution), levelCount(1), baseTexelSize(baseTexelSize) {
+
+    // Toroidal addressing wraps texel coordinates with a mask
+    if (resolution == 0 || (resolution & (resolution - 1)) != 0) {
+        throw std::runtime_error("Failed to create height clipmap, resolution must be a power of two");
+    }
+
+    // Past the coarsest window the sampled heights wrap around, so it has to cover everything that is drawn
+    while (0.5f * resolution * baseTexelSize * static_cast<float>(1u << (levelCount - 1)) < range) {
+        ++levelCount;
+    }
+
+    // Baked on the compute queue and sampled on the graphics queue every frame, shared so that no ownership transfers are needed.
+    // The transfer queue only transitions it once
+    std::vector<uint32_t> queueFamilies = device->GetQueueFamilies(QueueFlagBit::GraphicsBit | QueueFlagBit::ComputeBit | QueueFlagBit::TransferBit);
+
+    Image::Create(device, resolution, resolution, FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory, 1, levelCount, queueFamilies);
+
+    // Baked by a compute shader and sampled by the tessellation evaluation shaders, so it lives in the general layout.
+    // Recorded with the renderer's startup uploads, which its first frame waits for
+    device->GetUploadManager()->TransitionImage(image, 1, levelCount, VK_IMAGE_LAYOUT_GENERAL);
+
+    imageView = Image::CreateView(device, image, FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, VK_IMAGE_VIEW_TYPE_2D_ARRAY, levelCount);
+
+    // Bilinear within a level, repeating so that the window can wrap around the texture
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = samplerInfo.addressModeU;
+    samplerInfo.addressModeW = samplerInfo.addressModeU;
+    samplerInfo.mipLodBias = 0.0f;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = 0.0f;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+
+    if (vkCreateSampler(device->GetVkDevice(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create height clipmap sampler");
+    }
+
+    // Start every level with a window that overlaps nothing
+    std::vector<char> state(GetStateBufferSize());
+
+    ClipmapStateHeader* header = reinterpret_cast<ClipmapStateHeader*>(state.data());
+    header->baseTexelSize = baseTexelSize;
+    header->levelCount = levelCount;
+
+    ClipmapLevelState* levels = reinterpret_cast<ClipmapLevelState*>(state.data() + sizeof(ClipmapStateHeader));
+    for (uint32_t i = 0; i < levelCount; ++i) {
+        levels[i].origin = glm::ivec2(CLIPMAP_INVALID_ORIGIN);
+        levels[i].previousOrigin = glm::ivec2(CLIPMAP_INVALID_ORIGIN);
+    }
+
+    BufferUtils::CreateBufferFromData(device, state.data(), GetStateBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, stateBuffer, stateBufferMemory, queueFamilies);
+}
+
+uint32_t HeightClipmap::GetResolution() const {
+    return resolution;
+}
+
+uint32_t HeightClipmap::GetLevelCount() const {
+    return levelCount;
+}
+
+VkImage HeightClipmap::GetImage() const {
+    return image;
+}
+
+VkImageView HeightClipmap::GetImageView() const {
+    return imageView;
+}
+
+VkSampler HeightClipmap::GetSampler() const {
+    return sampler;
+}
+
+VkBuffer HeightClipmap::GetStateBuffer() const {
+    return stateBuffer;
+}
+
+VkDeviceSize HeightClipmap::GetStateBufferSize() const {
+    return sizeof(ClipmapStateHeader) + levelCount * sizeof(ClipmapLevelState);
+}
+
+HeightClipmap::~HeightClipmap() {
+    vkDestroyBuffer(device->GetVkDevice(), stateBuffer, nullptr);
+    device->GetAllocator()->Free(stateBufferMemory);
+
+    vkDestroySampler(device->GetVkDevice(), sampler, nullptr);
+    vkDestroyImageView(device->GetVkDevice(), imageView, nullptr);
+
+    vkDestroyImage(device->GetVkDevice(), image, nullptr);
+    device->GetAllocator()->Free(imageMemory);
+}
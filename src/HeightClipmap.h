@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include "Device.h"
+
+// Start of the clipmap state buffer, followed by one ClipmapLevelState per level (std430, see clipmap.comp)
+struct ClipmapStateHeader {
+    float baseTexelSize;
+    uint32_t levelCount;
+};
+
+// Window of one level in texels of that level, advanced on the GPU every frame
+struct ClipmapLevelState {
+    glm::ivec2 origin;
+    // Window the level was baked for last frame, texels outside of it are baked again
+    glm::ivec2 previousOrigin;
+};
+
+// Terrain height and gradient baked into nested square windows around the camera, one array layer per level.
+// Each level has twice the texel size of the one before it and is addressed toroidally, so that moving the
+// camera only re-bakes the rows and columns that scrolled into view
+class HeightClipmap {
+private:
+    Device* device;
+
+    uint32_t resolution;
+    uint32_t levelCount;
+    float baseTexelSize;
+
+    VkImage image;
+    MemoryAllocation imageMemory;
+    // 2D array view over all levels, used both to bake and to sample
+    VkImageView imageView;
+    VkSampler sampler;
+
+    VkBuffer stateBuffer;
+    MemoryAllocation stateBufferMemory;
+
+public:
+    static constexpr VkFormat FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+    HeightClipmap() = delete;
+    // resolution must be a power of two. Levels are added until the coarsest window reaches range from its center
+    // along x and z
+    HeightClipmap(Device* device, uint32_t resolution, float baseTexelSize, float range);
+    ~HeightClipmap();
+
+    uint32_t GetResolution() const;
+    uint32_t GetLevelCount() const;
+
+    VkImage GetImage() const;
+    VkImageView GetImageView() const;
+    VkSampler GetSampler() const;
+    VkBuffer GetStateBuffer() const;
+    VkDeviceSize GetStateBufferSize() const;
+};
@@ -1,12 +1,14 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include "Image.h"
 #include "Device.h"
 #include "Instance.h"
-#include "BufferUtils.h"
 
-void Image::Create(Device* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void Image::Create(Device* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, uint32_t mipLevels, uint32_t arrayLayers, const std::vector<uint32_t>& queueFamilies) {
     // Create Vulkan image
     VkImageCreateInfo imageInfo = {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -14,133 +16,47 @@ void Image::Create(Device* device, uint32_t width, uint32_t height, VkFormat for
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
-    imageInfo.arrayLayers = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = arrayLayers;
     imageInfo.format = format;
     imageInfo.tiling = tiling;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageInfo.usage = usage;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (queueFamilies.size() > 1) {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        imageInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
 
     if (vkCreateImage(device->GetVkDevice(), &imageInfo, nullptr, &image) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create image");
     }
 
-    // Allocate memory for the image
+    // Carve memory for the image out of a shared block
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(device->GetVkDevice(), image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = device->GetInstance()->GetMemoryTypeIndex(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device->GetVkDevice(), &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate image memory");
-    }
+    imageMemory = device->GetAllocator()->Allocate(memRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
 
     // Bind the image
-    vkBindImageMemory(device->GetVkDevice(), image, imageMemory, 0);
+    vkBindImageMemory(device->GetVkDevice(), image, imageMemory.memory, imageMemory.offset);
 }
 
-void Image::TransitionLayout(Device* device, VkCommandPool commandPool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-    auto hasStencilComponent = [](VkFormat format) {
-        return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
-  };
-
-    // Use an image memory barrier (type of pipeline barrier) to transition image layout
-    VkImageMemoryBarrier barrier = {};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-  
-    if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    
-        if (hasStencilComponent(format)) {
-            barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-        }
-    }
-    else {
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    }
-  
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-  
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-  
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    } else {
-        throw std::invalid_argument("Unsupported layout transition");
-    }
-
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device->GetVkDevice(), &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-  
-    vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-  
-    vkEndCommandBuffer(commandBuffer);
-    
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(device->GetQueue(QueueFlags::Graphics), 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(device->GetQueue(QueueFlags::Graphics));
-    vkFreeCommandBuffers(device->GetVkDevice(), commandPool, 1, &commandBuffer);
-}
-
-VkImageView Image::CreateView(Device* device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
+VkImageView Image::CreateView(Device* device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel, uint32_t levelCount, VkImageViewType viewType, uint32_t layerCount) {
     VkImageViewCreateInfo viewInfo = {};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = image;
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.viewType = viewType;
     viewInfo.format = format;
 
     // Describe the image's purpose and which part of the image should be accessed
     viewInfo.subresourceRange.aspectMask = aspectFlags;
-    viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+    viewInfo.subresourceRange.levelCount = levelCount;
     viewInfo.subresourceRange.baseArrayLayer = 0;
-    viewInfo.subresourceRange.layerCount = 1;
+    viewInfo.subresourceRange.layerCount = layerCount;
 
     VkImageView imageView;
     if (vkCreateImageView(device->GetVkDevice(), &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
@@ -150,88 +66,221 @@ VkImageView Image::CreateView(Device* device, VkImage image, VkFormat format, Vk
     return imageView;
 }
 
-void Image::CopyFromBuffer(Device* device, VkCommandPool commandPool, VkBuffer buffer, VkImage& image, uint32_t width, uint32_t height) {
-    // Specify which part of the buffer is going to be copied to which part of the image
-    VkBufferImageCopy region = {};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
+uint32_t Image::GetMipLevelCount(uint32_t width, uint32_t height) {
+    uint32_t mipLevels = 1;
+    while ((std::max(width, height) >> mipLevels) > 0) {
+        ++mipLevels;
+    }
+    return mipLevels;
+}
 
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
+uint64_t Image::FromFile(Device* device, const char* path, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkImageLayout layout, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, uint32_t& mipLevels) {
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load(path, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    VkDeviceSize imageSize = texWidth * texHeight * 4;
 
-    region.imageOffset = { 0, 0, 0 };
-    region.imageExtent = { width, height, 1 };
+    if (!pixels) {
+        throw std::runtime_error("Failed to load texture image");
+    }
 
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
+    // Mips are blitted from the first level, which needs linear filtering of the format
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(device->GetInstance()->GetPhysicalDevice(), format, &formatProperties);
+    VkFormatFeatureFlags tilingFeatures = tiling == VK_IMAGE_TILING_OPTIMAL ? formatProperties.optimalTilingFeatures : formatProperties.linearTilingFeatures;
+    VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    bool generateMips = (tilingFeatures & blitFeatures) == blitFeatures;
+    mipLevels = generateMips ? GetMipLevelCount(texWidth, texHeight) : 1;
 
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device->GetVkDevice(), &allocInfo, &commandBuffer);
+    // Create Vulkan image
+    VkImageUsageFlags uploadUsage = generateMips ? VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT : VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    Image::Create(device, texWidth, texHeight, format, tiling, uploadUsage | usage, properties, image, imageMemory, mipLevels);
 
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    // Copy pixel values to the staging ring, then transition the image, copy and hand it over to the graphics queue for shader access in the open upload batch
+    uint64_t uploadId;
+    if (generateMips) {
+        uploadId = device->GetUploadManager()->UploadToImageWithMips(pixels, imageSize, image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), mipLevels, layout);
+    } else {
+        uploadId = device->GetUploadManager()->UploadToImage(pixels, imageSize, image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), layout, device->GetQueueIndex(QueueFlags::Graphics));
+    }
 
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    // Free pixel array
+    stbi_image_free(pixels);
 
-    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    return uploadId;
+}
 
-    vkEndCommandBuffer(commandBuffer);
+namespace {
+    // See the DDS_HEADER, DDS_PIXELFORMAT and DDS_HEADER_DXT10 structures of the DirectX documentation
+    constexpr uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+    constexpr uint32_t DDS_PIXEL_FORMAT_FOURCC = 0x4;
+
+    struct DDSPixelFormat {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t fourCC;
+        uint32_t rgbBitCount;
+        uint32_t bitMasks[4];
+    };
+
+    struct DDSHeader {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        DDSPixelFormat pixelFormat;
+        uint32_t caps[4];
+        uint32_t reserved2;
+    };
+
+    struct DDSHeaderDXT10 {
+        uint32_t dxgiFormat;
+        uint32_t resourceDimension;
+        uint32_t miscFlag;
+        uint32_t arraySize;
+        uint32_t miscFlags2;
+    };
+
+    constexpr uint32_t makeFourCC(char a, char b, char c, char d) {
+        return (uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24);
+    }
 
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
+    // Vulkan format of the block-compressed formats the terrain uses, undefined for anything else
+    VkFormat getDDSFormat(const DDSPixelFormat& pixelFormat, const DDSHeaderDXT10* headerDXT10) {
+        if (headerDXT10 != nullptr) {
+            switch (headerDXT10->dxgiFormat) {
+            case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK; // DXGI_FORMAT_BC1_UNORM
+            case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;  // DXGI_FORMAT_BC1_UNORM_SRGB
+            case 77: return VK_FORMAT_BC3_UNORM_BLOCK;      // DXGI_FORMAT_BC3_UNORM
+            case 78: return VK_FORMAT_BC3_SRGB_BLOCK;       // DXGI_FORMAT_BC3_UNORM_SRGB
+            case 98: return VK_FORMAT_BC7_UNORM_BLOCK;      // DXGI_FORMAT_BC7_UNORM
+            case 99: return VK_FORMAT_BC7_SRGB_BLOCK;       // DXGI_FORMAT_BC7_UNORM_SRGB
+            default: return VK_FORMAT_UNDEFINED;
+            }
+        }
+        if (pixelFormat.fourCC == makeFourCC('D', 'X', 'T', '1')) {
+            return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        }
+        if (pixelFormat.fourCC == makeFourCC('D', 'X', 'T', '5')) {
+            return VK_FORMAT_BC3_UNORM_BLOCK;
+        }
+        return VK_FORMAT_UNDEFINED;
+    }
+}
 
-    vkQueueSubmit(device->GetQueue(QueueFlags::Transfer), 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(device->GetQueue(QueueFlags::Transfer));
-    vkFreeCommandBuffers(device->GetVkDevice(), commandPool, 1, &commandBuffer);
+uint32_t Image::GetBlockDim(VkFormat format) {
+    return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK ? 4 : 1;
 }
 
-void Image::FromFile(Device* device, VkCommandPool commandPool, const char* path, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkImageLayout layout, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
-    int texWidth, texHeight, texChannels;
-    stbi_uc* pixels = stbi_load(path, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
+uint32_t Image::GetBlockBytes(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return 16;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        return 4;
+    default:
+        throw std::invalid_argument("Unsupported texture format");
+    }
+}
 
-    if (!pixels) {
-        throw std::runtime_error("Failed to load texture image");
+VkDeviceSize Image::GetLevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level) {
+    uint32_t blockDim = GetBlockDim(format);
+    uint32_t levelWidth = std::max(width >> level, 1u);
+    uint32_t levelHeight = std::max(height >> level, 1u);
+    return (VkDeviceSize)((levelWidth + blockDim - 1) / blockDim) * ((levelHeight + blockDim - 1) / blockDim) * GetBlockBytes(format);
+}
+
+VkBufferImageCopy Image::GetLevelRegion(uint32_t width, uint32_t height, uint32_t level, VkDeviceSize bufferOffset) {
+    VkBufferImageCopy region = {};
+    region.bufferOffset = bufferOffset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = level;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { std::max(width >> level, 1u), std::max(height >> level, 1u), 1 };
+    return region;
+}
+
+size_t Image::ParseDDSHeader(const char* data, size_t size, VkFormat& format, uint32_t& width, uint32_t& height, uint32_t& mipLevels) {
+    uint32_t magic;
+    DDSHeader header;
+    if (size < sizeof(magic) + sizeof(DDSHeader)) {
+        throw std::runtime_error("Failed to load texture image, truncated DDS header");
+    }
+    memcpy(&magic, data, sizeof(magic));
+    memcpy(&header, data + sizeof(magic), sizeof(DDSHeader));
+    size_t dataOffset = sizeof(magic) + sizeof(DDSHeader);
+    if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || (header.pixelFormat.flags & DDS_PIXEL_FORMAT_FOURCC) == 0) {
+        throw std::runtime_error("Failed to load texture image, not a block-compressed DDS file");
     }
 
-    // Create staging buffer
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    DDSHeaderDXT10 headerDXT10;
+    bool hasHeaderDXT10 = header.pixelFormat.fourCC == makeFourCC('D', 'X', '1', '0');
+    if (hasHeaderDXT10) {
+        if (size < dataOffset + sizeof(DDSHeaderDXT10)) {
+            throw std::runtime_error("Failed to load texture image, truncated DDS header");
+        }
+        memcpy(&headerDXT10, data + dataOffset, sizeof(DDSHeaderDXT10));
+        dataOffset += sizeof(DDSHeaderDXT10);
+    }
 
-    VkBufferUsageFlags stagingUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    VkMemoryPropertyFlags stagingProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    BufferUtils::CreateBuffer(device, imageSize, stagingUsage, stagingProperties, stagingBuffer, stagingBufferMemory);
+    format = getDDSFormat(header.pixelFormat, hasHeaderDXT10 ? &headerDXT10 : nullptr);
+    if (format == VK_FORMAT_UNDEFINED) {
+        throw std::runtime_error("Failed to load texture image, unsupported DDS format");
+    }
 
-    // Copy pixel values to the buffer
-    void* data;
-    vkMapMemory(device->GetVkDevice(), stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(device->GetVkDevice(), stagingBufferMemory);
+    width = header.width;
+    height = header.height;
+    mipLevels = std::min(std::max(header.mipMapCount, 1u), GetMipLevelCount(width, height));
+    return dataOffset;
+}
 
-    // Free pixel array
-    stbi_image_free(pixels);
+uint64_t Image::FromDDSFile(Device* device, const char* path, VkImageUsageFlags usage, VkImageLayout layout, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, VkFormat& format, uint32_t& mipLevels) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to load texture image");
+    }
 
-    // Create Vulkan image
-    Image::Create(device, texWidth, texHeight, format, tiling, VK_IMAGE_USAGE_TRANSFER_DST_BIT | usage, properties, image, imageMemory);
+    std::vector<char> fileData(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(fileData.data(), fileData.size());
+
+    uint32_t width, height;
+    size_t dataOffset = ParseDDSHeader(fileData.data(), fileData.size(), format, width, height, mipLevels);
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(device->GetInstance()->GetPhysicalDevice(), format, &formatProperties);
+    if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == 0) {
+        throw std::runtime_error("Failed to load texture image, block-compressed format not supported by the device");
+    }
+
+    // Levels are stored largest first, each as rows of 4x4 blocks
+    std::vector<VkBufferImageCopy> regions(mipLevels);
+    VkDeviceSize levelOffset = 0;
+    for (uint32_t level = 0; level < mipLevels; ++level) {
+        regions[level] = GetLevelRegion(width, height, level, levelOffset);
+        levelOffset += GetLevelSize(format, width, height, level);
+    }
 
-    // Copy the staging buffer to the texture image
-    // --> First need to transition the texture image to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-    Image::TransitionLayout(device, commandPool, image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    Image::CopyFromBuffer(device, commandPool, stagingBuffer, image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+    if (fileData.size() < dataOffset + levelOffset) {
+        throw std::runtime_error("Failed to load texture image, truncated DDS mip chain");
+    }
 
-    // Transition texture image for shader access
-    Image::TransitionLayout(device, commandPool, image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layout);
+    Image::Create(device, width, height, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | usage, properties, image, imageMemory, mipLevels);
 
-    // No need for staging buffer anymore
-    vkDestroyBuffer(device->GetVkDevice(), stagingBuffer, nullptr);
-    vkFreeMemory(device->GetVkDevice(), stagingBufferMemory, nullptr);
+    // The whole chain goes through the staging ring in one copy, handed over to the graphics queue like FromFile
+    return device->GetUploadManager()->UploadToImage(fileData.data() + dataOffset, levelOffset, image, regions, layout, device->GetQueueIndex(QueueFlags::Graphics));
 }
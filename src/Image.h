@@ -1,13 +1,29 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <vector>
 #include "Device.h"
 
 namespace Image {
 
-    void Create(Device* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
-    void TransitionLayout(Device* device, VkCommandPool commandPool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-    VkImageView CreateView(Device* device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
-    void CopyFromBuffer(Device* device, VkCommandPool commandPool, VkBuffer buffer, VkImage& image, uint32_t width, uint32_t height);
-    void FromFile(Device* device, VkCommandPool commandPool, const char* path, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkImageLayout layout, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+    // Owned by one queue family at a time, unless more than one queueFamilies are given to share it concurrently
+    void Create(Device* device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, uint32_t mipLevels = 1, uint32_t arrayLayers = 1, const std::vector<uint32_t>& queueFamilies = {});
+    VkImageView CreateView(Device* device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel = 0, uint32_t levelCount = 1, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t layerCount = 1);
+    // Levels of a full mip chain down to 1x1
+    uint32_t GetMipLevelCount(uint32_t width, uint32_t height);
+    // Returns without waiting for the copy, the returned id is waited on with the device's UploadManager before first use.
+    // The decoded image gets a full mip chain blitted on the graphics queue if format supports it, otherwise just one level
+    uint64_t FromFile(Device* device, const char* path, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkImageLayout layout, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, uint32_t& mipLevels);
+    // Texel block width and height, and bytes per block, of the formats textures are loaded as
+    uint32_t GetBlockDim(VkFormat format);
+    uint32_t GetBlockBytes(VkFormat format);
+    VkDeviceSize GetLevelSize(VkFormat format, uint32_t width, uint32_t height, uint32_t level);
+    // Copy of a whole tightly packed level at bufferOffset
+    VkBufferImageCopy GetLevelRegion(uint32_t width, uint32_t height, uint32_t level, VkDeviceSize bufferOffset);
+    // Magic, header and DX10 header, the most ParseDDSHeader reads
+    constexpr size_t DDS_MAX_HEADER_SIZE = 148;
+    // Reads the header of a BC1, BC3 or BC7 DDS file, levels follow it largest first at the returned offset
+    size_t ParseDDSHeader(const char* data, size_t size, VkFormat& format, uint32_t& width, uint32_t& height, uint32_t& mipLevels);
+    // Loads a block-compressed BC1, BC3 or BC7 DDS file with the mips stored in it, which brings its own format
+    uint64_t FromDDSFile(Device* device, const char* path, VkImageUsageFlags usage, VkImageLayout layout, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, VkFormat& format, uint32_t& mipLevels);
 }
@@ -215,6 +215,28 @@ namespace {
             i++;
         }
 
+        // Prefer a family without graphics for compute, so that culling runs on an async compute queue
+        // alongside the graphics work instead of being serialized with it
+        if (requiredQueues[QueueFlags::Compute]) {
+            for (uint32_t j = 0; j < queueFamilyCount; ++j) {
+                if (queueFamilies[j].queueCount > 0 && (queueFamilies[j].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilies[j].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+                    indices[QueueFlags::Compute] = j;
+                    break;
+                }
+            }
+        }
+
+        // Prefer a transfer only family, which maps to the copy engines, so that uploads run alongside rendering.
+        // Its image transfer granularity may be coarse, but uploads always copy whole mips
+        if (requiredQueues[QueueFlags::Transfer]) {
+            for (uint32_t j = 0; j < queueFamilyCount; ++j) {
+                if (queueFamilies[j].queueCount > 0 && (queueFamilies[j].queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamilies[j].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                    indices[QueueFlags::Transfer] = j;
+                    break;
+                }
+            }
+        }
+
         return indices;
     }
 
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <stdexcept>
+#include "MemoryAllocator.h"
+#include "Device.h"
+#include "Instance.h"
+
+constexpr VkDeviceSize MemoryAllocator::DEFAULT_BLOCK_SIZE;
+
+MemoryAllocator::MemoryAllocator(Device* device, VkDeviceSize blockSize)
+  : device(device), blockSize(blockSize), blocks(VK_MAX_MEMORY_TYPES) {
+}
+
+bool MemoryAllocator::Carve(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+    // First fit
+    for (size_t i = 0; i < block.freeRanges.size(); ++i) {
+        FreeRange range = block.freeRanges[i];
+        VkDeviceSize alignedOffset = (range.offset + alignment - 1) / alignment * alignment;
+        if (alignedOffset + size > range.offset + range.size) {
+            continue;
+        }
+
+        // Keep the padding in front and the rest behind the allocation free
+        block.freeRanges.erase(block.freeRanges.begin() + i);
+        if (alignedOffset + size < range.offset + range.size) {
+            FreeRange after = { alignedOffset + size, range.offset + range.size - alignedOffset - size };
+            block.freeRanges.insert(block.freeRanges.begin() + i, after);
+        }
+        if (alignedOffset > range.offset) {
+            FreeRange before = { range.offset, alignedOffset - range.offset };
+            block.freeRanges.insert(block.freeRanges.begin() + i, before);
+        }
+
+        block.allocationCount++;
+        offset = alignedOffset;
+        return true;
+    }
+    return false;
+}
+
+MemoryAllocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    MemoryAllocation allocation;
+    allocation.memoryTypeIndex = device->GetInstance()->GetMemoryTypeIndex(requirements.memoryTypeBits, properties);
+    allocation.size = requirements.size;
+
+    std::vector<Block>& typeBlocks = blocks[allocation.memoryTypeIndex];
+    for (Block& block : typeBlocks) {
+        if (block.linear == linear && Carve(block, requirements.size, requirements.alignment, allocation.offset)) {
+            allocation.memory = block.memory;
+            return allocation;
+        }
+    }
+
+    // No room left, start a new block
+    Block block = {};
+    block.size = std::max(blockSize, requirements.size);
+    block.linear = linear;
+    block.freeRanges.push_back({ 0, block.size });
+    block.allocationCount = 0;
+    block.mapped = nullptr;
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = block.size;
+    allocInfo.memoryTypeIndex = allocation.memoryTypeIndex;
+
+    if (vkAllocateMemory(device->GetVkDevice(), &allocInfo, nullptr, &block.memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate memory block");
+    }
+
+    Carve(block, requirements.size, requirements.alignment, allocation.offset);
+    allocation.memory = block.memory;
+    typeBlocks.push_back(block);
+    return allocation;
+}
+
+void MemoryAllocator::Free(const MemoryAllocation& allocation) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<Block>& typeBlocks = blocks[allocation.memoryTypeIndex];
+    auto block = std::find_if(typeBlocks.begin(), typeBlocks.end(), [&](const Block& b) { return b.memory == allocation.memory; });
+    if (block == typeBlocks.end()) {
+        throw std::runtime_error("Failed to free memory, allocation does not belong to any block");
+    }
+
+    // Keep one empty block of each memory type, so that short-lived staging buffers do not allocate a block every time
+    if (--block->allocationCount == 0) {
+        bool keep = block->size == blockSize && std::none_of(typeBlocks.begin(), typeBlocks.end(), [&](const Block& b) { return b.memory != block->memory && b.allocationCount == 0; });
+        if (keep) {
+            block->freeRanges.assign(1, { 0, block->size });
+            return;
+        }
+
+        if (block->mapped != nullptr) {
+            vkUnmapMemory(device->GetVkDevice(), block->memory);
+        }
+        vkFreeMemory(device->GetVkDevice(), block->memory, nullptr);
+        typeBlocks.erase(block);
+        return;
+    }
+
+    // Insert in offset order and merge with the free neighbours
+    FreeRange range = { allocation.offset, allocation.size };
+    auto next = std::find_if(block->freeRanges.begin(), block->freeRanges.end(), [&](const FreeRange& r) { return r.offset > range.offset; });
+    if (next != block->freeRanges.end() && range.offset + range.size == next->offset) {
+        range.size += next->size;
+        next = block->freeRanges.erase(next);
+    }
+    if (next != block->freeRanges.begin()) {
+        auto previous = next - 1;
+        if (previous->offset + previous->size == range.offset) {
+            previous->size += range.size;
+            return;
+        }
+    }
+    block->freeRanges.insert(next, range);
+}
+
+void* MemoryAllocator::Map(const MemoryAllocation& allocation) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<Block>& typeBlocks = blocks[allocation.memoryTypeIndex];
+    auto block = std::find_if(typeBlocks.begin(), typeBlocks.end(), [&](const Block& b) { return b.memory == allocation.memory; });
+    if (block == typeBlocks.end()) {
+        throw std::runtime_error("Failed to map memory, allocation does not belong to any block");
+    }
+
+    // A memory object can only be mapped once, so the whole block is mapped for every allocation in it
+    if (block->mapped == nullptr && vkMapMemory(device->GetVkDevice(), block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map memory block");
+    }
+    return static_cast<char*>(block->mapped) + allocation.offset;
+}
+
+MemoryAllocatorStats MemoryAllocator::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    MemoryAllocatorStats stats = {};
+    VkDeviceSize freeBytes = 0;
+    for (const std::vector<Block>& typeBlocks : blocks) {
+        for (const Block& block : typeBlocks) {
+            stats.blockCount++;
+            stats.blockBytes += block.size;
+            stats.allocationCount += block.allocationCount;
+            stats.freeRangeCount += static_cast<uint32_t>(block.freeRanges.size());
+            for (const FreeRange& range : block.freeRanges) {
+                freeBytes += range.size;
+                stats.largestFreeRange = std::max(stats.largestFreeRange, range.size);
+            }
+        }
+    }
+    stats.usedBytes = stats.blockBytes - freeBytes;
+    stats.fragmentation = freeBytes > 0 ? 1.0f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(freeBytes) : 0.0f;
+    return stats;
+}
+
+MemoryAllocator::~MemoryAllocator() {
+    for (std::vector<Block>& typeBlocks : blocks) {
+        for (Block& block : typeBlocks) {
+            if (block.mapped != nullptr) {
+                vkUnmapMemory(device->GetVkDevice(), block.memory);
+            }
+            vkFreeMemory(device->GetVkDevice(), block.memory, nullptr);
+        }
+    }
+}
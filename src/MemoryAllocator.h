@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <mutex>
+#include <vector>
+
+class Device;
+
+// Range of a memory block handed out by MemoryAllocator, bind resources at memory + offset
+struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memoryTypeIndex = 0;
+};
+
+struct MemoryAllocatorStats {
+    // Live vkAllocateMemory allocations and their total size
+    uint32_t blockCount;
+    VkDeviceSize blockBytes;
+    // Ranges handed out and their total size
+    uint32_t allocationCount;
+    VkDeviceSize usedBytes;
+    // Holes between allocations. Free space spread over many small holes means the blocks are fragmented,
+    // fragmentation is 1 - largestFreeRange / free bytes
+    uint32_t freeRangeCount;
+    VkDeviceSize largestFreeRange;
+    float fragmentation;
+};
+
+// Carves buffers and images out of a few large vkAllocateMemory blocks per memory type, instead of one allocation
+// per resource. Drivers limit the number of live allocations (maxMemoryAllocationCount) and allocating is slow
+class MemoryAllocator {
+private:
+    struct FreeRange {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    struct Block {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        // Buffers and linear images never share a block with optimal images, so neighbours in a block
+        // never have to be bufferImageGranularity apart
+        bool linear;
+        // Sorted by offset, adjacent ranges are merged when freeing
+        std::vector<FreeRange> freeRanges;
+        uint32_t allocationCount;
+        // Mapped as a whole on the first Map and until the block is released
+        void* mapped;
+    };
+
+    Device* device;
+    VkDeviceSize blockSize;
+
+    // Blocks of each memory type
+    std::vector<std::vector<Block>> blocks;
+    std::mutex mutex;
+
+    static bool Carve(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+
+public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+    MemoryAllocator() = delete;
+    MemoryAllocator(Device* device, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+    ~MemoryAllocator();
+
+    // linear is true for buffers and linearly tiled images. Larger requests than the block size get a block of their own
+    MemoryAllocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear);
+    // Empty blocks are released, except for one per memory type
+    void Free(const MemoryAllocation& allocation);
+    // Host address of a host visible allocation, valid until it is freed
+    void* Map(const MemoryAllocation& allocation);
+
+    MemoryAllocatorStats GetStats();
+};
@@ -1,35 +1,44 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include "Model.h"
 #include "BufferUtils.h"
 #include "Image.h"
+#include "Instance.h"
 
-Model::Model(Device* device, VkCommandPool commandPool, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices)
+Model::Model(Device* device, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices)
   : device(device), vertices(vertices), indices(indices) {
 
     if (vertices.size() > 0) {
-        BufferUtils::CreateBufferFromData(device, commandPool, this->vertices.data(), vertices.size() * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexBufferMemory);
+        BufferUtils::CreateBufferFromData(device, this->vertices.data(), vertices.size() * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexBufferMemory);
     }
 
     if (indices.size() > 0) {
-        BufferUtils::CreateBufferFromData(device, commandPool, this->indices.data(), indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexBufferMemory);
+        BufferUtils::CreateBufferFromData(device, this->indices.data(), indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexBufferMemory);
     }
 
     modelBufferObject.modelMatrix = glm::mat4(1.0f);
-    BufferUtils::CreateBufferFromData(device, commandPool, &modelBufferObject, sizeof(ModelBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, modelBuffer, modelBufferMemory);
+    modelBufferObject.textureMinLod = 0.0f;
+
+    // Host visible, so that the texture's residency can be updated while it streams in
+    BufferUtils::CreateBuffer(device, sizeof(ModelBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, modelBuffer, modelBufferMemory);
+    mappedModelBuffer = device->GetAllocator()->Map(modelBufferMemory);
+    memcpy(mappedModelBuffer, &modelBufferObject, sizeof(ModelBufferObject));
 }
 
 Model::~Model() {
     if (indices.size() > 0) {
         vkDestroyBuffer(device->GetVkDevice(), indexBuffer, nullptr);
-        vkFreeMemory(device->GetVkDevice(), indexBufferMemory, nullptr);
+        device->GetAllocator()->Free(indexBufferMemory);
     }
 
     if (vertices.size() > 0) {
         vkDestroyBuffer(device->GetVkDevice(), vertexBuffer, nullptr);
-        vkFreeMemory(device->GetVkDevice(), vertexBufferMemory, nullptr);
+        device->GetAllocator()->Free(vertexBufferMemory);
     }
 
     vkDestroyBuffer(device->GetVkDevice(), modelBuffer, nullptr);
-    vkFreeMemory(device->GetVkDevice(), modelBufferMemory, nullptr);
+    device->GetAllocator()->Free(modelBufferMemory);
 
     if (textureView != VK_NULL_HANDLE) {
         vkDestroyImageView(device->GetVkDevice(), textureView, nullptr);
@@ -40,9 +49,9 @@ Model::~Model() {
     }
 }
 
-void Model::SetTexture(VkImage texture) {
+void Model::SetTexture(VkImage texture, VkFormat format, uint32_t mipLevels) {
     this->texture = texture;
-    this->textureView = Image::CreateView(device, texture, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+    this->textureView = Image::CreateView(device, texture, format, VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels);
 
     // --- Specify all filters and transformations ---
     VkSamplerCreateInfo samplerInfo = {};
@@ -58,8 +67,10 @@ void Model::SetTexture(VkImage texture) {
     samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 
     // Anisotropic filtering
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device->GetInstance()->GetPhysicalDevice(), &properties);
     samplerInfo.anisotropyEnable = VK_TRUE;
-    samplerInfo.maxAnisotropy = 16;
+    samplerInfo.maxAnisotropy = std::min(16.0f, properties.limits.maxSamplerAnisotropy);
 
     // Border color
     samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
@@ -75,13 +86,18 @@ void Model::SetTexture(VkImage texture) {
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(mipLevels);
 
     if (vkCreateSampler(device->GetVkDevice(), &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create texture sampler");
     }
 }
 
+void Model::SetTextureMinLod(float minLod) {
+    modelBufferObject.textureMinLod = minLod;
+    memcpy(static_cast<char*>(mappedModelBuffer) + offsetof(ModelBufferObject, textureMinLod), &minLod, sizeof(float));
+}
+
 const std::vector<Vertex>& Model::getVertices() const {
     return vertices;
 }
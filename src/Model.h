@@ -9,6 +9,8 @@
 
 struct ModelBufferObject {
     glm::mat4 modelMatrix;
+    // Finest mip of the texture that is resident, shaders sampling it clamp their level of detail to this
+    float textureMinLod;
 };
 
 class Model {
@@ -17,14 +19,15 @@ protected:
 
     std::vector<Vertex> vertices;
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    MemoryAllocation vertexBufferMemory;
 
     std::vector<uint32_t> indices;
     VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
+    MemoryAllocation indexBufferMemory;
 
     VkBuffer modelBuffer;
-    VkDeviceMemory modelBufferMemory;
+    MemoryAllocation modelBufferMemory;
+    void* mappedModelBuffer;
 
     ModelBufferObject modelBufferObject;
 
@@ -34,10 +37,14 @@ protected:
 
 public:
     Model() = delete;
-    Model(Device* device, VkCommandPool commandPool, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices);
+    Model(Device* device, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices);
     virtual ~Model();
 
-    void SetTexture(VkImage texture);
+    // Samples every one of mipLevels, with anisotropic filtering
+    void SetTexture(VkImage texture, VkFormat format, uint32_t mipLevels);
+    // For textures that are still streaming in, every frame that might read the new value must be ordered after the
+    // levels it allows became resident
+    void SetTextureMinLod(float minLod);
 
     const std::vector<Vertex>& getVertices() const;
 
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstddef>
+
+// Kernels and hashes selectable in noise.glsl
+enum NoiseKernel : int32_t {
+    NOISE_KERNEL_VALUE = 0,
+    NOISE_KERNEL_PERLIN = 1,
+    NOISE_KERNEL_SIMPLEX = 2,
+};
+
+// The sine hash depends on the precision of each driver's sin, the integer hash is the same everywhere,
+// so Terrain follows it exactly and it is the default
+enum NoiseHash : int32_t {
+    NOISE_HASH_SINE = 0,
+    NOISE_HASH_INTEGER = 1,
+};
+
+// Terrain noise settings, passed to noise.glsl as specialization constants. Members are in constant id order
+struct NoiseParams {
+    int32_t kernel = NOISE_KERNEL_VALUE;
+    int32_t hash = NOISE_HASH_INTEGER;
+    int32_t octaves = 6;
+    float lacunarity = 2.0f;
+    float gain = 0.5f;
+    uint32_t seed = 0;
+    // World space frequency and height scale of the fractal sum
+    float frequency = 0.125f;
+    float amplitude = 6.0f;
+
+    // Points into this struct, which must stay alive until the vkCreate*Pipelines call using it returns
+    VkSpecializationInfo GetSpecializationInfo() const {
+        static const std::array<VkSpecializationMapEntry, 8> mapEntries = { {
+            { 0, offsetof(NoiseParams, kernel), sizeof(int32_t) },
+            { 1, offsetof(NoiseParams, hash), sizeof(int32_t) },
+            { 2, offsetof(NoiseParams, octaves), sizeof(int32_t) },
+            { 3, offsetof(NoiseParams, lacunarity), sizeof(float) },
+            { 4, offsetof(NoiseParams, gain), sizeof(float) },
+            { 5, offsetof(NoiseParams, seed), sizeof(uint32_t) },
+            { 6, offsetof(NoiseParams, frequency), sizeof(float) },
+            { 7, offsetof(NoiseParams, amplitude), sizeof(float) },
+        } };
+
+        VkSpecializationInfo specializationInfo = {};
+        specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+        specializationInfo.pMapEntries = mapEntries.data();
+        specializationInfo.dataSize = sizeof(NoiseParams);
+        specializationInfo.pData = this;
+
+        return specializationInfo;
+    }
+};
@@ -0,0 +1,127 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include "PipelineCache.h"
+#include "Device.h"
+#include "Instance.h"
+
+constexpr uint32_t PipelineCache::FILE_MAGIC;
+
+namespace {
+    // Header the driver puts in front of its own data, see VkPipelineCacheHeaderVersion
+    struct VulkanPipelineCacheHeader {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    };
+
+    PipelineCacheFileHeader getExpectedHeader(Device* device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device->GetInstance()->GetPhysicalDevice(), &properties);
+
+        PipelineCacheFileHeader header = {};
+        header.magic = PipelineCache::FILE_MAGIC;
+        header.vendorID = properties.vendorID;
+        header.deviceID = properties.deviceID;
+        header.driverVersion = properties.driverVersion;
+        memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+        return header;
+    }
+
+    // Empty if the file is missing or was written for another device or driver
+    std::vector<char> readCacheFile(const std::string& path, const PipelineCacheFileHeader& expected) {
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            return {};
+        }
+
+        size_t fileSize = (size_t)file.tellg();
+        if (fileSize < sizeof(PipelineCacheFileHeader)) {
+            return {};
+        }
+
+        PipelineCacheFileHeader header;
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(&header), sizeof(PipelineCacheFileHeader));
+
+        bool matches = header.magic == expected.magic &&
+            header.vendorID == expected.vendorID &&
+            header.deviceID == expected.deviceID &&
+            header.driverVersion == expected.driverVersion &&
+            memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+            header.dataSize == fileSize - sizeof(PipelineCacheFileHeader) &&
+            header.dataSize >= sizeof(VulkanPipelineCacheHeader);
+        if (!matches) {
+            return {};
+        }
+
+        std::vector<char> data(static_cast<size_t>(header.dataSize));
+        file.read(data.data(), data.size());
+
+        // Drivers are meant to reject foreign data themselves, but some crash on it instead
+        VulkanPipelineCacheHeader vulkanHeader;
+        memcpy(&vulkanHeader, data.data(), sizeof(VulkanPipelineCacheHeader));
+        if (vulkanHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            vulkanHeader.vendorID != expected.vendorID ||
+            vulkanHeader.deviceID != expected.deviceID ||
+            memcmp(vulkanHeader.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+            return {};
+        }
+
+        return data;
+    }
+}
+
+PipelineCache::PipelineCache(Device* device, const std::string& path)
+  : device(device), path(path) {
+    std::vector<char> data = readCacheFile(path, getExpectedHeader(device));
+    warm = !data.empty();
+
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.data();
+
+    if (vkCreatePipelineCache(device->GetVkDevice(), &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache");
+    }
+}
+
+VkPipelineCache PipelineCache::GetVkPipelineCache() const {
+    return pipelineCache;
+}
+
+bool PipelineCache::IsWarm() const {
+    return warm;
+}
+
+void PipelineCache::Save() {
+    // Not being able to save the cache only costs the next startup some time, so failures are not errors
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(device->GetVkDevice(), pipelineCache, &dataSize, nullptr) != VK_SUCCESS) {
+        return;
+    }
+
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(device->GetVkDevice(), pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    PipelineCacheFileHeader header = getExpectedHeader(device);
+    header.dataSize = dataSize;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(PipelineCacheFileHeader));
+    file.write(data.data(), dataSize);
+}
+
+PipelineCache::~PipelineCache() {
+    Save();
+    vkDestroyPipelineCache(device->GetVkDevice(), pipelineCache, nullptr);
+}
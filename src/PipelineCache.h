@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+
+class Device;
+
+// Written in front of the cache data, so that a file from another GPU or driver is thrown away instead of handed to the driver
+struct PipelineCacheFileHeader {
+    uint32_t magic;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+};
+
+// VkPipelineCache loaded from disk on creation and written back on destruction, so that pipelines compiled in a
+// previous run are not compiled again
+class PipelineCache {
+private:
+    Device* device;
+    std::string path;
+    VkPipelineCache pipelineCache;
+    // Whether usable data was loaded from path
+    bool warm;
+
+public:
+    static constexpr uint32_t FILE_MAGIC = 0x48435056; // "VPCH"
+
+    PipelineCache() = delete;
+    PipelineCache(Device* device, const std::string& path);
+    ~PipelineCache();
+
+    VkPipelineCache GetVkPipelineCache() const;
+    bool IsWarm() const;
+
+    void Save();
+};
@@ -0,0 +1,875 @@
+#include <algorithm>
+#include <stdexcept>
+#include "RenderGraph.h"
+#include "Device.h"
+#include "Image.h"
+#include "Instance.h"
+
+namespace {
+    constexpr uint32_t NO_PASS = UINT32_MAX;
+
+    bool isDepthFormat(VkFormat format) {
+        return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D16_UNORM_S8_UINT ||
+            format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_X8_D24_UNORM_PACK32;
+    }
+
+    bool hasStencilComponent(VkFormat format) {
+        return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+    }
+
+    bool isAttachment(RenderGraphUsage usage) {
+        return usage == RenderGraphUsage::ColorAttachment || usage == RenderGraphUsage::DepthAttachment;
+    }
+
+    bool isWrite(RenderGraphUsage usage) {
+        return isAttachment(usage);
+    }
+
+    // Part of the framebuffer of the pass's render pass
+    bool isFramebufferUsage(RenderGraphUsage usage) {
+        return isAttachment(usage) || usage == RenderGraphUsage::InputAttachment;
+    }
+
+    // Layout, stages and accesses of a usage. writeAccess is 0 for reads
+    struct UsageState {
+        VkImageLayout layout;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkAccessFlags writeAccess;
+        VkImageUsageFlags imageUsage;
+    };
+
+    UsageState getUsageState(RenderGraphUsage usage, bool depth) {
+        VkImageLayout sampledLayout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        switch (usage) {
+        case RenderGraphUsage::ColorAttachment:
+            return {
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+            };
+        case RenderGraphUsage::DepthAttachment:
+            return {
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+            };
+        case RenderGraphUsage::FragmentSampled:
+            return { sampledLayout, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT };
+        case RenderGraphUsage::ComputeSampled:
+            return { sampledLayout, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT };
+        case RenderGraphUsage::InputAttachment:
+            return { sampledLayout, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT, 0, VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT };
+        }
+        throw std::invalid_argument("Unknown render graph usage");
+    }
+
+    bool overlaps(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB) {
+        return !(lastA < firstB || lastB < firstA);
+    }
+}
+
+RenderGraph::RenderGraph(Device* device, uint32_t framesInFlight)
+  : device(device), framesInFlight(framesInFlight), extent({ 0, 0 }), compiled(false), timer(nullptr), firstTimerSection(0) {}
+
+uint32_t RenderGraph::AddImage(const std::string& name, VkFormat format, VkClearValue clearValue) {
+    Resource resource = {};
+    resource.name = name;
+    resource.format = format;
+    resource.clearValue = clearValue;
+    resource.imported = false;
+    resource.transient = false;
+    resource.lazilyAllocated = false;
+    resource.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource.finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resource.firstPass = NO_PASS;
+    resource.lastPass = NO_PASS;
+    resources.push_back(resource);
+    return static_cast<uint32_t>(resources.size() - 1);
+}
+
+uint32_t RenderGraph::ImportImage(const std::string& name, VkFormat format, VkImageLayout initialLayout, VkImageLayout finalLayout, VkClearValue clearValue) {
+    uint32_t image = AddImage(name, format, clearValue);
+    resources[image].imported = true;
+    resources[image].initialLayout = initialLayout;
+    resources[image].finalLayout = finalLayout;
+    return image;
+}
+
+uint32_t RenderGraph::AddPass(const std::string& name, std::function<void(VkCommandBuffer commandBuffer, uint32_t frame)> record) {
+    if (compiled) {
+        throw std::logic_error("Render graph passes must be added before it is compiled");
+    }
+
+    Pass pass = {};
+    pass.name = name;
+    pass.record = record;
+    pass.sideEffects = false;
+    pass.culled = false;
+    pass.renderPassPass = NO_PASS;
+    pass.lastSubpassPass = NO_PASS;
+    pass.subpass = 0;
+    pass.renderPass = VK_NULL_HANDLE;
+    pass.framebufferVariants = 1;
+    passes.push_back(pass);
+    return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void RenderGraph::Read(uint32_t pass, uint32_t image, RenderGraphUsage usage) {
+    for (const ImageUse& use : passes[pass].uses) {
+        if (use.image == image) {
+            throw std::logic_error("Render graph pass " + passes[pass].name + " uses " + resources[image].name + " twice");
+        }
+    }
+    passes[pass].uses.push_back({ image, usage });
+}
+
+void RenderGraph::Write(uint32_t pass, uint32_t image, RenderGraphUsage usage) {
+    if (!isWrite(usage)) {
+        throw std::logic_error("Render graph pass " + passes[pass].name + " writes " + resources[image].name + " with a read-only usage");
+    }
+    Read(pass, image, usage);
+}
+
+void RenderGraph::SetSideEffects(uint32_t pass) {
+    passes[pass].sideEffects = true;
+}
+
+void RenderGraph::CullPasses() {
+    // Walking backwards, a pass is needed if it writes an image a later needed pass uses or that leaves the graph
+    std::vector<bool> needed(resources.size());
+    for (uint32_t i = 0; i < resources.size(); ++i) {
+        needed[i] = resources[i].imported;
+    }
+
+    for (uint32_t p = static_cast<uint32_t>(passes.size()); p-- > 0;) {
+        Pass& pass = passes[p];
+        bool kept = pass.sideEffects;
+        for (const ImageUse& use : pass.uses) {
+            kept = kept || (isWrite(use.usage) && needed[use.image]);
+        }
+        pass.culled = !kept;
+
+        // Attachments load what earlier passes wrote, so they count as reads too
+        if (kept) {
+            for (const ImageUse& use : pass.uses) {
+                needed[use.image] = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::Compile() {
+    CullPasses();
+
+    // Images are created for what the kept passes do with them only
+    for (uint32_t p = 0; p < passes.size(); ++p) {
+        if (passes[p].culled) {
+            continue;
+        }
+        for (const ImageUse& use : passes[p].uses) {
+            Resource& resource = resources[use.image];
+            if (resource.firstPass == NO_PASS) {
+                resource.firstPass = p;
+            }
+            resource.lastPass = p;
+            resource.usage |= getUsageState(use.usage, isDepthFormat(resource.format)).imageUsage;
+        }
+    }
+
+    MergeSubpasses();
+
+    // Images that live and die within one render pass never have to be stored, tilers can keep them in tile memory
+    const VkImageUsageFlags framebufferUsages = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+    for (Resource& resource : resources) {
+        resource.transient = !resource.imported && resource.firstPass != NO_PASS && (resource.usage & ~framebufferUsages) == 0 &&
+            passes[resource.firstPass].renderPassPass != NO_PASS && passes[resource.firstPass].renderPassPass == passes[resource.lastPass].renderPassPass;
+        if (resource.transient) {
+            resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+    }
+
+    for (uint32_t p = 0; p < passes.size(); ++p) {
+        if (!passes[p].culled && passes[p].renderPassPass == p) {
+            CreateRenderPass(p);
+        }
+    }
+    compiled = true;
+}
+
+void RenderGraph::MergeSubpasses() {
+    uint32_t previous = NO_PASS;
+    for (uint32_t p = 0; p < passes.size(); ++p) {
+        Pass& pass = passes[p];
+        if (pass.culled) {
+            continue;
+        }
+
+        bool hasFramebuffer = false;
+        bool readsInputs = false;
+        for (const ImageUse& use : pass.uses) {
+            hasFramebuffer = hasFramebuffer || isFramebufferUsage(use.usage);
+            readsInputs = readsInputs || use.usage == RenderGraphUsage::InputAttachment;
+        }
+
+        if (readsInputs) {
+            // Continues the render pass of the kept pass before it, as its next subpass
+            if (previous == NO_PASS || passes[previous].renderPassPass == NO_PASS) {
+                throw std::logic_error("Render graph pass " + pass.name + " reads input attachments, but the pass before it has no render pass");
+            }
+            pass.renderPassPass = passes[previous].renderPassPass;
+            pass.subpass = passes[previous].subpass + 1;
+            passes[pass.renderPassPass].lastSubpassPass = p;
+
+            // Inputs must have been rendered by an earlier subpass, and what earlier subpasses render cannot be sampled
+            for (const ImageUse& use : pass.uses) {
+                bool rendered = false;
+                for (uint32_t q = pass.renderPassPass; q < p; ++q) {
+                    for (const ImageUse& earlierUse : passes[q].uses) {
+                        rendered = rendered || (!passes[q].culled && earlierUse.image == use.image && isAttachment(earlierUse.usage));
+                    }
+                }
+                if (use.usage == RenderGraphUsage::InputAttachment && !rendered) {
+                    throw std::logic_error("Render graph pass " + pass.name + " reads " + resources[use.image].name + " as an input attachment, but no earlier subpass renders it");
+                }
+                if (!isFramebufferUsage(use.usage) && rendered) {
+                    throw std::logic_error("Render graph pass " + pass.name + " samples " + resources[use.image].name + ", which its render pass renders");
+                }
+            }
+        } else if (hasFramebuffer) {
+            pass.renderPassPass = p;
+            pass.subpass = 0;
+            pass.lastSubpassPass = p;
+        }
+        previous = p;
+    }
+}
+
+void RenderGraph::CreateRenderPass(uint32_t first) {
+    Pass& owner = passes[first];
+    uint32_t last = owner.lastSubpassPass;
+
+    // Every image a subpass renders or reads, in the order they are first used. Layouts only change between
+    // subpasses, the graph's barriers take care of the rest
+    std::vector<VkAttachmentDescription> attachmentDescriptions;
+    for (uint32_t p = first; p <= last; ++p) {
+        if (passes[p].culled) {
+            continue;
+        }
+        for (const ImageUse& use : passes[p].uses) {
+            if (!isFramebufferUsage(use.usage)) {
+                continue;
+            }
+            const Resource& resource = resources[use.image];
+            VkImageLayout layout = getUsageState(use.usage, isDepthFormat(resource.format)).layout;
+
+            size_t a = std::find(owner.attachments.begin(), owner.attachments.end(), use.image) - owner.attachments.begin();
+            if (a == owner.attachments.size()) {
+                // What nothing reads after the render pass is not stored
+                VkAttachmentDescription attachment = {};
+                attachment.format = resource.format;
+                attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+                bool undefinedBefore = resource.firstPass == p && (!resource.imported || resource.initialLayout == VK_IMAGE_LAYOUT_UNDEFINED);
+                attachment.loadOp = undefinedBefore ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+                attachment.storeOp = resource.imported || resource.lastPass > last ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                attachment.initialLayout = layout;
+                attachmentDescriptions.push_back(attachment);
+                owner.attachments.push_back(use.image);
+            }
+            attachmentDescriptions[a].finalLayout = layout;
+        }
+    }
+
+    struct SubpassReferences {
+        std::vector<VkAttachmentReference> colors;
+        std::vector<VkAttachmentReference> inputs;
+        VkAttachmentReference depth;
+        bool hasDepth;
+        std::vector<uint32_t> preserves;
+    };
+    std::vector<SubpassReferences> references;
+    std::vector<uint32_t> subpassPasses;
+
+    for (uint32_t p = first; p <= last; ++p) {
+        const Pass& pass = passes[p];
+        if (pass.culled) {
+            continue;
+        }
+
+        // Colors in the order the pass declared them, which is the order of the pipeline's blend attachments
+        SubpassReferences subpassReferences = {};
+        for (const ImageUse& use : pass.uses) {
+            if (!isFramebufferUsage(use.usage)) {
+                continue;
+            }
+            uint32_t a = static_cast<uint32_t>(std::find(owner.attachments.begin(), owner.attachments.end(), use.image) - owner.attachments.begin());
+            VkAttachmentReference reference = { a, getUsageState(use.usage, isDepthFormat(resources[use.image].format)).layout };
+            if (use.usage == RenderGraphUsage::ColorAttachment) {
+                subpassReferences.colors.push_back(reference);
+            } else if (use.usage == RenderGraphUsage::InputAttachment) {
+                subpassReferences.inputs.push_back(reference);
+            } else {
+                if (subpassReferences.hasDepth) {
+                    throw std::logic_error("Render graph pass " + pass.name + " has more than one depth attachment");
+                }
+                subpassReferences.depth = reference;
+                subpassReferences.hasDepth = true;
+            }
+        }
+
+        // Attachments a subpass skips keep their contents for the subpasses after it
+        for (uint32_t a = 0; a < owner.attachments.size(); ++a) {
+            bool usedBefore = false;
+            bool used = false;
+            bool usedAfter = false;
+            for (uint32_t q = first; q <= last; ++q) {
+                for (const ImageUse& use : passes[q].uses) {
+                    if (!passes[q].culled && use.image == owner.attachments[a] && isFramebufferUsage(use.usage)) {
+                        usedBefore = usedBefore || q < p;
+                        used = used || q == p;
+                        usedAfter = usedAfter || q > p;
+                    }
+                }
+            }
+            if (usedBefore && usedAfter && !used) {
+                subpassReferences.preserves.push_back(a);
+            }
+        }
+
+        references.push_back(subpassReferences);
+        subpassPasses.push_back(p);
+    }
+
+    std::vector<VkSubpassDescription> subpasses(references.size());
+    for (size_t s = 0; s < references.size(); ++s) {
+        subpasses[s].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpasses[s].inputAttachmentCount = static_cast<uint32_t>(references[s].inputs.size());
+        subpasses[s].pInputAttachments = references[s].inputs.data();
+        subpasses[s].colorAttachmentCount = static_cast<uint32_t>(references[s].colors.size());
+        subpasses[s].pColorAttachments = references[s].colors.data();
+        subpasses[s].pDepthStencilAttachment = references[s].hasDepth ? &references[s].depth : nullptr;
+        subpasses[s].preserveAttachmentCount = static_cast<uint32_t>(references[s].preserves.size());
+        subpasses[s].pPreserveAttachments = references[s].preserves.data();
+    }
+
+    // A later subpass waits for the earlier ones that wrote what it uses, or used what it writes, pixel by pixel
+    std::vector<VkSubpassDependency> dependencies;
+    for (uint32_t src = 0; src < subpassPasses.size(); ++src) {
+        for (uint32_t dst = src + 1; dst < subpassPasses.size(); ++dst) {
+            VkSubpassDependency dependency = {};
+            dependency.srcSubpass = src;
+            dependency.dstSubpass = dst;
+            dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+            for (const ImageUse& srcUse : passes[subpassPasses[src]].uses) {
+                for (const ImageUse& dstUse : passes[subpassPasses[dst]].uses) {
+                    if (srcUse.image != dstUse.image || !(isWrite(srcUse.usage) || isWrite(dstUse.usage))) {
+                        continue;
+                    }
+                    bool depth = isDepthFormat(resources[srcUse.image].format);
+                    UsageState srcState = getUsageState(srcUse.usage, depth);
+                    UsageState dstState = getUsageState(dstUse.usage, depth);
+                    dependency.srcStageMask |= srcState.stages;
+                    dependency.srcAccessMask |= srcState.writeAccess;
+                    dependency.dstStageMask |= dstState.stages;
+                    dependency.dstAccessMask |= dstState.access;
+                }
+            }
+
+            if (dependency.srcStageMask != 0) {
+                dependencies.push_back(dependency);
+            }
+        }
+    }
+
+    VkRenderPassCreateInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescriptions.size());
+    renderPassInfo.pAttachments = attachmentDescriptions.data();
+    renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+    renderPassInfo.pSubpasses = subpasses.data();
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(device->GetVkDevice(), &renderPassInfo, nullptr, &owner.renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create render pass for " + owner.name);
+    }
+}
+
+bool RenderGraph::IsCulled(uint32_t pass) const {
+    return passes[pass].culled;
+}
+
+VkRenderPass RenderGraph::GetRenderPass(uint32_t pass) const {
+    return passes[pass].renderPassPass == NO_PASS ? VK_NULL_HANDLE : passes[passes[pass].renderPassPass].renderPass;
+}
+
+uint32_t RenderGraph::GetSubpass(uint32_t pass) const {
+    return passes[pass].subpass;
+}
+
+uint32_t RenderGraph::GetPassCount() const {
+    return static_cast<uint32_t>(passes.size());
+}
+
+const std::string& RenderGraph::GetPassName(uint32_t pass) const {
+    return passes[pass].name;
+}
+
+void RenderGraph::SetTimer(GpuTimer* timer, uint32_t firstSection) {
+    this->timer = timer;
+    firstTimerSection = firstSection;
+}
+
+void RenderGraph::SetImportedImages(uint32_t image, const std::vector<VkImage>& images, const std::vector<VkImageView>& views) {
+    resources[image].images = images;
+    resources[image].views = views;
+}
+
+void RenderGraph::AssignSlots() {
+    // Largest first, each into the first slot whose images are all dead by the time it is used
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < resources.size(); ++i) {
+        if (!resources[i].imported && resources[i].firstPass != NO_PASS) {
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return resources[a].memoryRequirements.size > resources[b].memoryRequirements.size;
+    });
+
+    // Attachments are bound for their whole render pass, so a lifetime covers every subpass of the render passes
+    // it starts and ends in
+    std::vector<uint32_t> firstUses(resources.size()), lastUses(resources.size());
+    for (uint32_t i : order) {
+        const Pass& first = passes[resources[i].firstPass];
+        const Pass& last = passes[resources[i].lastPass];
+        firstUses[i] = first.renderPassPass == NO_PASS ? resources[i].firstPass : first.renderPassPass;
+        lastUses[i] = last.renderPassPass == NO_PASS ? resources[i].lastPass : passes[last.renderPassPass].lastSubpassPass;
+    }
+
+    slots.clear();
+    for (uint32_t i : order) {
+        Resource& resource = resources[i];
+
+        uint32_t s = 0;
+        for (; s < slots.size(); ++s) {
+            if (slots[s].lazilyAllocated != resource.lazilyAllocated || (slots[s].memoryRequirements.memoryTypeBits & resource.memoryRequirements.memoryTypeBits) == 0) {
+                continue;
+            }
+            bool free = true;
+            for (uint32_t other : slots[s].images) {
+                free = free && !overlaps(firstUses[i], lastUses[i], firstUses[other], lastUses[other]);
+            }
+            if (free) {
+                break;
+            }
+        }
+
+        if (s == slots.size()) {
+            slots.push_back({ resource.memoryRequirements, resource.lazilyAllocated, {}, {} });
+        }
+        Slot& slot = slots[s];
+        slot.memoryRequirements.size = std::max(slot.memoryRequirements.size, resource.memoryRequirements.size);
+        slot.memoryRequirements.alignment = std::max(slot.memoryRequirements.alignment, resource.memoryRequirements.alignment);
+        slot.memoryRequirements.memoryTypeBits &= resource.memoryRequirements.memoryTypeBits;
+        slot.images.push_back(i);
+        resource.slot = s;
+    }
+}
+
+void RenderGraph::DeriveTransitions() {
+    // What each image went through since its last write, following the passes in order
+    struct State {
+        bool valid;
+        VkImageLayout layout;
+        VkPipelineStageFlags writeStages;
+        VkAccessFlags writeAccess;
+        VkPipelineStageFlags readStages;
+    };
+    std::vector<State> states(resources.size(), { false, VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0 });
+    std::vector<uint32_t> slotOccupants(slots.size(), NO_PASS);
+    // Last kept pass that used each image
+    std::vector<uint32_t> lastUses(resources.size(), NO_PASS);
+
+    for (uint32_t p = 0; p < passes.size(); ++p) {
+        Pass& pass = passes[p];
+        pass.before.clear();
+        pass.after.clear();
+        if (pass.culled) {
+            continue;
+        }
+
+        // Barriers cannot be recorded between subpasses, so they all go before the render pass
+        std::vector<Transition>& before = pass.renderPassPass == NO_PASS ? pass.before : passes[pass.renderPassPass].before;
+
+        for (const ImageUse& use : pass.uses) {
+            const Resource& resource = resources[use.image];
+            UsageState usage = getUsageState(use.usage, isDepthFormat(resource.format));
+            State& state = states[use.image];
+
+            Transition transition = { use.image, state.layout, usage.layout, 0, usage.stages, 0, usage.access };
+            bool needed = true;
+            if (pass.renderPassPass != NO_PASS && lastUses[use.image] != NO_PASS && passes[lastUses[use.image]].renderPassPass == pass.renderPassPass) {
+                // Already used by an earlier subpass, the render pass's dependencies and layouts cover it
+                needed = false;
+            } else if (!state.valid) {
+                // Nothing earlier in the frame to wait for, except the image that had the memory before
+                transition.srcStages = usage.stages;
+                if (resource.imported) {
+                    transition.oldLayout = resource.initialLayout;
+                } else {
+                    transition.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                    uint32_t occupant = slotOccupants[resource.slot];
+                    if (occupant != NO_PASS) {
+                        transition.srcStages = states[occupant].writeStages | states[occupant].readStages;
+                        transition.srcAccess = states[occupant].writeAccess;
+                    }
+                    slotOccupants[resource.slot] = use.image;
+                }
+            } else if (state.layout != usage.layout || usage.writeAccess != 0) {
+                transition.srcStages = state.writeStages | state.readStages;
+                transition.srcAccess = state.writeAccess;
+            } else if (state.writeStages != 0 && (state.readStages & usage.stages) != usage.stages) {
+                transition.srcStages = state.writeStages;
+                transition.srcAccess = state.writeAccess;
+            } else {
+                needed = false;
+            }
+
+            if (needed) {
+                before.push_back(transition);
+            }
+
+            if (usage.writeAccess != 0) {
+                state.writeStages = usage.stages;
+                state.writeAccess = usage.writeAccess;
+                state.readStages = 0;
+            } else {
+                state.readStages = (needed ? 0 : state.readStages) | usage.stages;
+            }
+            state.valid = true;
+            state.layout = usage.layout;
+            lastUses[use.image] = p;
+        }
+
+        // Imported images leave the graph in the layout their owner expects, once the render pass is over
+        if (pass.renderPassPass != NO_PASS && passes[pass.renderPassPass].lastSubpassPass != p) {
+            continue;
+        }
+        for (uint32_t q = pass.renderPassPass == NO_PASS ? p : pass.renderPassPass; q <= p; ++q) {
+            if (passes[q].culled) {
+                continue;
+            }
+            for (const ImageUse& use : passes[q].uses) {
+                const Resource& resource = resources[use.image];
+                const State& state = states[use.image];
+                if (resource.imported && resource.lastPass == q && state.layout != resource.finalLayout) {
+                    pass.after.push_back({ use.image, state.layout, resource.finalLayout, state.writeStages | state.readStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, state.writeAccess, 0 });
+                }
+            }
+        }
+    }
+}
+
+void RenderGraph::CreateResources(VkExtent2D extent) {
+    this->extent = extent;
+    VkDevice logicalDevice = device->GetVkDevice();
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device->GetInstance()->GetPhysicalDevice(), &memoryProperties);
+
+    for (Resource& resource : resources) {
+        if (resource.imported || resource.firstPass == NO_PASS) {
+            continue;
+        }
+
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = extent.width;
+        imageInfo.extent.height = extent.height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = resource.format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = resource.usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        resource.images.resize(framesInFlight);
+        for (uint32_t f = 0; f < framesInFlight; ++f) {
+            if (vkCreateImage(logicalDevice, &imageInfo, nullptr, &resource.images[f]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create render graph image " + resource.name);
+            }
+        }
+        vkGetImageMemoryRequirements(logicalDevice, resource.images[0], &resource.memoryRequirements);
+
+        // Transient attachments are backed by memory only as far as the device needs to, where it can do that
+        resource.lazilyAllocated = false;
+        if (resource.transient) {
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+                resource.lazilyAllocated = resource.lazilyAllocated ||
+                    ((resource.memoryRequirements.memoryTypeBits & (1u << i)) != 0 && (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0);
+            }
+        }
+    }
+
+    // Every image in a slot is bound to the start of the slot's memory
+    AssignSlots();
+    for (Slot& slot : slots) {
+        slot.memories.resize(framesInFlight);
+        for (uint32_t f = 0; f < framesInFlight; ++f) {
+            VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | (slot.lazilyAllocated ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0);
+            slot.memories[f] = device->GetAllocator()->Allocate(slot.memoryRequirements, properties, false);
+            for (uint32_t image : slot.images) {
+                vkBindImageMemory(logicalDevice, resources[image].images[f], slot.memories[f].memory, slot.memories[f].offset);
+            }
+        }
+    }
+
+    for (Resource& resource : resources) {
+        if (resource.imported || resource.firstPass == NO_PASS) {
+            continue;
+        }
+        VkImageAspectFlags aspect = isDepthFormat(resource.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+        resource.views.resize(framesInFlight);
+        for (uint32_t f = 0; f < framesInFlight; ++f) {
+            resource.views[f] = Image::CreateView(device, resource.images[f], resource.format, aspect);
+        }
+    }
+
+    for (Pass& pass : passes) {
+        if (pass.culled || pass.renderPass == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        // Owned by the first pass of each render pass. One framebuffer per image of the imported attachments, e.g.
+        // per swap chain image
+        pass.framebufferVariants = 1;
+        for (uint32_t image : pass.attachments) {
+            const Resource& resource = resources[image];
+            if (resource.imported && resource.views.empty()) {
+                throw std::logic_error("Imported render graph image " + resource.name + " was not set");
+            }
+            if (resource.imported && resource.views.size() > 1) {
+                if (pass.framebufferVariants != 1 && pass.framebufferVariants != resource.views.size()) {
+                    throw std::logic_error("Imported attachments of render graph pass " + pass.name + " differ in count");
+                }
+                pass.framebufferVariants = static_cast<uint32_t>(resource.views.size());
+            }
+        }
+
+        pass.framebuffers.resize(framesInFlight * pass.framebufferVariants);
+        for (uint32_t f = 0; f < framesInFlight; ++f) {
+            for (uint32_t v = 0; v < pass.framebufferVariants; ++v) {
+                std::vector<VkImageView> attachmentViews;
+                for (uint32_t image : pass.attachments) {
+                    const Resource& resource = resources[image];
+                    attachmentViews.push_back(resource.imported ? resource.views[resource.views.size() == 1 ? 0 : v] : resource.views[f]);
+                }
+
+                VkFramebufferCreateInfo framebufferInfo = {};
+                framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+                framebufferInfo.renderPass = pass.renderPass;
+                framebufferInfo.attachmentCount = static_cast<uint32_t>(attachmentViews.size());
+                framebufferInfo.pAttachments = attachmentViews.data();
+                framebufferInfo.width = extent.width;
+                framebufferInfo.height = extent.height;
+                framebufferInfo.layers = 1;
+
+                if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, nullptr, &pass.framebuffers[f * pass.framebufferVariants + v]) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create framebuffer for " + pass.name);
+                }
+            }
+        }
+    }
+
+    DeriveTransitions();
+}
+
+void RenderGraph::DestroyResources() {
+    VkDevice logicalDevice = device->GetVkDevice();
+
+    for (Pass& pass : passes) {
+        for (VkFramebuffer framebuffer : pass.framebuffers) {
+            vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+        }
+        pass.framebuffers.clear();
+    }
+
+    for (Resource& resource : resources) {
+        if (!resource.imported) {
+            for (VkImageView view : resource.views) {
+                vkDestroyImageView(logicalDevice, view, nullptr);
+            }
+            for (VkImage image : resource.images) {
+                vkDestroyImage(logicalDevice, image, nullptr);
+            }
+        }
+        resource.views.clear();
+        resource.images.clear();
+    }
+
+    for (Slot& slot : slots) {
+        for (const MemoryAllocation& memory : slot.memories) {
+            device->GetAllocator()->Free(memory);
+        }
+    }
+    slots.clear();
+}
+
+VkImageView RenderGraph::GetImageView(uint32_t image, uint32_t frame) const {
+    return resources[image].views[frame];
+}
+
+VkImage RenderGraph::GetImage(uint32_t image, uint32_t frame, uint32_t importIndex) const {
+    const Resource& resource = resources[image];
+    if (resource.imported) {
+        return resource.images[resource.images.size() == 1 ? 0 : importIndex];
+    }
+    return resource.images[frame];
+}
+
+void RenderGraph::RecordTransitions(VkCommandBuffer commandBuffer, const std::vector<Transition>& transitions, uint32_t frame, uint32_t importIndex) const {
+    if (transitions.empty()) {
+        return;
+    }
+
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    std::vector<VkImageMemoryBarrier> barriers(transitions.size());
+    for (size_t i = 0; i < transitions.size(); ++i) {
+        const Transition& transition = transitions[i];
+        VkFormat format = resources[transition.image].format;
+
+        VkImageMemoryBarrier& barrier = barriers[i];
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = transition.srcAccess;
+        barrier.dstAccessMask = transition.dstAccess;
+        barrier.oldLayout = transition.oldLayout;
+        barrier.newLayout = transition.newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = GetImage(transition.image, frame, importIndex);
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        if (isDepthFormat(format)) {
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencilComponent(format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+        }
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        srcStages |= transition.srcStages;
+        dstStages |= transition.dstStages;
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+void RenderGraph::Record(VkCommandBuffer commandBuffer, uint32_t firstPass, uint32_t lastPass, uint32_t frame, uint32_t importIndex) const {
+    if ((passes[firstPass].renderPassPass != NO_PASS && passes[firstPass].renderPassPass != firstPass) ||
+        (passes[lastPass].renderPassPass != NO_PASS && passes[passes[lastPass].renderPassPass].lastSubpassPass != lastPass)) {
+        throw std::logic_error("Render graph passes " + passes[firstPass].name + " to " + passes[lastPass].name + " split a render pass");
+    }
+
+    // Culled passes are reset too, so that every query of the frame can be read
+    if (timer != nullptr) {
+        timer->RecordReset(commandBuffer, frame, firstTimerSection + firstPass, lastPass - firstPass + 1);
+    }
+
+    for (uint32_t p = firstPass; p <= lastPass; ++p) {
+        const Pass& pass = passes[p];
+        if (pass.culled) {
+            continue;
+        }
+
+        if (pass.renderPassPass == NO_PASS || pass.renderPassPass == p) {
+            // A pass's time includes the barriers it waits on
+            if (timer != nullptr) {
+                timer->RecordBegin(commandBuffer, frame, firstTimerSection + p);
+            }
+
+            RecordTransitions(commandBuffer, pass.before, frame, importIndex);
+        }
+
+        if (pass.renderPassPass == p) {
+            std::vector<VkClearValue> clearValues;
+            for (uint32_t image : pass.attachments) {
+                clearValues.push_back(resources[image].clearValue);
+            }
+
+            VkRenderPassBeginInfo renderPassInfo = {};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = pass.renderPass;
+            renderPassInfo.framebuffer = pass.framebuffers[frame * pass.framebufferVariants + (pass.framebufferVariants == 1 ? 0 : importIndex)];
+            renderPassInfo.renderArea.offset = { 0, 0 };
+            renderPassInfo.renderArea.extent = extent;
+            renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+            renderPassInfo.pClearValues = clearValues.data();
+
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        } else if (pass.renderPassPass != NO_PASS) {
+            vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+            if (timer != nullptr) {
+                timer->RecordBegin(commandBuffer, frame, firstTimerSection + p);
+            }
+        }
+
+        pass.record(commandBuffer, frame);
+
+        if (pass.renderPassPass != NO_PASS) {
+            if (passes[pass.renderPassPass].lastSubpassPass != p) {
+                if (timer != nullptr) {
+                    timer->RecordEnd(commandBuffer, frame, firstTimerSection + p);
+                }
+                continue;
+            }
+            vkCmdEndRenderPass(commandBuffer);
+        }
+
+        RecordTransitions(commandBuffer, pass.after, frame, importIndex);
+
+        if (timer != nullptr) {
+            timer->RecordEnd(commandBuffer, frame, firstTimerSection + p);
+        }
+    }
+}
+
+RenderGraphStats RenderGraph::GetStats() const {
+    RenderGraphStats stats = {};
+    stats.passCount = static_cast<uint32_t>(passes.size());
+    for (const Pass& pass : passes) {
+        stats.culledPassCount += pass.culled ? 1 : 0;
+    }
+    for (const Resource& resource : resources) {
+        if (!resource.imported && resource.firstPass != NO_PASS) {
+            ++stats.transientImageCount;
+            stats.unaliasedBytes += resource.memoryRequirements.size;
+        }
+    }
+    for (const Slot& slot : slots) {
+        stats.transientBytes += slot.memoryRequirements.size;
+        stats.lazilyAllocatedBytes += slot.lazilyAllocated ? slot.memoryRequirements.size : 0;
+    }
+    return stats;
+}
+
+RenderGraph::~RenderGraph() {
+    DestroyResources();
+    for (const Pass& pass : passes) {
+        if (pass.renderPass != VK_NULL_HANDLE) {
+            vkDestroyRenderPass(device->GetVkDevice(), pass.renderPass, nullptr);
+        }
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "MemoryAllocator.h"
+#include "GpuTimer.h"
+
+class Device;
+
+// How a pass uses an image, which decides the layout the image is in during the pass and what barriers wait for
+enum class RenderGraphUsage {
+    ColorAttachment,
+    DepthAttachment,
+    FragmentSampled,
+    ComputeSampled,
+    // Read at the pixel being shaded. The pass becomes the next subpass of the render pass of the pass before it,
+    // which must render the image
+    InputAttachment,
+};
+
+struct RenderGraphStats {
+    uint32_t passCount;
+    uint32_t culledPassCount;
+    uint32_t transientImageCount;
+    // Memory of one frame's transient images, and what it would take if none of them were aliased
+    VkDeviceSize transientBytes;
+    VkDeviceSize unaliasedBytes;
+    // Part of transientBytes the device only backs with memory as far as it needs to, e.g. none on tilers
+    VkDeviceSize lazilyAllocatedBytes;
+};
+
+// Frame made of passes that declare the images they read and write, in the order they run. Compile culls passes
+// whose results nothing uses and creates a render pass for every pass with attachments, which passes reading its
+// attachments as input attachments join as subpasses. Transient images get one instance per frame in flight, and
+// those whose lifetimes within a frame do not overlap share memory. Recording a pass inserts the barriers and layout
+// transitions its images need since their previous use
+class RenderGraph {
+private:
+    struct ImageUse {
+        uint32_t image;
+        RenderGraphUsage usage;
+    };
+
+    struct Resource {
+        std::string name;
+        VkFormat format;
+        VkImageUsageFlags usage;
+        VkClearValue clearValue;
+        bool imported;
+        // Only used within one render pass, so never stored
+        bool transient;
+        bool lazilyAllocated;
+        // Imported images only, transient images are undefined before their first use and after their last
+        VkImageLayout initialLayout;
+        VkImageLayout finalLayout;
+        // One per frame in flight for transient images, those set with SetImportedImages otherwise
+        std::vector<VkImage> images;
+        std::vector<VkImageView> views;
+        // Kept passes of the first and last use, UINT32_MAX if no kept pass uses the image
+        uint32_t firstPass;
+        uint32_t lastPass;
+        // Transient images in the same slot share memory
+        uint32_t slot;
+        VkMemoryRequirements memoryRequirements;
+    };
+
+    // Barrier recorded around a pass
+    struct Transition {
+        uint32_t image;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+        VkPipelineStageFlags srcStages;
+        VkPipelineStageFlags dstStages;
+        VkAccessFlags srcAccess;
+        VkAccessFlags dstAccess;
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void(VkCommandBuffer, uint32_t)> record;
+        std::vector<ImageUse> uses;
+        bool sideEffects;
+        bool culled;
+
+        // First pass of the render pass this pass is a subpass of, UINT32_MAX without attachments
+        uint32_t renderPassPass;
+        uint32_t subpass;
+
+        // Set on the first pass of a render pass only
+        uint32_t lastSubpassPass;
+        VkRenderPass renderPass;
+        // Every subpass's attachments, in the order they are first used
+        std::vector<uint32_t> attachments;
+        // Frame f with imported image i uses framebuffer f * framebufferVariants + i
+        uint32_t framebufferVariants;
+        std::vector<VkFramebuffer> framebuffers;
+
+        std::vector<Transition> before;
+        std::vector<Transition> after;
+    };
+
+    struct Slot {
+        VkMemoryRequirements memoryRequirements;
+        bool lazilyAllocated;
+        std::vector<uint32_t> images;
+        // One per frame in flight
+        std::vector<MemoryAllocation> memories;
+    };
+
+    Device* device;
+    uint32_t framesInFlight;
+    VkExtent2D extent;
+    bool compiled;
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<Slot> slots;
+
+    // Optional, pass p is timed as section firstTimerSection + p
+    GpuTimer* timer;
+    uint32_t firstTimerSection;
+
+    void CullPasses();
+    void MergeSubpasses();
+    void CreateRenderPass(uint32_t firstPass);
+    void AssignSlots();
+    void DeriveTransitions();
+    VkImage GetImage(uint32_t image, uint32_t frame, uint32_t importIndex) const;
+    void RecordTransitions(VkCommandBuffer commandBuffer, const std::vector<Transition>& transitions, uint32_t frame, uint32_t importIndex) const;
+
+public:
+    RenderGraph() = delete;
+    RenderGraph(Device* device, uint32_t framesInFlight);
+    ~RenderGraph();
+
+    // Sized to the extent given to CreateResources. Attachments are cleared to clearValue by their first pass
+    uint32_t AddImage(const std::string& name, VkFormat format, VkClearValue clearValue = {});
+    // Owned outside the graph, like the swap chain's images. Left in finalLayout after the last pass using it
+    uint32_t ImportImage(const std::string& name, VkFormat format, VkImageLayout initialLayout, VkImageLayout finalLayout, VkClearValue clearValue = {});
+
+    // Passes run in the order they are added. record is called inside the pass's render pass if it has attachments
+    uint32_t AddPass(const std::string& name, std::function<void(VkCommandBuffer commandBuffer, uint32_t frame)> record);
+    void Read(uint32_t pass, uint32_t image, RenderGraphUsage usage);
+    void Write(uint32_t pass, uint32_t image, RenderGraphUsage usage);
+    // Keeps a pass whose results leave the graph some other way, e.g. buffers or images it does not declare
+    void SetSideEffects(uint32_t pass);
+
+    // Once every pass has been added. Creates the render passes, which pipelines can be created against
+    void Compile();
+    bool IsCulled(uint32_t pass) const;
+    // Render pass and subpass to create the pass's pipelines against
+    VkRenderPass GetRenderPass(uint32_t pass) const;
+    uint32_t GetSubpass(uint32_t pass) const;
+    uint32_t GetPassCount() const;
+    const std::string& GetPassName(uint32_t pass) const;
+
+    // Times every recorded pass, before command buffers are recorded. The timer must have a section for each pass
+    void SetTimer(GpuTimer* timer, uint32_t firstSection);
+
+    // Every imported image must be set before CreateResources, and again after it is recreated
+    void SetImportedImages(uint32_t image, const std::vector<VkImage>& images, const std::vector<VkImageView>& views);
+    void CreateResources(VkExtent2D extent);
+    void DestroyResources();
+    VkImageView GetImageView(uint32_t image, uint32_t frame) const;
+
+    // Records passes first to last with the transient images of frame, and importIndex of every imported image.
+    // A frame may be split over several command buffers, as long as they are submitted in order to one queue and
+    // no render pass is split
+    void Record(VkCommandBuffer commandBuffer, uint32_t firstPass, uint32_t lastPass, uint32_t frame, uint32_t importIndex = 0) const;
+
+    RenderGraphStats GetStats() const;
+};
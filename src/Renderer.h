@@ -1,89 +1,19 @@
 #pragma once
 
-#include "Device.h"
-#include "SwapChain.h"
-#include "Scene.h"
-#include "Camera.h"
+#include <vector>
+#include "GpuTimer.h"
 
+// Rendering path that main can switch between at runtime. A renderer owns its pipelines, attachments and command
+// buffers, while the device, swap chain, scene and camera it is created with outlive it
 class Renderer {
 public:
-    Renderer() = delete;
-    Renderer(Device* device, SwapChain* swapChain, Scene* scene, Camera* camera);
-    ~Renderer();
+    virtual ~Renderer() {}
 
-    void CreateCommandPools();
+    virtual const char* GetName() const = 0;
 
-    void CreateRenderPass();
+    virtual void RecreateFrameResources() = 0;
+    virtual void Frame() = 0;
 
-    void CreateCameraDescriptorSetLayout();
-    void CreateModelDescriptorSetLayout();
-    void CreateTimeDescriptorSetLayout();
-    void CreateComputeDescriptorSetLayout();
-
-    void CreateDescriptorPool();
-
-    void CreateCameraDescriptorSet();
-    void CreateModelDescriptorSets();
-    void CreateGrassDescriptorSets();
-    void CreateTimeDescriptorSet();
-    void CreateComputeDescriptorSets();
-
-    void CreateGraphicsPipeline();
-    void CreateGrassPipeline();
-    void CreateComputePipeline();
-
-    void CreateFrameResources();
-    void DestroyFrameResources();
-    void RecreateFrameResources();
-
-    void RecordCommandBuffers();
-    void RecordComputeCommandBuffer();
-
-    void Frame();
-
-private:
-    Device* device;
-    VkDevice logicalDevice;
-    SwapChain* swapChain;
-    Scene* scene;
-    Camera* camera;
-
-    VkCommandPool graphicsCommandPool;
-    VkCommandPool computeCommandPool;
-
-    VkRenderPass renderPass;
-
-    VkDescriptorSetLayout cameraDescriptorSetLayout;
-    VkDescriptorSetLayout modelDescriptorSetLayout;
-    VkDescriptorSetLayout timeDescriptorSetLayout;
-    VkDescriptorSetLayout grassComputeDescriptorSetLayout;
-    
-    VkDescriptorPool descriptorPool;
-
-    VkDescriptorSet cameraDescriptorSet;
-    std::vector<VkDescriptorSet> modelDescriptorSets;
-    std::vector<VkDescriptorSet> grassDescriptorSets;
-    VkDescriptorSet timeDescriptorSet;
-    std::vector<VkDescriptorSet> grassComputeDescriptorSets;
-
-    VkPipelineLayout graphicsPipelineLayout;
-    VkPipelineLayout grassPipelineLayout;
-    VkPipelineLayout computePipelineLayout;
-	// newly added
-	VkPipelineLayout deferredPipelineLayout;
-
-    VkPipeline graphicsPipeline;
-    VkPipeline grassPipeline;
-    VkPipeline computePipeline;
-	// newly added
-	VkPipeline deferredPipeline;
-
-    std::vector<VkImageView> imageViews;
-    VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
-    std::vector<VkFramebuffer> framebuffers;
-
-    std::vector<VkCommandBuffer> commandBuffers;
-    VkCommandBuffer computeCommandBuffer;
+    // GPU time of every pass timed so far, empty if the device has no timestamps
+    virtual std::vector<GpuTiming> GetPassTimings() const = 0;
 };
@@ -3,10 +3,13 @@
 
 #define PRINT_AVG_DELTA 0
 
-Scene::Scene(Device* device) : device(device), deltaAcc(0.0f), deltaCount(0) {
-    BufferUtils::CreateBuffer(device, sizeof(Time), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, timeBuffer, timeBufferMemory);
-    vkMapMemory(device->GetVkDevice(), timeBufferMemory, 0, sizeof(Time), 0, &mappedData);
-    memcpy(mappedData, &time, sizeof(Time));
+Scene::Scene(Device* device, uint32_t framesInFlight) : device(device), deltaAcc(0.0f), deltaCount(0) {
+    timeBufferStride = BufferUtils::GetUniformBufferStride(device, sizeof(Time));
+    BufferUtils::CreateBuffer(device, framesInFlight * timeBufferStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, timeBuffer, timeBufferMemory);
+    mappedData = device->GetAllocator()->Map(timeBufferMemory);
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        UpdateTimeBuffer(i);
+    }
 }
 
 const std::vector<Model*>& Scene::GetModels() const {
@@ -25,6 +28,14 @@ void Scene::AddBlades(Blades* blades) {
   this->blades.push_back(blades);
 }
 
+const NoiseParams& Scene::GetNoiseParams() const {
+    return noiseParams;
+}
+
+void Scene::SetNoiseParams(const NoiseParams& noiseParams) {
+    this->noiseParams = noiseParams;
+}
+
 void Scene::UpdateTime() {
     high_resolution_clock::time_point currentTime = high_resolution_clock::now();
     duration<float> nextDeltaTime = duration_cast<duration<float>>(currentTime - startTime);
@@ -32,8 +43,6 @@ void Scene::UpdateTime() {
 
     time.deltaTime = nextDeltaTime.count();
     time.totalTime += time.deltaTime;
-
-    memcpy(mappedData, &time, sizeof(Time));
 #if PRINT_AVG_DELTA
     deltaAcc += time.deltaTime;
     deltaCount++;
@@ -46,12 +55,19 @@ void Scene::UpdateTime() {
 #endif // PRINT_AVG_DELTA
 }
 
+void Scene::UpdateTimeBuffer(uint32_t frameIndex) {
+    memcpy(static_cast<char*>(mappedData) + GetTimeBufferOffset(frameIndex), &time, sizeof(Time));
+}
+
 VkBuffer Scene::GetTimeBuffer() const {
     return timeBuffer;
 }
 
+VkDeviceSize Scene::GetTimeBufferOffset(uint32_t frameIndex) const {
+    return frameIndex * timeBufferStride;
+}
+
 Scene::~Scene() {
-    vkUnmapMemory(device->GetVkDevice(), timeBufferMemory);
     vkDestroyBuffer(device->GetVkDevice(), timeBuffer, nullptr);
-    vkFreeMemory(device->GetVkDevice(), timeBufferMemory, nullptr);
+    device->GetAllocator()->Free(timeBufferMemory);
 }
@@ -5,6 +5,7 @@
 
 #include "Model.h"
 #include "Blades.h"
+#include "Noise.h"
 
 #define MAX_DELTA_COUNT 2000
 
@@ -19,8 +20,10 @@ class Scene {
 private:
     Device* device;
     
+    // One slice per frame in flight
     VkBuffer timeBuffer;
-    VkDeviceMemory timeBufferMemory;
+    MemoryAllocation timeBufferMemory;
+    VkDeviceSize timeBufferStride;
     Time time;
     
     void* mappedData;
@@ -28,6 +31,8 @@ private:
     std::vector<Model*> models;
     std::vector<Blades*> blades;
 
+    NoiseParams noiseParams;
+
     float deltaAcc; // accumulates deltaTime
     int deltaCount; // counts how many times deltaTime has been accumulated
 
@@ -35,7 +40,7 @@ high_resolution_clock::time_point startTime = high_resolution_clock::now();
 
 public:
     Scene() = delete;
-    Scene(Device* device);
+    Scene(Device* device, uint32_t framesInFlight);
     ~Scene();
 
     const std::vector<Model*>& GetModels() const;
@@ -44,7 +49,14 @@ public:
     void AddModel(Model* model);
     void AddBlades(Blades* blades);
 
+    // Read when the renderer creates its pipelines
+    const NoiseParams& GetNoiseParams() const;
+    void SetNoiseParams(const NoiseParams& noiseParams);
+
     VkBuffer GetTimeBuffer() const;
+    VkDeviceSize GetTimeBufferOffset(uint32_t frameIndex) const;
 
     void UpdateTime();
+    // Copies the current time into the slice of the given frame
+    void UpdateTimeBuffer(uint32_t frameIndex);
 };
@@ -1,5 +1,6 @@
 #include <fstream>
 #include "ShaderModule.h"
+#include "EmbeddedShaders.h"
 
 namespace {
     std::vector<char> readFile(const std::string& filename) {
@@ -21,11 +22,11 @@ namespace {
 }
 
 // Wrap the shaders in shader modules
-VkShaderModule ShaderModule::Create(const std::vector<char>& code, VkDevice logicalDevice) {
+VkShaderModule ShaderModule::Create(const uint32_t* code, size_t wordCount, VkDevice logicalDevice) {
     VkShaderModuleCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    createInfo.codeSize = wordCount * sizeof(uint32_t);
+    createInfo.pCode = code;
 
     VkShaderModule shaderModule;
     if (vkCreateShaderModule(logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -35,6 +36,55 @@ VkShaderModule ShaderModule::Create(const std::vector<char>& code, VkDevice logi
     return shaderModule;
 }
 
+VkShaderModule ShaderModule::Create(const std::vector<char>& code, VkDevice logicalDevice) {
+    return ShaderModule::Create(reinterpret_cast<const uint32_t*>(code.data()), code.size() / sizeof(uint32_t), logicalDevice);
+}
+
 VkShaderModule ShaderModule::Create(const std::string& filename, VkDevice logicalDevice) {
     return ShaderModule::Create(readFile(filename), logicalDevice);
 }
+
+ShaderModuleCache::ShaderModuleCache(VkDevice logicalDevice)
+  : logicalDevice(logicalDevice) {
+}
+
+VkShaderModule ShaderModuleCache::Get(const std::string& filename) {
+    std::promise<VkShaderModule> promise;
+    std::shared_future<VkShaderModule> module;
+    bool load = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = modules.find(filename);
+        if (it == modules.end()) {
+            module = promise.get_future().share();
+            modules[filename] = module;
+            load = true;
+        } else {
+            module = it->second;
+        }
+    }
+
+    // Created outside the lock so that different modules are created in parallel, threads asking for the same one wait on the future
+    if (load) {
+        try {
+            const EmbeddedShaders::Shader* shader = EmbeddedShaders::Find(filename);
+            if (shader == nullptr) {
+                throw std::runtime_error("Failed to find embedded shader " + filename);
+            }
+            promise.set_value(ShaderModule::Create(shader->code, shader->wordCount, logicalDevice));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }
+    return module.get();
+}
+
+ShaderModuleCache::~ShaderModuleCache() {
+    for (auto& module : modules) {
+        try {
+            vkDestroyShaderModule(logicalDevice, module.second.get(), nullptr);
+        } catch (...) {
+            // Failed to load, nothing to destroy
+        }
+    }
+}
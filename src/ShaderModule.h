@@ -1,10 +1,30 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <future>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace ShaderModule {
+    VkShaderModule Create(const uint32_t* code, size_t wordCount, VkDevice logicalDevice);
     VkShaderModule Create(const std::vector<char>& code, VkDevice logicalDevice);
     VkShaderModule Create(const std::string& filename, VkDevice logicalDevice);
 }
+
+// Shader modules by file name, so that each is wrapped once however many pipelines use it. The SPIR-V comes from
+// EmbeddedShaders, nothing is read from disk. Modules live until the cache is destroyed. Safe to use from several threads
+class ShaderModuleCache {
+private:
+    VkDevice logicalDevice;
+    std::map<std::string, std::shared_future<VkShaderModule>> modules;
+    std::mutex mutex;
+
+public:
+    ShaderModuleCache() = delete;
+    ShaderModuleCache(VkDevice logicalDevice);
+    ~ShaderModuleCache();
+
+    VkShaderModule Get(const std::string& filename);
+};
@@ -60,17 +60,21 @@ namespace {
   }
 }
 
-SwapChain::SwapChain(Device* device, VkSurfaceKHR vkSurface, unsigned int numBuffers)
-  : device(device), vkSurface(vkSurface), numBuffers(numBuffers) {
+SwapChain::SwapChain(Device* device, VkSurfaceKHR vkSurface, unsigned int numBuffers, unsigned int framesInFlight)
+  : device(device), vkSurface(vkSurface), numBuffers(numBuffers), framesInFlight(framesInFlight) {
     
     Create();
 
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    if (vkCreateSemaphore(device->GetVkDevice(), &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-        vkCreateSemaphore(device->GetVkDevice(), &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create semaphores");
+    imageAvailableSemaphores.resize(framesInFlight);
+    renderFinishedSemaphores.resize(framesInFlight);
+    for (unsigned int i = 0; i < framesInFlight; ++i) {
+        if (vkCreateSemaphore(device->GetVkDevice(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+            vkCreateSemaphore(device->GetVkDevice(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create semaphores");
+        }
     }
 }
 
@@ -179,13 +183,21 @@ VkImage SwapChain::GetVkImage(uint32_t index) const {
     return vkSwapChainImages[index];
 }
 
+uint32_t SwapChain::GetFrameIndex() const {
+    return frameIndex;
+}
+
+uint32_t SwapChain::GetFramesInFlight() const {
+    return framesInFlight;
+}
+
 VkSemaphore SwapChain::GetImageAvailableVkSemaphore() const {
-    return imageAvailableSemaphore;
+    return imageAvailableSemaphores[frameIndex];
 
 }
 
 VkSemaphore SwapChain::GetRenderFinishedVkSemaphore() const {
-    return renderFinishedSemaphore;
+    return renderFinishedSemaphores[frameIndex];
 }
 
 void SwapChain::Recreate() {
@@ -194,11 +206,8 @@ void SwapChain::Recreate() {
 }
 
 bool SwapChain::Acquire() {
-    if (ENABLE_VALIDATION) {
-        // the validation layer implementation expects the application to explicitly synchronize with the GPU
-        vkQueueWaitIdle(device->GetQueue(QueueFlags::Present));
-    }
-    VkResult result = vkAcquireNextImageKHR(device->GetVkDevice(), vkSwapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+    // The renderer waits on the fence of this frame before acquiring, so there is no need to idle the queue here
+    VkResult result = vkAcquireNextImageKHR(device->GetVkDevice(), vkSwapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[frameIndex], VK_NULL_HANDLE, &imageIndex);
     if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("Failed to acquire swap chain image");
     }
@@ -212,7 +221,7 @@ bool SwapChain::Acquire() {
 }
 
 bool SwapChain::Present() {
-    VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
+    VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[frameIndex] };
 
     // Submit result back to swap chain for presentation
     VkPresentInfoKHR presentInfo = {};
@@ -228,6 +237,9 @@ bool SwapChain::Present() {
 
     VkResult result = vkQueuePresentKHR(device->GetQueue(QueueFlags::Present), &presentInfo);
 
+    // Move on to the next frame's semaphores whether or not the swap chain has to be recreated
+    frameIndex = (frameIndex + 1) % framesInFlight;
+
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to present swap chain image");
     }
@@ -241,7 +253,9 @@ bool SwapChain::Present() {
 }
 
 SwapChain::~SwapChain() {
-    vkDestroySemaphore(device->GetVkDevice(), imageAvailableSemaphore, nullptr);
-    vkDestroySemaphore(device->GetVkDevice(), renderFinishedSemaphore, nullptr);
+    for (unsigned int i = 0; i < framesInFlight; ++i) {
+        vkDestroySemaphore(device->GetVkDevice(), imageAvailableSemaphores[i], nullptr);
+        vkDestroySemaphore(device->GetVkDevice(), renderFinishedSemaphores[i], nullptr);
+    }
     Destroy();
 }
@@ -13,6 +13,8 @@ public:
     VkExtent2D GetVkExtent() const;
     uint32_t GetIndex() const;
     uint32_t GetCount() const;
+    uint32_t GetFrameIndex() const;
+    uint32_t GetFramesInFlight() const;
     VkImage GetVkImage(uint32_t index) const;
     VkSemaphore GetImageAvailableVkSemaphore() const;
     VkSemaphore GetRenderFinishedVkSemaphore() const;
@@ -23,7 +25,7 @@ public:
     ~SwapChain();
 
 private:
-    SwapChain(Device* device, VkSurfaceKHR vkSurface, unsigned int numBuffers);
+    SwapChain(Device* device, VkSurfaceKHR vkSurface, unsigned int numBuffers, unsigned int framesInFlight);
     void Create();
     void Destroy();
 
@@ -36,6 +38,10 @@ private:
     VkExtent2D vkSwapChainExtent;
     uint32_t imageIndex = 0;
 
-    VkSemaphore imageAvailableSemaphore;
-    VkSemaphore renderFinishedSemaphore;
+    // Frames the CPU may record ahead of the GPU, each with its own pair of semaphores
+    unsigned int framesInFlight;
+    uint32_t frameIndex = 0;
+
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
 };
@@ -0,0 +1,313 @@
+#include <cmath>
+#include "Terrain.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_SSE2 1
+#include <emmintrin.h>
+#else
+#define TERRAIN_SSE2 0
+#endif
+
+// Constants of the hashes in noise.glsl
+static constexpr uint32_t INTEGER_HASH_MULTIPLIER = 1103515245u;
+static constexpr uint32_t INTEGER_HASH_SEED_MULTIPLIER = 2654435761u;
+
+namespace {
+    float Fract(float v) {
+        return v - std::floor(v);
+    }
+
+    float RandInteger(uint32_t x, uint32_t y) {
+        uint32_t qx = INTEGER_HASH_MULTIPLIER * ((x >> 1u) ^ y);
+        uint32_t qy = INTEGER_HASH_MULTIPLIER * ((y >> 1u) ^ x);
+        uint32_t n = INTEGER_HASH_MULTIPLIER * (qx ^ (qy >> 3u));
+        return static_cast<float>(n) * (1.0f / static_cast<float>(0xffffffffu));
+    }
+}
+
+Terrain::Terrain(const NoiseParams& noiseParams, float baseHeight)
+  : noiseParams(noiseParams), baseHeight(baseHeight) {}
+
+float Terrain::Hash(float ipx, float ipz) const {
+    if (noiseParams.hash == NOISE_HASH_INTEGER) {
+        uint32_t x = static_cast<uint32_t>(static_cast<int32_t>(ipx)) + noiseParams.seed;
+        uint32_t y = static_cast<uint32_t>(static_cast<int32_t>(ipz)) + noiseParams.seed * INTEGER_HASH_SEED_MULTIPLIER;
+        return RandInteger(x, y);
+    }
+
+    float px = ipx + static_cast<float>(noiseParams.seed) * 17.0f;
+    float pz = ipz + static_cast<float>(noiseParams.seed) * 59.0f;
+    return Fract(std::sin(px * 12.9898f + pz * 4.1414f) * 43758.5453f);
+}
+
+glm::vec2 Terrain::Gradient(float ipx, float ipz) const {
+    float angle = 6.2831853f * Hash(ipx, ipz);
+    return glm::vec2(std::cos(angle), std::sin(angle));
+}
+
+glm::vec3 Terrain::ValueNoised(glm::vec2 p) const {
+    glm::vec2 ip = glm::floor(p);
+    glm::vec2 f = p - ip;
+    glm::vec2 u = f * f * (3.0f - 2.0f * f);
+    glm::vec2 du = 6.0f * f * (1.0f - f);
+
+    float a = Hash(ip.x, ip.y);
+    float b = Hash(ip.x + 1.0f, ip.y);
+    float c = Hash(ip.x, ip.y + 1.0f);
+    float d = Hash(ip.x + 1.0f, ip.y + 1.0f);
+
+    float res = a + (b - a) * u.x + (c - a) * u.y + (a - b - c + d) * u.x * u.y;
+    glm::vec2 dres = du * (glm::vec2(b - a, c - a) + (a - b - c + d) * glm::vec2(u.y, u.x));
+
+    return glm::vec3(res * res, 2.0f * res * dres);
+}
+
+glm::vec3 Terrain::PerlinNoised(glm::vec2 p) const {
+    glm::vec2 ip = glm::floor(p);
+    glm::vec2 f = p - ip;
+    glm::vec2 u = f * f * f * (f * (f * 6.0f - 15.0f) + 10.0f);
+    glm::vec2 du = 30.0f * f * f * (f * (f - 2.0f) + 1.0f);
+
+    glm::vec2 ga = Gradient(ip.x, ip.y);
+    glm::vec2 gb = Gradient(ip.x + 1.0f, ip.y);
+    glm::vec2 gc = Gradient(ip.x, ip.y + 1.0f);
+    glm::vec2 gd = Gradient(ip.x + 1.0f, ip.y + 1.0f);
+
+    float va = glm::dot(ga, f);
+    float vb = glm::dot(gb, f - glm::vec2(1.0f, 0.0f));
+    float vc = glm::dot(gc, f - glm::vec2(0.0f, 1.0f));
+    float vd = glm::dot(gd, f - glm::vec2(1.0f, 1.0f));
+
+    float res = va + u.x * (vb - va) + u.y * (vc - va) + u.x * u.y * (va - vb - vc + vd);
+    glm::vec2 dres = ga + u.x * (gb - ga) + u.y * (gc - ga) + u.x * u.y * (ga - gb - gc + gd)
+        + du * (glm::vec2(u.y, u.x) * (va - vb - vc + vd) + glm::vec2(vb, vc) - va);
+
+    return glm::vec3(0.5f + 0.5f * res, 0.5f * dres);
+}
+
+glm::vec3 Terrain::SimplexNoised(glm::vec2 p) const {
+    const float K1 = 0.366025404f;
+    const float K2 = 0.211324865f;
+
+    glm::vec2 ip = glm::floor(p + (p.x + p.y) * K1);
+    glm::vec2 a = p - ip + (ip.x + ip.y) * K2;
+    float m = a.x >= a.y ? 1.0f : 0.0f;
+    glm::vec2 o = glm::vec2(m, 1.0f - m);
+    glm::vec2 b = a - o + K2;
+    glm::vec2 c = a - 1.0f + 2.0f * K2;
+
+    glm::vec2 ga = Gradient(ip.x, ip.y);
+    glm::vec2 gb = Gradient(ip.x + o.x, ip.y + o.y);
+    glm::vec2 gc = Gradient(ip.x + 1.0f, ip.y + 1.0f);
+
+    glm::vec3 h = glm::max(0.5f - glm::vec3(glm::dot(a, a), glm::dot(b, b), glm::dot(c, c)), 0.0f);
+    glm::vec3 h2 = h * h;
+    glm::vec3 h4 = h2 * h2;
+    glm::vec3 n = glm::vec3(glm::dot(ga, a), glm::dot(gb, b), glm::dot(gc, c));
+
+    float res = glm::dot(h4, n);
+    glm::vec2 dres = -8.0f * (h2.x * h.x * n.x * a + h2.y * h.y * n.y * b + h2.z * h.z * n.z * c) + h4.x * ga + h4.y * gb + h4.z * gc;
+
+    return glm::vec3(0.5f + 35.0f * res, 35.0f * dres);
+}
+
+glm::vec3 Terrain::Noised(glm::vec2 p) const {
+    if (noiseParams.kernel == NOISE_KERNEL_PERLIN) {
+        return PerlinNoised(p);
+    }
+    if (noiseParams.kernel == NOISE_KERNEL_SIMPLEX) {
+        return SimplexNoised(p);
+    }
+    return ValueNoised(p);
+}
+
+glm::vec3 Terrain::GetHeightAndGradient(float x, float z) const {
+    glm::vec2 p = glm::vec2(x, z) * noiseParams.frequency;
+
+    // smoothNoised
+    glm::vec3 total = glm::vec3(0.0f);
+    float freq = 1.0f;
+    float ampl = 1.0f;
+    float maxVal = 0.0f;
+    for (int i = 0; i < noiseParams.octaves; i++) {
+        glm::vec3 n = Noised(p * freq);
+        total += glm::vec3(n.x, glm::vec2(n.y, n.z) * freq) * ampl;
+        maxVal += ampl;
+        ampl *= noiseParams.gain;
+        freq *= noiseParams.lacunarity;
+    }
+    total /= maxVal;
+
+    // terrainHeight
+    glm::vec3 height = glm::vec3(total.x, glm::vec2(total.y, total.z) * noiseParams.frequency) * noiseParams.amplitude;
+    height.x += baseHeight;
+    return height;
+}
+
+float Terrain::GetHeight(float x, float z) const {
+    return GetHeightAndGradient(x, z).x;
+}
+
+glm::vec3 Terrain::GetNormal(float x, float z) const {
+    glm::vec3 height = GetHeightAndGradient(x, z);
+    return glm::normalize(glm::vec3(-height.y, 1.0f, -height.z));
+}
+
+void Terrain::GetHeights(const float* x, const float* z, size_t count, float* heights, float* gradientsX, float* gradientsZ) const {
+#if TERRAIN_SSE2
+    // Only value noise is vectorized, the other kernels are sampled one query at a time
+    if (noiseParams.kernel == NOISE_KERNEL_VALUE) {
+        GetHeightsSSE2(x, z, count, heights, gradientsX, gradientsZ);
+        return;
+    }
+#endif
+    GetHeightsScalar(x, z, count, heights, gradientsX, gradientsZ);
+}
+
+void Terrain::GetHeightsScalar(const float* x, const float* z, size_t count, float* heights, float* gradientsX, float* gradientsZ) const {
+    for (size_t i = 0; i < count; ++i) {
+        glm::vec3 height = GetHeightAndGradient(x[i], z[i]);
+        heights[i] = height.x;
+        if (gradientsX != nullptr) {
+            gradientsX[i] = height.y;
+        }
+        if (gradientsZ != nullptr) {
+            gradientsZ[i] = height.z;
+        }
+    }
+}
+
+#if TERRAIN_SSE2
+namespace {
+    // SSE2 has no floor, truncate and step down where that rounded up
+    __m128 Floor(__m128 v) {
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+    }
+
+    // SSE2 has no 32 bit multiply, multiply the even and odd lanes into 64 bits and keep the low halves
+    __m128i MulLo(__m128i a, __m128i b) {
+        __m128i even = _mm_mul_epu32(a, b);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    // The conversion is signed, so convert the halves separately. The product is exact and the sum
+    // rounds once, like a scalar conversion
+    __m128 UintToFloat(__m128i n) {
+        __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(n, 16));
+        __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(n, _mm_set1_epi32(0xffff)));
+        return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo);
+    }
+
+    struct HashSSE2 {
+        const NoiseParams& noiseParams;
+
+        __m128 operator()(__m128 ipx, __m128 ipz) const {
+            if (noiseParams.hash == NOISE_HASH_INTEGER) {
+                const __m128i multiplier = _mm_set1_epi32(static_cast<int>(INTEGER_HASH_MULTIPLIER));
+                __m128i x = _mm_add_epi32(_mm_cvttps_epi32(ipx), _mm_set1_epi32(static_cast<int>(noiseParams.seed)));
+                __m128i y = _mm_add_epi32(_mm_cvttps_epi32(ipz), _mm_set1_epi32(static_cast<int>(noiseParams.seed * INTEGER_HASH_SEED_MULTIPLIER)));
+                __m128i qx = MulLo(multiplier, _mm_xor_si128(_mm_srli_epi32(x, 1), y));
+                __m128i qy = MulLo(multiplier, _mm_xor_si128(_mm_srli_epi32(y, 1), x));
+                __m128i n = MulLo(multiplier, _mm_xor_si128(qx, _mm_srli_epi32(qy, 3)));
+                return _mm_mul_ps(UintToFloat(n), _mm_set1_ps(1.0f / static_cast<float>(0xffffffffu)));
+            }
+
+            // Vectorized up to the sin, which is taken per lane so that it matches the scalar path
+            __m128 px = _mm_add_ps(ipx, _mm_set1_ps(static_cast<float>(noiseParams.seed) * 17.0f));
+            __m128 pz = _mm_add_ps(ipz, _mm_set1_ps(static_cast<float>(noiseParams.seed) * 59.0f));
+            __m128 arg = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(12.9898f)), _mm_mul_ps(pz, _mm_set1_ps(4.1414f)));
+
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, arg);
+            for (int i = 0; i < 4; ++i) {
+                lanes[i] = std::sin(lanes[i]) * 43758.5453f;
+            }
+            __m128 s = _mm_load_ps(lanes);
+            return _mm_sub_ps(s, Floor(s));
+        }
+    };
+}
+
+void Terrain::GetHeightsSSE2(const float* x, const float* z, size_t count, float* heights, float* gradientsX, float* gradientsZ) const {
+    HashSSE2 hash = { noiseParams };
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 frequency = _mm_set1_ps(noiseParams.frequency);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_mul_ps(_mm_loadu_ps(x + i), frequency);
+        __m128 pz = _mm_mul_ps(_mm_loadu_ps(z + i), frequency);
+
+        __m128 totalH = _mm_setzero_ps();
+        __m128 totalX = _mm_setzero_ps();
+        __m128 totalZ = _mm_setzero_ps();
+        float freq = 1.0f;
+        float ampl = 1.0f;
+        float maxVal = 0.0f;
+        for (int octave = 0; octave < noiseParams.octaves; ++octave) {
+            __m128 freqs = _mm_set1_ps(freq);
+            __m128 sx = _mm_mul_ps(px, freqs);
+            __m128 sz = _mm_mul_ps(pz, freqs);
+
+            // ValueNoised, four queries per lane
+            __m128 ipx = Floor(sx);
+            __m128 ipz = Floor(sz);
+            __m128 fx = _mm_sub_ps(sx, ipx);
+            __m128 fz = _mm_sub_ps(sz, ipz);
+            __m128 ux = _mm_mul_ps(_mm_mul_ps(fx, fx), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_set1_ps(2.0f), fx)));
+            __m128 uz = _mm_mul_ps(_mm_mul_ps(fz, fz), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_set1_ps(2.0f), fz)));
+            __m128 dux = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(6.0f), fx), _mm_sub_ps(one, fx));
+            __m128 duz = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(6.0f), fz), _mm_sub_ps(one, fz));
+
+            __m128 a = hash(ipx, ipz);
+            __m128 b = hash(_mm_add_ps(ipx, one), ipz);
+            __m128 c = hash(ipx, _mm_add_ps(ipz, one));
+            __m128 d = hash(_mm_add_ps(ipx, one), _mm_add_ps(ipz, one));
+
+            __m128 ba = _mm_sub_ps(b, a);
+            __m128 ca = _mm_sub_ps(c, a);
+            __m128 abcd = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(a, b), c), d);
+
+            __m128 res = _mm_add_ps(_mm_add_ps(_mm_add_ps(a, _mm_mul_ps(ba, ux)), _mm_mul_ps(ca, uz)), _mm_mul_ps(_mm_mul_ps(abcd, ux), uz));
+            __m128 dresX = _mm_mul_ps(dux, _mm_add_ps(ba, _mm_mul_ps(abcd, uz)));
+            __m128 dresZ = _mm_mul_ps(duz, _mm_add_ps(ca, _mm_mul_ps(abcd, ux)));
+
+            __m128 twoRes = _mm_mul_ps(_mm_set1_ps(2.0f), res);
+            __m128 n = _mm_mul_ps(res, res);
+            __m128 nx = _mm_mul_ps(twoRes, dresX);
+            __m128 nz = _mm_mul_ps(twoRes, dresZ);
+
+            __m128 ampls = _mm_set1_ps(ampl);
+            totalH = _mm_add_ps(totalH, _mm_mul_ps(n, ampls));
+            totalX = _mm_add_ps(totalX, _mm_mul_ps(_mm_mul_ps(nx, freqs), ampls));
+            totalZ = _mm_add_ps(totalZ, _mm_mul_ps(_mm_mul_ps(nz, freqs), ampls));
+            maxVal += ampl;
+            ampl *= noiseParams.gain;
+            freq *= noiseParams.lacunarity;
+        }
+
+        __m128 maxVals = _mm_set1_ps(maxVal);
+        __m128 amplitude = _mm_set1_ps(noiseParams.amplitude);
+        totalH = _mm_div_ps(totalH, maxVals);
+        totalX = _mm_div_ps(totalX, maxVals);
+        totalZ = _mm_div_ps(totalZ, maxVals);
+
+        _mm_storeu_ps(heights + i, _mm_add_ps(_mm_mul_ps(totalH, amplitude), _mm_set1_ps(baseHeight)));
+        if (gradientsX != nullptr) {
+            _mm_storeu_ps(gradientsX + i, _mm_mul_ps(_mm_mul_ps(totalX, frequency), amplitude));
+        }
+        if (gradientsZ != nullptr) {
+            _mm_storeu_ps(gradientsZ + i, _mm_mul_ps(_mm_mul_ps(totalZ, frequency), amplitude));
+        }
+    }
+
+    // Remainder that does not fill a vector
+    GetHeightsScalar(x + i, z + i, count - i, heights + i, gradientsX != nullptr ? gradientsX + i : nullptr, gradientsZ != nullptr ? gradientsZ + i : nullptr);
+}
+#else
+void Terrain::GetHeightsSSE2(const float* x, const float* z, size_t count, float* heights, float* gradientsX, float* gradientsZ) const {
+    GetHeightsScalar(x, z, count, heights, gradientsX, gradientsZ);
+}
+#endif // TERRAIN_SSE2
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include "Noise.h"
+
+// CPU side of noise.glsl, for collision and placement queries against the terrain the GPU renders.
+// Every operation follows the shader in the same order, so results agree with the GPU up to the
+// precision of its sin and fused multiply-adds. The integer hash does not depend on sin
+class Terrain {
+private:
+    NoiseParams noiseParams;
+    // Height of the tiles the noise displaces, see Blades
+    float baseHeight;
+
+    float Hash(float ipx, float ipz) const;
+    glm::vec2 Gradient(float ipx, float ipz) const;
+
+    glm::vec3 ValueNoised(glm::vec2 p) const;
+    glm::vec3 PerlinNoised(glm::vec2 p) const;
+    glm::vec3 SimplexNoised(glm::vec2 p) const;
+    glm::vec3 Noised(glm::vec2 p) const;
+
+    void GetHeightsScalar(const float* x, const float* z, size_t count, float* heights, float* gradientsX, float* gradientsZ) const;
+    void GetHeightsSSE2(const float* x, const float* z, size_t count, float* heights, float* gradientsX, float* gradientsZ) const;
+
+public:
+    Terrain() = delete;
+    Terrain(const NoiseParams& noiseParams, float baseHeight);
+
+    // World space height at (x, z)
+    float GetHeight(float x, float z) const;
+    // World space height in x, its gradient along x and z in yz
+    glm::vec3 GetHeightAndGradient(float x, float z) const;
+    // Upward unit normal at (x, z)
+    glm::vec3 GetNormal(float x, float z) const;
+
+    // Evaluates count queries at once, four at a time with SSE2 when it is available.
+    // The gradient outputs may be null
+    void GetHeights(const float* x, const float* z, size_t count, float* heights, float* gradientsX = nullptr, float* gradientsZ = nullptr) const;
+};
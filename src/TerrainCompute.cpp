@@ -0,0 +1,800 @@
+#include "TerrainCompute.h"
+#include "ShaderModule.h"
+#include "Blades.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+static constexpr unsigned int WORKGROUP_SIZE = 32;
+static constexpr unsigned int CLIPMAP_WORKGROUP_SIZE = 8;
+
+constexpr uint32_t TerrainCompute::CLIPMAP_TIMER_SECTION;
+constexpr uint32_t TerrainCompute::CULLING_TIMER_SECTION;
+constexpr uint32_t TerrainCompute::TIMER_SECTION_COUNT;
+
+std::vector<std::string> TerrainCompute::GetTimerSectionNames() {
+    return { "clipmap", "culling" };
+}
+
+TerrainCompute::TerrainCompute(Device* device, Scene* scene, uint32_t framesInFlight, VkDescriptorSetLayout cameraDescriptorSetLayout,
+    uint32_t depthWidth, uint32_t depthHeight)
+  : device(device),
+    logicalDevice(device->GetVkDevice()),
+    scene(scene),
+    framesInFlight(framesInFlight),
+    cameraDescriptorSetLayout(cameraDescriptorSetLayout) {
+
+    CreateDepthPyramids(depthWidth, depthHeight);
+    CreateHeightClipmaps();
+    CreateTimeDescriptorSetLayout();
+    CreateComputeDescriptorSetLayout();
+    CreateHiZDescriptorSetLayout();
+    CreateClipmapDescriptorSetLayouts();
+    CreateDescriptorPool();
+    CreateTimeDescriptorSets();
+    CreateComputeDescriptorSets();
+    CreateHiZDescriptorSets();
+    CreateClipmapDescriptorSets();
+}
+
+DepthPyramid* TerrainCompute::GetDepthPyramid(uint32_t frame) const {
+    return depthPyramids[frame];
+}
+
+VkDescriptorSetLayout TerrainCompute::GetClipmapDescriptorSetLayout() const {
+    return clipmapDescriptorSetLayout;
+}
+
+VkDescriptorSet TerrainCompute::GetClipmapDescriptorSet(uint32_t frame) const {
+    return clipmapDescriptorSets[frame];
+}
+
+void TerrainCompute::CreateDepthPyramids(uint32_t width, uint32_t height) {
+    // Frame f culls against the pyramid its previous use of the slot built, which its fences have already waited for
+    depthPyramids.resize(framesInFlight);
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        depthPyramids[f] = new DepthPyramid(device, width, height);
+    }
+}
+
+void TerrainCompute::CreateHeightClipmaps() {
+    // 512 texels per level from 1/8 of a unit per texel up, with as many levels as it takes to reach across every
+    // quadtree from an eye anywhere above it
+    float range = 0.0f;
+    for (const Blades* blades : scene->GetBlades()) {
+        range = std::max(range, blades->GetExtent());
+    }
+
+    // One per frame, so that baking a frame never waits for an earlier frame to be done sampling
+    heightClipmaps.resize(framesInFlight);
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        heightClipmaps[f] = new HeightClipmap(device, 512, 0.125f, range);
+    }
+}
+
+void TerrainCompute::CreateTimeDescriptorSetLayout() {
+    // Describe the binding of the descriptor set layout
+    VkDescriptorSetLayoutBinding uboLayoutBinding = {};
+    uboLayoutBinding.binding = 0;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorCount = 1;
+    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    uboLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { uboLayoutBinding };
+
+    // Create the descriptor set layout
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &timeDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout");
+    }
+}
+
+void TerrainCompute::CreateComputeDescriptorSetLayout() {
+    // TODOX: Create the descriptor set layout for the compute pipeline
+    // Remember this is like a class definition stating why types of information
+    // will be stored at each binding
+    // Describe the binding of the descriptor set layout
+    // TODOX: just copied this from time descriptor
+    VkDescriptorSetLayoutBinding inputBladesLayoutBinding = {};
+    inputBladesLayoutBinding.binding = 0;
+    inputBladesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    inputBladesLayoutBinding.descriptorCount = 1; // TODO: number of input blades???
+    inputBladesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    inputBladesLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding culledBladesLayoutBinding = {};
+    culledBladesLayoutBinding.binding = 1;
+    culledBladesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    culledBladesLayoutBinding.descriptorCount = 1; // TODO: number of input blades???
+    culledBladesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    culledBladesLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding numBladesLayoutBinding = {};
+    numBladesLayoutBinding.binding = 2;
+    numBladesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    numBladesLayoutBinding.descriptorCount = 1;
+    numBladesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    numBladesLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding cullStatsLayoutBinding = {};
+    cullStatsLayoutBinding.binding = 3;
+    cullStatsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    cullStatsLayoutBinding.descriptorCount = 1;
+    cullStatsLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    cullStatsLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding traversalLevelsLayoutBinding = {};
+    traversalLevelsLayoutBinding.binding = 4;
+    traversalLevelsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    traversalLevelsLayoutBinding.descriptorCount = 1;
+    traversalLevelsLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    traversalLevelsLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding traversalNodesLayoutBinding = {};
+    traversalNodesLayoutBinding.binding = 5;
+    traversalNodesLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    traversalNodesLayoutBinding.descriptorCount = 1;
+    traversalNodesLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    traversalNodesLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { inputBladesLayoutBinding, culledBladesLayoutBinding, numBladesLayoutBinding, cullStatsLayoutBinding, traversalLevelsLayoutBinding, traversalNodesLayoutBinding };
+
+    // Create the descriptor set layout
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &grassComputeDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout");
+    }
+}
+
+void TerrainCompute::CreateHiZDescriptorSetLayout() {
+    VkDescriptorSetLayoutBinding hizCameraLayoutBinding = {};
+    hizCameraLayoutBinding.binding = 0;
+    hizCameraLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    hizCameraLayoutBinding.descriptorCount = 1;
+    hizCameraLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    hizCameraLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding depthPyramidLayoutBinding = {};
+    depthPyramidLayoutBinding.binding = 1;
+    depthPyramidLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    depthPyramidLayoutBinding.descriptorCount = 1;
+    depthPyramidLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    depthPyramidLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { hizCameraLayoutBinding, depthPyramidLayoutBinding };
+
+    // Create the descriptor set layout
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &hizDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout");
+    }
+}
+
+void TerrainCompute::CreateClipmapDescriptorSetLayouts() {
+    // Sampled when tessellating the terrain and when resolving the visibility buffer
+    VkDescriptorSetLayoutBinding clipmapLayoutBinding = {};
+    clipmapLayoutBinding.binding = 0;
+    clipmapLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    clipmapLayoutBinding.descriptorCount = 1;
+    clipmapLayoutBinding.stageFlags = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    clipmapLayoutBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutBinding clipmapStateLayoutBinding = {};
+    clipmapStateLayoutBinding.binding = 1;
+    clipmapStateLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    clipmapStateLayoutBinding.descriptorCount = 1;
+    clipmapStateLayoutBinding.stageFlags = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    clipmapStateLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { clipmapLayoutBinding, clipmapStateLayoutBinding };
+
+    // Create the descriptor set layout
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &clipmapDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout");
+    }
+
+    // Written when baking
+    VkDescriptorSetLayoutBinding clipmapTargetLayoutBinding = {};
+    clipmapTargetLayoutBinding.binding = 0;
+    clipmapTargetLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    clipmapTargetLayoutBinding.descriptorCount = 1;
+    clipmapTargetLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    clipmapTargetLayoutBinding.pImmutableSamplers = nullptr;
+
+    clipmapStateLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    bindings = { clipmapTargetLayoutBinding, clipmapStateLayoutBinding };
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &clipmapBakeDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout");
+    }
+}
+
+void TerrainCompute::CreateDescriptorPool() {
+    // Describe which descriptor types that the descriptor sets will contain
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        // Time, per frame
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , framesInFlight },
+
+        // Input blades, culled blades, number of remaining blades, cull statistics and the traversal levels and nodes, per frame
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , static_cast<uint32_t>(6 * framesInFlight * scene->GetBlades().size()) },
+
+        // Depth pyramid camera and sampler, per frame
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , framesInFlight },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER , framesInFlight },
+
+        // Height clipmap and its state, sampled, per frame
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER , framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , framesInFlight },
+
+        // Height clipmap bake target and state, per frame
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE , framesInFlight },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER , framesInFlight },
+    };
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+
+    // Per frame the time, the depth pyramid camera, the two clipmap sets and one per blades
+    poolInfo.maxSets = static_cast<uint32_t>(framesInFlight * (4 + scene->GetBlades().size()));
+
+    if (vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor pool");
+    }
+}
+
+void TerrainCompute::CreateTimeDescriptorSets() {
+    timeDescriptorSets.resize(framesInFlight);
+
+    // Describe the desciptor sets
+    std::vector<VkDescriptorSetLayout> layouts(timeDescriptorSets.size(), timeDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(timeDescriptorSets.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    // Allocate descriptor sets
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, timeDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set");
+    }
+
+    // Configure the descriptors to refer to each frame's slice of the time buffer
+    std::vector<VkDescriptorBufferInfo> timeBufferInfos(timeDescriptorSets.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(timeDescriptorSets.size());
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        timeBufferInfos[f].buffer = scene->GetTimeBuffer();
+        timeBufferInfos[f].offset = scene->GetTimeBufferOffset(f);
+        timeBufferInfos[f].range = sizeof(Time);
+
+        descriptorWrites[f].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[f].dstSet = timeDescriptorSets[f];
+        descriptorWrites[f].dstBinding = 0;
+        descriptorWrites[f].dstArrayElement = 0;
+        descriptorWrites[f].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[f].descriptorCount = 1;
+        descriptorWrites[f].pBufferInfo = &timeBufferInfos[f];
+        descriptorWrites[f].pImageInfo = nullptr;
+        descriptorWrites[f].pTexelBufferView = nullptr;
+    }
+
+    // Update descriptor sets
+    vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void TerrainCompute::CreateComputeDescriptorSets() {
+    // TODO: Create Descriptor sets for the compute pipeline
+    // The descriptors should point to Storage buffers which will hold the grass blades, the culled grass blades, and the output number of grass blades 
+    // Each frame culls into its own buffers
+    uint32_t numBlades = static_cast<uint32_t>(scene->GetBlades().size());
+    grassComputeDescriptorSets.resize(framesInFlight * numBlades);
+
+    // Describe the desciptor sets
+    std::vector<VkDescriptorSetLayout> layouts(grassComputeDescriptorSets.size(), grassComputeDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(grassComputeDescriptorSets.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    // Allocate descriptor sets
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, grassComputeDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set");
+    }
+
+    std::vector<VkDescriptorBufferInfo> inputBladesBufferInfos(grassComputeDescriptorSets.size());
+    std::vector<VkDescriptorBufferInfo> culledBladesBufferInfos(grassComputeDescriptorSets.size());
+    std::vector<VkDescriptorBufferInfo> numBladesBufferInfos(grassComputeDescriptorSets.size());
+    std::vector<VkDescriptorBufferInfo> cullStatsBufferInfos(grassComputeDescriptorSets.size());
+    std::vector<VkDescriptorBufferInfo> traversalLevelsBufferInfos(grassComputeDescriptorSets.size());
+    std::vector<VkDescriptorBufferInfo> traversalNodesBufferInfos(grassComputeDescriptorSets.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(6 * grassComputeDescriptorSets.size());
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        for (uint32_t j = 0; j < numBlades; ++j) {
+            uint32_t i = f * numBlades + j;
+
+            inputBladesBufferInfos[i].buffer = scene->GetBlades()[j]->GetBladesBuffer();
+            inputBladesBufferInfos[i].offset = 0;
+            inputBladesBufferInfos[i].range = sizeof(Tile) * scene->GetBlades()[j]->GetNumRootTiles();
+
+            culledBladesBufferInfos[i].buffer = scene->GetBlades()[j]->GetCulledBladesBuffer(f);
+            culledBladesBufferInfos[i].offset = 0;
+            culledBladesBufferInfos[i].range = sizeof(Tile) * scene->GetBlades()[j]->GetMaxTiles();
+
+            numBladesBufferInfos[i].buffer = scene->GetBlades()[j]->GetNumBladesBuffer(f);
+            numBladesBufferInfos[i].offset = 0;
+            numBladesBufferInfos[i].range = sizeof(BladeDrawIndirect);
+
+            cullStatsBufferInfos[i].buffer = scene->GetBlades()[j]->GetCullStatsBuffer(f);
+            cullStatsBufferInfos[i].offset = 0;
+            cullStatsBufferInfos[i].range = sizeof(TileCullStats);
+
+            traversalLevelsBufferInfos[i].buffer = scene->GetBlades()[j]->GetTraversalLevelsBuffer(f);
+            traversalLevelsBufferInfos[i].offset = 0;
+            traversalLevelsBufferInfos[i].range = VK_WHOLE_SIZE;
+
+            traversalNodesBufferInfos[i].buffer = scene->GetBlades()[j]->GetTraversalNodesBuffer(f);
+            traversalNodesBufferInfos[i].offset = 0;
+            traversalNodesBufferInfos[i].range = VK_WHOLE_SIZE;
+
+            descriptorWrites[6 * i + 0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[6 * i + 0].dstSet = grassComputeDescriptorSets[i];
+            descriptorWrites[6 * i + 0].dstBinding = 0;
+            descriptorWrites[6 * i + 0].dstArrayElement = 0;
+            descriptorWrites[6 * i + 0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[6 * i + 0].descriptorCount = 1; // TODO: should this be 1? same for culledBlades below??? 
+                                                             // I think so, because docs say descriptorCount is number of elts in pBufferInfo,
+                                                             // and pBufferInfo is array of VkDescriptorBufferInfo, of which we only have one (inputBladesBufferInfo)
+                                                             // https://www.khronos.org/registry/vulkan/specs/1.0/man/html/VkWriteDescriptorSet.html
+            descriptorWrites[6 * i + 0].pBufferInfo = &inputBladesBufferInfos[i];
+            descriptorWrites[6 * i + 0].pImageInfo = nullptr;
+            descriptorWrites[6 * i + 0].pTexelBufferView = nullptr;
+
+            descriptorWrites[6 * i + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[6 * i + 1].dstSet = grassComputeDescriptorSets[i];
+            descriptorWrites[6 * i + 1].dstBinding = 1;
+            descriptorWrites[6 * i + 1].dstArrayElement = 0;
+            descriptorWrites[6 * i + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[6 * i + 1].descriptorCount = 1;
+            descriptorWrites[6 * i + 1].pBufferInfo = &culledBladesBufferInfos[i];
+            descriptorWrites[6 * i + 1].pImageInfo = nullptr;
+            descriptorWrites[6 * i + 1].pTexelBufferView = nullptr;
+
+            descriptorWrites[6 * i + 2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[6 * i + 2].dstSet = grassComputeDescriptorSets[i];
+            descriptorWrites[6 * i + 2].dstBinding = 2;
+            descriptorWrites[6 * i + 2].dstArrayElement = 0;
+            descriptorWrites[6 * i + 2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[6 * i + 2].descriptorCount = 1;
+            descriptorWrites[6 * i + 2].pBufferInfo = &numBladesBufferInfos[i];
+            descriptorWrites[6 * i + 2].pImageInfo = nullptr;
+            descriptorWrites[6 * i + 2].pTexelBufferView = nullptr;
+
+            descriptorWrites[6 * i + 3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[6 * i + 3].dstSet = grassComputeDescriptorSets[i];
+            descriptorWrites[6 * i + 3].dstBinding = 3;
+            descriptorWrites[6 * i + 3].dstArrayElement = 0;
+            descriptorWrites[6 * i + 3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[6 * i + 3].descriptorCount = 1;
+            descriptorWrites[6 * i + 3].pBufferInfo = &cullStatsBufferInfos[i];
+            descriptorWrites[6 * i + 3].pImageInfo = nullptr;
+            descriptorWrites[6 * i + 3].pTexelBufferView = nullptr;
+
+            descriptorWrites[6 * i + 4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[6 * i + 4].dstSet = grassComputeDescriptorSets[i];
+            descriptorWrites[6 * i + 4].dstBinding = 4;
+            descriptorWrites[6 * i + 4].dstArrayElement = 0;
+            descriptorWrites[6 * i + 4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[6 * i + 4].descriptorCount = 1;
+            descriptorWrites[6 * i + 4].pBufferInfo = &traversalLevelsBufferInfos[i];
+            descriptorWrites[6 * i + 4].pImageInfo = nullptr;
+            descriptorWrites[6 * i + 4].pTexelBufferView = nullptr;
+
+            descriptorWrites[6 * i + 5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[6 * i + 5].dstSet = grassComputeDescriptorSets[i];
+            descriptorWrites[6 * i + 5].dstBinding = 5;
+            descriptorWrites[6 * i + 5].dstArrayElement = 0;
+            descriptorWrites[6 * i + 5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[6 * i + 5].descriptorCount = 1;
+            descriptorWrites[6 * i + 5].pBufferInfo = &traversalNodesBufferInfos[i];
+            descriptorWrites[6 * i + 5].pImageInfo = nullptr;
+            descriptorWrites[6 * i + 5].pTexelBufferView = nullptr;
+        }
+    }
+
+    // Update descriptor sets
+    vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void TerrainCompute::CreateHiZDescriptorSets() {
+    hizDescriptorSets.resize(framesInFlight);
+
+    // Describe the desciptor sets
+    std::vector<VkDescriptorSetLayout> layouts(hizDescriptorSets.size(), hizDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(hizDescriptorSets.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    // Allocate descriptor sets
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, hizDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set");
+    }
+
+    std::vector<VkDescriptorBufferInfo> hizCameraBufferInfos(hizDescriptorSets.size());
+    std::vector<VkDescriptorImageInfo> depthPyramidInfos(hizDescriptorSets.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(2 * hizDescriptorSets.size());
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        hizCameraBufferInfos[f].buffer = depthPyramids[f]->GetHiZBuffer();
+        hizCameraBufferInfos[f].offset = 0;
+        hizCameraBufferInfos[f].range = sizeof(HiZBufferObject);
+
+        depthPyramidInfos[f].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        depthPyramidInfos[f].imageView = depthPyramids[f]->GetImageView();
+        depthPyramidInfos[f].sampler = depthPyramids[f]->GetSampler();
+
+        descriptorWrites[2 * f + 0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[2 * f + 0].dstSet = hizDescriptorSets[f];
+        descriptorWrites[2 * f + 0].dstBinding = 0;
+        descriptorWrites[2 * f + 0].dstArrayElement = 0;
+        descriptorWrites[2 * f + 0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrites[2 * f + 0].descriptorCount = 1;
+        descriptorWrites[2 * f + 0].pBufferInfo = &hizCameraBufferInfos[f];
+        descriptorWrites[2 * f + 0].pImageInfo = nullptr;
+        descriptorWrites[2 * f + 0].pTexelBufferView = nullptr;
+
+        descriptorWrites[2 * f + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[2 * f + 1].dstSet = hizDescriptorSets[f];
+        descriptorWrites[2 * f + 1].dstBinding = 1;
+        descriptorWrites[2 * f + 1].dstArrayElement = 0;
+        descriptorWrites[2 * f + 1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[2 * f + 1].descriptorCount = 1;
+        descriptorWrites[2 * f + 1].pImageInfo = &depthPyramidInfos[f];
+    }
+
+    // Update descriptor sets
+    vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void TerrainCompute::CreateClipmapDescriptorSets() {
+    clipmapDescriptorSets.resize(framesInFlight);
+    clipmapBakeDescriptorSets.resize(framesInFlight);
+
+    // Describe the desciptor sets
+    std::vector<VkDescriptorSetLayout> layouts(clipmapDescriptorSets.size(), clipmapDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(clipmapDescriptorSets.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    // Allocate descriptor sets
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, clipmapDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set");
+    }
+
+    std::fill(layouts.begin(), layouts.end(), clipmapBakeDescriptorSetLayout);
+    if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, clipmapBakeDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set");
+    }
+
+    std::vector<VkDescriptorImageInfo> clipmapInfos(clipmapDescriptorSets.size());
+    std::vector<VkDescriptorImageInfo> clipmapTargetInfos(clipmapDescriptorSets.size());
+    std::vector<VkDescriptorBufferInfo> clipmapStateInfos(clipmapDescriptorSets.size());
+    std::vector<VkWriteDescriptorSet> descriptorWrites(4 * clipmapDescriptorSets.size());
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        clipmapInfos[f].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        clipmapInfos[f].imageView = heightClipmaps[f]->GetImageView();
+        clipmapInfos[f].sampler = heightClipmaps[f]->GetSampler();
+
+        clipmapTargetInfos[f].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        clipmapTargetInfos[f].imageView = heightClipmaps[f]->GetImageView();
+        clipmapTargetInfos[f].sampler = VK_NULL_HANDLE;
+
+        clipmapStateInfos[f].buffer = heightClipmaps[f]->GetStateBuffer();
+        clipmapStateInfos[f].offset = 0;
+        clipmapStateInfos[f].range = heightClipmaps[f]->GetStateBufferSize();
+
+        descriptorWrites[4 * f + 0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[4 * f + 0].dstSet = clipmapDescriptorSets[f];
+        descriptorWrites[4 * f + 0].dstBinding = 0;
+        descriptorWrites[4 * f + 0].dstArrayElement = 0;
+        descriptorWrites[4 * f + 0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[4 * f + 0].descriptorCount = 1;
+        descriptorWrites[4 * f + 0].pImageInfo = &clipmapInfos[f];
+
+        descriptorWrites[4 * f + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[4 * f + 1].dstSet = clipmapDescriptorSets[f];
+        descriptorWrites[4 * f + 1].dstBinding = 1;
+        descriptorWrites[4 * f + 1].dstArrayElement = 0;
+        descriptorWrites[4 * f + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[4 * f + 1].descriptorCount = 1;
+        descriptorWrites[4 * f + 1].pBufferInfo = &clipmapStateInfos[f];
+
+        descriptorWrites[4 * f + 2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[4 * f + 2].dstSet = clipmapBakeDescriptorSets[f];
+        descriptorWrites[4 * f + 2].dstBinding = 0;
+        descriptorWrites[4 * f + 2].dstArrayElement = 0;
+        descriptorWrites[4 * f + 2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[4 * f + 2].descriptorCount = 1;
+        descriptorWrites[4 * f + 2].pImageInfo = &clipmapTargetInfos[f];
+
+        descriptorWrites[4 * f + 3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[4 * f + 3].dstSet = clipmapBakeDescriptorSets[f];
+        descriptorWrites[4 * f + 3].dstBinding = 1;
+        descriptorWrites[4 * f + 3].dstArrayElement = 0;
+        descriptorWrites[4 * f + 3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[4 * f + 3].descriptorCount = 1;
+        descriptorWrites[4 * f + 3].pBufferInfo = &clipmapStateInfos[f];
+    }
+
+    // Update descriptor sets
+    vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void TerrainCompute::CreateComputePipeline() {
+    // Set up programmable shaders
+    VkShaderModule computeShaderModule = device->GetShaderModuleCache()->Get("shaders/compute.comp.spv");
+
+    VkPipelineShaderStageCreateInfo computeShaderStageInfo = {};
+    computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    computeShaderStageInfo.module = computeShaderModule;
+    computeShaderStageInfo.pName = "main";
+    // The culling bounds are derived from the same noise parameters as the terrain heights
+    VkSpecializationInfo noiseSpecializationInfo = scene->GetNoiseParams().GetSpecializationInfo();
+    computeShaderStageInfo.pSpecializationInfo = &noiseSpecializationInfo;
+
+    // TODO: Add the compute dsecriptor set layout you create to this list
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { cameraDescriptorSetLayout, timeDescriptorSetLayout, grassComputeDescriptorSetLayout, hizDescriptorSetLayout };
+
+    // Define push constant stuff to hold the quadtree traversal parameters
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(TileTraversalPushConstants);
+    VkPushConstantRange pushConstantRangeArray[] = { pushConstantRange };
+
+    // Create pipeline layout
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = pushConstantRangeArray;
+
+    if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &computePipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    // Create compute pipeline
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = computeShaderStageInfo;
+    pipelineInfo.layout = computePipelineLayout;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(logicalDevice, device->GetPipelineCache()->GetVkPipelineCache(), 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create compute pipeline");
+    }
+}
+
+void TerrainCompute::CreateClipmapPipeline() {
+    // Set up programmable shaders
+    VkShaderModule clipmapShaderModule = device->GetShaderModuleCache()->Get("shaders/clipmap.comp.spv");
+
+    VkPipelineShaderStageCreateInfo clipmapShaderStageInfo = {};
+    clipmapShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    clipmapShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    clipmapShaderStageInfo.module = clipmapShaderModule;
+    clipmapShaderStageInfo.pName = "main";
+
+    // Terrain noise settings
+    VkSpecializationInfo noiseSpecializationInfo = scene->GetNoiseParams().GetSpecializationInfo();
+    clipmapShaderStageInfo.pSpecializationInfo = &noiseSpecializationInfo;
+
+    std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { cameraDescriptorSetLayout, clipmapBakeDescriptorSetLayout };
+
+    // Push constant to select the pass
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(uint32_t);
+
+    // Create pipeline layout
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &clipmapPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    // Create compute pipeline
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = clipmapShaderStageInfo;
+    pipelineInfo.layout = clipmapPipelineLayout;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(logicalDevice, device->GetPipelineCache()->GetVkPipelineCache(), 1, &pipelineInfo, nullptr, &clipmapPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create height clipmap pipeline");
+    }
+}
+
+void TerrainCompute::Record(VkCommandBuffer commandBuffer, uint32_t frame, VkDescriptorSet cameraDescriptorSet, float viewportHeight, const GpuTimer* gpuTimer) const {
+    gpuTimer->RecordReset(commandBuffer, frame, CLIPMAP_TIMER_SECTION, TIMER_SECTION_COUNT);
+    gpuTimer->RecordBegin(commandBuffer, frame, CLIPMAP_TIMER_SECTION);
+
+    // Move the height clipmap with the camera, then bake the texels that scrolled into view
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clipmapPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clipmapPipelineLayout, 0, 1, &cameraDescriptorSet, 0, nullptr);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clipmapPipelineLayout, 1, 1, &clipmapBakeDescriptorSets[frame], 0, nullptr);
+
+    uint32_t clipmapPass = 0;
+    vkCmdPushConstants(commandBuffer, clipmapPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &clipmapPass);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+
+    VkMemoryBarrier clipmapStateBarrier = {};
+    clipmapStateBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clipmapStateBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    clipmapStateBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clipmapStateBarrier, 0, nullptr, 0, nullptr);
+
+    uint32_t clipmapGroups = (heightClipmaps[frame]->GetResolution() + CLIPMAP_WORKGROUP_SIZE - 1) / CLIPMAP_WORKGROUP_SIZE;
+    clipmapPass = 1;
+    vkCmdPushConstants(commandBuffer, clipmapPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &clipmapPass);
+    vkCmdDispatch(commandBuffer, clipmapGroups, clipmapGroups, heightClipmaps[frame]->GetLevelCount());
+
+    gpuTimer->RecordEnd(commandBuffer, frame, CLIPMAP_TIMER_SECTION);
+    gpuTimer->RecordBegin(commandBuffer, frame, CULLING_TIMER_SECTION);
+
+    // Reset the indirect draws, the cull counters and the traversal levels before the culling pass appends to them.
+    // The whole draw is written, so the graphics queue never has to hand the buffer back
+    BladeDrawIndirect indirectDraw = {};
+    indirectDraw.instanceCount = 1;
+
+    std::array<TraversalLevel, Blades::MAX_QUADTREE_DEPTH + 1> traversalLevels = {};
+    for (TraversalLevel& traversalLevel : traversalLevels) {
+        traversalLevel.groupCountY = 1;
+        traversalLevel.groupCountZ = 1;
+    }
+
+    uint32_t levelCount = 0;
+    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+        vkCmdUpdateBuffer(commandBuffer, scene->GetBlades()[j]->GetNumBladesBuffer(frame), 0, sizeof(BladeDrawIndirect), &indirectDraw);
+        vkCmdFillBuffer(commandBuffer, scene->GetBlades()[j]->GetCullStatsBuffer(frame), 0, sizeof(TileCullStats), 0);
+        vkCmdUpdateBuffer(commandBuffer, scene->GetBlades()[j]->GetTraversalLevelsBuffer(frame), 0, sizeof(traversalLevels), traversalLevels.data());
+        levelCount = std::max(levelCount, scene->GetBlades()[j]->GetTraversalLevelCount());
+    }
+
+    VkMemoryBarrier resetBarrier = {};
+    resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &resetBarrier, 0, nullptr, 0, nullptr);
+
+    // Bind to the compute pipeline
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+
+    // Bind camera descriptor set
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &cameraDescriptorSet, 0, nullptr);
+
+    // Bind descriptor set for time uniforms
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 1, 1, &timeDescriptorSets[frame], 0, nullptr);
+
+    // Bind the depth pyramid built framesInFlight frames ago for occlusion culling
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 3, 1, &hizDescriptorSets[frame], 0, nullptr);
+
+    // Traverse the quadtrees one level at a time. The roots are dispatched directly, every later level indirectly
+    // from the nodes the level before it appended
+    VkMemoryBarrier levelBarrier = {};
+    levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        if (level > 0) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+        }
+
+        for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+            if (level >= scene->GetBlades()[j]->GetTraversalLevelCount()) {
+                continue;
+            }
+
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 2, 1, &grassComputeDescriptorSets[frame * scene->GetBlades().size() + j], 0, nullptr);
+
+            // Update push constants, one thread visits each node of the level
+            TileTraversalPushConstants pushValues = scene->GetBlades()[j]->GetTraversalPushConstants();
+            pushValues.viewportHeight = viewportHeight;
+            pushValues.level = level;
+            vkCmdPushConstants(commandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TileTraversalPushConstants), &pushValues);
+
+            if (level == 0) {
+                vkCmdDispatch(commandBuffer, (pushValues.numRootTiles + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+            } else {
+                vkCmdDispatchIndirect(commandBuffer, scene->GetBlades()[j]->GetTraversalLevelsBuffer(frame), level * sizeof(TraversalLevel));
+            }
+        }
+    }
+
+    // Release the culled blades to the graphics queue family, acquired again before they are drawn
+    std::vector<VkBufferMemoryBarrier> releaseBarriers(2 * scene->GetBlades().size());
+    for (uint32_t j = 0; j < scene->GetBlades().size(); ++j) {
+        VkBuffer buffers[] = { scene->GetBlades()[j]->GetCulledBladesBuffer(frame), scene->GetBlades()[j]->GetNumBladesBuffer(frame) };
+        for (uint32_t k = 0; k < 2; ++k) {
+            VkBufferMemoryBarrier& barrier = releaseBarriers[2 * j + k];
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Compute);
+            barrier.dstQueueFamilyIndex = device->GetQueueIndex(QueueFlags::Graphics);
+            barrier.buffer = buffers[k];
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+        }
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, static_cast<uint32_t>(releaseBarriers.size()), releaseBarriers.data(), 0, nullptr);
+
+    gpuTimer->RecordEnd(commandBuffer, frame, CULLING_TIMER_SECTION);
+}
+
+TerrainCompute::~TerrainCompute() {
+    vkDestroyPipeline(logicalDevice, computePipeline, nullptr);
+    vkDestroyPipeline(logicalDevice, clipmapPipeline, nullptr);
+    vkDestroyPipelineLayout(logicalDevice, computePipelineLayout, nullptr);
+    vkDestroyPipelineLayout(logicalDevice, clipmapPipelineLayout, nullptr);
+
+    vkDestroyDescriptorSetLayout(logicalDevice, timeDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, grassComputeDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, hizDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, clipmapDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, clipmapBakeDescriptorSetLayout, nullptr);
+
+    vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+
+    for (uint32_t f = 0; f < framesInFlight; ++f) {
+        delete depthPyramids[f];
+        delete heightClipmaps[f];
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+#include "Device.h"
+#include "Scene.h"
+#include "DepthPyramid.h"
+#include "HeightClipmap.h"
+#include "GpuTimer.h"
+
+// Compute work every renderer records the same way before drawing the terrain: the height clipmap is moved with the
+// camera and baked, then the quadtree is culled against the frustum and the depth pyramid of an earlier frame.
+// The renderer owns the camera descriptor sets, the command buffers and the queue submits.
+// Frame f only touches the clipmap and depth pyramid of slot f, whose previous use the CPU has already waited for
+// with the frame's fences, so compute work never waits on a semaphore from the graphics queue and can overlap the
+// previous frame's rendering. The pyramid frame f culls against was built framesInFlight frames ago
+class TerrainCompute {
+private:
+    Device* device;
+    VkDevice logicalDevice;
+    Scene* scene;
+
+    // Frames the CPU may record ahead of the GPU, see SwapChain
+    uint32_t framesInFlight;
+
+    // One of each per frame in flight, so that no frame's compute work has to wait for an earlier frame's graphics
+    std::vector<DepthPyramid*> depthPyramids;
+    std::vector<HeightClipmap*> heightClipmaps;
+
+    // Owned by the renderer, set 0 of both pipelines
+    VkDescriptorSetLayout cameraDescriptorSetLayout;
+    VkDescriptorSetLayout timeDescriptorSetLayout;
+    VkDescriptorSetLayout grassComputeDescriptorSetLayout;
+    VkDescriptorSetLayout hizDescriptorSetLayout;
+    VkDescriptorSetLayout clipmapDescriptorSetLayout;
+    VkDescriptorSetLayout clipmapBakeDescriptorSetLayout;
+
+    VkDescriptorPool descriptorPool;
+
+    // Sets that refer to per-frame resources are stored frame by frame, frame f of n sets per frame starts at f * n
+    std::vector<VkDescriptorSet> timeDescriptorSets;
+    std::vector<VkDescriptorSet> grassComputeDescriptorSets;
+    std::vector<VkDescriptorSet> hizDescriptorSets;
+    std::vector<VkDescriptorSet> clipmapDescriptorSets;
+    std::vector<VkDescriptorSet> clipmapBakeDescriptorSets;
+
+    VkPipelineLayout computePipelineLayout;
+    VkPipelineLayout clipmapPipelineLayout;
+    VkPipeline computePipeline;
+    VkPipeline clipmapPipeline;
+
+    void CreateDepthPyramids(uint32_t width, uint32_t height);
+    void CreateHeightClipmaps();
+
+    void CreateTimeDescriptorSetLayout();
+    void CreateComputeDescriptorSetLayout();
+    void CreateHiZDescriptorSetLayout();
+    void CreateClipmapDescriptorSetLayouts();
+
+    void CreateDescriptorPool();
+
+    void CreateTimeDescriptorSets();
+    void CreateComputeDescriptorSets();
+    void CreateHiZDescriptorSets();
+    void CreateClipmapDescriptorSets();
+
+public:
+    // GPU timer sections recorded by Record, a renderer's own sections follow them
+    static constexpr uint32_t CLIPMAP_TIMER_SECTION = 0;
+    static constexpr uint32_t CULLING_TIMER_SECTION = 1;
+    static constexpr uint32_t TIMER_SECTION_COUNT = 2;
+    static std::vector<std::string> GetTimerSectionNames();
+
+    TerrainCompute() = delete;
+    // The depth pyramid's base level is depthWidth by depthHeight, to match the depth buffer it is built from
+    TerrainCompute(Device* device, Scene* scene, uint32_t framesInFlight, VkDescriptorSetLayout cameraDescriptorSetLayout,
+        uint32_t depthWidth, uint32_t depthHeight);
+    ~TerrainCompute();
+
+    // Independent of each other and of the renderer's pipelines, so they can be compiled on worker threads
+    void CreateComputePipeline();
+    void CreateClipmapPipeline();
+
+    // Bakes the clipmap and culls every Blades into its buffers for the frame, then releases the culled tiles to the
+    // graphics queue family
+    void Record(VkCommandBuffer commandBuffer, uint32_t frame, VkDescriptorSet cameraDescriptorSet, float viewportHeight, const GpuTimer* gpuTimer) const;
+
+    // Built by the renderer after drawing frame f, if it has a depth pass
+    DepthPyramid* GetDepthPyramid(uint32_t frame) const;
+
+    // Sampled by the tessellation evaluation shaders and the visibility resolve, at set 2
+    VkDescriptorSetLayout GetClipmapDescriptorSetLayout() const;
+    VkDescriptorSet GetClipmapDescriptorSet(uint32_t frame) const;
+};
@@ -0,0 +1,427 @@
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include "TextureStreamer.h"
+#include "BufferUtils.h"
+#include "Device.h"
+#include "Image.h"
+#include "Instance.h"
+#include "Model.h"
+#include "ThreadPool.h"
+#include "UploadManager.h"
+
+constexpr uint32_t TextureStreamer::PLACEHOLDER_DIM;
+constexpr VkDeviceSize TextureStreamer::DEFAULT_BYTES_PER_UPDATE;
+
+namespace {
+    bool hasExtension(const std::string& path, const std::string& extension) {
+        if (path.size() < extension.size()) {
+            return false;
+        }
+        return std::equal(extension.begin(), extension.end(), path.end() - extension.size(), [](char a, char b) {
+            return std::tolower(a) == std::tolower(b);
+        });
+    }
+
+    // One block of flat mid grey in format
+    std::vector<char> getPlaceholderBlock(VkFormat format) {
+        switch (format) {
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            // Both endpoints 0x8410 in RGB565, every index picks the first
+            return { 0x10, (char)0x84, 0x10, (char)0x84, 0, 0, 0, 0 };
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            // Opaque alpha block followed by the BC1 colour block
+            return { (char)0xFF, (char)0xFF, 0, 0, 0, 0, 0, 0, 0x10, (char)0x84, 0x10, (char)0x84, 0, 0, 0, 0 };
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            // Mode 6 with both endpoints at 129 grey and 255 alpha, every index picks the first
+            return { 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, (char)0xFF, (char)0xFF, 0x01, 0, 0, 0, 0, 0, 0, 0 };
+        default:
+            return { (char)0x80, (char)0x80, (char)0x80, (char)0xFF };
+        }
+    }
+
+    // Halves an RGBA8 level with a box filter, the last row or column of an odd level is folded into its neighbour
+    std::vector<char> downsample(const std::vector<char>& level, uint32_t width, uint32_t height) {
+        uint32_t nextWidth = std::max(width / 2, 1u);
+        uint32_t nextHeight = std::max(height / 2, 1u);
+        std::vector<char> next(static_cast<size_t>(nextWidth) * nextHeight * 4);
+
+        const unsigned char* src = reinterpret_cast<const unsigned char*>(level.data());
+        unsigned char* dst = reinterpret_cast<unsigned char*>(next.data());
+        for (uint32_t y = 0; y < nextHeight; ++y) {
+            uint32_t y0 = std::min(2 * y, height - 1);
+            uint32_t y1 = std::min(2 * y + 1, height - 1);
+            for (uint32_t x = 0; x < nextWidth; ++x) {
+                uint32_t x0 = std::min(2 * x, width - 1);
+                uint32_t x1 = std::min(2 * x + 1, width - 1);
+                for (uint32_t c = 0; c < 4; ++c) {
+                    uint32_t sum = src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c] + src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c];
+                    dst[(y * nextWidth + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+        return next;
+    }
+
+    // Decodes the image and builds every level above firstResidentLevel on the CPU, the others are already resident
+    void decodeImage(StreamedTexture* texture) {
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(texture->path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!pixels) {
+            throw std::runtime_error("Failed to load texture image");
+        }
+
+        texture->levels.resize(texture->mipLevels);
+        texture->levels[0].assign(reinterpret_cast<char*>(pixels), reinterpret_cast<char*>(pixels) + static_cast<size_t>(width) * height * 4);
+        stbi_image_free(pixels);
+
+        for (uint32_t level = 1; level < texture->mipLevels; ++level) {
+            texture->levels[level] = downsample(texture->levels[level - 1], std::max(texture->width >> (level - 1), 1u), std::max(texture->height >> (level - 1), 1u));
+        }
+    }
+
+    // Reads the levels above the resident ones out of the file
+    void readCompressedLevels(StreamedTexture* texture) {
+        std::ifstream file(texture->path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to load texture image");
+        }
+
+        char header[Image::DDS_MAX_HEADER_SIZE];
+        file.read(header, sizeof(header));
+        VkFormat format;
+        uint32_t width, height, mipLevels;
+        size_t dataOffset = Image::ParseDDSHeader(header, static_cast<size_t>(file.gcount()), format, width, height, mipLevels);
+
+        file.seekg(dataOffset);
+        texture->levels.resize(texture->placeholderLevel);
+        for (uint32_t level = 0; level < texture->placeholderLevel; ++level) {
+            texture->levels[level].resize(static_cast<size_t>(Image::GetLevelSize(format, width, height, level)));
+            file.read(texture->levels[level].data(), texture->levels[level].size());
+            if (static_cast<size_t>(file.gcount()) != texture->levels[level].size()) {
+                throw std::runtime_error("Failed to load texture image, truncated DDS mip chain");
+            }
+        }
+    }
+}
+
+TextureStreamer::TextureStreamer(Device* device, uint32_t framesInFlight, VkDeviceSize bytesPerUpdate)
+  : device(device), framesInFlight(framesInFlight), bytesPerUpdate(bytesPerUpdate) {
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = device->GetQueueIndex(QueueFlags::Graphics);
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    if (vkCreateCommandPool(device->GetVkDevice(), &poolInfo, nullptr, &graphicsCommandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture streaming command pool");
+    }
+}
+
+StreamedTexture* TextureStreamer::Load(const char* path, Model* model, VkFormat format) {
+    StreamedTexture* texture = new StreamedTexture();
+    texture->path = path;
+    texture->model = model;
+    texture->compressed = hasExtension(texture->path, ".dds");
+
+    // Only the header is read here, it is all the image needs to be created
+    size_t dataOffset = 0;
+    if (texture->compressed) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to load texture image");
+        }
+        char header[Image::DDS_MAX_HEADER_SIZE];
+        file.read(header, sizeof(header));
+        dataOffset = Image::ParseDDSHeader(header, static_cast<size_t>(file.gcount()), format, texture->width, texture->height, texture->mipLevels);
+
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(device->GetInstance()->GetPhysicalDevice(), format, &formatProperties);
+        if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == 0) {
+            throw std::runtime_error("Failed to load texture image, block-compressed format not supported by the device");
+        }
+    } else {
+        int width, height, channels;
+        if (!stbi_info(path, &width, &height, &channels)) {
+            throw std::runtime_error("Failed to load texture image");
+        }
+        texture->width = static_cast<uint32_t>(width);
+        texture->height = static_cast<uint32_t>(height);
+        texture->mipLevels = Image::GetMipLevelCount(texture->width, texture->height);
+    }
+    texture->format = format;
+
+    texture->placeholderLevel = texture->mipLevels - 1;
+    while (texture->placeholderLevel > 0 && std::max(texture->width, texture->height) >> (texture->placeholderLevel - 1) <= PLACEHOLDER_DIM) {
+        --texture->placeholderLevel;
+    }
+    texture->residentLevel = texture->placeholderLevel;
+    texture->nextLevel = texture->placeholderLevel;
+
+    Image::Create(device, texture->width, texture->height, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture->image, texture->imageMemory, texture->mipLevels);
+
+    // Smallest levels, straight from the file if it has them
+    std::vector<VkBufferImageCopy> regions;
+    VkDeviceSize tailSize = 0;
+    VkDeviceSize tailOffset = 0;
+    for (uint32_t level = 0; level < texture->mipLevels; ++level) {
+        if (level == texture->placeholderLevel) {
+            tailOffset = tailSize;
+        }
+        if (level >= texture->placeholderLevel) {
+            regions.push_back(Image::GetLevelRegion(texture->width, texture->height, level, tailSize - tailOffset));
+        }
+        tailSize += Image::GetLevelSize(format, texture->width, texture->height, level);
+    }
+    tailSize -= tailOffset;
+
+    std::vector<char> tail(static_cast<size_t>(tailSize));
+    if (texture->compressed) {
+        std::ifstream file(path, std::ios::binary);
+        file.seekg(dataOffset + tailOffset);
+        file.read(tail.data(), tail.size());
+        if (static_cast<size_t>(file.gcount()) != tail.size()) {
+            throw std::runtime_error("Failed to load texture image, truncated DDS mip chain");
+        }
+    } else {
+        std::vector<char> block = getPlaceholderBlock(format);
+        for (size_t i = 0; i < tail.size(); i += block.size()) {
+            memcpy(tail.data() + i, block.data(), std::min(block.size(), tail.size() - i));
+        }
+    }
+
+    // Levels above the tail stay undefined until they are streamed in, the min LOD keeps shaders off them
+    texture->tailUploadId = device->GetUploadManager()->UploadToImage(tail.data(), tailSize, texture->image, regions, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, device->GetQueueIndex(QueueFlags::Graphics));
+    model->SetTexture(texture->image, format, texture->mipLevels);
+    model->SetTextureMinLod(static_cast<float>(texture->residentLevel));
+
+    if (texture->compressed) {
+        texture->decoded = device->GetThreadPool()->Submit([texture]() { readCompressedLevels(texture); });
+    } else {
+        texture->decoded = device->GetThreadPool()->Submit([texture]() { decodeImage(texture); });
+    }
+
+    textures.push_back(texture);
+    return texture;
+}
+
+void TextureStreamer::SetBounds(StreamedTexture* texture, const glm::vec3& center, float radius) {
+    texture->hasBounds = true;
+    texture->center = center;
+    texture->radius = radius;
+}
+
+bool TextureStreamer::IsResident(const StreamedTexture* texture) const {
+    return texture->residentLevel == 0;
+}
+
+float TextureStreamer::GetPriority(const StreamedTexture* texture, const glm::vec3& eye) const {
+    if (!texture->hasBounds) {
+        return std::numeric_limits<float>::max();
+    }
+
+    // Proportional to the size of the bounding sphere on screen
+    float dist = std::max(glm::distance(eye, texture->center) - texture->radius, 0.001f);
+    return texture->radius / dist;
+}
+
+void TextureStreamer::ReplaceTail(StreamedTexture* texture) {
+    // The placeholder levels are sampled by every frame, so they are overwritten on the graphics queue in order with them
+    VkDeviceSize tailSize = 0;
+    std::vector<VkBufferImageCopy> regions;
+    for (uint32_t level = texture->placeholderLevel; level < texture->mipLevels; ++level) {
+        regions.push_back(Image::GetLevelRegion(texture->width, texture->height, level, tailSize));
+        tailSize += texture->levels[level].size();
+    }
+
+    StreamedTexture::TailReplacement& replacement = texture->tailReplacement;
+    BufferUtils::CreateBuffer(device, tailSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, replacement.stagingBuffer, replacement.stagingBufferMemory);
+    char* stagingData = static_cast<char*>(device->GetAllocator()->Map(replacement.stagingBufferMemory));
+    for (uint32_t level = texture->placeholderLevel; level < texture->mipLevels; ++level) {
+        memcpy(stagingData + regions[level - texture->placeholderLevel].bufferOffset, texture->levels[level].data(), texture->levels[level].size());
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = graphicsCommandPool;
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device->GetVkDevice(), &allocInfo, &replacement.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate texture streaming command buffer");
+    }
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    if (vkCreateFence(device->GetVkDevice(), &fenceInfo, nullptr, &replacement.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture streaming fence");
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(replacement.commandBuffer, &beginInfo);
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = texture->image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = texture->placeholderLevel;
+    barrier.subresourceRange.levelCount = texture->mipLevels - texture->placeholderLevel;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(replacement.commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    vkCmdCopyBufferToImage(replacement.commandBuffer, replacement.stagingBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(replacement.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    vkEndCommandBuffer(replacement.commandBuffer);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &replacement.commandBuffer;
+
+    if (vkQueueSubmit(device->GetQueue(QueueFlags::Graphics), 1, &submitInfo, replacement.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit texture streaming command buffer");
+    }
+}
+
+void TextureStreamer::RetireTailReplacement(StreamedTexture* texture, bool wait) {
+    StreamedTexture::TailReplacement& replacement = texture->tailReplacement;
+    if (replacement.fence == VK_NULL_HANDLE) {
+        return;
+    }
+
+    if (wait) {
+        vkWaitForFences(device->GetVkDevice(), 1, &replacement.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    } else if (vkGetFenceStatus(device->GetVkDevice(), replacement.fence) != VK_SUCCESS) {
+        return;
+    }
+
+    vkDestroyFence(device->GetVkDevice(), replacement.fence, nullptr);
+    vkFreeCommandBuffers(device->GetVkDevice(), graphicsCommandPool, 1, &replacement.commandBuffer);
+    vkDestroyBuffer(device->GetVkDevice(), replacement.stagingBuffer, nullptr);
+    device->GetAllocator()->Free(replacement.stagingBufferMemory);
+    replacement = StreamedTexture::TailReplacement();
+}
+
+void TextureStreamer::PublishLevels(StreamedTexture* texture) {
+    UploadManager* uploadManager = device->GetUploadManager();
+
+    // Levels are uploaded in order, so they complete in order
+    while (!texture->pendingLevels.empty()) {
+        StreamedTexture::PendingLevel& pending = texture->pendingLevels.front();
+        if (pending.publishUpdate == 0) {
+            if (!uploadManager->IsComplete(pending.uploadId)) {
+                break;
+            }
+            // The acquire has just been submitted to the graphics queue. Frames submitted before it may still be
+            // running until framesInFlight more frames have waited on their fences, the new min LOD waits for them
+            pending.publishUpdate = updateCount + framesInFlight;
+        }
+        if (updateCount < pending.publishUpdate) {
+            break;
+        }
+
+        // Either value is safe for every frame still in flight, so the uniform is written in place
+        texture->residentLevel = pending.level;
+        texture->model->SetTextureMinLod(static_cast<float>(pending.level));
+        texture->pendingLevels.pop_front();
+    }
+}
+
+void TextureStreamer::Update(const glm::vec3& eye) {
+    ++updateCount;
+
+    UploadManager* uploadManager = device->GetUploadManager();
+    std::vector<StreamedTexture*> streaming;
+    for (StreamedTexture* texture : textures) {
+        if (!texture->decodeDone && texture->decoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            // Rethrows decode errors
+            texture->decoded.get();
+            texture->decodeDone = true;
+        }
+
+        // Checking completion also submits the tail's acquire, which the replacement is then queued behind
+        if (texture->decodeDone && !texture->compressed && !texture->tailReplaced && uploadManager->IsComplete(texture->tailUploadId)) {
+            ReplaceTail(texture);
+            texture->tailReplaced = true;
+        }
+
+        RetireTailReplacement(texture, false);
+        PublishLevels(texture);
+
+        if (texture->decodeDone && texture->nextLevel > 0) {
+            streaming.push_back(texture);
+        }
+    }
+
+    std::stable_sort(streaming.begin(), streaming.end(), [&](const StreamedTexture* a, const StreamedTexture* b) {
+        return GetPriority(a, eye) > GetPriority(b, eye);
+    });
+
+    // Coarse levels first, so every texture sharpens gradually. A level larger than the budget goes alone
+    VkDeviceSize uploadedBytes = 0;
+    for (StreamedTexture* texture : streaming) {
+        while (texture->nextLevel > 0) {
+            uint32_t level = texture->nextLevel - 1;
+            std::vector<char>& levelData = texture->levels[level];
+            if (uploadedBytes > 0 && uploadedBytes + levelData.size() > bytesPerUpdate) {
+                break;
+            }
+
+            std::vector<VkBufferImageCopy> regions = { Image::GetLevelRegion(texture->width, texture->height, level, 0) };
+            StreamedTexture::PendingLevel pending;
+            pending.level = level;
+            pending.uploadId = uploadManager->UploadToImage(levelData.data(), levelData.size(), texture->image, regions, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, device->GetQueueIndex(QueueFlags::Graphics));
+            pending.publishUpdate = 0;
+            texture->pendingLevels.push_back(pending);
+            texture->nextLevel = level;
+            uploadedBytes += levelData.size();
+
+            // The staging ring has its own copy
+            std::vector<char>().swap(levelData);
+        }
+        if (uploadedBytes >= bytesPerUpdate) {
+            break;
+        }
+    }
+
+    if (uploadedBytes > 0) {
+        uploadManager->Flush();
+    }
+}
+
+TextureStreamer::~TextureStreamer() {
+    for (StreamedTexture* texture : textures) {
+        if (texture->decoded.valid()) {
+            texture->decoded.wait();
+        }
+        RetireTailReplacement(texture, true);
+        vkDestroyImage(device->GetVkDevice(), texture->image, nullptr);
+        device->GetAllocator()->Free(texture->imageMemory);
+        delete texture;
+    }
+    vkDestroyCommandPool(device->GetVkDevice(), graphicsCommandPool, nullptr);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+#include "MemoryAllocator.h"
+
+class Device;
+class Model;
+
+// Texture whose mips stream in from the coarsest to the finest. The image and the model's view of it cover the whole
+// chain from the start, so descriptors written once stay valid while the model's min LOD follows what is resident
+struct StreamedTexture {
+    // Levels uploaded but not yet published to the model
+    struct PendingLevel {
+        uint32_t level;
+        uint64_t uploadId;
+        // Update from which every frame that could read the new min LOD was submitted after the level's acquire, 0
+        // until the upload completes
+        uint64_t publishUpdate;
+    };
+
+    // Placeholder levels of a decoded image being overwritten on the graphics queue
+    struct TailReplacement {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;
+        MemoryAllocation stagingBufferMemory;
+    };
+
+    std::string path;
+    Model* model;
+    VkImage image;
+    MemoryAllocation imageMemory;
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    bool compressed;
+
+    // Levels from placeholderLevel on are resident from the start. Compressed files bring their own, anything else
+    // gets a flat placeholder that is replaced once the file is decoded
+    uint32_t placeholderLevel;
+    // Finest level the model samples, and the next level to upload, which counts down to 0
+    uint32_t residentLevel;
+    uint32_t nextLevel;
+    std::deque<PendingLevel> pendingLevels;
+    // Upload of the levels resident from the start. Placeholders are replaced only once it has completed and its
+    // acquire has been submitted, so that neither can land on top of the decoded levels
+    uint64_t tailUploadId;
+    bool tailReplaced = false;
+    TailReplacement tailReplacement;
+
+    // Written by a worker of the thread pool, owned by the streamer once decoded is ready
+    std::future<void> decoded;
+    bool decodeDone = false;
+    std::vector<std::vector<char>> levels;
+
+    // Streaming priority, textures without bounds come first
+    bool hasBounds = false;
+    glm::vec3 center;
+    float radius;
+};
+
+// Loads textures in the background. Reading and decoding files runs on the device's thread pool, uploads go through
+// the transfer queue a budget of bytes at a time, and the coarsest levels are resident before Load returns, so the
+// number of textures does not add to startup time
+class TextureStreamer {
+private:
+    Device* device;
+    uint32_t framesInFlight;
+    VkDeviceSize bytesPerUpdate;
+    VkCommandPool graphicsCommandPool = VK_NULL_HANDLE;
+
+    std::vector<StreamedTexture*> textures;
+    uint64_t updateCount = 0;
+
+    void ReplaceTail(StreamedTexture* texture);
+    void RetireTailReplacement(StreamedTexture* texture, bool wait);
+    void PublishLevels(StreamedTexture* texture);
+    float GetPriority(const StreamedTexture* texture, const glm::vec3& eye) const;
+
+public:
+    // Levels no larger than this are resident as soon as a texture is loaded
+    static constexpr uint32_t PLACEHOLDER_DIM = 16;
+    static constexpr VkDeviceSize DEFAULT_BYTES_PER_UPDATE = 8 * 1024 * 1024;
+
+    TextureStreamer() = delete;
+    TextureStreamer(Device* device, uint32_t framesInFlight, VkDeviceSize bytesPerUpdate = DEFAULT_BYTES_PER_UPDATE);
+    // Waits for decodes still running, the GPU must be done with the textures
+    ~TextureStreamer();
+
+    // Creates the texture of model from a BC1, BC3 or BC7 DDS file, or from any image stb decodes to format
+    StreamedTexture* Load(const char* path, Model* model, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+    // World space bounding sphere of what the texture covers, for prioritizing by screen coverage
+    void SetBounds(StreamedTexture* texture, const glm::vec3& center, float radius);
+    bool IsResident(const StreamedTexture* texture) const;
+
+    // Called once per frame before it is recorded. Starts uploads for the textures with the highest priority and
+    // publishes levels to models once no frame in flight can sample them before they are acquired
+    void Update(const glm::vec3& eye);
+};
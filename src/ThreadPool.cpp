@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <memory>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+        // hardware_concurrency is 0 when unknown
+        threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::Work, this);
+    }
+}
+
+void ThreadPool::Work() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> job) {
+    // Captures the job's exception in its future instead of letting it escape the worker
+    auto task = std::make_shared<std::packaged_task<void()>>(std::move(job));
+    std::future<void> future = task->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back([task]() { (*task)(); });
+    }
+    jobAvailable.notify_one();
+    return future;
+}
+
+void ThreadPool::WaitAll(std::vector<std::future<void>>& futures) {
+    for (std::future<void>& future : futures) {
+        future.wait();
+    }
+    for (std::future<void>& future : futures) {
+        future.get();
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
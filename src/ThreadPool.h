@@ -0,0 +1,33 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running jobs in submission order, for work like compiling pipelines and decoding textures
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping = false;
+
+    void Work();
+
+public:
+    // One worker per hardware thread besides the calling one if threadCount is 0
+    ThreadPool(uint32_t threadCount = 0);
+    // Runs the jobs still queued before returning
+    ~ThreadPool();
+
+    // Exceptions thrown by the job are rethrown by the future's get
+    std::future<void> Submit(std::function<void()> job);
+
+    // Waits for every job, then rethrows the first exception any of them threw
+    static void WaitAll(std::vector<std::future<void>>& futures);
+};
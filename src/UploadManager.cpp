@@ -0,0 +1,635 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include "UploadManager.h"
+#include "BufferUtils.h"
+#include "Device.h"
+#include "Instance.h"
+
+constexpr VkDeviceSize UploadManager::DEFAULT_RING_SIZE;
+constexpr VkDeviceSize UploadManager::RING_ALIGNMENT;
+
+UploadManager::UploadManager(Device* device, VkDeviceSize ringSize)
+  : device(device), transferQueueFamily(device->GetQueueIndex(QueueFlags::Transfer)), ringSize(ringSize) {
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = transferQueueFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    if (vkCreateCommandPool(device->GetVkDevice(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upload command pool");
+    }
+
+    BufferUtils::CreateBuffer(device, ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, ringBuffer, ringBufferMemory);
+    ringData = static_cast<char*>(device->GetAllocator()->Map(ringBufferMemory));
+}
+
+VkCommandBuffer UploadManager::GetCommandBuffer() {
+    if (batchOpen) {
+        return openBatch.commandBuffer;
+    }
+
+    if (!freeBatches.empty()) {
+        openBatch = std::move(freeBatches.back());
+        freeBatches.pop_back();
+    } else {
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(device->GetVkDevice(), &allocInfo, &openBatch.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate upload command buffer");
+        }
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(device->GetVkDevice(), &fenceInfo, nullptr, &openBatch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create upload fence");
+        }
+    }
+
+    openBatch.id = nextBatchId++;
+    openBatch.ringBytes = 0;
+    batchOpen = true;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(openBatch.commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording upload command buffer");
+    }
+    return openBatch.commandBuffer;
+}
+
+bool UploadManager::TryReserveRing(VkDeviceSize size, VkDeviceSize& offset, VkDeviceSize& consumed) {
+    // Start at the next aligned byte, or wrap around to the start if the rest of the ring is too short
+    offset = (ringHead + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+    if (offset + size <= ringSize) {
+        consumed = offset - ringHead + size;
+    } else {
+        offset = 0;
+        consumed = ringSize - ringHead + size;
+    }
+
+    // Live bytes end at ringHead, so the new range cannot overlap them as long as the total fits
+    if (ringUsed + consumed > ringSize) {
+        return false;
+    }
+
+    ringHead = offset + size;
+    ringUsed += consumed;
+    return true;
+}
+
+void UploadManager::Stage(const void* data, VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset) {
+    if (size > ringSize) {
+        // Too large for the ring, give it a staging buffer of its own
+        VkBuffer stagingBuffer;
+        MemoryAllocation stagingBufferMemory;
+        BufferUtils::CreateBuffer(device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        memcpy(device->GetAllocator()->Map(stagingBufferMemory), data, static_cast<size_t>(size));
+
+        GetCommandBuffer();
+        openBatch.stagingBuffers.push_back(std::make_pair(stagingBuffer, stagingBufferMemory));
+        buffer = stagingBuffer;
+        offset = 0;
+        return;
+    }
+
+    // Out of ring space, wait for the oldest batch to give its bytes back
+    VkDeviceSize consumed;
+    while (!TryReserveRing(size, offset, consumed)) {
+        if (!pendingBatches.empty()) {
+            Retire(true);
+        } else {
+            Submit();
+        }
+    }
+
+    GetCommandBuffer();
+    openBatch.ringBytes += consumed;
+    memcpy(ringData + offset, data, static_cast<size_t>(size));
+    buffer = ringBuffer;
+}
+
+uint64_t UploadManager::Submit() {
+    if (vkEndCommandBuffer(openBatch.commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record upload command buffer");
+    }
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &openBatch.commandBuffer;
+
+    if (vkQueueSubmit(device->GetQueue(QueueFlags::Transfer), 1, &submitInfo, openBatch.fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit upload command buffer");
+    }
+
+    uint64_t batchId = openBatch.id;
+    pendingBatches.push_back(std::move(openBatch));
+    openBatch = Batch();
+    batchOpen = false;
+    return batchId;
+}
+
+void UploadManager::Retire(bool waitOldest) {
+    RetireAcquires(false);
+
+    std::vector<VkBufferMemoryBarrier> bufferAcquires;
+    std::vector<VkImageMemoryBarrier> imageAcquires;
+    std::vector<MipGeneration> mipGenerations;
+
+    // Batches complete in submission order
+    while (!pendingBatches.empty()) {
+        Batch& batch = pendingBatches.front();
+        if (waitOldest) {
+            vkWaitForFences(device->GetVkDevice(), 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+            waitOldest = false;
+        } else if (vkGetFenceStatus(device->GetVkDevice(), batch.fence) != VK_SUCCESS) {
+            break;
+        }
+
+        ringUsed -= batch.ringBytes;
+        for (auto& stagingBuffer : batch.stagingBuffers) {
+            vkDestroyBuffer(device->GetVkDevice(), stagingBuffer.first, nullptr);
+            device->GetAllocator()->Free(stagingBuffer.second);
+        }
+        batch.stagingBuffers.clear();
+        bufferAcquires.insert(bufferAcquires.end(), batch.bufferAcquires.begin(), batch.bufferAcquires.end());
+        imageAcquires.insert(imageAcquires.end(), batch.imageAcquires.begin(), batch.imageAcquires.end());
+        mipGenerations.insert(mipGenerations.end(), batch.mipGenerations.begin(), batch.mipGenerations.end());
+        batch.bufferAcquires.clear();
+        batch.imageAcquires.clear();
+        batch.mipGenerations.clear();
+        vkResetFences(device->GetVkDevice(), 1, &batch.fence);
+
+        completedBatchId = batch.id;
+        freeBatches.push_back(std::move(batch));
+        pendingBatches.pop_front();
+    }
+
+    // Nothing in flight, start over at the front so that large uploads do not have to wrap
+    if (ringUsed == 0) {
+        ringHead = 0;
+    }
+
+    // The releases have executed, so the owning queues can acquire now without waiting on the transfer queue
+    if (!bufferAcquires.empty() || !imageAcquires.empty()) {
+        SubmitAcquires(bufferAcquires, imageAcquires, mipGenerations);
+    }
+}
+
+VkQueue UploadManager::GetQueue(uint32_t queueFamily) {
+    if (queueFamily == device->GetQueueIndex(QueueFlags::Graphics)) {
+        return device->GetQueue(QueueFlags::Graphics);
+    }
+    if (queueFamily == device->GetQueueIndex(QueueFlags::Compute)) {
+        return device->GetQueue(QueueFlags::Compute);
+    }
+    throw std::runtime_error("Failed to acquire upload, no queue of the destination family");
+}
+
+void UploadManager::SubmitAcquires(const std::vector<VkBufferMemoryBarrier>& bufferAcquires, const std::vector<VkImageMemoryBarrier>& imageAcquires, const std::vector<MipGeneration>& mipGenerations) {
+    // One command buffer per owning family
+    std::vector<uint32_t> queueFamilies;
+    for (const VkBufferMemoryBarrier& barrier : bufferAcquires) {
+        if (std::find(queueFamilies.begin(), queueFamilies.end(), barrier.dstQueueFamilyIndex) == queueFamilies.end()) {
+            queueFamilies.push_back(barrier.dstQueueFamilyIndex);
+        }
+    }
+    for (const VkImageMemoryBarrier& barrier : imageAcquires) {
+        if (std::find(queueFamilies.begin(), queueFamilies.end(), barrier.dstQueueFamilyIndex) == queueFamilies.end()) {
+            queueFamilies.push_back(barrier.dstQueueFamilyIndex);
+        }
+    }
+
+    for (uint32_t queueFamily : queueFamilies) {
+        std::vector<VkBufferMemoryBarrier> familyBufferAcquires;
+        std::copy_if(bufferAcquires.begin(), bufferAcquires.end(), std::back_inserter(familyBufferAcquires), [&](const VkBufferMemoryBarrier& b) { return b.dstQueueFamilyIndex == queueFamily; });
+        std::vector<VkImageMemoryBarrier> familyImageAcquires;
+        std::copy_if(imageAcquires.begin(), imageAcquires.end(), std::back_inserter(familyImageAcquires), [&](const VkImageMemoryBarrier& b) { return b.dstQueueFamilyIndex == queueFamily; });
+
+        if (acquireCommandPools.count(queueFamily) == 0) {
+            VkCommandPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.queueFamilyIndex = queueFamily;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+            if (vkCreateCommandPool(device->GetVkDevice(), &poolInfo, nullptr, &acquireCommandPools[queueFamily]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create acquire command pool");
+            }
+        }
+
+        AcquireSubmission submission;
+        submission.queueFamily = queueFamily;
+
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = acquireCommandPools[queueFamily];
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(device->GetVkDevice(), &allocInfo, &submission.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate acquire command buffer");
+        }
+
+        if (!freeAcquireFences.empty()) {
+            submission.fence = freeAcquireFences.back();
+            freeAcquireFences.pop_back();
+        } else {
+            VkFenceCreateInfo fenceInfo = {};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+            if (vkCreateFence(device->GetVkDevice(), &fenceInfo, nullptr, &submission.fence) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create acquire fence");
+            }
+        }
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(submission.commandBuffer, &beginInfo);
+
+        // Everything submitted to the queue afterwards is ordered after the acquire
+        vkCmdPipelineBarrier(submission.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+            static_cast<uint32_t>(familyBufferAcquires.size()), familyBufferAcquires.data(),
+            static_cast<uint32_t>(familyImageAcquires.size()), familyImageAcquires.data());
+
+        // Mips are generated once their first level has been acquired
+        if (queueFamily == device->GetQueueIndex(QueueFlags::Graphics)) {
+            for (const MipGeneration& mipGeneration : mipGenerations) {
+                RecordMipGeneration(submission.commandBuffer, mipGeneration);
+            }
+        }
+
+        vkEndCommandBuffer(submission.commandBuffer);
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &submission.commandBuffer;
+
+        if (vkQueueSubmit(GetQueue(queueFamily), 1, &submitInfo, submission.fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit acquire command buffer");
+        }
+        pendingAcquires.push_back(submission);
+    }
+}
+
+void UploadManager::RetireAcquires(bool waitAll) {
+    // Acquires on different queues may complete out of order, so only look at those that are done
+    for (auto it = pendingAcquires.begin(); it != pendingAcquires.end();) {
+        if (waitAll) {
+            vkWaitForFences(device->GetVkDevice(), 1, &it->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        } else if (vkGetFenceStatus(device->GetVkDevice(), it->fence) != VK_SUCCESS) {
+            ++it;
+            continue;
+        }
+
+        vkFreeCommandBuffers(device->GetVkDevice(), acquireCommandPools[it->queueFamily], 1, &it->commandBuffer);
+        vkResetFences(device->GetVkDevice(), 1, &it->fence);
+        freeAcquireFences.push_back(it->fence);
+        it = pendingAcquires.erase(it);
+    }
+}
+
+void UploadManager::WaitLocked(uint64_t batchId) {
+    if (batchOpen && openBatch.id <= batchId) {
+        Submit();
+    }
+    while (completedBatchId < batchId && !pendingBatches.empty()) {
+        Retire(true);
+    }
+}
+
+uint64_t UploadManager::UploadToBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset, uint32_t dstQueueFamily) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    VkBuffer src;
+    VkBufferCopy copyRegion = {};
+    Stage(data, size, src, copyRegion.srcOffset);
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+
+    VkCommandBuffer commandBuffer = GetCommandBuffer();
+    vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegion);
+
+    // Hand an exclusive buffer over to the queue family that reads it
+    if (dstQueueFamily != VK_QUEUE_FAMILY_IGNORED && dstQueueFamily != transferQueueFamily) {
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = transferQueueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+        barrier.buffer = dst;
+        barrier.offset = dstOffset;
+        barrier.size = size;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        openBatch.bufferAcquires.push_back(barrier);
+    }
+
+    return openBatch.id;
+}
+
+uint64_t UploadManager::UploadToImage(const void* data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, VkImageLayout layout, uint32_t dstQueueFamily) {
+    VkBufferImageCopy region = {};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { width, height, 1 };
+
+    return UploadToImage(data, size, image, std::vector<VkBufferImageCopy>{ region }, layout, dstQueueFamily);
+}
+
+uint64_t UploadManager::UploadToImage(const void* data, VkDeviceSize size, VkImage image, const std::vector<VkBufferImageCopy>& regions, VkImageLayout layout, uint32_t dstQueueFamily) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    VkBuffer src;
+    VkDeviceSize srcOffset;
+    Stage(data, size, src, srcOffset);
+
+    uint32_t baseMipLevel = std::numeric_limits<uint32_t>::max();
+    uint32_t endMipLevel = 0;
+    std::vector<VkBufferImageCopy> stagedRegions(regions);
+    for (VkBufferImageCopy& region : stagedRegions) {
+        region.bufferOffset += srcOffset;
+        baseMipLevel = std::min(baseMipLevel, region.imageSubresource.mipLevel);
+        endMipLevel = std::max(endMipLevel, region.imageSubresource.mipLevel + 1);
+    }
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = baseMipLevel;
+    barrier.subresourceRange.levelCount = endMipLevel - baseMipLevel;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    VkCommandBuffer commandBuffer = GetCommandBuffer();
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    vkCmdCopyBufferToImage(commandBuffer, src, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(stagedRegions.size()), stagedRegions.data());
+
+    // The transfer queue knows no shader stages, readers are ordered after the batch by waiting on its fence.
+    // An exclusive image is handed over to the queue family that reads it in the same barrier
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = layout;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    bool release = dstQueueFamily != VK_QUEUE_FAMILY_IGNORED && dstQueueFamily != transferQueueFamily;
+    if (release) {
+        barrier.srcQueueFamilyIndex = transferQueueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    if (release) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        openBatch.imageAcquires.push_back(barrier);
+    }
+
+    return openBatch.id;
+}
+
+uint64_t UploadManager::UploadToImageWithMips(const void* data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout layout) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    VkBuffer src;
+    VkBufferImageCopy region = {};
+    Stage(data, size, src, region.bufferOffset);
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { width, height, 1 };
+
+    // Only the first level is touched here, the others stay undefined until the blits
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    VkCommandBuffer commandBuffer = GetCommandBuffer();
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    vkCmdCopyBufferToImage(commandBuffer, src, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    MipGeneration mipGeneration;
+    mipGeneration.image = image;
+    mipGeneration.width = width;
+    mipGeneration.height = height;
+    mipGeneration.mipLevels = mipLevels;
+    mipGeneration.layout = layout;
+
+    // The first level becomes the source of the blits, handed over to the graphics queue unless this one can blit
+    uint32_t graphicsQueueFamily = device->GetQueueIndex(QueueFlags::Graphics);
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    if (graphicsQueueFamily == transferQueueFamily) {
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        RecordMipGeneration(commandBuffer, mipGeneration);
+        return openBatch.id;
+    }
+
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = transferQueueFamily;
+    barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    openBatch.imageAcquires.push_back(barrier);
+    openBatch.mipGenerations.push_back(mipGeneration);
+
+    return openBatch.id;
+}
+
+void UploadManager::RecordMipGeneration(VkCommandBuffer commandBuffer, const MipGeneration& mipGeneration) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = mipGeneration.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    if (mipGeneration.mipLevels > 1) {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.subresourceRange.baseMipLevel = 1;
+        barrier.subresourceRange.levelCount = mipGeneration.mipLevels - 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    // Each level is blitted from the one before, which is then ready to be read by the next blit
+    int32_t mipWidth = static_cast<int32_t>(mipGeneration.width);
+    int32_t mipHeight = static_cast<int32_t>(mipGeneration.height);
+    for (uint32_t level = 1; level < mipGeneration.mipLevels; ++level) {
+        int32_t nextWidth = std::max(mipWidth / 2, 1);
+        int32_t nextHeight = std::max(mipHeight / 2, 1);
+
+        VkImageBlit blit = {};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+        blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+        vkCmdBlitImage(commandBuffer, mipGeneration.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mipGeneration.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.subresourceRange.baseMipLevel = level;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        mipWidth = nextWidth;
+        mipHeight = nextHeight;
+    }
+
+    // Everything submitted to the queue afterwards is ordered after the blits
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = mipGeneration.layout;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipGeneration.mipLevels;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+uint64_t UploadManager::CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = size;
+    vkCmdCopyBuffer(GetCommandBuffer(), src, dst, 1, &copyRegion);
+    return openBatch.id;
+}
+
+uint64_t UploadManager::TransitionImage(VkImage image, uint32_t mipLevels, uint32_t arrayLayers, VkImageLayout layout, uint32_t dstQueueFamily) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = arrayLayers;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = 0;
+
+    // Like the uploads, readers are ordered after the batch by waiting on its fence
+    bool release = dstQueueFamily != VK_QUEUE_FAMILY_IGNORED && dstQueueFamily != transferQueueFamily;
+    if (release) {
+        barrier.srcQueueFamilyIndex = transferQueueFamily;
+        barrier.dstQueueFamilyIndex = dstQueueFamily;
+    }
+    vkCmdPipelineBarrier(GetCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    if (release) {
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        openBatch.imageAcquires.push_back(barrier);
+    }
+
+    return openBatch.id;
+}
+
+uint64_t UploadManager::Flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (batchOpen) {
+        Submit();
+    }
+    return nextBatchId - 1;
+}
+
+bool UploadManager::IsComplete(uint64_t batchId) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Retire(false);
+    return completedBatchId >= batchId;
+}
+
+void UploadManager::Wait(uint64_t batchId) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    WaitLocked(batchId);
+}
+
+UploadManager::~UploadManager() {
+    WaitLocked(nextBatchId - 1);
+    RetireAcquires(true);
+
+    for (Batch& batch : freeBatches) {
+        vkDestroyFence(device->GetVkDevice(), batch.fence, nullptr);
+    }
+    for (VkFence fence : freeAcquireFences) {
+        vkDestroyFence(device->GetVkDevice(), fence, nullptr);
+    }
+    for (auto& acquireCommandPool : acquireCommandPools) {
+        vkDestroyCommandPool(device->GetVkDevice(), acquireCommandPool.second, nullptr);
+    }
+    vkDestroyCommandPool(device->GetVkDevice(), commandPool, nullptr);
+
+    vkDestroyBuffer(device->GetVkDevice(), ringBuffer, nullptr);
+    device->GetAllocator()->Free(ringBufferMemory);
+}
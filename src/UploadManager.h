@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "MemoryAllocator.h"
+
+class Device;
+
+// Records buffer and image uploads into batches that are submitted together on the transfer queue. Source data is
+// copied into a persistently mapped staging ring right away, so callers can drop it as soon as an upload returns.
+// Every upload returns the id of its batch, which is waited on only when the data is about to be used.
+// Exclusively owned destinations are released by the transfer queue and acquired by the owning queue once their batch
+// completes, so acquires are submitted to the graphics and compute queues from the thread that waits on uploads
+class UploadManager {
+private:
+    // Mips of an image blitted from its first level once the graphics queue owns it
+    struct MipGeneration {
+        VkImage image;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels;
+        VkImageLayout layout;
+    };
+
+    struct Batch {
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        uint64_t id;
+        // Ring bytes consumed by the batch, including alignment and wrap padding, given back once its fence signals
+        VkDeviceSize ringBytes;
+        // Staging buffers for uploads that do not fit in the ring, destroyed once its fence signals
+        std::vector<std::pair<VkBuffer, MemoryAllocation>> stagingBuffers;
+        // Acquire halves of the ownership transfers released by the batch
+        std::vector<VkBufferMemoryBarrier> bufferAcquires;
+        std::vector<VkImageMemoryBarrier> imageAcquires;
+        // Recorded after the acquires on the graphics queue
+        std::vector<MipGeneration> mipGenerations;
+    };
+
+    struct AcquireSubmission {
+        uint32_t queueFamily;
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+    };
+
+    Device* device;
+    VkCommandPool commandPool;
+    uint32_t transferQueueFamily;
+
+    VkBuffer ringBuffer;
+    MemoryAllocation ringBufferMemory;
+    char* ringData;
+    VkDeviceSize ringSize;
+    // Next free byte and bytes still read by open or pending batches, the oldest live byte is ringHead - ringUsed
+    VkDeviceSize ringHead = 0;
+    VkDeviceSize ringUsed = 0;
+
+    // Batch being recorded, if batchOpen
+    Batch openBatch;
+    bool batchOpen = false;
+    // Submitted, oldest first
+    std::deque<Batch> pendingBatches;
+    // Completed, ready to be recorded again
+    std::vector<Batch> freeBatches;
+
+    // Pools of the acquire command buffers by queue family, and acquires the owning queues may still be executing
+    std::map<uint32_t, VkCommandPool> acquireCommandPools;
+    std::deque<AcquireSubmission> pendingAcquires;
+    std::vector<VkFence> freeAcquireFences;
+
+    uint64_t nextBatchId = 1;
+    uint64_t completedBatchId = 0;
+
+    std::mutex mutex;
+
+    // The following expect the mutex to be held
+    VkCommandBuffer GetCommandBuffer();
+    void Stage(const void* data, VkDeviceSize size, VkBuffer& buffer, VkDeviceSize& offset);
+    bool TryReserveRing(VkDeviceSize size, VkDeviceSize& offset, VkDeviceSize& consumed);
+    uint64_t Submit();
+    void Retire(bool waitOldest);
+    void SubmitAcquires(const std::vector<VkBufferMemoryBarrier>& bufferAcquires, const std::vector<VkImageMemoryBarrier>& imageAcquires, const std::vector<MipGeneration>& mipGenerations);
+    // Expects the first level in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL and the others undefined
+    void RecordMipGeneration(VkCommandBuffer commandBuffer, const MipGeneration& mipGeneration);
+    void RetireAcquires(bool waitAll);
+    VkQueue GetQueue(uint32_t queueFamily);
+    void WaitLocked(uint64_t batchId);
+
+public:
+    static constexpr VkDeviceSize DEFAULT_RING_SIZE = 32 * 1024 * 1024;
+    // Satisfies the buffer offset rules of buffer to image copies for every format used here
+    static constexpr VkDeviceSize RING_ALIGNMENT = 16;
+
+    UploadManager() = delete;
+    UploadManager(Device* device, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+    ~UploadManager();
+
+    // dst must have been created with VK_BUFFER_USAGE_TRANSFER_DST_BIT. dstQueueFamily owns an exclusive dst afterwards,
+    // leave it ignored for concurrently shared buffers
+    uint64_t UploadToBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset = 0, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
+    // Tightly packed texels of the first mip, the image goes from undefined to layout
+    uint64_t UploadToImage(const void* data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, VkImageLayout layout, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
+    // A range of mips at the offsets into data given by regions, e.g. a block-compressed mip chain. Every level
+    // the regions touch goes from undefined to layout, levels outside the range are left alone
+    uint64_t UploadToImage(const void* data, VkDeviceSize size, VkImage image, const std::vector<VkBufferImageCopy>& regions, VkImageLayout layout, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
+    // Uploads the first mip like UploadToImage and fills the others by blitting each from the one before. Blits need a
+    // graphics queue, so an exclusive image ends up owned by the graphics family. The image needs transfer source usage
+    // and a format that supports linear blits
+    uint64_t UploadToImageWithMips(const void* data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout layout);
+    uint64_t CopyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+    // Takes every level and layer of an image from undefined to layout without uploading anything, e.g. for images
+    // that shaders write. A concurrently shared image must list the transfer family among its queue families
+    uint64_t TransitionImage(VkImage image, uint32_t mipLevels, uint32_t arrayLayers, VkImageLayout layout, uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED);
+
+    // Submits the batch being recorded, returns the id of the last submitted batch
+    uint64_t Flush();
+    bool IsComplete(uint64_t batchId);
+    // Submits the batch first if it is still being recorded
+    void Wait(uint64_t batchId);
+};
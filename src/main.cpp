@@ -2,20 +2,100 @@
 #include <glm/glm.hpp>
 #include "Instance.h"
 #include "Window.h"
-#include "Renderer.h"
+#include "ForwardRenderer.h"
 #include "DeferredRenderer.h"
 #include "VisibilityRenderer.h"
 #include "Camera.h"
 #include "Scene.h"
-#include "Image.h"
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 
+#define PRINT_MEMORY_STATS 0
+
 Device* device;
 SwapChain* swapChain;
-VisibilityRenderer* renderer;
+Renderer* renderer;
 Camera* camera;
 
 namespace {
+    // Renderers the number keys and --renderer switch between
+    enum RendererType {
+        ForwardRendererType,
+        DeferredRendererType,
+        VisibilityRendererType,
+        RendererTypeCount,
+    };
+    const char* rendererOptions[RendererTypeCount] = { "forward", "deferred", "visibility" };
+
+    RendererType currentRenderer = VisibilityRendererType;
+    RendererType requestedRenderer = VisibilityRendererType;
+    // Pass timings of every renderer used so far, as of when it was last switched away from or printed
+    std::vector<GpuTiming> rendererTimings[RendererTypeCount];
+    bool printTimingsRequested = false;
+
+    Renderer* createRenderer(RendererType type, Scene* scene) {
+        switch (type) {
+        case ForwardRendererType:
+            return new ForwardRenderer(device, swapChain, scene, camera);
+        case DeferredRendererType:
+            return new DeferredRenderer(device, swapChain, scene, camera);
+        default:
+            return new VisibilityRenderer(device, swapChain, scene, camera);
+        }
+    }
+
+    // One row per pass and one column per renderer, passes a renderer does not have are left blank
+    void printTimings() {
+        rendererTimings[currentRenderer] = renderer->GetPassTimings();
+
+        std::vector<std::string> passes;
+        for (uint32_t r = 0; r < RendererTypeCount; ++r) {
+            for (const GpuTiming& timing : rendererTimings[r]) {
+                if (std::find(passes.begin(), passes.end(), timing.name) == passes.end()) {
+                    passes.push_back(timing.name);
+                }
+            }
+        }
+        if (passes.empty()) {
+            printf("no GPU timings, the device has no timestamps\n");
+            return;
+        }
+
+        printf("%-16s", "GPU ms");
+        for (uint32_t r = 0; r < RendererTypeCount; ++r) {
+            printf("%12s", rendererOptions[r]);
+        }
+        printf("\n");
+
+        float totals[RendererTypeCount] = {};
+        for (const std::string& pass : passes) {
+            printf("%-16s", pass.c_str());
+            for (uint32_t r = 0; r < RendererTypeCount; ++r) {
+                auto timing = std::find_if(rendererTimings[r].begin(), rendererTimings[r].end(), [&pass](const GpuTiming& t) { return t.name == pass; });
+                if (timing == rendererTimings[r].end()) {
+                    printf("%12s", "");
+                } else {
+                    printf("%12.3f", timing->milliseconds);
+                    totals[r] += timing->milliseconds;
+                }
+            }
+            printf("\n");
+        }
+
+        printf("%-16s", "total");
+        for (uint32_t r = 0; r < RendererTypeCount; ++r) {
+            if (rendererTimings[r].empty()) {
+                printf("%12s", "");
+            } else {
+                printf("%12.3f", totals[r]);
+            }
+        }
+        printf("\n");
+    }
+
     void resizeCallback(GLFWwindow* window, int width, int height) {
         if (width == 0 || height == 0) return;
 
@@ -100,6 +180,15 @@ namespace {
 				camera->ResetCamera();
 				camera->UpdateOrbit(0.0f, 0.0f, 0.0f);
 			}
+		} else if (key >= GLFW_KEY_1 && key < GLFW_KEY_1 + RendererTypeCount) {
+			// Switched between frames in the main loop
+			if (action == GLFW_PRESS) {
+				requestedRenderer = static_cast<RendererType>(key - GLFW_KEY_1);
+			}
+		} else if (key == GLFW_KEY_T) {
+			if (action == GLFW_PRESS) {
+				printTimingsRequested = true;
+			}
 		}
 
 		if (keyPressedA || keyPressedS || keyPressedD || keyPressedW || keyPressedQ || keyPressedE) {
@@ -156,8 +245,22 @@ namespace {
     }
 }
 
-int main() {
+int main(int argc, char** argv) {
     static constexpr char* applicationName = "Vulkan Procedural Terrain Generator";
+
+    // --renderer forward|deferred|visibility picks the renderer to start with
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc) {
+            const char* option = argv[++i];
+            auto type = std::find_if(std::begin(rendererOptions), std::end(rendererOptions), [option](const char* o) { return strcmp(o, option) == 0; });
+            if (type == std::end(rendererOptions)) {
+                throw std::runtime_error(std::string("Unknown renderer ") + option);
+            }
+            currentRenderer = static_cast<RendererType>(type - std::begin(rendererOptions));
+            requestedRenderer = currentRenderer;
+        }
+    }
+
     InitializeWindow(640, 480, applicationName);
 
     unsigned int glfwExtensionCount = 0;
@@ -177,39 +280,23 @@ int main() {
     deviceFeatures.fillModeNonSolid = VK_TRUE;
     deviceFeatures.samplerAnisotropy = VK_TRUE;
 
-    device = instance->CreateDevice(QueueFlagBit::GraphicsBit | QueueFlagBit::TransferBit | QueueFlagBit::ComputeBit | QueueFlagBit::PresentBit, deviceFeatures);
+    // Block-compressed textures are used when the device samples them, see below
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(instance->GetPhysicalDevice(), &supportedFeatures);
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
 
-    swapChain = device->CreateSwapChain(surface, 5);
+    device = instance->CreateDevice(QueueFlagBit::GraphicsBit | QueueFlagBit::TransferBit | QueueFlagBit::ComputeBit | QueueFlagBit::PresentBit, deviceFeatures);
 
-    camera = new Camera(device, 640.f / 480.f);
+    // Frames the CPU may record while the GPU is still rendering earlier ones
+    uint32_t framesInFlight = 2;
 
-    VkCommandPoolCreateInfo transferPoolInfo = {};
-    transferPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    transferPoolInfo.queueFamilyIndex = device->GetInstance()->GetQueueFamilyIndices()[QueueFlags::Transfer];
-    transferPoolInfo.flags = 0;
+    swapChain = device->CreateSwapChain(surface, 5, framesInFlight);
 
-    VkCommandPool transferCommandPool;
-    if (vkCreateCommandPool(device->GetVkDevice(), &transferPoolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create command pool");
-    }
-
-    VkImage grassImage;
-    VkDeviceMemory grassImageMemory;
-    Image::FromFile(device,
-        transferCommandPool,
-        "images/grass.jpg",
-        VK_FORMAT_R8G8B8A8_UNORM,
-        VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-        grassImage,
-        grassImageMemory
-    );
+    camera = new Camera(device, 640.f / 480.f, framesInFlight);
 
     float planeDim = 15.f;
     float halfWidth = planeDim * 0.5f;
-    Model* plane = new Model(device, transferCommandPool,
+    Model* plane = new Model(device,
         {
             { { -1.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f },{ 0.0f, 1.0f } },
             { { 1.0f, 1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },{ 1.0f, 1.0f } },
@@ -218,40 +305,97 @@ int main() {
         },
         { 0, 1, 2, 2, 3, 0 }
     );
-    plane->SetTexture(grassImage);
-    
-    Blades* blades = new Blades(device, transferCommandPool, planeDim);
-
-    vkDestroyCommandPool(device->GetVkDevice(), transferCommandPool, nullptr);
 
-    Scene* scene = new Scene(device);
+    // Prefer a pre-compressed texture with its mips baked in, otherwise decode the JPEG on a worker thread. Either way
+    // only the smallest mips are resident before the first frame and the rest stream in while rendering
+    TextureStreamer* textureStreamer = new TextureStreamer(device, framesInFlight);
+    if (supportedFeatures.textureCompressionBC && std::ifstream("images/grass.dds").good()) {
+        textureStreamer->Load("images/grass.dds", plane);
+    } else {
+        textureStreamer->Load("images/grass.jpg", plane, VK_FORMAT_R8G8B8A8_UNORM);
+    }
+    
+    // 16x16 roots of 160 units give a view range of over a kilometre in every direction,
+    // refined down to the 5 unit tiles of the old fixed grid near the camera
+    float rootTileDim = 160.0f;
+    uint32_t rootGridDim = 16;
+    float minTileDim = 5.0f;
+    float lodThreshold = 1.0f;
+    uint32_t maxTiles = 1 << 14;
+    float targetEdgePixels = 8.0f;
+    Blades* blades = new Blades(device, rootTileDim, rootGridDim, minTileDim, lodThreshold, maxTiles, targetEdgePixels, framesInFlight);
+
+    // Uploads above are only recorded so far, submit them together while the renderer is being created.
+    // The renderer waits for them before its first frame
+    device->GetUploadManager()->Flush();
+
+    Scene* scene = new Scene(device, framesInFlight);
     scene->AddModel(plane);
     scene->AddBlades(blades);
 
-    //renderer = new Renderer(device, swapChain, scene, camera);
-    //renderer = new DeferredRenderer(device, swapChain, scene, camera);
-    renderer = new VisibilityRenderer(device, swapChain, scene, camera);
+    // Tiles sit at a height of 1, see Blades
+    Terrain* terrain = new Terrain(scene->GetNoiseParams(), 1.0f);
+    camera->SetTerrain(terrain);
+    camera->UpdateOrbit(0.0f, 0.0f, 0.0f);
+
+    renderer = createRenderer(currentRenderer, scene);
+
+#if PRINT_MEMORY_STATS
+    MemoryAllocatorStats memoryStats = device->GetAllocator()->GetStats();
+    printf("memory blocks: %u (%llu bytes), allocations: %u (%llu bytes), free ranges: %u, fragmentation: %.2f\n",
+        memoryStats.blockCount, (unsigned long long)memoryStats.blockBytes, memoryStats.allocationCount, (unsigned long long)memoryStats.usedBytes,
+        memoryStats.freeRangeCount, memoryStats.fragmentation);
+#endif // PRINT_MEMORY_STATS
 
     glfwSetWindowSizeCallback(GetGLFWWindow(), resizeCallback);
     glfwSetMouseButtonCallback(GetGLFWWindow(), mouseDownCallback);
 	glfwSetCursorPosCallback(GetGLFWWindow(), mouseMoveCallback);
 	glfwSetKeyCallback(GetGLFWWindow(), keyPressCallback);
 
+    double titleTime = glfwGetTime();
+
     while (!ShouldQuit()) {
         glfwPollEvents();
+
+        // Only the renderer is recreated, the device, swap chain, scene and camera carry over
+        if (requestedRenderer != currentRenderer) {
+            rendererTimings[currentRenderer] = renderer->GetPassTimings();
+            delete renderer;
+            currentRenderer = requestedRenderer;
+            renderer = createRenderer(currentRenderer, scene);
+        }
+
+        if (printTimingsRequested) {
+            printTimings();
+            printTimingsRequested = false;
+        }
+
+        // Live GPU time of the current renderer, press T for every pass of every renderer
+        if (glfwGetTime() - titleTime > 0.5) {
+            float milliseconds = 0.0f;
+            for (const GpuTiming& timing : renderer->GetPassTimings()) {
+                milliseconds += timing.milliseconds;
+            }
+
+            char title[256];
+            snprintf(title, sizeof(title), "%s - %s - %.2f ms GPU", applicationName, renderer->GetName(), milliseconds);
+            glfwSetWindowTitle(GetGLFWWindow(), title);
+            titleTime = glfwGetTime();
+        }
+
         scene->UpdateTime();
+        textureStreamer->Update(glm::vec3(glm::inverse(camera->GetCBO().viewMatrix)[3]));
         renderer->Frame();
     }
 
     vkDeviceWaitIdle(device->GetVkDevice());
 
-    vkDestroyImage(device->GetVkDevice(), grassImage, nullptr);
-    vkFreeMemory(device->GetVkDevice(), grassImageMemory, nullptr);
-
     delete scene;
     delete plane;
+    delete textureStreamer;
     delete blades;
     delete camera;
+    delete terrain;
     delete renderer;
     delete swapChain;
     delete device;
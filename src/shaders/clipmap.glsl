@@ -0,0 +1,64 @@
+// Terrain height baked by clipmap.comp, shared by the tessellation evaluation shaders and the visibility resolve
+// so that both see the same surface. Include with
+// #extension GL_GOOGLE_include_directive : require
+// Set 2 bindings 0 and 1 must not be reused by the including shader
+
+// Height above the tile base in x, its gradient along x and z in yz, one layer per level
+layout(set = 2, binding = 0) uniform sampler2DArray heightClipmap;
+
+struct ClipmapLevel {
+	ivec2 origin;
+	ivec2 previousOrigin;
+};
+
+layout(std430, set = 2, binding = 1) readonly buffer ClipmapState {
+	float baseTexelSize;
+	uint levelCount;
+	ClipmapLevel levels[];
+} clipmap;
+
+// Width of the band, in texels, over which a level fades into the next coarser one at the edge of its window
+#define CLIPMAP_BLEND_TEXELS 32.0
+
+// Baked terrain at world position p from the finest clipmap level whose window covers it,
+// faded into the next coarser level towards the edge of the window
+vec3 sampleHeightClipmap(vec2 p) {
+	float resolution = float(textureSize(heightClipmap, 0).x);
+	int lastLevel = int(clipmap.levelCount) - 1;
+
+	for (int level = 0; level < lastLevel; ++level) {
+		float texelSize = clipmap.baseTexelSize * float(1 << level);
+		vec2 texel = p / texelSize;
+
+		// Distance to the edge of the window, less the texel the bilinear footprint needs
+		vec2 windowMin = vec2(clipmap.levels[level].origin);
+		vec2 border = min(texel - windowMin, windowMin + resolution - 1.0 - texel) - 1.0;
+		float borderDist = min(border.x, border.y);
+		if (borderDist < 0.0) {
+			continue;
+		}
+
+		vec3 value = textureLod(heightClipmap, vec3((texel + 0.5) / resolution, float(level)), 0.0).xyz;
+		float fade = clamp(borderDist / CLIPMAP_BLEND_TEXELS, 0.0, 1.0);
+		if (fade < 1.0) {
+			vec2 coarseTexel = p / (texelSize * 2.0);
+			vec3 coarseValue = textureLod(heightClipmap, vec3((coarseTexel + 0.5) / resolution, float(level + 1)), 0.0).xyz;
+			value = mix(coarseValue, value, fade);
+		}
+		return value;
+	}
+
+	// Past the finer windows. The coarsest window is sized to reach across the whole quadtree, see HeightClipmap
+	float texelSize = clipmap.baseTexelSize * float(1 << lastLevel);
+	return textureLod(heightClipmap, vec3((p / texelSize + 0.5) / resolution, float(lastLevel)), 0.0).xyz;
+}
+
+// World position of the vertex at tessCoord of a tile, with the baked terrain there in terrain.
+// The vertex shader passes the origin and base height of the tile in xyz and its size in w
+vec4 tessellatedTerrainPosition(vec4 tile, vec2 tessCoord, out vec3 terrain) {
+	vec4 worldPos = vec4(tile.xyz, 1.0);
+	worldPos.xz += tessCoord * tile.w;
+	terrain = sampleHeightClipmap(worldPos.xz);
+	worldPos.y += terrain.x;
+	return worldPos;
+}
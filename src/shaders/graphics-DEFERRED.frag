@@ -1,25 +1,51 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+layout(set = 0, binding = 0) uniform CameraBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec3 cameraPos;
+    mat4 inverseViewProj;
+} camera;
 
 layout(set = 1, binding = 1) uniform sampler2D texSampler;
 
-layout (set = 1, binding = 2) uniform sampler2D samplerAlbedo;
-layout (set = 1, binding = 3) uniform sampler2D samplerPosition;
-layout (set = 1, binding = 4) uniform sampler2D samplerNormal;
+// Written by the geometry subpass, read at this pixel
+layout (input_attachment_index = 0, set = 1, binding = 2) uniform subpassInput inputAlbedo;
+layout (input_attachment_index = 1, set = 1, binding = 3) uniform subpassInput inputNormal;
+layout (input_attachment_index = 2, set = 1, binding = 4) uniform subpassInput inputDepth;
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
+#include "octahedral.glsl"
+
+// World position of the pixel at uv, from its depth
+vec3 reconstructPosition(vec2 uv, float depth) {
+	vec4 position = camera.inverseViewProj * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	return position.xyz / position.w;
+}
+
 void main() {
     //outColor = vec4(fragTexCoord.x, fragTexCoord.y, 0.0, 1.0);//texture(texSampler, fragTexCoord);
 	// Lambertian Shading
 	const vec3 lightDirection = -normalize(vec3(2.0f, 1.0f, 2.0f));
-	vec4 albedo = texture(samplerAlbedo, fragTexCoord);
+	vec4 albedo = subpassLoad(inputAlbedo);
+	vec3 position = reconstructPosition(fragTexCoord, subpassLoad(inputDepth).r);
 	const float ambient = 0.2;
-	vec3 normal = texture(samplerNormal, fragTexCoord).xyz;
-	float dotProd = (dot(normalize(normal), lightDirection));
-	vec4 color = albedo * dotProd + vec4(ambient);
+	vec3 normal = normalize(octahedralDecode(subpassLoad(inputNormal).xy));
+	float dotProd = (dot(normal, lightDirection));
+	// Blinn-Phong highlight, the view vector needs the position of the pixel. The terrain normal and lightDirection
+	// both point down, so both are flipped to face the eye. cameraPos is the orbit target, not the eye
+	const float shininess = 32.0;
+	const float specularStrength = 0.2;
+	vec3 eyePos = (inverse(camera.view) * vec4(0, 0, 0, 1)).xyz;
+	vec3 viewDirection = normalize(eyePos - position);
+	vec3 halfway = normalize(viewDirection - lightDirection);
+	float specular = dotProd > 0.0 ? specularStrength * pow(max(dot(-normal, halfway), 0.0), shininess) : 0.0;
+	vec4 color = albedo * dotProd + vec4(ambient) + vec4(specular);
 	outColor = vec4(color.xyz, 1.0);
 }
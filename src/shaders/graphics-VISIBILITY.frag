@@ -1,66 +1,46 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+layout(set = 0, binding = 0) uniform CameraBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec3 cameraPos;
+    mat4 inverseViewProj;
+} camera;
 
 layout(set = 1, binding = 1) uniform sampler2D texSampler;
 
-layout (set = 1, binding = 2) uniform sampler2D samplerVisibility;
+// Written by the geometry subpass, read at this pixel
+layout (input_attachment_index = 0, set = 1, binding = 2) uniform usubpassInput inputVisibility;
+layout (input_attachment_index = 1, set = 1, binding = 3) uniform subpassInput inputDepth;
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
-// https://gist.github.com/patriciogonzalezvivo/670c22f3966e662d2f83
-float rand(vec2 n) { 
-	return fract(sin(dot(n, vec2(12.9898, 4.1414))) * 43758.5453);
-}
+#include "clipmap.glsl"
+#include "visibility.glsl"
 
-float noise(vec2 p){
-	vec2 ip = floor(p);
-	vec2 u = fract(p);
-	u = u*u*(3.0-2.0*u);
-	
-	float res = mix(
-		mix(rand(ip),rand(ip+vec2(1.0,0.0)),u.x),
-		mix(rand(ip+vec2(0.0,1.0)),rand(ip+vec2(1.0,1.0)),u.x),u.y);
-	return res*res;
-}
-
-// http://flafla2.github.io/2014/08/09/perlinnoise.html
-float smoothNoise(vec2 p){
-	float total = 0.0;
-	float freq = 1.0;
-	float ampl = 1.0;
-	float maxVal = 0.0;
-	for (int i = 0; i < 6; i++) {
-		total += noise(p * freq) * ampl;
-		maxVal += ampl;
-		ampl *= 0.5;
-		freq *= 2.0;
-	}
-	return total / maxVal;
+// World position of the pixel at uv, from its depth
+vec3 reconstructPosition(vec2 uv, float depth) {
+	vec4 position = camera.inverseViewProj * vec4(uv * 2.0 - 1.0, depth, 1.0);
+	return position.xyz / position.w;
 }
 
 void main() {
-	vec4 viz = texture(samplerVisibility, fragTexCoord);
-	vec4 worldPos = vec4(viz.x, 1.0, viz.z, 1.0);
-	vec2 uv = viz.yw; // not used yet
-
-	// Re-compute noise
-	worldPos.y += smoothNoise(worldPos.xz * 0.125) * 6.0;
+	uint visibility = subpassLoad(inputVisibility).r;
+	if (visibility == VISIBILITY_EMPTY) {
+		// No terrain, the sky the swap chain was cleared to shows through
+		discard;
+	}
 
-	// Re-compute normal
-	float deviation = 0.0001;
-	vec3 posXOffset = worldPos.xyz;
-	posXOffset.x += 1.0 * deviation;
-	posXOffset.y = 1.0;
-	posXOffset.y += smoothNoise(posXOffset.xz * 0.125) * 6.0;
-	vec3 posZOffset = worldPos.xyz;
-	posZOffset.z += 1.0 * deviation;
-	posZOffset.y = 1.0;
-	posZOffset.y += smoothNoise(posZOffset.xz * 0.125) * 6.0;
+	// Where the pixel is on the ground, and the gradient there from the same clipmap grass-VISIBILITY.tese sampled
+	vec3 worldPos = reconstructPosition(fragTexCoord, subpassLoad(inputDepth).r);
+	vec3 terrain = sampleHeightClipmap(worldPos.xz);
 
-	vec3 normal = normalize(cross(posXOffset - worldPos.xyz, posZOffset - worldPos.xyz));
+	vec3 normal = normalize(cross(vec3(1.0, terrain.y, 0.0), vec3(0.0, terrain.z, 1.0)));
 
 	// Lambertian Shading
 	const vec3 lightDirection = -normalize(vec3(2.0f, 1.0f, 2.0f));
@@ -1,5 +1,6 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
 layout(set = 0, binding = 0) uniform CameraBufferObject {
     mat4 view;
@@ -10,11 +11,12 @@ layout(set = 0, binding = 0) uniform CameraBufferObject {
 layout(location = 0) in vec2 fs_uv;
 layout(location = 1) in vec3 fs_normal;
 layout(location = 2) in vec4 fs_color;
-layout(location = 3) in vec4 fs_pos;
 
+// Position is reconstructed from depth by the lighting subpass
 layout(location = 0) out vec4 outAlbedo;
-layout(location = 1) out vec4 outPosition;
-layout(location = 2) out vec4 outNormal;
+layout(location = 1) out vec2 outNormal;
+
+#include "octahedral.glsl"
 
 void main() {
 #if 0
@@ -40,6 +42,5 @@ void main() {
 #endif
 
 	outAlbedo = vec4(0.75, 0.75, 0.75, 1.0);
-	outPosition = fs_pos;
-	outNormal = vec4(fs_normal, 0.0);
+	outNormal = octahedralEncode(normalize(fs_normal));
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
 layout(set = 0, binding = 0) uniform CameraBufferObject {
     mat4 view;
@@ -10,9 +11,11 @@ layout(set = 0, binding = 0) uniform CameraBufferObject {
 layout(location = 0) in vec2 fs_uv;
 layout(location = 1) in vec3 fs_normal;
 layout(location = 2) in vec4 fs_color;
-layout(location = 3) in vec4 fs_pos;
+layout(location = 3) flat in uint fs_tileIndex;
 
-layout(location = 0) out vec4 outVisibility;
+layout(location = 0) out uint outVisibility;
+
+#include "visibility.glsl"
 
 void main() {
 #if 0
@@ -37,5 +40,5 @@ void main() {
 	color = color * dotProd + ambient;
 #endif
 
-	outVisibility = vec4(fs_pos.x, fs_uv.x, fs_pos.z, fs_uv.y);
+	outVisibility = encodeVisibility(fs_tileIndex);
 }
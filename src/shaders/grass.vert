@@ -1,53 +1,26 @@
-
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
-#define PI_OVER_TWO 1.57079632679
 
 layout(set = 1, binding = 0) uniform ModelBufferObject {
     mat4 model;
 };
 
-// TODO: Declare vertex shader inputs and outputs
-
-layout(location = 0) in vec4 vs_v0;
-layout(location = 1) in vec4 vs_v1;
-layout(location = 2) in vec4 vs_v2;
-layout(location = 3) in vec4 vs_up;
-layout(location = 4) in vec4 vs_color;
+// A tile written by the compute pass, see Tile in Blades.h
+layout(location = 0) in ivec2 vs_origin;
+layout(location = 1) in uint vs_sizeAndHeight;
+layout(location = 2) in uvec4 vs_edgeTessLevels;
 
-layout(location = 0) out vec4 tesc_v1;
-layout(location = 1) out vec4 tesc_v2;
-layout(location = 2) out vec4 tesc_up;
-layout(location = 3) out vec4 tesc_bitangent;
-layout(location = 4) out vec4 tesc_color;
+layout(location = 0) out vec4 tesc_edgeTessLevels;
 
 out gl_PerVertex {
     vec4 gl_Position;
 };
 
 void main() {
-	// TODO: Write gl_Position and any other shader outputs
-	// compute v0 in world space
-	vec4 worldV0 = model * vec4(vs_v0.xyz, 1.0);
-	gl_Position = vs_v0;
-
-	
-	tesc_v1 = vs_v1;
-
-	// compute v2 in world space
-	vec4 worldV2 = model * vec4(vs_v2.xyz, 1.0);
-	tesc_v2 = worldV2;
-
-	// compute up in world space
-	vec4 worldUp = normalize(model * vec4(vs_up.xyz, 0.0));
-	tesc_up = worldUp;
-
-	// pass color along
-	tesc_color = vs_color;
+	// Origin of the tile in xyz and its size in w
+	vec2 sizeAndHeight = unpackHalf2x16(vs_sizeAndHeight);
+	vec2 origin = vec2(vs_origin) * sizeAndHeight.x;
+	gl_Position = vec4(origin.x, sizeAndHeight.y, origin.y, sizeAndHeight.x);
 
-	// add pi / 2 to get direction along width	
-	float orientation = vs_v0.w - PI_OVER_TWO;
-	vec4 worldBitangent = normalize(model * vec4(cos(orientation), 0.0, sin(orientation), 0.0));
-	//tesc_orientationAndWidth = vec4(worldOrientation.xyz, vs_v2.w);
-	tesc_bitangent = vec4(worldBitangent.xyz, vs_v2.w); // store width in W
+	tesc_edgeTessLevels = vec4(vs_edgeTessLevels);
 }
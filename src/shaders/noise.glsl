@@ -0,0 +1,162 @@
+// Terrain noise shared by every shader that needs terrain height. Include with
+// #extension GL_GOOGLE_include_directive : require
+// The kernel and the shape of the fractal sum are specialization constants, see NoiseParams in Noise.h.
+// The constant ids must not be reused by the including shader
+
+#define NOISE_KERNEL_VALUE 0
+#define NOISE_KERNEL_PERLIN 1
+#define NOISE_KERNEL_SIMPLEX 2
+
+#define NOISE_HASH_SINE 0
+#define NOISE_HASH_INTEGER 1
+
+layout(constant_id = 0) const int NOISE_KERNEL = NOISE_KERNEL_VALUE;
+layout(constant_id = 1) const int NOISE_HASH = NOISE_HASH_INTEGER;
+layout(constant_id = 2) const int NOISE_OCTAVES = 6;
+layout(constant_id = 3) const float NOISE_LACUNARITY = 2.0;
+layout(constant_id = 4) const float NOISE_GAIN = 0.5;
+layout(constant_id = 5) const uint NOISE_SEED = 0;
+layout(constant_id = 6) const float TERRAIN_FREQUENCY = 0.125;
+layout(constant_id = 7) const float TERRAIN_AMPLITUDE = 6.0;
+
+// https://gist.github.com/patriciogonzalezvivo/670c22f3966e662d2f83
+float rand(vec2 n) {
+	return fract(sin(dot(n, vec2(12.9898, 4.1414))) * 43758.5453);
+}
+
+// Integer lattice hash, cheaper than sin and identical on every GPU
+// http://iquilezles.org/www/articles/sfrand/sfrand.htm
+float randInteger(uvec2 x) {
+	uvec2 q = 1103515245u * ((x >> 1u) ^ x.yx);
+	uint n = 1103515245u * (q.x ^ (q.y >> 3u));
+	return float(n) * (1.0 / float(0xffffffffu));
+}
+
+// Value in [0, 1) at lattice point ip
+float hash(vec2 ip) {
+	if (NOISE_HASH == NOISE_HASH_INTEGER) {
+		return randInteger(uvec2(ivec2(ip)) + uvec2(NOISE_SEED, NOISE_SEED * 2654435761u));
+	}
+	return rand(ip + float(NOISE_SEED) * vec2(17.0, 59.0));
+}
+
+// Unit gradient at lattice point ip
+vec2 gradient(vec2 ip) {
+	float angle = 6.2831853 * hash(ip);
+	return vec2(cos(angle), sin(angle));
+}
+
+// Value noise in x and its analytic gradient in yz
+// http://iquilezles.org/www/articles/morenoise/morenoise.htm
+vec3 valueNoised(vec2 p) {
+	vec2 ip = floor(p);
+	vec2 f = fract(p);
+	vec2 u = f*f*(3.0-2.0*f);
+	vec2 du = 6.0*f*(1.0-f);
+
+	float a = hash(ip);
+	float b = hash(ip+vec2(1.0,0.0));
+	float c = hash(ip+vec2(0.0,1.0));
+	float d = hash(ip+vec2(1.0,1.0));
+
+	float res = a + (b-a)*u.x + (c-a)*u.y + (a-b-c+d)*u.x*u.y;
+	vec2 dres = du * (vec2(b-a, c-a) + (a-b-c+d)*u.yx);
+
+	// Squared like the original noise, so the gradient follows the chain rule
+	return vec3(res*res, 2.0*res*dres);
+}
+
+// Gradient noise with a quintic fade, remapped to [0, 1]
+// http://iquilezles.org/www/articles/gradientnoise/gradientnoise.htm
+vec3 perlinNoised(vec2 p) {
+	vec2 ip = floor(p);
+	vec2 f = fract(p);
+	vec2 u = f*f*f*(f*(f*6.0-15.0)+10.0);
+	vec2 du = 30.0*f*f*(f*(f-2.0)+1.0);
+
+	vec2 ga = gradient(ip);
+	vec2 gb = gradient(ip+vec2(1.0,0.0));
+	vec2 gc = gradient(ip+vec2(0.0,1.0));
+	vec2 gd = gradient(ip+vec2(1.0,1.0));
+
+	float va = dot(ga, f);
+	float vb = dot(gb, f-vec2(1.0,0.0));
+	float vc = dot(gc, f-vec2(0.0,1.0));
+	float vd = dot(gd, f-vec2(1.0,1.0));
+
+	float res = va + u.x*(vb-va) + u.y*(vc-va) + u.x*u.y*(va-vb-vc+vd);
+	vec2 dres = ga + u.x*(gb-ga) + u.y*(gc-ga) + u.x*u.y*(ga-gb-gc+gd) + du*(u.yx*(va-vb-vc+vd) + vec2(vb,vc) - va);
+
+	return vec3(0.5 + 0.5*res, 0.5*dres);
+}
+
+// Simplex noise, fewer lattice points per sample than the square kernels, remapped to [0, 1]
+// http://iquilezles.org/www/articles/morenoise/morenoise.htm
+vec3 simplexNoised(vec2 p) {
+	const float K1 = 0.366025404; // (sqrt(3)-1)/2
+	const float K2 = 0.211324865; // (3-sqrt(3))/6
+
+	vec2 ip = floor(p + (p.x+p.y)*K1);
+	vec2 a = p - ip + (ip.x+ip.y)*K2;
+	float m = step(a.y, a.x);
+	vec2 o = vec2(m, 1.0-m);
+	vec2 b = a - o + K2;
+	vec2 c = a - 1.0 + 2.0*K2;
+
+	vec2 ga = gradient(ip);
+	vec2 gb = gradient(ip+o);
+	vec2 gc = gradient(ip+1.0);
+
+	vec3 h = max(0.5 - vec3(dot(a,a), dot(b,b), dot(c,c)), 0.0);
+	vec3 h2 = h*h;
+	vec3 h4 = h2*h2;
+	vec3 n = vec3(dot(ga,a), dot(gb,b), dot(gc,c));
+
+	float res = dot(h4, n);
+	vec2 dres = -8.0*(h2.x*h.x*n.x*a + h2.y*h.y*n.y*b + h2.z*h.z*n.z*c) + h4.x*ga + h4.y*gb + h4.z*gc;
+
+	return vec3(0.5 + 35.0*res, 35.0*dres);
+}
+
+// Selected kernel, value in x and its analytic gradient in yz
+vec3 noised(vec2 p) {
+	if (NOISE_KERNEL == NOISE_KERNEL_PERLIN) {
+		return perlinNoised(p);
+	}
+	if (NOISE_KERNEL == NOISE_KERNEL_SIMPLEX) {
+		return simplexNoised(p);
+	}
+	return valueNoised(p);
+}
+
+float noise(vec2 p) {
+	return noised(p).x;
+}
+
+// http://flafla2.github.io/2014/08/09/perlinnoise.html
+vec3 smoothNoised(vec2 p) {
+	vec3 total = vec3(0.0);
+	float freq = 1.0;
+	float ampl = 1.0;
+	float maxVal = 0.0;
+	for (int i = 0; i < NOISE_OCTAVES; i++) {
+		vec3 n = noised(p * freq);
+		total += vec3(n.x, n.yz * freq) * ampl;
+		maxVal += ampl;
+		ampl *= NOISE_GAIN;
+		freq *= NOISE_LACUNARITY;
+	}
+	return total / maxVal;
+}
+
+// Conservative range of terrainHeight's value. Every kernel is remapped to [0, 1] and the fractal sum is
+// normalized by the summed octave amplitudes, so the range only depends on the amplitude
+vec2 terrainHeightRange() {
+	return vec2(0.0, TERRAIN_AMPLITUDE);
+}
+
+// Height above the tile base in x and its gradient along x and z in yz
+vec3 terrainHeight(vec2 p) {
+	vec3 n = smoothNoised(p * TERRAIN_FREQUENCY);
+	return vec3(n.x, n.yz * TERRAIN_FREQUENCY) * TERRAIN_AMPLITUDE;
+}
@@ -0,0 +1,20 @@
+// Unit vectors folded onto an octahedron and flattened into two [-1, 1] components, so that normals fit a two
+// channel attachment. Include with
+// #extension GL_GOOGLE_include_directive : require
+
+vec2 octahedralSignNotZero(vec2 v) {
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 octahedralEncode(vec3 n) {
+	vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+	return n.z <= 0.0 ? (1.0 - abs(p.yx)) * octahedralSignNotZero(p) : p;
+}
+
+vec3 octahedralDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * octahedralSignNotZero(n.xy);
+	}
+	return normalize(n);
+}
@@ -0,0 +1,15 @@
+// Visibility buffer texel: the index of the tile in the culled tiles buffer. The resolve takes the position of the
+// pixel from the depth attachment and the gradient from the clipmap the tile was tessellated with, so no position
+// is quantized into the texel. Include with
+// #extension GL_GOOGLE_include_directive : require
+
+// What the visibility buffer is cleared to. The renderer checks that no tile index reaches it
+#define VISIBILITY_EMPTY 0xFFFFFFFFu
+
+uint encodeVisibility(uint tileIndex) {
+	return tileIndex;
+}
+
+uint decodeVisibilityTile(uint visibility) {
+	return visibility;
+}
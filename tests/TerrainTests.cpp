@@ -0,0 +1,1046 @@
+#include <vulkan/vulkan.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include "Terrain.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Consistency checks of Terrain, run as terrain_tests cpu|gpu.
+// cpu compares the vectorized GetHeights with single queries and the analytic gradient with finite differences.
+// gpu compares GetHeights with noise.glsl evaluated by a CPU implementation of Vulkan, such as lavapipe or
+// SwiftShader, whose results do not depend on the graphics driver. It is skipped where there is none.
+// gpu also bakes the height clipmap with clipmap.comp, draws tiles through grass.vert, grass.tesc and the
+// clipmap sampling of the tessellation evaluation shaders, and compares every vertex with a CPU reference
+
+namespace {
+    // Reported to CTest as a skipped test, see SKIP_RETURN_CODE
+    constexpr int SKIPPED = 77;
+
+    constexpr float BASE_HEIGHT = 1.5f;
+    // Not a multiple of four, so that the SSE2 path also goes through its scalar remainder
+    constexpr size_t SAMPLE_COUNT = 1021;
+
+    // Height clipmap the tessellation checks bake, the coarsest of its windows reaches 32 units from the eye
+    constexpr uint32_t CLIPMAP_RESOLUTION = 64;
+    constexpr uint32_t CLIPMAP_LEVELS = 3;
+    constexpr float CLIPMAP_BASE_TEXEL_SIZE = 0.25f;
+    // Match CLIPMAP_BLEND_TEXELS in clipmap.glsl and CLIPMAP_INVALID_ORIGIN in HeightClipmap.cpp
+    constexpr float CLIPMAP_BLEND_TEXELS = 32.0f;
+    constexpr int32_t CLIPMAP_INVALID_ORIGIN = -(1 << 30);
+
+    // Matches TESS_LEVEL in terrain_patch.tese
+    constexpr uint32_t TESS_LEVEL = 8;
+    constexpr uint32_t PATCH_VERTEX_COUNT = (TESS_LEVEL + 1) * (TESS_LEVEL + 1);
+    // A grid of tiles around the origin that crosses the windows of every clipmap level
+    constexpr int32_t PATCH_GRID_DIM = 12;
+    constexpr float PATCH_DIM = 4.0f;
+    // Off the texel grid of every level
+    const glm::vec3 CLIPMAP_EYE(0.3f, 10.0f, 0.7f);
+
+    // Same layout as Tile in Blades.h, the vertex grass.vert reads
+    struct PatchTile {
+        int32_t originX;
+        int32_t originZ;
+        uint32_t sizeAndHeight;
+        uint32_t edgeTessLevels;
+    };
+
+    // Matches PatchVertex in terrain_patch.tese
+    struct PatchVertex {
+        glm::vec4 position;
+        glm::vec4 terrain;
+    };
+
+    // Every kernel with the given hashes, once with the defaults and once with everything else changed
+    std::vector<NoiseParams> NoiseCases(bool includeSineHash) {
+        std::vector<NoiseParams> cases;
+        for (int32_t hash = includeSineHash ? NOISE_HASH_SINE : NOISE_HASH_INTEGER; hash <= NOISE_HASH_INTEGER; ++hash) {
+            for (int32_t kernel = NOISE_KERNEL_VALUE; kernel <= NOISE_KERNEL_SIMPLEX; ++kernel) {
+                NoiseParams params;
+                params.kernel = kernel;
+                params.hash = hash;
+                cases.push_back(params);
+
+                params.octaves = 4;
+                params.lacunarity = 2.1f;
+                params.gain = 0.45f;
+                params.seed = 7;
+                params.frequency = 0.2f;
+                params.amplitude = 4.0f;
+                cases.push_back(params);
+            }
+        }
+        return cases;
+    }
+
+    std::string CaseName(const NoiseParams& params) {
+        const char* kernels[] = { "value", "perlin", "simplex" };
+        const char* hashes[] = { "sine", "integer" };
+        return std::string(kernels[params.kernel]) + " noise, " + hashes[params.hash] + " hash, seed " + std::to_string(params.seed);
+    }
+
+    // Deterministic spread of points over several tiles on both sides of the origin
+    void SamplePositions(std::vector<float>& x, std::vector<float>& z) {
+        x.resize(SAMPLE_COUNT);
+        z.resize(SAMPLE_COUNT);
+        for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+            x[i] = -20.0f + 40.0f * static_cast<float>((i * 37) % SAMPLE_COUNT) / SAMPLE_COUNT;
+            z[i] = -20.0f + 40.0f * static_cast<float>((i * 101) % SAMPLE_COUNT) / SAMPLE_COUNT;
+        }
+    }
+
+    std::vector<PatchTile> PatchTiles() {
+        std::vector<PatchTile> tiles;
+        for (int32_t z = 0; z < PATCH_GRID_DIM; ++z) {
+            for (int32_t x = 0; x < PATCH_GRID_DIM; ++x) {
+                PatchTile tile;
+                tile.originX = x - PATCH_GRID_DIM / 2;
+                tile.originZ = z - PATCH_GRID_DIM / 2;
+                tile.sizeAndHeight = glm::packHalf2x16(glm::vec2(PATCH_DIM, BASE_HEIGHT));
+                tile.edgeTessLevels = TESS_LEVEL | (TESS_LEVEL << 8) | (TESS_LEVEL << 16) | (TESS_LEVEL << 24);
+                tiles.push_back(tile);
+            }
+        }
+        return tiles;
+    }
+
+    // Texel of a clipmap level as clipmap.comp bakes it into halfs. terrain has a base height of 0
+    glm::vec3 BakedTexel(const Terrain& terrain, glm::ivec2 texel, float texelSize) {
+        glm::vec3 value = terrain.GetHeightAndGradient(static_cast<float>(texel.x) * texelSize, static_cast<float>(texel.y) * texelSize);
+        return glm::vec3(glm::unpackHalf1x16(glm::packHalf1x16(value.x)), glm::unpackHalf1x16(glm::packHalf1x16(value.y)), glm::unpackHalf1x16(glm::packHalf1x16(value.z)));
+    }
+
+    // Bilinear filter between the four baked texels around texel
+    glm::vec3 FilterTexels(const Terrain& terrain, glm::vec2 texel, float texelSize) {
+        glm::vec2 texelFloor = glm::floor(texel);
+        glm::vec2 f = texel - texelFloor;
+        glm::ivec2 i(texelFloor);
+
+        glm::vec3 v00 = BakedTexel(terrain, i, texelSize);
+        glm::vec3 v10 = BakedTexel(terrain, i + glm::ivec2(1, 0), texelSize);
+        glm::vec3 v01 = BakedTexel(terrain, i + glm::ivec2(0, 1), texelSize);
+        glm::vec3 v11 = BakedTexel(terrain, i + glm::ivec2(1, 1), texelSize);
+        return glm::mix(glm::mix(v00, v10, f.x), glm::mix(v01, v11, f.x), f.y);
+    }
+
+    // sampleHeightClipmap in clipmap.glsl, over the windows clipmap.comp centers on eye
+    glm::vec3 SampleClipmap(const Terrain& terrain, glm::vec2 eye, glm::vec2 p) {
+        const float resolution = static_cast<float>(CLIPMAP_RESOLUTION);
+        const int lastLevel = static_cast<int>(CLIPMAP_LEVELS) - 1;
+
+        for (int level = 0; level < lastLevel; ++level) {
+            float texelSize = CLIPMAP_BASE_TEXEL_SIZE * static_cast<float>(1 << level);
+            glm::vec2 texel = p / texelSize;
+
+            glm::vec2 windowMin = glm::floor(eye / texelSize) - resolution * 0.5f;
+            glm::vec2 border = glm::min(texel - windowMin, windowMin + resolution - 1.0f - texel) - 1.0f;
+            float borderDist = std::min(border.x, border.y);
+            if (borderDist < 0.0f) {
+                continue;
+            }
+
+            glm::vec3 value = FilterTexels(terrain, texel, texelSize);
+            float fade = glm::clamp(borderDist / CLIPMAP_BLEND_TEXELS, 0.0f, 1.0f);
+            if (fade < 1.0f) {
+                value = glm::mix(FilterTexels(terrain, p / (texelSize * 2.0f), texelSize * 2.0f), value, fade);
+            }
+            return value;
+        }
+
+        float texelSize = CLIPMAP_BASE_TEXEL_SIZE * static_cast<float>(1 << lastLevel);
+        return FilterTexels(terrain, p / texelSize, texelSize);
+    }
+
+    class Checker {
+    public:
+        // Passes if actual is within tolerance of expected, relative to expected once that exceeds 1
+        void Near(float actual, float expected, float tolerance, const std::string& what) {
+            ++checks;
+            if (!(std::abs(actual - expected) <= tolerance * std::max(1.0f, std::abs(expected)))) {
+                if (++failures <= 20) {
+                    std::cerr << "FAILED: " << what << ": " << actual << ", expected " << expected << std::endl;
+                }
+            }
+        }
+
+        int Report(const char* name) const {
+            std::cout << name << ": " << checks - failures << "/" << checks << " checks passed" << std::endl;
+            return failures == 0 ? 0 : 1;
+        }
+
+    private:
+        size_t checks = 0;
+        size_t failures = 0;
+    };
+
+    int RunCpuChecks() {
+        Checker checker;
+        std::vector<float> x, z;
+        SamplePositions(x, z);
+
+        for (const NoiseParams& params : NoiseCases(true)) {
+            Terrain terrain(params, BASE_HEIGHT);
+            std::string name = CaseName(params);
+
+            // GetHeights takes the SSE2 path for value noise where it is available, GetHeightAndGradient never does.
+            // Both round the same operations in the same order
+            std::vector<float> heights(SAMPLE_COUNT), gradientsX(SAMPLE_COUNT), gradientsZ(SAMPLE_COUNT);
+            terrain.GetHeights(x.data(), z.data(), SAMPLE_COUNT, heights.data(), gradientsX.data(), gradientsZ.data());
+            for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+                glm::vec3 expected = terrain.GetHeightAndGradient(x[i], z[i]);
+                checker.Near(heights[i], expected.x, 1e-5f, name + ": batched height " + std::to_string(i));
+                checker.Near(gradientsX[i], expected.y, 1e-5f, name + ": batched gradient x " + std::to_string(i));
+                checker.Near(gradientsZ[i], expected.z, 1e-5f, name + ": batched gradient z " + std::to_string(i));
+            }
+
+            // Without the gradient outputs
+            std::vector<float> heightsOnly(SAMPLE_COUNT);
+            terrain.GetHeights(x.data(), z.data(), SAMPLE_COUNT, heightsOnly.data());
+            for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+                checker.Near(heightsOnly[i], heights[i], 0.0f, name + ": height without gradients " + std::to_string(i));
+            }
+
+            // Central differences, in double so that the step is not lost to the height's rounding
+            const float step = 1e-3f;
+            for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+                glm::vec3 analytic = terrain.GetHeightAndGradient(x[i], z[i]);
+                double dx = (static_cast<double>(terrain.GetHeight(x[i] + step, z[i])) - terrain.GetHeight(x[i] - step, z[i])) / (2.0 * step);
+                double dz = (static_cast<double>(terrain.GetHeight(x[i], z[i] + step)) - terrain.GetHeight(x[i], z[i] - step)) / (2.0 * step);
+                checker.Near(static_cast<float>(dx), analytic.y, 5e-3f, name + ": finite difference x " + std::to_string(i));
+                checker.Near(static_cast<float>(dz), analytic.z, 5e-3f, name + ": finite difference z " + std::to_string(i));
+            }
+        }
+
+        return checker.Report("cpu");
+    }
+
+    std::vector<char> ReadFile(const std::string& filename) {
+        std::ifstream file(filename, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file " + filename);
+        }
+        std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(buffer.data(), buffer.size());
+        return buffer;
+    }
+
+    // Loads one of the shaders tests/CMakeLists.txt compiles
+    VkShaderModule CreateShaderModule(VkDevice device, const std::string& name) {
+        std::vector<char> code = ReadFile(std::string(TEST_SHADER_DIR) + "/" + name + ".spv");
+        VkShaderModuleCreateInfo shaderInfo = {};
+        shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        shaderInfo.codeSize = code.size();
+        shaderInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device, &shaderInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create shader module " + name);
+        }
+        return shaderModule;
+    }
+
+    // Binding i of the layout has descriptor type types[i]
+    VkDescriptorSetLayout CreateDescriptorSetLayout(VkDevice device, const std::vector<VkDescriptorType>& types, VkShaderStageFlags stages) {
+        std::vector<VkDescriptorSetLayoutBinding> bindings(types.size());
+        for (uint32_t i = 0; i < bindings.size(); ++i) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = types[i];
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = stages;
+        }
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        VkDescriptorSetLayout descriptorSetLayout;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor set layout");
+        }
+        return descriptorSetLayout;
+    }
+
+    // Host visible buffer the test reads and writes directly
+    struct HostBuffer {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        void* data;
+    };
+
+    VkDeviceMemory AllocateMemory(VkPhysicalDevice physicalDevice, VkDevice device, const VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags properties) {
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memoryRequirements.size;
+        allocInfo.memoryTypeIndex = UINT32_MAX;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+            if ((memoryRequirements.memoryTypeBits & (1u << i)) != 0 && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                allocInfo.memoryTypeIndex = i;
+                break;
+            }
+        }
+        if (allocInfo.memoryTypeIndex == UINT32_MAX) {
+            throw std::runtime_error("Failed to find a suitable memory type");
+        }
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate memory");
+        }
+        return memory;
+    }
+
+    HostBuffer CreateHostBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+        HostBuffer result = {};
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &result.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create buffer");
+        }
+
+        VkMemoryRequirements memoryRequirements;
+        vkGetBufferMemoryRequirements(device, result.buffer, &memoryRequirements);
+        result.memory = AllocateMemory(physicalDevice, device, memoryRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        vkBindBufferMemory(device, result.buffer, result.memory, 0);
+        if (vkMapMemory(device, result.memory, 0, size, 0, &result.data) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to map buffer memory");
+        }
+        return result;
+    }
+
+    void DestroyHostBuffer(VkDevice device, const HostBuffer& buffer) {
+        vkDestroyBuffer(device, buffer.buffer, nullptr);
+        vkFreeMemory(device, buffer.memory, nullptr);
+    }
+
+    // Runs terrain_heights.comp over positions and returns height and gradient per position
+    std::vector<glm::vec4> EvaluateOnDevice(VkPhysicalDevice physicalDevice, uint32_t queueFamily, const NoiseParams& params, const std::vector<glm::vec2>& positions) {
+        const uint32_t count = static_cast<uint32_t>(positions.size());
+
+        float queuePriority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo = {};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = queueFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &queuePriority;
+
+        VkDeviceCreateInfo deviceInfo = {};
+        deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+
+        VkDevice device;
+        if (vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create logical device");
+        }
+        VkQueue queue;
+        vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+        HostBuffer positionBuffer = CreateHostBuffer(physicalDevice, device, count * sizeof(glm::vec2));
+        HostBuffer heightBuffer = CreateHostBuffer(physicalDevice, device, count * sizeof(glm::vec4));
+        std::copy(positions.begin(), positions.end(), static_cast<glm::vec2*>(positionBuffer.data));
+
+        VkDescriptorSetLayoutBinding bindings[2] = {};
+        for (uint32_t i = 0; i < 2; ++i) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 2;
+        layoutInfo.pBindings = bindings;
+        VkDescriptorSetLayout descriptorSetLayout;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor set layout");
+        }
+
+        VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) };
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        VkPipelineLayout pipelineLayout;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline layout");
+        }
+
+        VkShaderModule shaderModule = CreateShaderModule(device, "terrain_heights.comp");
+
+        VkSpecializationInfo noiseSpecializationInfo = params.GetSpecializationInfo();
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.stage.pSpecializationInfo = &noiseSpecializationInfo;
+        pipelineInfo.layout = pipelineLayout;
+        VkPipeline pipeline;
+        if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline");
+        }
+        vkDestroyShaderModule(device, shaderModule, nullptr);
+
+        VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 };
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        VkDescriptorPool descriptorPool;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor pool");
+        }
+
+        VkDescriptorSetAllocateInfo setInfo = {};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = descriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &descriptorSetLayout;
+        VkDescriptorSet descriptorSet;
+        if (vkAllocateDescriptorSets(device, &setInfo, &descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate descriptor set");
+        }
+
+        VkDescriptorBufferInfo bufferInfos[2] = {
+            { positionBuffer.buffer, 0, VK_WHOLE_SIZE },
+            { heightBuffer.buffer, 0, VK_WHOLE_SIZE },
+        };
+        VkWriteDescriptorSet writes[2] = {};
+        for (uint32_t i = 0; i < 2; ++i) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+
+        VkCommandPoolCreateInfo commandPoolInfo = {};
+        commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolInfo.queueFamilyIndex = queueFamily;
+        VkCommandPool commandPool;
+        if (vkCreateCommandPool(device, &commandPoolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create command pool");
+        }
+
+        VkCommandBufferAllocateInfo commandBufferInfo = {};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferInfo.commandPool = commandPool;
+        commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &commandBufferInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffer");
+        }
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &count);
+        vkCmdDispatch(commandBuffer, (count + 63) / 64, 1, 1);
+
+        // Make the heights visible to the mapped read below
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer");
+        }
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit command buffer");
+        }
+        vkQueueWaitIdle(queue);
+
+        const glm::vec4* results = static_cast<const glm::vec4*>(heightBuffer.data);
+        std::vector<glm::vec4> heights(results, results + count);
+
+        vkDestroyCommandPool(device, commandPool, nullptr);
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        DestroyHostBuffer(device, positionBuffer);
+        DestroyHostBuffer(device, heightBuffer);
+        vkDestroyDevice(device, nullptr);
+
+        return heights;
+    }
+
+    // Bakes the height clipmap around CLIPMAP_EYE with clipmap.comp, then draws tiles through grass.vert, grass.tesc
+    // and terrain_patch.tese and returns the PATCH_VERTEX_COUNT vertices of every tile. The device needs the
+    // tessellationShader and vertexPipelineStoresAndAtomics features
+    std::vector<PatchVertex> EvaluatePatchesOnDevice(VkPhysicalDevice physicalDevice, uint32_t queueFamily, const NoiseParams& params, const std::vector<PatchTile>& tiles) {
+        const uint32_t vertexCount = static_cast<uint32_t>(tiles.size()) * PATCH_VERTEX_COUNT;
+
+        float queuePriority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo = {};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = queueFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &queuePriority;
+
+        VkPhysicalDeviceFeatures features = {};
+        features.tessellationShader = VK_TRUE;
+        features.vertexPipelineStoresAndAtomics = VK_TRUE;
+
+        VkDeviceCreateInfo deviceInfo = {};
+        deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+        deviceInfo.pEnabledFeatures = &features;
+
+        VkDevice device;
+        if (vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create logical device");
+        }
+        VkQueue queue;
+        vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+        // Camera block of clipmap.comp, only the view matrix is read
+        HostBuffer cameraBuffer = CreateHostBuffer(physicalDevice, device, 2 * sizeof(glm::mat4) + sizeof(glm::vec4), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+        glm::mat4* camera = static_cast<glm::mat4*>(cameraBuffer.data);
+        camera[0] = glm::translate(glm::mat4(1.0f), -CLIPMAP_EYE);
+        camera[1] = glm::mat4(1.0f);
+        *reinterpret_cast<glm::vec4*>(camera + 2) = glm::vec4(CLIPMAP_EYE, 1.0f);
+
+        // Same initial state as HeightClipmap, every window overlaps nothing so that all of it is baked
+        HostBuffer stateBuffer = CreateHostBuffer(physicalDevice, device, 2 * sizeof(uint32_t) + CLIPMAP_LEVELS * sizeof(glm::ivec4));
+        float* baseTexelSize = static_cast<float*>(stateBuffer.data);
+        *baseTexelSize = CLIPMAP_BASE_TEXEL_SIZE;
+        *reinterpret_cast<uint32_t*>(baseTexelSize + 1) = CLIPMAP_LEVELS;
+        glm::ivec4* levels = reinterpret_cast<glm::ivec4*>(baseTexelSize + 2);
+        std::fill(levels, levels + CLIPMAP_LEVELS, glm::ivec4(CLIPMAP_INVALID_ORIGIN));
+
+        HostBuffer tileBuffer = CreateHostBuffer(physicalDevice, device, tiles.size() * sizeof(PatchTile), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        std::copy(tiles.begin(), tiles.end(), static_cast<PatchTile*>(tileBuffer.data));
+
+        // Vertices the shader never writes stay NaN and fail every comparison
+        HostBuffer vertexBuffer = CreateHostBuffer(physicalDevice, device, vertexCount * sizeof(PatchVertex));
+        PatchVertex unwritten;
+        unwritten.position = glm::vec4(std::numeric_limits<float>::quiet_NaN());
+        unwritten.terrain = unwritten.position;
+        std::fill(static_cast<PatchVertex*>(vertexBuffer.data), static_cast<PatchVertex*>(vertexBuffer.data) + vertexCount, unwritten);
+
+        // The clipmap, created as HeightClipmap does
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+        imageInfo.extent = { CLIPMAP_RESOLUTION, CLIPMAP_RESOLUTION, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = CLIPMAP_LEVELS;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImage image;
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create image");
+        }
+        VkMemoryRequirements imageRequirements;
+        vkGetImageMemoryRequirements(device, image, &imageRequirements);
+        VkDeviceMemory imageMemory = AllocateMemory(physicalDevice, device, imageRequirements, 0);
+        vkBindImageMemory(device, image, imageMemory, 0);
+
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.format = imageInfo.format;
+        viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, CLIPMAP_LEVELS };
+        VkImageView imageView;
+        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create image view");
+        }
+
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.maxAnisotropy = 1.0f;
+        VkSampler sampler;
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create sampler");
+        }
+
+        // Sets 0 and 1 of the bake follow clipmap.comp, sets 2 and 3 of the draw follow terrain_patch.tese.
+        // grass.vert and grass.tesc declare sets 0 and 1 without using them
+        VkDescriptorSetLayout cameraLayout = CreateDescriptorSetLayout(device, { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER }, VK_SHADER_STAGE_COMPUTE_BIT);
+        VkDescriptorSetLayout bakeLayout = CreateDescriptorSetLayout(device, { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER }, VK_SHADER_STAGE_COMPUTE_BIT);
+        VkDescriptorSetLayout emptyLayout = CreateDescriptorSetLayout(device, {}, 0);
+        VkDescriptorSetLayout clipmapLayout = CreateDescriptorSetLayout(device, { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER }, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT);
+        VkDescriptorSetLayout vertexLayout = CreateDescriptorSetLayout(device, { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER }, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT);
+
+        VkDescriptorPoolSize poolSizes[] = {
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+            { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+        };
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 4;
+        poolInfo.poolSizeCount = 4;
+        poolInfo.pPoolSizes = poolSizes;
+        VkDescriptorPool descriptorPool;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor pool");
+        }
+
+        VkDescriptorSetLayout setLayouts[] = { cameraLayout, bakeLayout, clipmapLayout, vertexLayout };
+        VkDescriptorSetAllocateInfo setInfo = {};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = descriptorPool;
+        setInfo.descriptorSetCount = 4;
+        setInfo.pSetLayouts = setLayouts;
+        // Camera, bake, clipmap and vertices
+        VkDescriptorSet descriptorSets[4];
+        if (vkAllocateDescriptorSets(device, &setInfo, descriptorSets) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate descriptor sets");
+        }
+
+        VkDescriptorBufferInfo cameraInfo = { cameraBuffer.buffer, 0, VK_WHOLE_SIZE };
+        VkDescriptorBufferInfo stateInfo = { stateBuffer.buffer, 0, VK_WHOLE_SIZE };
+        VkDescriptorBufferInfo vertexInfo = { vertexBuffer.buffer, 0, VK_WHOLE_SIZE };
+        VkDescriptorImageInfo storageImageInfo = { VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo sampledImageInfo = { sampler, imageView, VK_IMAGE_LAYOUT_GENERAL };
+
+        VkWriteDescriptorSet writes[6] = {};
+        for (uint32_t i = 0; i < 6; ++i) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].descriptorCount = 1;
+        }
+        writes[0].dstSet = descriptorSets[0];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writes[0].pBufferInfo = &cameraInfo;
+        writes[1].dstSet = descriptorSets[1];
+        writes[1].dstBinding = 0;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &storageImageInfo;
+        writes[2].dstSet = descriptorSets[1];
+        writes[2].dstBinding = 1;
+        writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[2].pBufferInfo = &stateInfo;
+        writes[3].dstSet = descriptorSets[2];
+        writes[3].dstBinding = 0;
+        writes[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[3].pImageInfo = &sampledImageInfo;
+        writes[4].dstSet = descriptorSets[2];
+        writes[4].dstBinding = 1;
+        writes[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[4].pBufferInfo = &stateInfo;
+        writes[5].dstSet = descriptorSets[3];
+        writes[5].dstBinding = 0;
+        writes[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[5].pBufferInfo = &vertexInfo;
+        vkUpdateDescriptorSets(device, 6, writes, 0, nullptr);
+
+        // Bake pipeline
+        VkDescriptorSetLayout bakeSetLayouts[] = { cameraLayout, bakeLayout };
+        VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) };
+        VkPipelineLayoutCreateInfo bakeLayoutInfo = {};
+        bakeLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        bakeLayoutInfo.setLayoutCount = 2;
+        bakeLayoutInfo.pSetLayouts = bakeSetLayouts;
+        bakeLayoutInfo.pushConstantRangeCount = 1;
+        bakeLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        VkPipelineLayout bakePipelineLayout;
+        if (vkCreatePipelineLayout(device, &bakeLayoutInfo, nullptr, &bakePipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline layout");
+        }
+
+        VkSpecializationInfo noiseSpecializationInfo = params.GetSpecializationInfo();
+        VkComputePipelineCreateInfo bakePipelineInfo = {};
+        bakePipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        bakePipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        bakePipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        bakePipelineInfo.stage.module = CreateShaderModule(device, "clipmap.comp");
+        bakePipelineInfo.stage.pName = "main";
+        bakePipelineInfo.stage.pSpecializationInfo = &noiseSpecializationInfo;
+        bakePipelineInfo.layout = bakePipelineLayout;
+        VkPipeline bakePipeline;
+        if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &bakePipelineInfo, nullptr, &bakePipeline) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline");
+        }
+        vkDestroyShaderModule(device, bakePipelineInfo.stage.module, nullptr);
+
+        // Draw pipeline. Rasterization is discarded, the vertices are only written out
+        VkDescriptorSetLayout drawSetLayouts[] = { emptyLayout, emptyLayout, clipmapLayout, vertexLayout };
+        VkPipelineLayoutCreateInfo drawLayoutInfo = {};
+        drawLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        drawLayoutInfo.setLayoutCount = 4;
+        drawLayoutInfo.pSetLayouts = drawSetLayouts;
+        VkPipelineLayout drawPipelineLayout;
+        if (vkCreatePipelineLayout(device, &drawLayoutInfo, nullptr, &drawPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline layout");
+        }
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        VkRenderPassCreateInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        VkRenderPass renderPass;
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create render pass");
+        }
+
+        VkFramebufferCreateInfo framebufferInfo = {};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.width = 1;
+        framebufferInfo.height = 1;
+        framebufferInfo.layers = 1;
+        VkFramebuffer framebuffer;
+        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create framebuffer");
+        }
+
+        const char* stageNames[] = { "grass.vert", "grass.tesc", "terrain_patch.tese" };
+        VkShaderStageFlagBits stageBits[] = { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT };
+        VkPipelineShaderStageCreateInfo stages[3] = {};
+        for (uint32_t i = 0; i < 3; ++i) {
+            stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stages[i].stage = stageBits[i];
+            stages[i].module = CreateShaderModule(device, stageNames[i]);
+            stages[i].pName = "main";
+        }
+
+        VkVertexInputBindingDescription bindingDescription = { 0, sizeof(PatchTile), VK_VERTEX_INPUT_RATE_VERTEX };
+        VkVertexInputAttributeDescription attributeDescriptions[] = {
+            { 0, 0, VK_FORMAT_R32G32_SINT, offsetof(PatchTile, originX) },
+            { 1, 0, VK_FORMAT_R32_UINT, offsetof(PatchTile, sizeAndHeight) },
+            { 2, 0, VK_FORMAT_R8G8B8A8_UINT, offsetof(PatchTile, edgeTessLevels) },
+        };
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = 3;
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+
+        VkPipelineTessellationStateCreateInfo tessellationInfo = {};
+        tessellationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+        tessellationInfo.patchControlPoints = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer = {};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.rasterizerDiscardEnable = VK_TRUE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.lineWidth = 1.0f;
+
+        VkGraphicsPipelineCreateInfo drawPipelineInfo = {};
+        drawPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        drawPipelineInfo.stageCount = 3;
+        drawPipelineInfo.pStages = stages;
+        drawPipelineInfo.pVertexInputState = &vertexInputInfo;
+        drawPipelineInfo.pInputAssemblyState = &inputAssembly;
+        drawPipelineInfo.pTessellationState = &tessellationInfo;
+        drawPipelineInfo.pRasterizationState = &rasterizer;
+        drawPipelineInfo.layout = drawPipelineLayout;
+        drawPipelineInfo.renderPass = renderPass;
+        drawPipelineInfo.subpass = 0;
+        VkPipeline drawPipeline;
+        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &drawPipelineInfo, nullptr, &drawPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create graphics pipeline");
+        }
+        for (uint32_t i = 0; i < 3; ++i) {
+            vkDestroyShaderModule(device, stages[i].module, nullptr);
+        }
+
+        VkCommandPoolCreateInfo commandPoolInfo = {};
+        commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolInfo.queueFamilyIndex = queueFamily;
+        VkCommandPool commandPool;
+        if (vkCreateCommandPool(device, &commandPoolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create command pool");
+        }
+
+        VkCommandBufferAllocateInfo commandBufferInfo = {};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferInfo.commandPool = commandPool;
+        commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &commandBufferInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffer");
+        }
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        VkImageMemoryBarrier imageBarrier = {};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcAccessMask = 0;
+        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = image;
+        imageBarrier.subresourceRange = viewInfo.subresourceRange;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+        // Move the windows to the eye, then bake them, as TerrainCompute::Record does
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bakePipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, bakePipelineLayout, 0, 2, descriptorSets, 0, nullptr);
+        uint32_t clipmapPass = 0;
+        vkCmdPushConstants(commandBuffer, bakePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &clipmapPass);
+        vkCmdDispatch(commandBuffer, 1, 1, 1);
+
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        clipmapPass = 1;
+        vkCmdPushConstants(commandBuffer, bakePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &clipmapPass);
+        vkCmdDispatch(commandBuffer, (CLIPMAP_RESOLUTION + 7) / 8, (CLIPMAP_RESOLUTION + 7) / 8, CLIPMAP_LEVELS);
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        VkRenderPassBeginInfo renderPassBeginInfo = {};
+        renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassBeginInfo.renderPass = renderPass;
+        renderPassBeginInfo.framebuffer = framebuffer;
+        renderPassBeginInfo.renderArea.extent = { 1, 1 };
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawPipelineLayout, 2, 2, descriptorSets + 2, 0, nullptr);
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &tileBuffer.buffer, &offset);
+        vkCmdDraw(commandBuffer, static_cast<uint32_t>(tiles.size()), 1, 0, 0);
+        vkCmdEndRenderPass(commandBuffer);
+
+        // Make the vertices visible to the mapped read below
+        VkMemoryBarrier hostBarrier = {};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer");
+        }
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit command buffer");
+        }
+        vkQueueWaitIdle(queue);
+
+        const PatchVertex* results = static_cast<const PatchVertex*>(vertexBuffer.data);
+        std::vector<PatchVertex> vertices(results, results + vertexCount);
+
+        vkDestroyCommandPool(device, commandPool, nullptr);
+        vkDestroyPipeline(device, drawPipeline, nullptr);
+        vkDestroyPipeline(device, bakePipeline, nullptr);
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+        vkDestroyRenderPass(device, renderPass, nullptr);
+        vkDestroyPipelineLayout(device, drawPipelineLayout, nullptr);
+        vkDestroyPipelineLayout(device, bakePipelineLayout, nullptr);
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        for (VkDescriptorSetLayout layout : { cameraLayout, bakeLayout, emptyLayout, clipmapLayout, vertexLayout }) {
+            vkDestroyDescriptorSetLayout(device, layout, nullptr);
+        }
+        vkDestroySampler(device, sampler, nullptr);
+        vkDestroyImageView(device, imageView, nullptr);
+        vkDestroyImage(device, image, nullptr);
+        vkFreeMemory(device, imageMemory, nullptr);
+        DestroyHostBuffer(device, cameraBuffer);
+        DestroyHostBuffer(device, stateBuffer);
+        DestroyHostBuffer(device, tileBuffer);
+        DestroyHostBuffer(device, vertexBuffer);
+        vkDestroyDevice(device, nullptr);
+
+        return vertices;
+    }
+
+    // Every vertex of the drawn tiles against SampleClipmap at its position
+    void RunTessellationChecks(VkPhysicalDevice physicalDevice, uint32_t queueFamily, Checker& checker) {
+        std::vector<PatchTile> tiles = PatchTiles();
+        const glm::vec2 eye(CLIPMAP_EYE.x, CLIPMAP_EYE.z);
+
+        for (const NoiseParams& params : NoiseCases(false)) {
+            // The clipmap holds heights above the tile base
+            Terrain terrain(params, 0.0f);
+            std::string name = CaseName(params);
+            std::vector<PatchVertex> vertices = EvaluatePatchesOnDevice(physicalDevice, queueFamily, params, tiles);
+
+            for (size_t t = 0; t < tiles.size(); ++t) {
+                for (uint32_t j = 0; j <= TESS_LEVEL; ++j) {
+                    for (uint32_t i = 0; i <= TESS_LEVEL; ++i) {
+                        const PatchVertex& vertex = vertices[(t * (TESS_LEVEL + 1) + j) * (TESS_LEVEL + 1) + i];
+                        std::string what = name + ": tile " + std::to_string(t) + " vertex " + std::to_string(i) + "," + std::to_string(j);
+
+                        glm::vec2 tileOrigin = glm::vec2(tiles[t].originX, tiles[t].originZ) * PATCH_DIM;
+                        glm::vec2 expectedXZ = tileOrigin + glm::vec2(i, j) * (PATCH_DIM / TESS_LEVEL);
+                        checker.Near(vertex.position.x, expectedXZ.x, 1e-4f, what + " x");
+                        checker.Near(vertex.position.z, expectedXZ.y, 1e-4f, what + " z");
+
+                        // Both sample the same halfs, only the precision of the filter weights differs
+                        glm::vec3 expected = SampleClipmap(terrain, eye, glm::vec2(vertex.position.x, vertex.position.z));
+                        checker.Near(vertex.position.y, BASE_HEIGHT + expected.x, 2e-2f, what + " height");
+                        checker.Near(vertex.terrain.y, expected.y, 2e-2f, what + " gradient x");
+                        checker.Near(vertex.terrain.z, expected.z, 2e-2f, what + " gradient z");
+                    }
+                }
+            }
+        }
+    }
+
+    int RunGpuChecks() {
+        VkApplicationInfo appInfo = {};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Terrain Tests";
+        appInfo.apiVersion = VK_API_VERSION_1_0;
+
+        VkInstanceCreateInfo instanceInfo = {};
+        instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceInfo.pApplicationInfo = &appInfo;
+
+        VkInstance instance;
+        if (vkCreateInstance(&instanceInfo, nullptr, &instance) != VK_SUCCESS) {
+            std::cout << "gpu: skipped, no Vulkan implementation" << std::endl;
+            return SKIPPED;
+        }
+
+        uint32_t physicalDeviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, nullptr);
+        std::vector<VkPhysicalDevice> physicalDevices(physicalDeviceCount);
+        vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices.data());
+
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        uint32_t queueFamily = UINT32_MAX;
+        for (VkPhysicalDevice candidate : physicalDevices) {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(candidate, &properties);
+            if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU) {
+                continue;
+            }
+
+            uint32_t queueFamilyCount = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(candidate, &queueFamilyCount, nullptr);
+            std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+            vkGetPhysicalDeviceQueueFamilyProperties(candidate, &queueFamilyCount, queueFamilies.data());
+            // The tessellation checks bake on the same queue they draw on
+            const VkQueueFlags queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+            for (uint32_t i = 0; i < queueFamilyCount && queueFamily == UINT32_MAX; ++i) {
+                if ((queueFamilies[i].queueFlags & queueFlags) == queueFlags) {
+                    physicalDevice = candidate;
+                    queueFamily = i;
+                    std::cout << "gpu: using " << properties.deviceName << std::endl;
+                }
+            }
+            if (physicalDevice != VK_NULL_HANDLE) {
+                break;
+            }
+        }
+
+        if (physicalDevice == VK_NULL_HANDLE) {
+            vkDestroyInstance(instance, nullptr);
+            std::cout << "gpu: skipped, no CPU Vulkan device such as lavapipe or SwiftShader" << std::endl;
+            return SKIPPED;
+        }
+
+        Checker checker;
+        std::vector<float> x, z;
+        SamplePositions(x, z);
+        std::vector<glm::vec2> positions(SAMPLE_COUNT);
+        for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+            positions[i] = glm::vec2(x[i], z[i]);
+        }
+
+        // The sine hash amplifies the difference between sin implementations far beyond any useful tolerance,
+        // so only the integer hash is expected to match
+        for (const NoiseParams& params : NoiseCases(false)) {
+            Terrain terrain(params, BASE_HEIGHT);
+            std::string name = CaseName(params);
+
+            std::vector<float> heights(SAMPLE_COUNT), gradientsX(SAMPLE_COUNT), gradientsZ(SAMPLE_COUNT);
+            terrain.GetHeights(x.data(), z.data(), SAMPLE_COUNT, heights.data(), gradientsX.data(), gradientsZ.data());
+            std::vector<glm::vec4> deviceHeights = EvaluateOnDevice(physicalDevice, queueFamily, params, positions);
+
+            // terrainHeight is relative to the tile base. The device may fuse multiply-adds
+            for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+                checker.Near(heights[i], deviceHeights[i].x + BASE_HEIGHT, 1e-3f, name + ": height " + std::to_string(i));
+                checker.Near(gradientsX[i], deviceHeights[i].y, 1e-3f, name + ": gradient x " + std::to_string(i));
+                checker.Near(gradientsZ[i], deviceHeights[i].z, 1e-3f, name + ": gradient z " + std::to_string(i));
+            }
+        }
+
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+        if (features.tessellationShader && features.vertexPipelineStoresAndAtomics) {
+            RunTessellationChecks(physicalDevice, queueFamily, checker);
+        } else {
+            std::cout << "gpu: tessellation checks skipped, the device cannot store from tessellation shaders" << std::endl;
+        }
+
+        vkDestroyInstance(instance, nullptr);
+        return checker.Report("gpu");
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    try {
+        if (mode == "cpu") {
+            return RunCpuChecks();
+        }
+        if (mode == "gpu") {
+            return RunGpuChecks();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Usage: " << argv[0] << " cpu|gpu" << std::endl;
+    return 1;
+}